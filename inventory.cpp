@@ -0,0 +1,2249 @@
+// Implementation of the inventory library (see inventory.h for the public API)
+
+#include "inventory_sqlite.h"
+#include "scheduler.h"
+
+#include <cerrno>   // For errno
+#include <climits>  // For INT_MAX
+#include <condition_variable> // For waking the schema rebuilder and coalesced callers
+#include <cstdio>   // For std::remove, std::rename
+#include <cstring>  // For std::strerror
+#include <sstream>  // For formatting prices
+#include <thread>   // For background rebuilds and backup pacing
+
+// --- Fixed-Point Prices ---
+
+// Parses a decimal amount such as "12", "-0.5" or "12.34" into cents without going through
+// floating point; false for anything else, including more than two decimals
+bool parseCents(const std::string& text, Cents& cents) {
+    std::string::size_type i = 0;
+    bool negative = false;
+    if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+        negative = text[i++] == '-';
+    }
+    Cents whole = 0;
+    int wholeDigits = 0;
+    while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+        if (whole > (INT64_MAX - 9) / 10 / 100) {
+            return false; // Too large to represent in cents
+        }
+        whole = whole * 10 + (text[i++] - '0');
+        ++wholeDigits;
+    }
+    Cents fraction = 0;
+    int fractionDigits = 0;
+    if (i < text.size() && text[i] == '.') {
+        ++i;
+        while (i < text.size() && text[i] >= '0' && text[i] <= '9' && fractionDigits < 3) {
+            fraction = fraction * 10 + (text[i++] - '0');
+            ++fractionDigits;
+        }
+    }
+    if (i != text.size() || (wholeDigits == 0 && fractionDigits == 0) || fractionDigits > 2) {
+        return false;
+    }
+    if (fractionDigits == 1) {
+        fraction *= 10;
+    }
+    cents = whole * 100 + fraction;
+    if (negative) {
+        cents = -cents;
+    }
+    return true;
+}
+
+// Formats cents as a decimal amount, e.g. 1234 -> "12.34"
+std::string formatCents(Cents cents) {
+    std::ostringstream out;
+    if (cents < 0) {
+        out << '-';
+        cents = -cents;
+    }
+    out << cents / 100 << '.' << std::setw(2) << std::setfill('0') << cents % 100;
+    return out.str();
+}
+
+// Total value of a set of products, sum(quantity * price), in exact integer arithmetic.
+// A plain counted loop over contiguous columns, which the compiler vectorizes.
+Cents sumInventoryValue(const int32_t* quantities, const Cents* priceCents, size_t count) {
+    Cents total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += static_cast<Cents>(quantities[i]) * priceCents[i];
+    }
+    return total;
+}
+
+
+// --- Normalized Names ---
+
+static bool isNameSpace(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Case-folds the name and collapses runs of whitespace into one space, trimming both ends
+std::string normalizeProductName(const std::string& name) {
+    std::string folded = foldCase(name);
+    std::string normalized;
+    normalized.reserve(folded.size());
+    bool pendingSpace = false;
+    for (unsigned char c : folded) {
+        if (isNameSpace(c)) {
+            pendingSpace = !normalized.empty();
+            continue;
+        }
+        if (pendingSpace) {
+            normalized += ' ';
+            pendingSpace = false;
+        }
+        normalized += static_cast<char>(c);
+    }
+    return normalized;
+}
+
+// normalize_name(text): the SQL face of normalizeProductName; NULL stays NULL
+static void normalizeNameFunction(sqlite3_context* context, int, sqlite3_value** args) {
+    if (sqlite3_value_type(args[0]) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    const char* text = reinterpret_cast<const char*>(sqlite3_value_text(args[0]));
+    if (!text) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+    std::string normalized = normalizeProductName(std::string(text, sqlite3_value_bytes(args[0])));
+    sqlite3_result_text(context, normalized.data(), static_cast<int>(normalized.size()), SQLITE_TRANSIENT);
+}
+
+// Connections whose main.products was seen to have name_normalized, with the schema
+// generation they were seen in (see hasNormalizedNameColumn). An entry lives as long as its
+// connection: normalize_name's destructor, which runs when the connection closes, drops it.
+static std::atomic<unsigned long long> schemaGeneration(1);
+
+static std::mutex& nameColumnMutex() {
+    static std::mutex* mutex = new std::mutex(); // Never destroyed: connections may close during exit
+    return *mutex;
+}
+
+static std::map<sqlite3*, unsigned long long>& nameColumnSeen() {
+    static std::map<sqlite3*, unsigned long long>* seen = new std::map<sqlite3*, unsigned long long>();
+    return *seen;
+}
+
+static void forgetNameColumn(void* connection) {
+    std::lock_guard<std::mutex> lock(nameColumnMutex());
+    nameColumnSeen().erase(static_cast<sqlite3*>(connection));
+}
+
+static int registerNameFunctionsOn(sqlite3* db, char**, const sqlite3_api_routines*) {
+    int rc = sqlite3_create_function_v2(db, "normalize_name", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS,
+                                        db, normalizeNameFunction, nullptr, nullptr, forgetNameColumn);
+    return rc == SQLITE_OK ? registerCaseFoldFunction(db) : rc;
+}
+
+// Registers the name functions as an automatic extension, so every connection opened from
+// now on has them. Safe to call repeatedly; sqlite3_shutdown forgets them, so the open paths
+// call it each time.
+void registerNameFunctions() {
+    sqlite3_auto_extension(reinterpret_cast<void (*)(void)>(registerNameFunctionsOn));
+}
+
+
+// --- Diagnostics ---
+
+static std::mutex& logHandlerMutex() {
+    static std::mutex* mutex = new std::mutex(); // Never destroyed: background threads may log during exit
+    return *mutex;
+}
+
+static std::function<void(LogLevel, const std::string&)>& logHandler() {
+    static std::function<void(LogLevel, const std::string&)>* handler =
+        new std::function<void(LogLevel, const std::string&)>();
+    return *handler;
+}
+
+void setLogHandler(std::function<void(LogLevel level, const std::string& message)> handler) {
+    std::lock_guard<std::mutex> lock(logHandlerMutex());
+    logHandler() = std::move(handler);
+}
+
+// The handler runs under the lock, so lines from different threads never interleave
+void logMessage(LogLevel level, const std::string& message) {
+    std::lock_guard<std::mutex> lock(logHandlerMutex());
+    if (logHandler()) {
+        logHandler()(level, message);
+    }
+}
+
+
+// --- Database Interaction Functions ---
+
+// Executes a non-SELECT SQL statement and logs its errors
+bool executeSQL(sqlite3* db, const std::string& sql, const std::string& successMsg, bool logErrors) {
+    char* errMsg = nullptr;
+    int rc = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg); // Use null callback for non-SELECT
+
+    if (rc != SQLITE_OK) {
+        if (logErrors) {
+            logMessage(LOG_LEVEL_ERROR, std::string("SQL error: ") + errMsg);
+        }
+        sqlite3_free(errMsg); // Free error message memory
+        return false;
+    } else if (!successMsg.empty()) {
+        logMessage(LOG_LEVEL_INFO, successMsg);
+    }
+    return true;
+}
+
+// Runs a single-value integer query (e.g. COUNT or MAX); false on error
+bool queryInt64(sqlite3* db, const std::string& sql, long long& value) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement: ") + sqlite3_errmsg(db));
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        value = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_ROW;
+}
+
+// Milliseconds since the Unix epoch
+long long currentTimeMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Inserts a suffix before a file name's extension, e.g. ("inventory.db", ".backup") -> "inventory.backup.db"
+std::string fileNameWithSuffix(const std::string& fileName, const std::string& suffix) {
+    std::string::size_type dot = fileName.rfind('.');
+    if (dot == std::string::npos) {
+        return fileName + suffix;
+    }
+    return fileName.substr(0, dot) + suffix + fileName.substr(dot);
+}
+
+// The table expression read queries select from: the hot products table alone, or the hot
+// and archived products together (the archive database must be attached as "archive"), or
+// the columnar copy of the same rows
+std::string productsSource(bool includeArchive, bool columnar) {
+    if (columnar) {
+        return includeArchive ? "products_columnar_all" : "products_columnar";
+    }
+    return includeArchive ? "(SELECT id, name, quantity, price_cents FROM main.products UNION ALL "
+                            "SELECT id, name, quantity, price_cents FROM archive.products)"
+                          : "products";
+}
+
+// True if the table in the given schema ("main", "archive", ...) has a column of that name,
+// generated columns included (table_info leaves them out)
+bool tableHasColumn(sqlite3* db, const std::string& schema, const std::string& table, const std::string& column) {
+    long long count = 0;
+    return queryInt64(db, "SELECT COUNT(*) FROM pragma_table_xinfo('" + table + "', '" + schema + "') WHERE name = '" +
+                          column + "';", count) && count > 0;
+}
+
+// Whether db's main.products has name_normalized, without querying the schema on every
+// prefix search. Only a seen column is remembered: once there it is never dropped, while a
+// missing one may appear any time a rebuild (in any process) swaps the table in. Migrations
+// in this process bump schemaGeneration, which makes every connection look again.
+static bool hasNormalizedNameColumn(sqlite3* db) {
+    unsigned long long generation = schemaGeneration.load();
+    {
+        std::lock_guard<std::mutex> lock(nameColumnMutex());
+        std::map<sqlite3*, unsigned long long>::const_iterator it = nameColumnSeen().find(db);
+        if (it != nameColumnSeen().end() && it->second == generation) {
+            return true;
+        }
+    }
+    if (!tableHasColumn(db, "main", "products", "name_normalized")) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(nameColumnMutex());
+    nameColumnSeen()[db] = generation;
+    return true;
+}
+
+// Triggers recording every product write in the change log (see Replication Mode)
+std::string changeLogTriggersSQL() {
+    const std::string nowMs = "CAST((julianday('now') - 2440587.5) * 86400000 AS INTEGER)";
+    return
+        "CREATE TRIGGER IF NOT EXISTS products_log_insert AFTER INSERT ON products BEGIN "
+        "INSERT INTO change_log (op, product_id, name, quantity, price_cents, committed_at) "
+        "VALUES ('I', NEW.id, NEW.name, NEW.quantity, NEW.price_cents, " + nowMs + "); END;"
+        "CREATE TRIGGER IF NOT EXISTS products_log_update AFTER UPDATE ON products BEGIN "
+        "INSERT INTO change_log (op, product_id, name, quantity, price_cents, committed_at) "
+        "VALUES ('U', NEW.id, NEW.name, NEW.quantity, NEW.price_cents, " + nowMs + "); END;"
+        "CREATE TRIGGER IF NOT EXISTS products_log_delete AFTER DELETE ON products BEGIN "
+        "INSERT INTO change_log (op, product_id, committed_at) VALUES ('D', OLD.id, " + nowMs + "); END;";
+}
+
+// Converts a products table created with a REAL price column to integer cents; run it inside a
+// transaction. The change log triggers read the price, so they are recreated around it;
+// an existing change log is converted the same way so replicas replay exact values.
+bool migratePricesToCents(sqlite3* db, const std::string& schema) {
+    if (!tableHasColumn(db, schema, "products", "price")) {
+        return true;
+    }
+    const std::string products = schema + ".products";
+    bool hasChangeLog = schema == "main" && tableHasColumn(db, "main", "change_log", "price");
+    std::string sql;
+    if (schema == "main") {
+        sql = "DROP TRIGGER IF EXISTS products_log_insert;"
+              "DROP TRIGGER IF EXISTS products_log_update;";
+    }
+    sql += "ALTER TABLE " + products + " ADD COLUMN price_cents INTEGER NOT NULL DEFAULT 0;"
+           "UPDATE " + products + " SET price_cents = CAST(ROUND(price * 100) AS INTEGER);"
+           "ALTER TABLE " + products + " DROP COLUMN price;";
+    if (hasChangeLog) {
+        sql += "ALTER TABLE change_log ADD COLUMN price_cents INTEGER;"
+               "UPDATE change_log SET price_cents = CAST(ROUND(price * 100) AS INTEGER) WHERE price IS NOT NULL;"
+               "ALTER TABLE change_log DROP COLUMN price;" + changeLogTriggersSQL();
+    }
+    if (!executeSQL(db, sql)) {
+        return false;
+    }
+    logMessage(LOG_LEVEL_INFO, "Converted prices in " + products + " to integer cents.");
+    return true;
+}
+
+// Triggers keeping stock_out_since up to date (see Cold Archive)
+std::string stockOutTriggersSQL() {
+    const std::string now = "CAST(strftime('%s', 'now') AS INTEGER)";
+    return
+        "CREATE TRIGGER IF NOT EXISTS products_stock_out_insert AFTER INSERT ON products WHEN NEW.quantity = 0 BEGIN "
+        "INSERT OR REPLACE INTO stock_out_since (product_id, since) VALUES (NEW.id, " + now + "); END;"
+        "CREATE TRIGGER IF NOT EXISTS products_stock_out_zero AFTER UPDATE OF quantity ON products "
+        "WHEN NEW.quantity = 0 AND OLD.quantity <> 0 BEGIN "
+        "INSERT OR REPLACE INTO stock_out_since (product_id, since) VALUES (NEW.id, " + now + "); END;"
+        "CREATE TRIGGER IF NOT EXISTS products_stock_out_restock AFTER UPDATE OF quantity ON products "
+        "WHEN NEW.quantity <> 0 BEGIN "
+        "DELETE FROM stock_out_since WHERE product_id = NEW.id; END;"
+        "CREATE TRIGGER IF NOT EXISTS products_stock_out_delete AFTER DELETE ON products BEGIN "
+        "DELETE FROM stock_out_since WHERE product_id = OLD.id; END;";
+}
+
+// Creates the stock-out tracking table used by the archive policy (see Cold Archive) and its
+// triggers on first use. Products already at zero when tracking starts count as out of stock from
+// that moment.
+bool enableStockOutTracking(sqlite3* db) {
+    long long tracked = 0;
+    if (!queryInt64(db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'stock_out_since';",
+                    tracked)) {
+        return false;
+    }
+    if (tracked > 0) {
+        return true;
+    }
+    return executeSQL(db,
+        "CREATE TABLE IF NOT EXISTS stock_out_since ("
+        "product_id INTEGER PRIMARY KEY,"
+        "since INTEGER NOT NULL);"
+        "CREATE INDEX IF NOT EXISTS stock_out_since_by_time ON stock_out_since (since);" +
+        stockOutTriggersSQL() +
+        "INSERT OR IGNORE INTO stock_out_since (product_id, since) "
+        "SELECT id, CAST(strftime('%s', 'now') AS INTEGER) FROM products WHERE quantity = 0;");
+}
+
+// Runs body inside a write transaction, committing if it succeeds and rolling back otherwise
+bool runInTransaction(sqlite3* db, const std::function<bool()>& body) {
+    if (!executeSQL(db, "BEGIN IMMEDIATE;")) {
+        return false;
+    }
+    if (!body() || !executeSQL(db, "COMMIT;")) {
+        executeSQL(db, "ROLLBACK;", "", false);
+        return false;
+    }
+    return true;
+}
+
+// Schema migrations: the schema version lives in PRAGMA user_version. Each migration moves the database from
+// version - 1 to version inside one transaction at startup. Migrations that change the products
+// table's definition (typically adding an index) rebuild it online instead: a shadow table with
+// the new definition is filled in small chunks while triggers mirror concurrent writes into it,
+// and a short final transaction swaps the two tables. The old table is then emptied in chunks
+// and dropped, so even a very large database stays usable while it is upgraded.
+
+static const char* const kProductColumns = "id, name, quantity, price_cents";
+static const int kRebuildChunkRows = 5000; // Rows copied or dropped per rebuild transaction
+
+struct SchemaMigration {
+    int version;
+    std::string description;
+    std::function<bool(sqlite3*)> apply; // Runs inside the migration's transaction
+    std::string rebuildSQL; // Non-empty: rebuild products online into this products_rebuild definition
+};
+
+bool createProductsTable(sqlite3* db) {
+    return executeSQL(db,
+        "CREATE TABLE IF NOT EXISTS products ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "name TEXT NOT NULL,"
+        "quantity INTEGER NOT NULL,"
+        "price_cents INTEGER NOT NULL);");
+}
+
+// Recomputes name_normalized for names with non-ASCII characters, which version 5 stored with
+// only their ASCII letters folded. Updating a row recomputes its stored generated columns.
+// Only rows whose stored value is wrong are touched, and the change log's update trigger is
+// left out of the rewrite: none of the replicated columns change, and each replica refolds its
+// own copy when it migrates, so logging every row would only make replicas re-apply them.
+bool refoldNormalizedNames(sqlite3* db) {
+    long long changeLog = 0;
+    if (!queryInt64(db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'change_log';",
+                    changeLog)) {
+        return false;
+    }
+    return executeSQL(db, "DROP TRIGGER IF EXISTS products_log_update;"
+                          "UPDATE products SET name = name "
+                          "WHERE length(name) <> length(CAST(name AS BLOB)) "
+                          "AND name_normalized IS NOT normalize_name(name);" +
+                          (changeLog > 0 ? changeLogTriggersSQL() : std::string()));
+}
+
+// All migrations in version order. Append new ones; never change a released migration.
+// Index names carry the version of the rebuild that created them, because the old table
+// still holds the previous index names until the swap.
+const std::vector<SchemaMigration>& schemaMigrations() {
+    static const std::vector<SchemaMigration> migrations = {
+        {1, "create the products table", createProductsTable, ""},
+        {2, "store prices as integer cents", [](sqlite3* db) { return migratePricesToCents(db, "main"); }, ""},
+        {3, "track how long products are out of stock", enableStockOutTracking, ""},
+        {4, "index products by quantity", nullptr,
+         "CREATE TABLE products_rebuild ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+         "name TEXT NOT NULL,"
+         "quantity INTEGER NOT NULL,"
+         "price_cents INTEGER NOT NULL);"
+         "CREATE INDEX products_by_quantity_v4 ON products_rebuild (quantity);"},
+        {5, "index normalized product names for prefix search", nullptr,
+         "CREATE TABLE products_rebuild ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+         "name TEXT NOT NULL,"
+         "quantity INTEGER NOT NULL,"
+         "price_cents INTEGER NOT NULL,"
+         "name_normalized TEXT GENERATED ALWAYS AS (normalize_name(name)) STORED);"
+         "CREATE INDEX products_by_quantity_v5 ON products_rebuild (quantity);"
+         "CREATE INDEX products_by_name_v5 ON products_rebuild (name_normalized);"},
+        {6, "fold the case of non-ASCII letters in normalized names", refoldNormalizedNames, ""},
+    };
+    return migrations;
+}
+
+int latestSchemaVersion() {
+    return schemaMigrations().back().version;
+}
+
+// The triggers other features keep on the products table; recreated after a rebuild swap
+std::string productsTriggersSQL(sqlite3* db) {
+    long long stockOut = 0;
+    long long changeLog = 0;
+    queryInt64(db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'stock_out_since';", stockOut);
+    queryInt64(db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'change_log';", changeLog);
+    return (stockOut > 0 ? stockOutTriggersSQL() : "") + (changeLog > 0 ? changeLogTriggersSQL() : "");
+}
+
+// Drops every trigger on the products table
+bool dropProductsTriggers(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT name FROM sqlite_master WHERE type = 'trigger' AND tbl_name = 'products';",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    std::string sql;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        sql += "DROP TRIGGER \"" + std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))) + "\";";
+    }
+    sqlite3_finalize(stmt);
+    return executeSQL(db, sql);
+}
+
+// Creates the shadow table and the triggers mirroring writes on products into it, unless a
+// rebuild for this version is already in progress (e.g. interrupted by a restart)
+bool beginProductsRebuild(sqlite3* db, const SchemaMigration& migration) {
+    return runInTransaction(db, [&]() {
+        long long inProgress = 0;
+        if (!executeSQL(db, "CREATE TABLE IF NOT EXISTS schema_rebuild ("
+                            "version INTEGER PRIMARY KEY,"
+                            "last_id INTEGER NOT NULL);") ||
+            !queryInt64(db, "SELECT COUNT(*) FROM schema_rebuild WHERE version = " +
+                            std::to_string(migration.version) + ";", inProgress)) {
+            return false;
+        }
+        if (inProgress > 0) {
+            return true;
+        }
+        const std::string columns = kProductColumns;
+        const std::string newColumns = "NEW.id, NEW.name, NEW.quantity, NEW.price_cents";
+        return executeSQL(db,
+            "DROP TABLE IF EXISTS products_rebuild;" + migration.rebuildSQL +
+            "CREATE TRIGGER products_rebuild_insert AFTER INSERT ON products BEGIN "
+            "INSERT OR REPLACE INTO products_rebuild (" + columns + ") VALUES (" + newColumns + "); END;"
+            "CREATE TRIGGER products_rebuild_update AFTER UPDATE ON products BEGIN "
+            "INSERT OR REPLACE INTO products_rebuild (" + columns + ") VALUES (" + newColumns + "); END;"
+            "CREATE TRIGGER products_rebuild_delete AFTER DELETE ON products BEGIN "
+            "DELETE FROM products_rebuild WHERE id = OLD.id; END;"
+            "INSERT INTO schema_rebuild (version, last_id) VALUES (" + std::to_string(migration.version) + ", 0);");
+    });
+}
+
+// Copies the next chunk of products into the shadow table in one transaction. Rows the triggers
+// already mirrored are newer than the copy and are kept. Once everything is copied, the same
+// transaction swaps the tables, retires the old one and bumps the schema version.
+bool copyProductsRebuildChunk(sqlite3* db, const SchemaMigration& migration, long long& copied, bool& swapped) {
+    copied = 0;
+    swapped = false;
+    const std::string version = std::to_string(migration.version);
+    return runInTransaction(db, [&]() {
+        long long lastId = 0;
+        long long chunkEnd = -1;
+        if (!queryInt64(db, "SELECT last_id FROM schema_rebuild WHERE version = " + version + ";", lastId) ||
+            !queryInt64(db, "SELECT COALESCE(MAX(id), -1) FROM (SELECT id FROM products WHERE id > " +
+                            std::to_string(lastId) + " ORDER BY id LIMIT " + std::to_string(kRebuildChunkRows) +
+                            ");", chunkEnd)) {
+            return false;
+        }
+        if (chunkEnd >= 0) {
+            if (!executeSQL(db, "INSERT OR IGNORE INTO products_rebuild (" + std::string(kProductColumns) + ") "
+                                "SELECT " + kProductColumns + " FROM products WHERE id > " + std::to_string(lastId) +
+                                " AND id <= " + std::to_string(chunkEnd) + ";")) {
+                return false;
+            }
+            copied = sqlite3_changes(db);
+            return executeSQL(db, "UPDATE schema_rebuild SET last_id = " + std::to_string(chunkEnd) +
+                                  " WHERE version = " + version + ";");
+        }
+
+        // Everything is copied: swap the tables. sqlite_sequence moves with a renamed table, so
+        // the new products table inherits the old one's id counter explicitly.
+        std::string triggers = productsTriggersSQL(db);
+        swapped = dropProductsTriggers(db) &&
+                  executeSQL(db,
+                      "DROP TABLE IF EXISTS products_retired;"
+                      "ALTER TABLE products RENAME TO products_retired;"
+                      "ALTER TABLE products_rebuild RENAME TO products;"
+                      "DELETE FROM sqlite_sequence WHERE name = 'products';"
+                      "INSERT INTO sqlite_sequence (name, seq) "
+                      "SELECT 'products', seq FROM sqlite_sequence WHERE name = 'products_retired';" + triggers +
+                      "DELETE FROM schema_rebuild WHERE version = " + version + ";"
+                      "PRAGMA user_version = " + version + ";");
+        if (swapped) {
+            ++schemaGeneration;
+        }
+        return swapped;
+    });
+}
+
+// Deletes the next chunk of rows from the table retired by a rebuild, dropping it once empty
+bool dropRetiredProductsChunk(sqlite3* db, long long& dropped, bool& finished) {
+    dropped = 0;
+    finished = false;
+    return runInTransaction(db, [&]() {
+        long long retired = 0;
+        if (!queryInt64(db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'products_retired';",
+                        retired)) {
+            return false;
+        }
+        if (retired == 0) {
+            finished = true;
+            return true;
+        }
+        if (!executeSQL(db, "DELETE FROM products_retired WHERE id IN (SELECT id FROM products_retired LIMIT " +
+                            std::to_string(kRebuildChunkRows) + ");")) {
+            return false;
+        }
+        dropped = sqlite3_changes(db);
+        finished = dropped == 0;
+        return !finished || executeSQL(db, "DROP TABLE products_retired;");
+    });
+}
+
+enum MigrationStatus {
+    MIGRATION_FAILED,
+    MIGRATION_DONE,
+    MIGRATION_REBUILDING // Stopped at an online rebuild too large to finish at startup
+};
+
+// Applies every pending migration. A rebuild whose table fits in one chunk completes right
+// away; a larger one is started and left to a SchemaRebuilder.
+MigrationStatus applySchemaMigrations(sqlite3* db, bool verbose) {
+    long long version = 0;
+    if (!queryInt64(db, "PRAGMA user_version;", version)) {
+        return MIGRATION_FAILED;
+    }
+    for (const SchemaMigration& migration : schemaMigrations()) {
+        if (migration.version <= version) {
+            continue;
+        }
+        if (migration.rebuildSQL.empty()) {
+            if (!runInTransaction(db, [&]() {
+                    return migration.apply(db) &&
+                           executeSQL(db, "PRAGMA user_version = " + std::to_string(migration.version) + ";");
+                })) {
+                logMessage(LOG_LEVEL_ERROR, "Schema migration " + std::to_string(migration.version) + " failed.");
+                return MIGRATION_FAILED;
+            }
+            ++schemaGeneration;
+        } else {
+            long long rows = 0;
+            if (!beginProductsRebuild(db, migration) ||
+                !queryInt64(db, "SELECT COUNT(*) FROM (SELECT 1 FROM products LIMIT " +
+                                std::to_string(kRebuildChunkRows + 1) + ");", rows)) {
+                logMessage(LOG_LEVEL_ERROR, "Schema migration " + std::to_string(migration.version) + " failed.");
+                return MIGRATION_FAILED;
+            }
+            if (rows > kRebuildChunkRows) {
+                if (verbose) {
+                    logMessage(LOG_LEVEL_INFO, "Schema migration " + std::to_string(migration.version) + " (" +
+                                                   migration.description + ") continues in the background.");
+                }
+                return MIGRATION_REBUILDING;
+            }
+            long long copied = 0;
+            bool swapped = false;
+            bool finished = false;
+            while (!swapped) {
+                if (!copyProductsRebuildChunk(db, migration, copied, swapped)) {
+                    return MIGRATION_FAILED;
+                }
+            }
+            while (!finished) {
+                if (!dropRetiredProductsChunk(db, copied, finished)) {
+                    return MIGRATION_FAILED;
+                }
+            }
+        }
+        version = migration.version;
+        if (verbose) {
+            logMessage(LOG_LEVEL_INFO, "Applied schema migration " + std::to_string(migration.version) + ": " +
+                                           migration.description + ".");
+        }
+    }
+    return MIGRATION_DONE;
+}
+
+// Finishes online rebuilds in the background, one chunk per short transaction, on a
+// connection of its own per database file. Progress is kept in the schema_rebuild table,
+// so an interrupted rebuild resumes where it stopped on the next start.
+class SchemaRebuilder {
+public:
+    static SchemaRebuilder& instance() {
+        static SchemaRebuilder rebuilder;
+        return rebuilder;
+    }
+
+    // Starts finishing the pending migrations of a database file
+    void start(const std::string& dbName) {
+        std::lock_guard<std::mutex> lock(mutex);
+        workers.push_back(std::thread(&SchemaRebuilder::run, this, dbName));
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    ~SchemaRebuilder() { stop(); }
+
+private:
+    static const int kPauseMs = 5; // Gap between chunks, so other writers get the lock
+
+    SchemaRebuilder() : stopping(false) {
+        Metrics::instance(); // Constructed first, so it outlives the workers
+    }
+
+    // Sleeps between chunks; false once the rebuilder is stopping
+    bool pause() {
+        std::unique_lock<std::mutex> lock(mutex);
+        return !wake.wait_for(lock, std::chrono::milliseconds(kPauseMs), [this]() { return stopping; });
+    }
+
+    void run(std::string dbName) {
+        sqlite3* db = nullptr;
+        if (sqlite3_open_v2(dbName.c_str(), &db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+            logMessage(LOG_LEVEL_ERROR, "Schema rebuild can't open " + dbName + ": " + sqlite3_errmsg(db));
+            sqlite3_close(db);
+            return;
+        }
+        sqlite3_busy_timeout(db, 5000);
+
+        MigrationStatus status = MIGRATION_REBUILDING;
+        while (status == MIGRATION_REBUILDING && pause()) {
+            long long version = 0;
+            queryInt64(db, "PRAGMA user_version;", version);
+            const SchemaMigration* migration = nullptr;
+            for (const SchemaMigration& m : schemaMigrations()) {
+                if (m.version == version + 1) {
+                    migration = &m;
+                }
+            }
+            if (!migration || migration->rebuildSQL.empty()) {
+                status = applySchemaMigrations(db, false); // Someone else finished this rebuild
+                continue;
+            }
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            long long copied = 0;
+            bool swapped = false;
+            if (!copyProductsRebuildChunk(db, *migration, copied, swapped)) {
+                Metrics::instance().increment("schema.rebuild_errors");
+                continue;
+            }
+            Metrics::instance().recordDuration("schema.rebuild_chunk", elapsedMs(start));
+            Metrics::instance().increment("schema.rows_copied", copied);
+            if (swapped) {
+                Metrics::instance().increment("schema.rebuilds_completed");
+                status = applySchemaMigrations(db, false);
+            }
+        }
+
+        bool finished = false;
+        while (status == MIGRATION_DONE && !finished && pause()) {
+            long long dropped = 0;
+            if (dropRetiredProductsChunk(db, dropped, finished)) {
+                Metrics::instance().increment("schema.retired_rows_dropped", dropped);
+            }
+        }
+        sqlite3_close(db);
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::vector<std::thread> workers;
+};
+
+const int SchemaRebuilder::kPauseMs;
+
+void stopSchemaRebuilds() {
+    SchemaRebuilder::instance().stop();
+}
+
+// Initializes the database and creates the products table if it doesn't exist
+// (verbose = false suppresses the success messages, e.g. when opening many shard files).
+// A file already at the latest schema version only costs one header read: no DDL, no
+// transaction and no messages beyond the open confirmation.
+bool initializeDatabase(sqlite3*& db, const std::string& dbName, bool verbose, StartupTimings* timings) {
+    StartupTimings localTimings;
+    StartupTimings& t = timings ? *timings : localTimings;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    installSqliteAllocator(); // Must come before SQLite starts
+    registerNameFunctions();  // The products table computes name_normalized with them
+    int rc = sqlite3_open(dbName.c_str(), &db); // Open the database file
+
+    if (rc != SQLITE_OK) { // Use SQLITE_OK check
+        logMessage(LOG_LEVEL_ERROR, std::string("Can't open database: ") + sqlite3_errmsg(db));
+        sqlite3_close(db); // Close DB if open failed partially
+        db = nullptr;
+        return false;
+    } else if (verbose) {
+        logMessage(LOG_LEVEL_INFO, "Opened database successfully");
+    }
+
+    // Background schema rebuilds and maintenance write from their own connections
+    sqlite3_busy_timeout(db, 5000);
+    t.openMs = elapsedMs(start);
+    start = std::chrono::steady_clock::now();
+
+    // Fast path: the schema is current and no rebuild left a retired table to clean up
+    long long version = 0;
+    long long retired = 0;
+    if (!queryInt64(db, "PRAGMA user_version;", version)) {
+        return false;
+    }
+    if (version >= latestSchemaVersion() &&
+        queryInt64(db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'products_retired';",
+                   retired) && retired == 0) {
+        t.fastPath = true;
+        t.schemaMs = elapsedMs(start);
+        return true;
+    }
+
+    // New database files use incremental auto-vacuum so background maintenance can return
+    // freed pages to the file system; this must be set before the first table is created.
+    if (!executeSQL(db, "PRAGMA auto_vacuum = INCREMENTAL;")) {
+        return false;
+    }
+
+    // Bring the schema up to date, creating the products table on first use
+    MigrationStatus status = applySchemaMigrations(db, verbose);
+    if (status == MIGRATION_REBUILDING || (status == MIGRATION_DONE && version >= latestSchemaVersion())) {
+        SchemaRebuilder::instance().start(dbName); // Finishes the rebuild or drops the retired table
+    } else if (status == MIGRATION_DONE && verbose) {
+        logMessage(LOG_LEVEL_INFO, "Table 'products' checked/created successfully.");
+    }
+    t.schemaMs = elapsedMs(start);
+    return status != MIGRATION_FAILED;
+}
+
+// Reads the current row of a "SELECT id, name, quantity, price_cents" statement into a Product
+Product readProductRow(sqlite3_stmt* stmt) {
+    Product p;
+    p.id = sqlite3_column_int(stmt, 0);
+    const unsigned char* name = sqlite3_column_text(stmt, 1);
+    p.name = name ? reinterpret_cast<const char*>(name) : "NULL";
+    p.quantity = sqlite3_column_int(stmt, 2);
+    p.priceCents = sqlite3_column_int64(stmt, 3);
+    return p;
+}
+
+// Runs a "SELECT id, name, quantity, price_cents" query and appends every row to results.
+// bindParams (optional) binds the statement's parameters before it is stepped.
+bool collectProducts(sqlite3* db, const std::string& sql, const std::function<void(sqlite3_stmt*)>& bindParams,
+                     std::vector<Product>& results) {
+    sqlite3_stmt* stmt;
+    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement (SELECT): ") + sqlite3_errmsg(db));
+        return false;
+    }
+
+    if (bindParams) {
+        bindParams(stmt);
+    }
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        results.push_back(readProductRow(stmt));
+    }
+    if (rc != SQLITE_DONE) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Error stepping through results: ") + sqlite3_errmsg(db));
+    }
+
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// Adds a new product using prepared statements; newId receives the id it was given
+bool insertProduct(sqlite3* db, const Product& product, int& newId) {
+    sqlite3_stmt* stmt;
+    std::string sql = "INSERT INTO products (name, quantity, price_cents) VALUES (?, ?, ?);";
+
+    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement (INSERT): ") + sqlite3_errmsg(db));
+        return false;
+    }
+
+    // Bind values
+    sqlite3_bind_text(stmt, 1, product.name.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, product.quantity);
+    sqlite3_bind_int64(stmt, 3, product.priceCents);
+
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        return false;
+    }
+    newId = static_cast<int>(sqlite3_last_insert_rowid(db));
+    return true;
+}
+
+// Updates an existing product using prepared statements; found is false if no product has its id
+bool updateProductById(sqlite3* db, const Product& product, bool& found) {
+    sqlite3_stmt* stmt;
+    std::string sql = "UPDATE products SET name = ?, quantity = ?, price_cents = ? WHERE id = ?;";
+
+    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement (UPDATE): ") + sqlite3_errmsg(db));
+        return false;
+    }
+
+    // Bind values
+    sqlite3_bind_text(stmt, 1, product.name.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, product.quantity);
+    sqlite3_bind_int64(stmt, 3, product.priceCents);
+    sqlite3_bind_int(stmt, 4, product.id);
+
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    found = sqlite3_changes(db) > 0;
+    return rc == SQLITE_DONE;
+}
+
+// Deletes a product by ID using prepared statements; found is false if no product has that id
+bool deleteProductById(sqlite3* db, int id, bool& found) {
+    sqlite3_stmt* stmt;
+    std::string sql = "DELETE FROM products WHERE id = ?;";
+
+    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement (DELETE): ") + sqlite3_errmsg(db));
+        return false;
+    }
+
+    sqlite3_bind_int(stmt, 1, id);
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    found = sqlite3_changes(db) > 0;
+    return rc == SQLITE_DONE;
+}
+
+// All products, ordered by id (includeArchive also lists archived products)
+bool queryAllProducts(sqlite3* db, std::vector<Product>& products, bool includeArchive, bool columnar) {
+    products.clear();
+    return collectProducts(db, "SELECT id, name, quantity, price_cents FROM " +
+                               productsSource(includeArchive, columnar) +
+                               " ORDER BY id;", nullptr, products);
+}
+
+// Prepares the products query of a ProductRange; bindParams binds its parameters
+sqlite3_stmt* prepareProductsQuery(sqlite3* db, const std::string& sql,
+                                   const std::function<void(sqlite3_stmt*)>& bindParams) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement (SELECT): ") + sqlite3_errmsg(db));
+        return nullptr;
+    }
+    bindParams(stmt);
+    return stmt;
+}
+
+// Products whose name contains nameContains (case-insensitive), ordered by id
+sqlite3_stmt* prepareProductsByName(sqlite3* db, const std::string& nameContains, bool includeArchive, bool columnar) {
+    std::string pattern = "%" + nameContains + "%";
+    // The columnar table only sees a bare column's LIKE, and folds case itself
+    std::string condition = columnar ? "name LIKE ?" : kNameLikeCondition;
+    return prepareProductsQuery(db, "SELECT id, name, quantity, price_cents FROM " +
+                                    productsSource(includeArchive, columnar) + " WHERE " + condition + " ORDER BY id;",
+                                [&pattern](sqlite3_stmt* stmt) {
+                                    sqlite3_bind_text(stmt, 1, pattern.c_str(), -1, SQLITE_TRANSIENT);
+                                });
+}
+
+// Products whose normalized name starts with the normalized prefix, ordered by id. The
+// condition is a range on name_normalized ([prefix, prefix with its last byte incremented)),
+// so the products_by_name index answers it. Until the rebuild that adds the column has
+// finished, and for archived products, the names are normalized row by row instead.
+sqlite3_stmt* prepareProductsByPrefix(sqlite3* db, const std::string& prefix, bool includeArchive) {
+    std::string lower = normalizeProductName(prefix);
+    if (!lower.empty() && isNameSpace(static_cast<unsigned char>(prefix.back()))) {
+        lower += ' '; // "red " must not match "redwood"
+    }
+    std::string upper = lower;
+    while (!upper.empty() && static_cast<unsigned char>(upper.back()) == 0xFF) {
+        upper.pop_back();
+    }
+    bool bounded = !upper.empty();
+    if (bounded) {
+        upper.back() = static_cast<char>(static_cast<unsigned char>(upper.back()) + 1);
+    }
+
+    auto condition = [bounded](const std::string& column) {
+        return column + " >= ?1" + (bounded ? " AND " + column + " < ?2" : "");
+    };
+    std::string hot = hasNormalizedNameColumn(db) ? "name_normalized" : "normalize_name(name)";
+    std::string sql = "SELECT id, name, quantity, price_cents FROM main.products WHERE " + condition(hot);
+    if (includeArchive) {
+        sql = "SELECT id, name, quantity, price_cents FROM (" + sql + " UNION ALL "
+              "SELECT id, name, quantity, price_cents FROM archive.products WHERE " +
+              condition("normalize_name(name)") + ")";
+    }
+    return prepareProductsQuery(db, sql + " ORDER BY id;", [&lower, &upper, bounded](sqlite3_stmt* stmt) {
+        sqlite3_bind_text(stmt, 1, lower.data(), static_cast<int>(lower.size()), SQLITE_TRANSIENT);
+        if (bounded) {
+            sqlite3_bind_text(stmt, 2, upper.data(), static_cast<int>(upper.size()), SQLITE_TRANSIENT);
+        }
+    });
+}
+
+// Appends the products whose normalized name starts with prefix (see prepareProductsByPrefix)
+bool queryProductsByPrefix(sqlite3* db, const std::string& prefix, std::vector<Product>& products,
+                           bool includeArchive) {
+    sqlite3_stmt* stmt = prepareProductsByPrefix(db, prefix, includeArchive);
+    if (!stmt) {
+        return false;
+    }
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        products.push_back(readProductRow(stmt));
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to search products: ") + sqlite3_errmsg(db));
+        return false;
+    }
+    return true;
+}
+
+// Products with a quantity below threshold, ordered by quantity
+sqlite3_stmt* prepareProductsBelowQuantity(sqlite3* db, int threshold, bool includeArchive, bool columnar) {
+    return prepareProductsQuery(db, "SELECT id, name, quantity, price_cents FROM " +
+                                    productsSource(includeArchive, columnar) +
+                                    " WHERE quantity < ? ORDER BY quantity;",
+                                [threshold](sqlite3_stmt* stmt) { sqlite3_bind_int(stmt, 1, threshold); });
+}
+
+// Computes the report aggregates (total items, total value) without printing them
+// The value is summed by SQLite in exact 64-bit integer cents.
+bool queryReportTotals(sqlite3* db, int& totalItems, Cents& totalValue, bool includeArchive, bool columnar) {
+    sqlite3_stmt* stmt_count;
+    sqlite3_stmt* stmt_value;
+    std::string sql_count = "SELECT COUNT(*) FROM " + productsSource(includeArchive, columnar) + ";";
+    std::string sql_value = "SELECT SUM(quantity * price_cents) FROM " + productsSource(includeArchive, columnar) + ";";
+    totalItems = 0;
+    totalValue = 0;
+    bool success = true;
+
+    // Get total item count
+    int rc_count = sqlite3_prepare_v2(db, sql_count.c_str(), -1, &stmt_count, nullptr);
+    if (rc_count == SQLITE_OK) {
+        if (sqlite3_step(stmt_count) == SQLITE_ROW) {
+            totalItems = sqlite3_column_int(stmt_count, 0);
+        } else {
+             logMessage(LOG_LEVEL_ERROR, std::string("Failed to get item count: ") + sqlite3_errmsg(db));
+             success = false;
+        }
+    } else {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare count statement: ") + sqlite3_errmsg(db));
+        success = false;
+    }
+    sqlite3_finalize(stmt_count);
+
+    // Get total inventory value
+    int rc_value = sqlite3_prepare_v2(db, sql_value.c_str(), -1, &stmt_value, nullptr);
+     if (rc_value == SQLITE_OK) {
+        if (sqlite3_step(stmt_value) == SQLITE_ROW) {
+            // Check if the result is NULL (happens if table is empty)
+            if (sqlite3_column_type(stmt_value, 0) != SQLITE_NULL) {
+                 totalValue = sqlite3_column_int64(stmt_value, 0);
+            } else {
+                totalValue = 0; // Set to 0 if SUM returns NULL
+            }
+        } else {
+             logMessage(LOG_LEVEL_ERROR, std::string("Failed to get total value: ") + sqlite3_errmsg(db));
+             success = false;
+        }
+    } else {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare value statement: ") + sqlite3_errmsg(db));
+        success = false;
+    }
+    sqlite3_finalize(stmt_value);
+
+    return success;
+}
+
+
+// Looks up a single product by ID; found reports whether such a product exists
+bool queryProductById(sqlite3* db, int id, Product& product, bool& found, bool includeArchive, bool columnar) {
+    std::vector<Product> rows;
+    found = false;
+    if (!collectProducts(db, "SELECT id, name, quantity, price_cents FROM " + productsSource(includeArchive, columnar) +
+                             " WHERE id = ?;",
+                         [id](sqlite3_stmt* stmt) { sqlite3_bind_int(stmt, 1, id); }, rows)) {
+        return false;
+    }
+    if (!rows.empty()) {
+        product = rows.front();
+        found = true;
+    }
+    return true;
+}
+
+
+// --- Online Backup ---
+// Backups copy the live database with the SQLite backup API a few pages at a time. The
+// source is only read-locked while a step runs, and the copier sleeps between steps, so
+// writers are held up for at most one short step.
+
+// Copies db into destName while the database stays in use. The copy is written to
+// destName + ".tmp" and renamed when complete, so a failed backup never replaces a good one.
+bool backupDatabase(sqlite3* db, const std::string& destName, BackupStats& stats,
+                    const std::function<void(int, int)>& progress, int pagesPerStep, int pauseMs) {
+    stats = BackupStats();
+    std::string tempName = destName + ".tmp";
+    std::remove(tempName.c_str());
+    sqlite3* dest = nullptr;
+    if (sqlite3_open(tempName.c_str(), &dest) != SQLITE_OK) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Can't open backup file: ") + sqlite3_errmsg(dest));
+        sqlite3_close(dest);
+        return false;
+    }
+
+    sqlite3_backup* backup = sqlite3_backup_init(dest, "main", db, "main");
+    if (!backup) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to start backup: ") + sqlite3_errmsg(dest));
+        sqlite3_close(dest);
+        std::remove(tempName.c_str());
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int rc;
+    do {
+        std::chrono::steady_clock::time_point stepStart = std::chrono::steady_clock::now();
+        rc = sqlite3_backup_step(backup, pagesPerStep);
+        double stepMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+        stats.longestStepMs = std::max(stats.longestStepMs, stepMs);
+
+        if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            ++stats.busyRetries;
+        }
+        int total = sqlite3_backup_pagecount(backup);
+        int remaining = sqlite3_backup_remaining(backup);
+        if (progress && rc != SQLITE_DONE) {
+            progress(total - remaining, total);
+        }
+        if (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(pauseMs)); // Let writers in
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    stats.totalPages = sqlite3_backup_pagecount(backup);
+    sqlite3_backup_finish(backup);
+    stats.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (rc != SQLITE_DONE) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Backup failed: ") + sqlite3_errstr(rc));
+        sqlite3_close(dest);
+        std::remove(tempName.c_str());
+        return false;
+    }
+    long long pageSize = 0;
+    queryInt64(dest, "PRAGMA page_size;", pageSize);
+    stats.bytesCopied = stats.totalPages * pageSize;
+    sqlite3_close(dest);
+
+    if (std::rename(tempName.c_str(), destName.c_str()) != 0) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to move backup into place: ") + std::strerror(errno));
+        std::remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+// --- Bulk Operations ---
+// Set-based updates and deletes: every row matching a filter is changed by one statement
+// inside one transaction, instead of one updateProduct call per product.
+
+// Builds the WHERE clause matching a filter
+std::string filterWhereClause(const ProductFilter& filter) {
+    std::string where = " WHERE 1 = 1";
+    if (!filter.nameContains.empty()) {
+        where += std::string(" AND ") + kNameLikeCondition;
+    }
+    if (filter.hasQuantityRange) {
+        where += " AND quantity BETWEEN ? AND ?";
+    }
+    if (filter.hasPriceRange) {
+        where += " AND price_cents BETWEEN ? AND ?";
+    }
+    return where;
+}
+
+// Binds the filter's parameters to the WHERE clause, starting at parameter firstParam
+void bindFilter(sqlite3_stmt* stmt, const ProductFilter& filter, int firstParam) {
+    int param = firstParam;
+    if (!filter.nameContains.empty()) {
+        std::string pattern = "%" + filter.nameContains + "%";
+        sqlite3_bind_text(stmt, param++, pattern.c_str(), -1, SQLITE_TRANSIENT);
+    }
+    if (filter.hasQuantityRange) {
+        sqlite3_bind_int(stmt, param++, filter.minQuantity);
+        sqlite3_bind_int(stmt, param++, filter.maxQuantity);
+    }
+    if (filter.hasPriceRange) {
+        sqlite3_bind_int64(stmt, param++, filter.minPrice);
+        sqlite3_bind_int64(stmt, param++, filter.maxPrice);
+    }
+}
+
+bool checkBulkRequest(const BulkRequest& request, std::string& error) {
+    switch (request.action) {
+    case BULK_ADJUST_PRICE_PERCENT:
+    case BULK_ADJUST_PRICE_ABSOLUTE:
+    case BULK_DELETE:
+        return true;
+    case BULK_SET_QUANTITY:
+        if (request.amount < 0 || request.amount > INT_MAX) {
+            error = "quantity " + std::to_string(request.amount) + " is out of range";
+            return false;
+        }
+        return true;
+    }
+    error = "unknown bulk action " + std::to_string(static_cast<long long>(request.action));
+    return false;
+}
+
+// Runs a bulk operation in a single transaction. affected receives the number of matching
+// products (dry run) or changed products. Percentage changes round half up to whole cents in
+// integer arithmetic, and prices never go negative. Refuses (without touching the database)
+// requests that checkBulkRequest() rejects; check them first for a useful error message.
+bool executeBulkOperation(sqlite3* db, const BulkRequest& request, long long& affected) {
+    std::string invalid;
+    if (!checkBulkRequest(request, invalid)) {
+        return false;
+    }
+    std::string sql;
+    bool hasAmount = true;
+    if (request.dryRun) {
+        sql = "SELECT COUNT(*) FROM products";
+        hasAmount = false;
+    } else if (request.action == BULK_ADJUST_PRICE_PERCENT) {
+        sql = "UPDATE products SET price_cents = MAX(0, (price_cents * (10000 + ?1) + 5000) / 10000)";
+    } else if (request.action == BULK_ADJUST_PRICE_ABSOLUTE) {
+        sql = "UPDATE products SET price_cents = MAX(0, price_cents + ?1)";
+    } else if (request.action == BULK_SET_QUANTITY) {
+        sql = "UPDATE products SET quantity = ?1";
+    } else if (request.action == BULK_DELETE) {
+        sql = "DELETE FROM products";
+        hasAmount = false;
+    }
+    sql += filterWhereClause(request.filter) + ";";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement (BULK): ") + sqlite3_errmsg(db));
+        return false;
+    }
+    if (hasAmount) {
+        sqlite3_bind_int64(stmt, 1, request.amount);
+    }
+    bindFilter(stmt, request.filter, hasAmount ? 2 : 1);
+
+    if (!request.dryRun && !executeSQL(db, "BEGIN IMMEDIATE;")) {
+        sqlite3_finalize(stmt);
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    bool success = request.dryRun ? rc == SQLITE_ROW : rc == SQLITE_DONE;
+    if (success) {
+        affected = request.dryRun ? sqlite3_column_int64(stmt, 0) : sqlite3_changes(db);
+    } else {
+        logMessage(LOG_LEVEL_ERROR, std::string("Bulk operation failed: ") + sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+
+    if (!request.dryRun) {
+        if (success) {
+            success = executeSQL(db, "COMMIT;");
+        }
+        if (!success) {
+            executeSQL(db, "ROLLBACK;", "", false);
+        }
+    }
+    return success;
+}
+
+
+// --- Batches ---
+// Integrations that submit many small changes at once send them as a batch: one transaction
+// (one fsync) for all of them, and each statement is prepared once per batch and only
+// re-bound for the next operation of its type.
+
+// The statements of a batch, prepared the first time an operation type appears
+class BatchStatements {
+public:
+    explicit BatchStatements(sqlite3* db) : db(db) {
+        for (sqlite3_stmt*& stmt : statements) {
+            stmt = nullptr;
+        }
+    }
+
+    ~BatchStatements() {
+        for (sqlite3_stmt* stmt : statements) {
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    // The reset statement for type (or the existence check, kExists); nullptr if it fails to prepare
+    sqlite3_stmt* get(int type) {
+        static const char* const sql[kCount] = {
+            "SELECT 1 FROM products WHERE id = ?1;",
+            "INSERT INTO products (name, quantity, price_cents) VALUES (?1, ?2, ?3);",
+            "UPDATE products SET name = ?1, quantity = ?2, price_cents = ?3 WHERE id = ?4;",
+            "DELETE FROM products WHERE id = ?1;",
+            "UPDATE products SET quantity = quantity + ?2 WHERE id = ?1 AND quantity + ?2 >= 0;",
+        };
+        sqlite3_stmt*& stmt = statements[type];
+        if (stmt) {
+            sqlite3_reset(stmt);
+        } else if (sqlite3_prepare_v2(db, sql[type], -1, &stmt, nullptr) != SQLITE_OK) {
+            logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement (BATCH): ") + sqlite3_errmsg(db));
+            stmt = nullptr;
+        }
+        return stmt;
+    }
+
+    static const int kExists = 0; // BatchOperationType values index the others
+    static const int kCount = BATCH_ADJUST + 1;
+
+private:
+    sqlite3* db;
+    sqlite3_stmt* statements[kCount];
+};
+
+// Runs one operation of a batch. Returns false only when the error ended the transaction.
+static bool executeBatchOperation(sqlite3* db, BatchStatements& statements, const BatchOperation& operation,
+                                  BatchStatus& status, int& newId) {
+    const Product& p = operation.product;
+    if (operation.type < BATCH_ADD || operation.type > BATCH_ADJUST ||
+        ((operation.type == BATCH_ADD || operation.type == BATCH_UPDATE) &&
+         (p.name.empty() || p.quantity < 0 || p.priceCents < 0))) {
+        status = BATCH_REJECTED;
+        return true;
+    }
+    sqlite3_stmt* stmt = statements.get(operation.type);
+    if (!stmt) {
+        status = BATCH_FAILED;
+        return !sqlite3_get_autocommit(db);
+    }
+    if (operation.type == BATCH_ADD || operation.type == BATCH_UPDATE) {
+        sqlite3_bind_text(stmt, 1, p.name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, p.quantity);
+        sqlite3_bind_int64(stmt, 3, p.priceCents);
+        if (operation.type == BATCH_UPDATE) {
+            sqlite3_bind_int(stmt, 4, p.id);
+        }
+    } else {
+        sqlite3_bind_int(stmt, 1, p.id);
+        if (operation.type == BATCH_ADJUST) {
+            sqlite3_bind_int(stmt, 2, operation.quantityDelta);
+        }
+    }
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        status = BATCH_FAILED;
+        return !sqlite3_get_autocommit(db); // Statement errors only undo the statement
+    }
+    if (sqlite3_changes(db) > 0) {
+        status = BATCH_APPLIED;
+        if (operation.type == BATCH_ADD) {
+            newId = static_cast<int>(sqlite3_last_insert_rowid(db));
+        }
+        return true;
+    }
+    status = BATCH_NOT_FOUND;
+    if (operation.type == BATCH_ADJUST) {
+        // Nothing changed: either no such product or the stock would have gone negative
+        sqlite3_stmt* exists = statements.get(BatchStatements::kExists);
+        if (!exists) {
+            status = BATCH_FAILED;
+            return !sqlite3_get_autocommit(db);
+        }
+        sqlite3_bind_int(exists, 1, p.id);
+        if (sqlite3_step(exists) == SQLITE_ROW) {
+            status = BATCH_REJECTED;
+        }
+        sqlite3_reset(exists);
+    }
+    return true;
+}
+
+bool executeBatchOperations(sqlite3* db, const std::vector<BatchOperation>& operations, BatchResult& result) {
+    result.committed = false;
+    result.statuses.assign(operations.size(), BATCH_NOT_RUN);
+    result.newIds.clear();
+    for (size_t i = 0; i < operations.size(); ++i) {
+        if (operations[i].type == BATCH_ADD) {
+            result.newIds.push_back(0);
+        }
+    }
+
+    bool success = runInTransaction(db, [&]() {
+        BatchStatements statements(db);
+        size_t add = 0;
+        for (size_t i = 0; i < operations.size(); ++i) {
+            int newId = 0;
+            if (!executeBatchOperation(db, statements, operations[i], result.statuses[i], newId)) {
+                return false;
+            }
+            if (operations[i].type == BATCH_ADD) {
+                result.newIds[add++] = newId;
+            }
+        }
+        return true;
+    });
+    if (!success) {
+        // Rolled back: what ran is undone, so only the operation that failed keeps its status
+        for (size_t i = 0; i < result.statuses.size(); ++i) {
+            if (result.statuses[i] != BATCH_FAILED) {
+                result.statuses[i] = BATCH_NOT_RUN;
+            }
+        }
+        result.newIds.assign(result.newIds.size(), 0);
+        return false;
+    }
+    result.committed = true;
+    return true;
+}
+
+
+// --- Cold Archive ---
+// Discontinued products are moved out of the hot products table into an attached archive
+// database, so everyday scans only touch live stock. Triggers keep a small stock_out_since
+// table with the time each product's quantity dropped to zero; the archive policy moves
+// products that have been out of stock for a given number of days.
+
+static const int kArchiveBatchSize = 1000; // Products moved per transaction
+
+// Attaches the archive database as "archive", creating its products table if needed
+bool attachArchive(sqlite3* db, const std::string& archiveName) {
+    long long attached = 0;
+    if (queryInt64(db, "SELECT COUNT(*) FROM pragma_database_list WHERE name = 'archive';", attached) && attached > 0) {
+        return true;
+    }
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS archive;", -1, &stmt, nullptr) != SQLITE_OK) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement (ATTACH): ") + sqlite3_errmsg(db));
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, archiveName.c_str(), -1, SQLITE_TRANSIENT);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        logMessage(LOG_LEVEL_ERROR, std::string("Can't attach archive database: ") + sqlite3_errmsg(db));
+        return false;
+    }
+    return executeSQL(db,
+        "CREATE TABLE IF NOT EXISTS archive.products ("
+        "id INTEGER PRIMARY KEY,"
+        "name TEXT NOT NULL,"
+        "quantity INTEGER NOT NULL,"
+        "price_cents INTEGER NOT NULL,"
+        "archived_at INTEGER NOT NULL);") &&
+           runInTransaction(db, [db]() { return migratePricesToCents(db, "archive"); });
+}
+
+// Moves products that have been out of stock for at least minDays into the archive, in
+// batched transactions so writers are never locked out for long. dryRun only counts them.
+bool archiveProducts(sqlite3* db, const std::string& archiveName, int minDays, bool dryRun, long long& moved) {
+    moved = 0;
+    if (!attachArchive(db, archiveName)) {
+        return false;
+    }
+    long long cutoff = currentTimeMs() / 1000 - static_cast<long long>(minDays) * 86400;
+    if (dryRun) {
+        return queryInt64(db, "SELECT COUNT(*) FROM stock_out_since WHERE since <= " + std::to_string(cutoff) + ";",
+                          moved);
+    }
+
+    if (!executeSQL(db, "CREATE TEMP TABLE IF NOT EXISTS archive_batch (id INTEGER PRIMARY KEY);")) {
+        return false;
+    }
+    const std::string batchSql =
+        "DELETE FROM temp.archive_batch;"
+        "INSERT INTO temp.archive_batch (id) SELECT product_id FROM stock_out_since WHERE since <= " +
+        std::to_string(cutoff) + " ORDER BY product_id LIMIT " + std::to_string(kArchiveBatchSize) + ";"
+        "INSERT OR REPLACE INTO archive.products (id, name, quantity, price_cents, archived_at) "
+        "SELECT id, name, quantity, price_cents, CAST(strftime('%s', 'now') AS INTEGER) FROM main.products "
+        "WHERE id IN (SELECT id FROM temp.archive_batch);"
+        "DELETE FROM main.products WHERE id IN (SELECT id FROM temp.archive_batch);";
+    for (;;) {
+        long long batch = 0;
+        if (!executeSQL(db, "BEGIN IMMEDIATE;")) {
+            return false;
+        }
+        if (!executeSQL(db, batchSql) || !queryInt64(db, "SELECT COUNT(*) FROM temp.archive_batch;", batch) ||
+            !executeSQL(db, "COMMIT;")) {
+            executeSQL(db, "ROLLBACK;", "", false);
+            return false;
+        }
+        moved += batch;
+        if (batch < kArchiveBatchSize) {
+            return true;
+        }
+    }
+}
+
+
+// --- Parallel Scans ---
+// Search, quantity filter and report can be split into id ranges that are scanned at the
+// same time as interactive tasks on the shared work-stealing scheduler; the match count of a
+// bulk dry run is split the same way at batch priority. Every partition has its own
+// connection, so the scans do not serialize on one connection's mutex; each partition reads
+// its own snapshot.
+
+// Runs scan(connection, firstId, lastId, index) for each connection's share of the
+// products' id range, in parallel
+bool scanPartitioned(sqlite3* db, const std::vector<sqlite3*>& connections, bool includeArchive,
+                     TaskPriority priority, const std::function<bool(sqlite3*, long long, long long, int)>& scan) {
+    long long minId = 0;
+    long long maxId = 0;
+    if (!queryInt64(db, "SELECT COALESCE(MIN(id), 1) FROM " + productsSource(includeArchive) + ";", minId) ||
+        !queryInt64(db, "SELECT COALESCE(MAX(id), 0) FROM " + productsSource(includeArchive) + ";", maxId)) {
+        return false;
+    }
+    int count = static_cast<int>(connections.size());
+    long long span = maxId - minId + 1;
+    std::vector<char> succeeded(count, 1);
+    if (span > 0) {
+        TaskScheduler::instance().parallelFor(count, priority, [&](int i) {
+            long long first = minId + span * i / count;
+            long long last = minId + span * (i + 1) / count - 1;
+            succeeded[i] = first > last || scan(connections[i], first, last, i);
+        });
+    }
+    return std::find(succeeded.begin(), succeeded.end(), 0) == succeeded.end();
+}
+
+// Runs a "SELECT id, name, quantity, price_cents ... WHERE id BETWEEN ? AND ? AND <condition>"
+// over all partitions and concatenates the rows in id order; bindCondition binds from ?3 on
+bool scanProducts(sqlite3* db, const std::vector<sqlite3*>& connections, bool includeArchive,
+                  const std::string& condition, const std::function<void(sqlite3_stmt*)>& bindCondition,
+                  std::vector<Product>& products) {
+    std::string sql = "SELECT id, name, quantity, price_cents FROM " + productsSource(includeArchive) +
+                      " WHERE id BETWEEN ? AND ? AND " + condition + " ORDER BY id;";
+    std::vector<std::vector<Product>> parts(connections.size());
+    bool success = scanPartitioned(db, connections, includeArchive, PRIORITY_INTERACTIVE,
+        [&](sqlite3* conn, long long first, long long last, int index) {
+            return collectProducts(conn, sql, [&](sqlite3_stmt* stmt) {
+                sqlite3_bind_int64(stmt, 1, first);
+                sqlite3_bind_int64(stmt, 2, last);
+                bindCondition(stmt);
+            }, parts[index]);
+        });
+    products.clear();
+    for (std::vector<Product>& part : parts) {
+        products.insert(products.end(), part.begin(), part.end());
+    }
+    return success;
+}
+
+bool scanProductsByName(sqlite3* db, const std::vector<sqlite3*>& connections, bool includeArchive,
+                        const std::string& nameContains, std::vector<Product>& products) {
+    std::string pattern = "%" + nameContains + "%";
+    return scanProducts(db, connections, includeArchive, kNameLikeCondition,
+                        [&pattern](sqlite3_stmt* stmt) {
+                            sqlite3_bind_text(stmt, 3, pattern.c_str(), -1, SQLITE_STATIC);
+                        }, products);
+}
+
+bool scanProductsBelowQuantity(sqlite3* db, const std::vector<sqlite3*>& connections, bool includeArchive,
+                               int threshold, std::vector<Product>& products) {
+    bool success = scanProducts(db, connections, includeArchive, "quantity < ?",
+                                [threshold](sqlite3_stmt* stmt) { sqlite3_bind_int(stmt, 3, threshold); }, products);
+    // Rows arrive in id order; stable sorting keeps that order among equal quantities
+    std::stable_sort(products.begin(), products.end(),
+                     [](const Product& a, const Product& b) { return a.quantity < b.quantity; });
+    return success;
+}
+
+bool scanReportTotals(sqlite3* db, const std::vector<sqlite3*>& connections, bool includeArchive,
+                      int& totalItems, Cents& totalValue) {
+    std::string sql = "SELECT COUNT(*), COALESCE(SUM(quantity * price_cents), 0) FROM " +
+                      productsSource(includeArchive) + " WHERE id BETWEEN ? AND ?;";
+    std::vector<long long> counts(connections.size(), 0);
+    std::vector<Cents> values(connections.size(), 0);
+    bool success = scanPartitioned(db, connections, includeArchive, PRIORITY_INTERACTIVE,
+        [&](sqlite3* conn, long long first, long long last, int index) {
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+                logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare report statement: ") + sqlite3_errmsg(conn));
+                return false;
+            }
+            sqlite3_bind_int64(stmt, 1, first);
+            sqlite3_bind_int64(stmt, 2, last);
+            bool found = sqlite3_step(stmt) == SQLITE_ROW;
+            if (found) {
+                counts[index] = sqlite3_column_int64(stmt, 0);
+                values[index] = sqlite3_column_int64(stmt, 1);
+            } else {
+                logMessage(LOG_LEVEL_ERROR, std::string("Failed to get report totals: ") + sqlite3_errmsg(conn));
+            }
+            sqlite3_finalize(stmt);
+            return found;
+        });
+    totalItems = 0;
+    totalValue = 0;
+    for (size_t i = 0; i < connections.size(); ++i) {
+        totalItems += static_cast<int>(counts[i]);
+        totalValue += values[i];
+    }
+    return success;
+}
+
+// Counts the products matching a bulk request's filter, as its dry run does, over all
+// partitions. Nobody is watching a bulk preview the way they watch a search, so its tasks
+// run at batch priority and yield the workers to interactive scans.
+bool scanBulkMatches(sqlite3* db, const std::vector<sqlite3*>& connections, const ProductFilter& filter,
+                     long long& matches) {
+    std::string sql = "SELECT COUNT(*) FROM products" + filterWhereClause(filter) + " AND id BETWEEN ? AND ?;";
+    std::vector<long long> counts(connections.size(), 0);
+    bool success = scanPartitioned(db, connections, false, PRIORITY_BATCH,
+        [&](sqlite3* conn, long long first, long long last, int index) {
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+                logMessage(LOG_LEVEL_ERROR, std::string("Failed to prepare statement (BULK): ") + sqlite3_errmsg(conn));
+                return false;
+            }
+            bindFilter(stmt, filter, 1);
+            int rangeParam = sqlite3_bind_parameter_count(stmt) - 1;
+            sqlite3_bind_int64(stmt, rangeParam, first);
+            sqlite3_bind_int64(stmt, rangeParam + 1, last);
+            bool found = sqlite3_step(stmt) == SQLITE_ROW;
+            if (found) {
+                counts[index] = sqlite3_column_int64(stmt, 0);
+            } else {
+                logMessage(LOG_LEVEL_ERROR, std::string("Bulk operation failed: ") + sqlite3_errmsg(conn));
+            }
+            sqlite3_finalize(stmt);
+            return found;
+        });
+    matches = 0;
+    for (long long count : counts) {
+        matches += count;
+    }
+    return success;
+}
+
+
+// --- Product Views ---
+
+Product ProductView::materialize() const {
+    Product product;
+    product.id = id;
+    product.name.assign(name.data(), name.size());
+    product.quantity = quantity;
+    product.priceCents = priceCents;
+    return product;
+}
+
+ProductRange::ProductRange(sqlite3_stmt* statement, const std::string& prepareError,
+                           std::function<void(std::string&)> onFinish)
+    : stmt(statement), started(false), hasRow(false), errorMessage(statement ? "" : prepareError),
+      onFinish(std::move(onFinish)) {
+    if (!stmt) {
+        finish();
+    }
+}
+
+ProductRange::ProductRange(ProductRange&& other) noexcept
+    : stmt(other.stmt), current(other.current), started(other.started), hasRow(other.hasRow),
+      errorMessage(std::move(other.errorMessage)), onFinish(std::move(other.onFinish)) {
+    other.stmt = nullptr;
+    other.hasRow = false;
+    other.onFinish = nullptr;
+}
+
+ProductRange::~ProductRange() {
+    sqlite3_finalize(stmt);
+    finish();
+}
+
+// Runs onFinish once, when the query is done or abandoned
+void ProductRange::finish() {
+    if (onFinish) {
+        onFinish(errorMessage);
+        onFinish = nullptr;
+    }
+}
+
+ProductRange::iterator ProductRange::begin() {
+    if (!started) {
+        started = true;
+        advance();
+    }
+    return hasRow ? iterator(this) : iterator();
+}
+
+// Steps to the next row. The name is read in place from SQLite's column buffer, which
+// stays valid until the following step; the statement is finalized after the last row.
+bool ProductRange::advance() {
+    hasRow = false;
+    if (!stmt) {
+        return false;
+    }
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        current.id = sqlite3_column_int(stmt, 0);
+        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        current.name = name ? std::string_view(name, sqlite3_column_bytes(stmt, 1)) : std::string_view();
+        current.quantity = sqlite3_column_int(stmt, 2);
+        current.priceCents = sqlite3_column_int64(stmt, 3);
+        hasRow = true;
+        return true;
+    }
+    if (rc != SQLITE_DONE) {
+        errorMessage = sqlite3_errmsg(sqlite3_db_handle(stmt));
+    }
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
+    finish();
+    return false;
+}
+
+std::vector<Product> ProductRange::materialize() {
+    std::vector<Product> products;
+    for (const ProductView& view : *this) {
+        products.push_back(view.materialize());
+    }
+    return products;
+}
+
+
+// --- Request Coalescing ---
+// Identical reads that arrive while one is already running (dashboards refreshing together,
+// say) wait for that execution and share its result instead of scanning again. Only calls
+// made since the process's last write share an execution, so a caller never gets a result
+// that started before one of its own writes.
+
+static std::atomic<long long> writeGeneration(0); // Bumped after every write call
+
+static long long steadyClockMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename Result>
+class SingleFlight {
+public:
+    // Runs execute, or if a call with the same key is in flight, waits for it and takes a
+    // copy of its result and error. metricName counts executions and saved executions.
+    // execute clears shareable when its outcome belongs to its caller alone (it was
+    // interrupted or timed out); the waiting calls then run the query again instead.
+    // A waiting call gives up once stopped reports (and describes in error) that its own
+    // caller interrupted it or that deadlineMs (steady clock, 0 = none) has passed.
+    bool run(const std::string& key, const std::string& metricName, Result& result, std::string& error,
+             const std::function<bool(Result&, std::string&, bool&)>& execute,
+             const std::function<bool(std::string&)>& stopped, long long deadlineMs) {
+        std::shared_ptr<Flight> flight;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                typename std::map<std::string, std::shared_ptr<Flight>>::iterator it = flights.find(key);
+                if (it == flights.end()) {
+                    break;
+                }
+                flight = it->second;
+                // interrupt() may come from a signal handler, which cannot notify a condition
+                // variable, so the waiters look at their stop flags every kStopPollMs
+                while (!flight->done) {
+                    if (stopped(error)) {
+                        return false;
+                    }
+                    long long wakeMs = steadyClockMs() + kStopPollMs;
+                    if (deadlineMs > 0) {
+                        wakeMs = std::min(wakeMs, deadlineMs);
+                    }
+                    std::chrono::steady_clock::time_point wake{std::chrono::milliseconds(wakeMs)};
+                    finished.wait_until(lock, wake);
+                }
+                if (flight->shareable) {
+                    result = flight->result;
+                    error = flight->error;
+                    Metrics::instance().increment("coalesce." + metricName + ".saved");
+                    return flight->ok;
+                }
+            }
+            flight = std::make_shared<Flight>();
+            flights[key] = flight;
+        }
+
+        bool shareable = true;
+        bool ok = execute(result, error, shareable);
+        Metrics::instance().increment("coalesce." + metricName + ".executions");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            flight->ok = ok;
+            flight->shareable = shareable;
+            if (shareable) {
+                flight->result = result;
+                flight->error = error;
+            }
+            flight->done = true;
+            flights.erase(key);
+        }
+        finished.notify_all();
+        return ok;
+    }
+
+private:
+    static const int kStopPollMs = 20;
+
+    struct Flight {
+        Flight() : done(false), ok(false), shareable(false) {}
+        bool done;
+        bool ok;
+        bool shareable;
+        Result result;
+        std::string error;
+    };
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::map<std::string, std::shared_ptr<Flight>> flights;
+};
+
+SingleFlight<std::vector<Product>>& productFlights() {
+    static SingleFlight<std::vector<Product>> flights;
+    return flights;
+}
+
+SingleFlight<InventoryReport>& reportFlights() {
+    static SingleFlight<InventoryReport> flights;
+    return flights;
+}
+
+
+// --- InventoryDB ---
+
+struct InventoryDB::Impl {
+    Impl() : db(nullptr), ownsConnection(false), includeArchive(false), columnar(false), columnarRegistered(false),
+             timeoutMs(0), activeCalls(0), deadlineMs(0), timedOut(false), interrupted(false) {}
+
+    static long long steadyNowMs() {
+        return steadyClockMs();
+    }
+
+    // Progress handler: stops the running statement once the call's deadline has passed
+    static int checkDeadline(void* context) {
+        Impl* impl = static_cast<Impl*>(context);
+        long long deadline = impl->deadlineMs.load(std::memory_order_relaxed);
+        if (deadline > 0 && steadyNowMs() >= deadline) {
+            impl->timedOut = true;
+            return 1;
+        }
+        return 0;
+    }
+
+    void installProgressHandler(sqlite3* conn) {
+        sqlite3_progress_handler(conn, timeoutMs > 0 ? kProgressInterval : 0, timeoutMs > 0 ? &checkDeadline : nullptr,
+                                 this);
+    }
+
+    // Calls nest (the vector searches run a range); the outermost one arms the deadline
+    void beginCall() {
+        if (activeCalls.fetch_add(1) == 0) {
+            timedOut = false;
+            interrupted = false;
+            deadlineMs = timeoutMs > 0 ? steadyNowMs() + timeoutMs : 0;
+        }
+    }
+
+    void endCall() {
+        if (activeCalls.fetch_sub(1) == 1) {
+            deadlineMs = 0;
+        }
+    }
+
+    // Scope of one public call; a writing call ends the reads that later calls may share.
+    // operation names the call's allocation metrics.
+    struct Call {
+        Call(Impl* impl, const char* operation, bool writes = false)
+            : impl(impl), writes(writes), allocations(operation) {
+            impl->beginCall();
+        }
+        ~Call() {
+            impl->endCall();
+            if (writes) {
+                ++writeGeneration;
+            }
+        }
+        Impl* impl;
+        bool writes;
+        AllocationScope allocations;
+    };
+
+    // Runs a read through flights, sharing an identical in-flight execution (same file,
+    // same archive setting and time limit, same operation and arguments, no write in
+    // between). An execution stopped by its own caller's interrupt() or time limit is not
+    // shared; while waiting, this call still honors its own.
+    template <typename Result>
+    bool coalesced(SingleFlight<Result>& flights, const std::string& metricName, const std::string& arguments,
+                   Result& result, const std::function<bool(Result&)>& execute) {
+        const char* fileName = sqlite3_db_filename(db, "main");
+        std::ostringstream key;
+        if (fileName && *fileName) {
+            key << fileName;
+        } else {
+            key << static_cast<const void*>(db); // In-memory databases are private to their connection
+        }
+        key << '\n' << writeGeneration.load() << '\n' << includeArchive << '\n' << timeoutMs << '\n' << metricName
+            << '\n' << arguments;
+        std::string sharedError;
+        bool ok = flights.run(key.str(), metricName, result, sharedError,
+            [&](Result& r, std::string& e, bool& shareable) {
+                bool success = execute(r);
+                e = error;
+                shareable = !timedOut && !interrupted;
+                return success;
+            },
+            [this](std::string& e) {
+                long long deadline = deadlineMs.load();
+                if (deadline > 0 && steadyNowMs() >= deadline) {
+                    timedOut = true;
+                }
+                if (!timedOut && !interrupted) {
+                    return false;
+                }
+                e = stopReason("interrupted");
+                return true;
+            },
+            deadlineMs.load());
+        error = sharedError;
+        return ok;
+    }
+
+    // What a statement stopped by the deadline or interrupt() reports instead of "interrupted"
+    std::string stopReason(const std::string& sqliteError) const {
+        if (timedOut) {
+            return "timed out after " + std::to_string(timeoutMs) + " ms";
+        }
+        return interrupted ? "interrupted" : sqliteError;
+    }
+
+    // Records why the last call failed; always false so callers can return it
+    bool fail() {
+        error = db ? stopReason(sqlite3_errmsg(db)) : "database is not open";
+        return false;
+    }
+
+    bool failWith(const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    bool check(bool success) {
+        if (success) {
+            error.clear();
+            return true;
+        }
+        return fail();
+    }
+
+    void closeScanConnections() {
+        for (sqlite3* conn : scanConnections) {
+            sqlite3_close(conn);
+        }
+        scanConnections.clear();
+    }
+
+    // Partitioned scans are used when there is more than one scan connection (and the
+    // columnar copy is not)
+    bool parallel() const { return scanConnections.size() > 1 && !columnar; }
+
+    static constexpr int kProgressInterval = 1000; // Virtual machine steps between deadline checks
+
+    sqlite3* db;
+    bool ownsConnection;
+    std::string archiveName;
+    bool includeArchive;
+    bool columnar;                          // Reads go to the columnar tables
+    bool columnarRegistered;                // The columnar tables exist on db
+    std::vector<sqlite3*> scanConnections; // One per partition of a parallel scan
+    int timeoutMs;                          // Limit for each call, 0 = none
+    std::atomic<int> activeCalls;           // Calls (and unfinished ranges) in progress
+    std::atomic<long long> deadlineMs;      // Steady-clock deadline of the current call, 0 = none
+    std::atomic<bool> timedOut;
+    std::atomic<bool> interrupted;
+    std::string error;
+};
+
+InventoryDB::InventoryDB() : impl(new Impl()) {}
+
+InventoryDB::InventoryDB(sqlite3* connection, const std::string& archiveFileName) : impl(new Impl()) {
+    impl->db = connection;
+    impl->archiveName = archiveFileName;
+}
+
+InventoryDB::~InventoryDB() {
+    close();
+}
+
+bool InventoryDB::open(const std::string& fileName) {
+    close();
+    if (!initializeDatabase(impl->db, fileName, false)) {
+        impl->error = "can't open or initialize " + fileName;
+        if (impl->db) {
+            impl->error += ": " + std::string(sqlite3_errmsg(impl->db));
+            sqlite3_close(impl->db);
+            impl->db = nullptr;
+        }
+        return false;
+    }
+    impl->ownsConnection = true;
+    impl->archiveName = fileNameWithSuffix(fileName, ".archive");
+    impl->installProgressHandler(impl->db);
+    impl->error.clear();
+    return true;
+}
+
+void InventoryDB::close() {
+    impl->closeScanConnections();
+    if (impl->ownsConnection && impl->db) {
+        sqlite3_close(impl->db);
+    }
+    impl->db = nullptr;
+    impl->ownsConnection = false;
+    impl->includeArchive = false;
+    impl->columnar = false;
+    impl->columnarRegistered = false;
+}
+
+bool InventoryDB::isOpen() const {
+    return impl->db != nullptr;
+}
+
+sqlite3* InventoryDB::handle() const {
+    return impl->db;
+}
+
+const std::string& InventoryDB::lastError() const {
+    return impl->error;
+}
+
+bool InventoryDB::setIncludeArchive(bool includeArchive) {
+    if (!impl->db || (includeArchive && !attachArchive(impl->db, impl->archiveName))) {
+        return impl->fail();
+    }
+    for (sqlite3* conn : impl->scanConnections) {
+        if (includeArchive && !attachArchive(conn, impl->archiveName)) {
+            return impl->failWith(sqlite3_errmsg(conn));
+        }
+    }
+    impl->includeArchive = includeArchive;
+    return true;
+}
+
+bool InventoryDB::setParallelScans(int partitions) {
+    impl->closeScanConnections();
+    if (partitions <= 1) {
+        return true;
+    }
+    const char* fileName = impl->db ? sqlite3_db_filename(impl->db, "main") : nullptr;
+    if (!fileName || !*fileName) {
+        return impl->failWith(impl->db ? "parallel scans need a database file" : "database is not open");
+    }
+    for (int i = 0; i < partitions; ++i) {
+        sqlite3* conn = nullptr;
+        bool opened = sqlite3_open_v2(fileName, &conn, SQLITE_OPEN_READWRITE, nullptr) == SQLITE_OK;
+        if (conn) {
+            impl->scanConnections.push_back(conn);
+        }
+        if (!opened || (impl->includeArchive && !attachArchive(conn, impl->archiveName))) {
+            impl->failWith(conn ? sqlite3_errmsg(conn) : "out of memory");
+            impl->closeScanConnections();
+            return false;
+        }
+        sqlite3_busy_timeout(conn, 5000);
+        impl->installProgressHandler(conn);
+    }
+    return true;
+}
+
+int InventoryDB::parallelScans() const {
+    return impl->parallel() ? static_cast<int>(impl->scanConnections.size()) : 0;
+}
+
+bool InventoryDB::setColumnarReads(bool enabled) {
+    if (!impl->db) {
+        return impl->fail();
+    }
+    if (enabled && !impl->columnarRegistered) {
+        if (!registerColumnarProducts(impl->db)) {
+            return impl->fail();
+        }
+        impl->columnarRegistered = true;
+    }
+    impl->columnar = enabled;
+    return true;
+}
+
+bool InventoryDB::columnarReads() const {
+    return impl->columnar;
+}
+
+void InventoryDB::setTimeout(int milliseconds) {
+    impl->timeoutMs = std::max(milliseconds, 0);
+    if (impl->db) {
+        impl->installProgressHandler(impl->db);
+    }
+    for (sqlite3* conn : impl->scanConnections) {
+        impl->installProgressHandler(conn);
+    }
+}
+
+int InventoryDB::timeout() const {
+    return impl->timeoutMs;
+}
+
+bool InventoryDB::interrupt() {
+    if (impl->activeCalls.load() == 0 || !impl->db) {
+        return false;
+    }
+    impl->interrupted = true;
+    sqlite3_interrupt(impl->db);
+    for (sqlite3* conn : impl->scanConnections) {
+        sqlite3_interrupt(conn);
+    }
+    return true;
+}
+
+bool InventoryDB::addProduct(const Product& product, int& newId) {
+    Impl::Call call(impl.get(), "add", true);
+    return impl->db ? impl->check(insertProduct(impl->db, product, newId)) : impl->fail();
+}
+
+bool InventoryDB::updateProduct(const Product& product, bool& found) {
+    Impl::Call call(impl.get(), "update", true);
+    return impl->db ? impl->check(updateProductById(impl->db, product, found)) : impl->fail();
+}
+
+bool InventoryDB::deleteProduct(int id, bool& found) {
+    Impl::Call call(impl.get(), "delete", true);
+    return impl->db ? impl->check(deleteProductById(impl->db, id, found)) : impl->fail();
+}
+
+bool InventoryDB::getProduct(int id, Product& product, bool& found) {
+    Impl::Call call(impl.get(), "get");
+    return impl->db ? impl->check(queryProductById(impl->db, id, product, found, impl->includeArchive, impl->columnar))
+                    : impl->fail();
+}
+
+bool InventoryDB::listProducts(std::vector<Product>& products) {
+    Impl::Call call(impl.get(), "list");
+    return impl->db ? impl->check(queryAllProducts(impl->db, products, impl->includeArchive, impl->columnar))
+                    : impl->fail();
+}
+
+bool InventoryDB::searchProducts(const std::string& nameContains, std::vector<Product>& products) {
+    Impl::Call call(impl.get(), "search");
+    if (!impl->db) {
+        return impl->fail();
+    }
+    return impl->coalesced<std::vector<Product>>(productFlights(), "search", nameContains, products,
+                                                 [this, &nameContains](std::vector<Product>& found) {
+        if (impl->parallel()) {
+            return impl->check(scanProductsByName(impl->db, impl->scanConnections, impl->includeArchive,
+                                                  nameContains, found));
+        }
+        ProductRange range = searchProducts(nameContains);
+        found = range.materialize();
+        return range.ok() ? impl->check(true) : impl->failWith(range.error());
+    });
+}
+
+bool InventoryDB::searchProductsByPrefix(const std::string& prefix, std::vector<Product>& products) {
+    Impl::Call call(impl.get(), "prefix");
+    if (!impl->db) {
+        return impl->fail();
+    }
+    return impl->coalesced<std::vector<Product>>(productFlights(), "prefix", prefix, products,
+                                                 [this, &prefix](std::vector<Product>& found) {
+        ProductRange range = searchProductsByPrefix(prefix);
+        found = range.materialize();
+        return range.ok() ? impl->check(true) : impl->failWith(range.error());
+    });
+}
+
+bool InventoryDB::filterProductsByQuantity(int below, std::vector<Product>& products) {
+    Impl::Call call(impl.get(), "filter");
+    if (!impl->db) {
+        return impl->fail();
+    }
+    return impl->coalesced<std::vector<Product>>(productFlights(), "filter", std::to_string(below), products,
+                                                 [this, below](std::vector<Product>& found) {
+        if (impl->parallel()) {
+            return impl->check(scanProductsBelowQuantity(impl->db, impl->scanConnections, impl->includeArchive,
+                                                         below, found));
+        }
+        ProductRange range = filterProductsByQuantity(below);
+        found = range.materialize();
+        return range.ok() ? impl->check(true) : impl->failWith(range.error());
+    });
+}
+
+ProductRange InventoryDB::searchProducts(const std::string& nameContains) {
+    std::function<void(std::string&)> finished = rangeFinished("search");
+    impl->beginCall(); // Ends when the range finishes
+    sqlite3_stmt* stmt =
+        impl->db ? prepareProductsByName(impl->db, nameContains, impl->includeArchive, impl->columnar) : nullptr;
+    if (!stmt) {
+        impl->fail();
+    }
+    return ProductRange(stmt, impl->error, finished);
+}
+
+ProductRange InventoryDB::searchProductsByPrefix(const std::string& prefix) {
+    std::function<void(std::string&)> finished = rangeFinished("prefix");
+    impl->beginCall();
+    sqlite3_stmt* stmt = impl->db ? prepareProductsByPrefix(impl->db, prefix, impl->includeArchive) : nullptr;
+    if (!stmt) {
+        impl->fail();
+    }
+    return ProductRange(stmt, impl->error, finished);
+}
+
+ProductRange InventoryDB::filterProductsByQuantity(int below) {
+    std::function<void(std::string&)> finished = rangeFinished("filter");
+    impl->beginCall();
+    sqlite3_stmt* stmt =
+        impl->db ? prepareProductsBelowQuantity(impl->db, below, impl->includeArchive, impl->columnar) : nullptr;
+    if (!stmt) {
+        impl->fail();
+    }
+    return ProductRange(stmt, impl->error, finished);
+}
+
+// Ends the call a range belongs to, naming a timeout or interrupt as its error. Counts the
+// range's allocations under operation, unless another call (a vector search) encloses it.
+std::function<void(std::string&)> InventoryDB::rangeFinished(const char* operation) {
+    Impl* state = impl.get();
+    const char* counted = state->activeCalls.load() == 0 ? operation : nullptr;
+    AllocationCounters start = threadAllocationCounters();
+    return [state, counted, start](std::string& error) {
+        if (!error.empty()) {
+            error = state->stopReason(error);
+        }
+        if (counted) {
+            recordAllocations(counted, start);
+        }
+        state->endCall();
+    };
+}
+
+bool InventoryDB::generateReport(InventoryReport& report) {
+    Impl::Call call(impl.get(), "report");
+    if (!impl->db) {
+        return impl->fail();
+    }
+    return impl->coalesced<InventoryReport>(reportFlights(), "report", "", report, [this](InventoryReport& totals) {
+        if (impl->parallel()) {
+            return impl->check(scanReportTotals(impl->db, impl->scanConnections, impl->includeArchive,
+                                                totals.totalItems, totals.totalValue));
+        }
+        return impl->check(queryReportTotals(impl->db, totals.totalItems, totals.totalValue, impl->includeArchive));
+    });
+}
+
+bool InventoryDB::bulkOperation(const BulkRequest& request, long long& affected) {
+    Impl::Call call(impl.get(), "bulk", true);
+    if (!impl->db) {
+        return impl->fail();
+    }
+    std::string invalid;
+    if (!checkBulkRequest(request, invalid)) {
+        return impl->failWith(invalid);
+    }
+    // Writes stay on the one writing connection; only the dry run's count can be split
+    if (request.dryRun && impl->parallel()) {
+        return impl->check(scanBulkMatches(impl->db, impl->scanConnections, request.filter, affected));
+    }
+    return impl->check(executeBulkOperation(impl->db, request, affected));
+}
+
+bool InventoryDB::executeBatch(const std::vector<BatchOperation>& operations, BatchResult& result) {
+    Impl::Call call(impl.get(), "batch", true);
+    return impl->db ? impl->check(executeBatchOperations(impl->db, operations, result)) : impl->fail();
+}
+
+bool InventoryDB::archiveProducts(int minDays, bool dryRun, long long& moved) {
+    Impl::Call call(impl.get(), "archive", true);
+    return impl->db ? impl->check(::archiveProducts(impl->db, impl->archiveName, minDays, dryRun, moved))
+                    : impl->fail();
+}
+
+bool InventoryDB::backup(const std::string& destFileName, BackupStats& stats) {
+    Impl::Call call(impl.get(), "backup");
+    return impl->db ? impl->check(backupDatabase(impl->db, destFileName, stats, nullptr)) : impl->fail();
+}
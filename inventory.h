@@ -0,0 +1,302 @@
+#ifndef INVENTORY_H
+#define INVENTORY_H
+
+// Public API of the inventory library: an embeddable product store on one SQLite file.
+// Calls return false on failure, with the reason in InventoryDB::lastError(); results come
+// back through output parameters, and nothing is printed (see setLogHandler).
+
+#include <cstddef>  // For std::ptrdiff_t
+#include <functional> // For std::function
+#include <iterator> // For std::input_iterator_tag
+#include <memory>   // For std::unique_ptr
+#include <string>   // For using string objects
+#include <string_view> // For zero-copy product names
+#include <vector>   // For using vector containers
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// Prices are stored as integer minor units (cents), so totals and adjustments are exact
+typedef long long Cents;
+
+// Structure to hold product data
+struct Product {
+    int id;
+    std::string name;
+    int quantity;
+    Cents priceCents;
+};
+
+// A product row read in place from a query: name points into SQLite's column buffer and
+// is only valid until the range it came from moves on. materialize() keeps a copy.
+struct ProductView {
+    ProductView() : id(0), quantity(0), priceCents(0) {}
+    ProductView(const Product& p) : id(p.id), name(p.name), quantity(p.quantity), priceCents(p.priceCents) {}
+    Product materialize() const;
+
+    int id;
+    std::string_view name;
+    int quantity;
+    Cents priceCents;
+};
+
+// Single-pass range over the rows of a running query, e.g.
+//     for (const ProductView& p : db.searchProducts("bolt")) { ... }
+// Nothing is allocated per row. The query holds a read transaction until the range is
+// exhausted or destroyed, so finish it before writing, and keep its InventoryDB open.
+class ProductRange {
+public:
+    class iterator {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef ProductView value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const ProductView* pointer;
+        typedef const ProductView& reference;
+
+        iterator() : range(nullptr) {}
+        reference operator*() const { return range->current; }
+        pointer operator->() const { return &range->current; }
+        iterator& operator++() {
+            if (!range->advance()) {
+                range = nullptr;
+            }
+            return *this;
+        }
+        bool operator==(const iterator& other) const { return range == other.range; }
+        bool operator!=(const iterator& other) const { return range != other.range; }
+
+    private:
+        friend class ProductRange;
+        explicit iterator(ProductRange* r) : range(r) {}
+        ProductRange* range;
+    };
+
+    ProductRange(ProductRange&& other) noexcept;
+    ~ProductRange();
+
+    iterator begin();
+    iterator end() { return iterator(); }
+
+    // Copies the remaining rows out
+    std::vector<Product> materialize();
+
+    // False if the query could not be prepared or failed while stepping
+    bool ok() const { return errorMessage.empty(); }
+    const std::string& error() const { return errorMessage; }
+
+private:
+    friend class InventoryDB;
+    ProductRange(sqlite3_stmt* statement, const std::string& prepareError,
+                 std::function<void(std::string&)> onFinish);
+    ProductRange(const ProductRange&) = delete;
+    ProductRange& operator=(const ProductRange&) = delete;
+    bool advance();
+    void finish();
+
+    sqlite3_stmt* stmt;
+    ProductView current;
+    bool started;
+    bool hasRow;
+    std::string errorMessage;
+    std::function<void(std::string&)> onFinish; // Told the final error (empty if none)
+};
+
+// Parses a decimal amount such as "12", "-0.5" or "12.34" into cents without going through
+// floating point; false for anything else, including more than two decimals
+bool parseCents(const std::string& text, Cents& cents);
+
+// Formats cents as a decimal amount, e.g. 1234 -> "12.34"
+std::string formatCents(Cents cents);
+
+// Which products a bulk operation applies to; unset criteria match everything
+struct ProductFilter {
+    ProductFilter() : hasQuantityRange(false), minQuantity(0), maxQuantity(0),
+                      hasPriceRange(false), minPrice(0), maxPrice(0) {}
+    std::string nameContains; // Case-insensitive substring, empty = any name
+    bool hasQuantityRange;
+    int minQuantity;          // Inclusive bounds
+    int maxQuantity;
+    bool hasPriceRange;
+    Cents minPrice;           // Inclusive bounds
+    Cents maxPrice;
+};
+
+enum BulkAction {
+    BULK_ADJUST_PRICE_PERCENT,  // price = price * (1 + amount / 10000), amount in basis points
+    BULK_ADJUST_PRICE_ABSOLUTE, // price = price + amount, amount in cents
+    BULK_SET_QUANTITY,          // quantity = amount
+    BULK_DELETE
+};
+
+struct BulkRequest {
+    BulkRequest() : action(BULK_DELETE), amount(0), dryRun(true) {}
+    BulkAction action;
+    long long amount;
+    ProductFilter filter;
+    bool dryRun; // Only count the matching products
+};
+
+// False, with the reason in error, for an unknown action or a BULK_SET_QUANTITY amount that
+// is not a valid quantity (0 to INT_MAX); bulkOperation() refuses such requests
+bool checkBulkRequest(const BulkRequest& request, std::string& error);
+
+// One operation of a batch. ADD ignores product.id; DELETE uses only product.id; ADJUST adds
+// quantityDelta to the quantity of product.id.
+enum BatchOperationType {
+    BATCH_ADD = 1,
+    BATCH_UPDATE = 2,
+    BATCH_DELETE = 3,
+    BATCH_ADJUST = 4
+};
+
+struct BatchOperation {
+    BatchOperation() : type(BATCH_ADD), quantityDelta(0) {}
+    BatchOperationType type;
+    Product product;
+    int quantityDelta;
+};
+
+enum BatchStatus {
+    BATCH_APPLIED = 0,
+    BATCH_NOT_FOUND = 1, // No product has the id
+    BATCH_REJECTED = 2,  // Empty name, negative quantity or price, or stock would go negative
+    BATCH_FAILED = 3,    // SQLite refused this operation; the rest of the batch still ran
+    BATCH_NOT_RUN = 4    // An earlier error rolled the whole batch back
+};
+
+// Outcome of a batch: one status per operation, and the ids of the ADD operations in order
+// (0 where the product was not added). Nothing was applied unless committed.
+struct BatchResult {
+    BatchResult() : committed(false) {}
+    bool committed;
+    std::vector<BatchStatus> statuses;
+    std::vector<int> newIds;
+};
+
+// Aggregates of the inventory report
+struct InventoryReport {
+    InventoryReport() : totalItems(0), totalValue(0) {}
+    int totalItems;   // Number of products
+    Cents totalValue; // Sum of quantity * price
+};
+
+// Throughput and progress of a finished (or failed) backup
+struct BackupStats {
+    BackupStats() : totalPages(0), bytesCopied(0), elapsedSeconds(0.0), longestStepMs(0.0), busyRetries(0) {}
+    int totalPages;
+    long long bytesCopied;
+    double elapsedSeconds;
+    double longestStepMs; // Longest time the source was locked by a single step
+    int busyRetries;      // Steps retried because the source was locked by a writer
+};
+
+// Diagnostics the library produces beyond lastError(): context for failed statements,
+// applied schema migrations and errors of background work (schema rebuilds, memory storage
+// flushes) that has no caller to report to. Nothing is logged until a handler is set.
+enum LogLevel {
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_ERROR
+};
+
+// Sends every diagnostic line to handler, from whichever thread produced it; an empty
+// function turns logging off again
+void setLogHandler(std::function<void(LogLevel level, const std::string& message)> handler);
+
+// One inventory database. open() creates the file or brings its schema up to date. A store
+// is used from one thread at a time; open one per thread for concurrent use.
+class InventoryDB {
+public:
+    InventoryDB();
+    // Wraps a connection the caller opened with the schema already initialized; the caller
+    // keeps ownership. archiveFileName is where archiveProducts() moves products to.
+    InventoryDB(sqlite3* connection, const std::string& archiveFileName);
+    ~InventoryDB();
+
+    bool open(const std::string& fileName);
+    void close();
+    bool isOpen() const;
+    sqlite3* handle() const; // The underlying connection, for features not covered here
+    const std::string& lastError() const;
+
+    // Lets the read operations also cover archived products (attaches the archive database)
+    bool setIncludeArchive(bool includeArchive);
+    // Splits the vector searches, quantity filter and report into this many id ranges that
+    // are scanned in parallel, each on its own connection; 0 or 1 scans serially again.
+    // Partitions read separate snapshots, so a concurrent write may show up in only some.
+    bool setParallelScans(int partitions);
+    int parallelScans() const; // 0 when scans are serial
+    // Answers getProduct, listProducts, the searches and the quantity filters from an
+    // in-memory columnar copy of the products (a SQLite virtual table) instead of the B-tree;
+    // the report keeps aggregating the B-tree, which SQLite does faster than any virtual
+    // table. The copy is rebuilt by the first read after a write, so it pays off for reads
+    // that far outnumber writes. Takes precedence over parallel scans.
+    bool setColumnarReads(bool enabled);
+    bool columnarReads() const;
+
+    // Each following call fails with "timed out after N ms" once it has run that long
+    // (checked by a SQLite progress handler); 0 turns the limit off. A range counts as
+    // running until it is exhausted or destroyed. See ScopedTimeout for a single call.
+    void setTimeout(int milliseconds);
+    int timeout() const;
+
+    // Stops the call in progress, which then fails with "interrupted". Safe to use from
+    // another thread or a signal handler; returns false if no call was running.
+    bool interrupt();
+
+    bool addProduct(const Product& product, int& newId);
+    bool updateProduct(const Product& product, bool& found);
+    bool deleteProduct(int id, bool& found);
+    bool getProduct(int id, Product& product, bool& found);
+
+    // Each fills products (replacing its contents), ordered by id unless noted. Identical
+    // searches, filters and reports running at the same time in this process (on any
+    // InventoryDB for the same file) share one execution and its result or error.
+    bool listProducts(std::vector<Product>& products);
+    bool searchProducts(const std::string& nameContains, std::vector<Product>& products);
+    // Names starting with prefix, compared case-insensitively with whitespace runs collapsed.
+    // Answered from the index on the normalized names, even with columnar reads or
+    // parallel scans turned on.
+    bool searchProductsByPrefix(const std::string& prefix, std::vector<Product>& products);
+    bool filterProductsByQuantity(int below, std::vector<Product>& products); // Ordered by quantity
+
+    // The same queries as row views; on failure the range is empty and reports the error
+    ProductRange searchProducts(const std::string& nameContains);
+    ProductRange searchProductsByPrefix(const std::string& prefix);
+    ProductRange filterProductsByQuantity(int below);
+
+    bool generateReport(InventoryReport& report);
+    // affected is the number of matching products for a dry run, else the number changed
+    bool bulkOperation(const BulkRequest& request, long long& affected);
+    // Runs the operations in one transaction; false (and nothing applied) if it had to roll back
+    bool executeBatch(const std::vector<BatchOperation>& operations, BatchResult& result);
+    // Moves products out of stock for at least minDays to the archive; dryRun only counts them
+    bool archiveProducts(int minDays, bool dryRun, long long& moved);
+    bool backup(const std::string& destFileName, BackupStats& stats);
+
+private:
+    InventoryDB(const InventoryDB&) = delete;
+    InventoryDB& operator=(const InventoryDB&) = delete;
+
+    std::function<void(std::string&)> rangeFinished(const char* operation);
+
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Gives the calls made while it exists their own time limit, e.g.
+//     { ScopedTimeout limit(db, 250); db.searchProducts(term, results); }
+class ScopedTimeout {
+public:
+    ScopedTimeout(InventoryDB& db, int milliseconds) : db(db), previous(db.timeout()) { db.setTimeout(milliseconds); }
+    ~ScopedTimeout() { db.setTimeout(previous); }
+
+private:
+    ScopedTimeout(const ScopedTimeout&) = delete;
+    ScopedTimeout& operator=(const ScopedTimeout&) = delete;
+
+    InventoryDB& db;
+    int previous;
+};
+
+#endif // INVENTORY_H
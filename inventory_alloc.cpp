@@ -0,0 +1,406 @@
+// SQLite allocators (see inventory_alloc.h)
+//
+// Every block carries an 8-byte header with its usable size, which is what xSize reports.
+// The pooled allocator rounds requests up to one of kClassCount size classes and keeps freed
+// blocks on per-thread lists, so the common allocate/free pairs of a statement touch no lock
+// and no shared cache line; a thread's list that grows too long gives half to the shared
+// lists. New blocks are carved from 4 MiB arenas. Requests above the largest class go to
+// malloc. It also hands SQLite a preallocated page cache and sets the lookaside slots every
+// connection gets, and turns off SQLite's own memory statistics, whose mutex every
+// allocation would otherwise take.
+
+#include "inventory_alloc.h"
+#include "inventory_sqlite.h"
+
+#include <cstdlib>  // For malloc, free
+#include <cstring>  // For std::memcpy
+#include <sys/mman.h> // For the arenas and the page cache
+
+static const size_t kHeaderBytes = 8;                 // SQLite needs 8-byte alignment
+static const size_t kArenaBytes = 4 * 1024 * 1024;
+static const int kPageCacheSlots = 2048;              // Pages of the preallocated page cache
+static const int kPageCachePageBytes = 4096;          // The default page size
+static const int kLookasideSlotBytes = 512;
+static const int kLookasideSlots = 256;               // Per connection
+
+// Usable sizes: steps of 16 up to 256, then steps of 1.5x and 2x up to 64 KiB
+static const size_t kClassSizes[] = {16,   32,   48,   64,   80,    96,    112,   128,   144,   160,   176,
+                                     192,  208,  224,  240,  256,   384,   512,   768,   1024,  1536,  2048,
+                                     3072, 4096, 6144, 8192, 12288, 16384, 24576, 32768, 49152, 65536};
+static const int kClassCount = static_cast<int>(sizeof(kClassSizes) / sizeof(kClassSizes[0]));
+static const size_t kLargestClass = kClassSizes[kClassCount - 1];
+
+static int sizeClass(size_t size) {
+    if (size <= 256) {
+        return size == 0 ? 0 : static_cast<int>((size + 15) / 16) - 1;
+    }
+    int c = 16;
+    while (kClassSizes[c] < size) {
+        ++c;
+    }
+    return c;
+}
+
+// Allocations and bytes requested on this thread, for AllocationScope
+static thread_local long long threadAllocations = 0;
+static thread_local long long threadBytes = 0;
+
+static void countAllocation(size_t bytes) {
+    ++threadAllocations;
+    threadBytes += static_cast<long long>(bytes);
+}
+
+static size_t blockSize(void* p) {
+    size_t size;
+    std::memcpy(&size, static_cast<char*>(p) - kHeaderBytes, sizeof(size));
+    return size;
+}
+
+// Stores size in the header of the block at base and returns the memory after it
+static void* finishBlock(void* base, size_t size) {
+    std::memcpy(base, &size, sizeof(size));
+    return static_cast<char*>(base) + kHeaderBytes;
+}
+
+
+// --- Counting Allocator ---
+
+static void* countingMalloc(int n) {
+    size_t size = static_cast<size_t>(n);
+    void* base = std::malloc(size + kHeaderBytes);
+    if (!base) {
+        return nullptr;
+    }
+    countAllocation(size);
+    return finishBlock(base, size);
+}
+
+static void countingFree(void* p) {
+    std::free(static_cast<char*>(p) - kHeaderBytes);
+}
+
+static void* countingRealloc(void* p, int n) {
+    size_t size = static_cast<size_t>(n);
+    void* base = std::realloc(static_cast<char*>(p) - kHeaderBytes, size + kHeaderBytes);
+    if (!base) {
+        return nullptr;
+    }
+    countAllocation(size);
+    return finishBlock(base, size);
+}
+
+static int memorySize(void* p) {
+    return static_cast<int>(blockSize(p));
+}
+
+static int countingRoundup(int n) {
+    return (n + 7) & ~7;
+}
+
+static int noInit(void*) {
+    return SQLITE_OK;
+}
+
+static void noShutdown(void*) {}
+
+
+// --- Pooled Allocator ---
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// Blocks no thread holds, and the arena new blocks are carved from
+class SharedPool {
+public:
+    static SharedPool& instance() {
+        static SharedPool* pool = new SharedPool(); // Never destroyed: threads free into it until exit
+        return *pool;
+    }
+
+    // Takes up to count blocks of class c into list; false when out of memory
+    bool take(int c, FreeBlock*& list, uint32_t& taken, uint32_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        taken = 0;
+        while (taken < count && lists[c]) {
+            FreeBlock* block = lists[c];
+            lists[c] = block->next;
+            block->next = list;
+            list = block;
+            ++taken;
+        }
+        size_t bytes = kClassSizes[c] + kHeaderBytes;
+        while (taken < count) {
+            if (arenaLeft < bytes) {
+                void* arena = ::mmap(nullptr, kArenaBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (arena == MAP_FAILED) {
+                    return taken > 0;
+                }
+                arenaNext = static_cast<char*>(arena);
+                arenaLeft = kArenaBytes;
+            }
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(arenaNext + kHeaderBytes);
+            arenaNext += bytes;
+            arenaLeft -= bytes;
+            block->next = list;
+            list = block;
+            ++taken;
+        }
+        return true;
+    }
+
+    void give(int c, FreeBlock* first, FreeBlock* last) {
+        std::lock_guard<std::mutex> lock(mutex);
+        last->next = lists[c];
+        lists[c] = first;
+    }
+
+private:
+    SharedPool() : lists(), arenaNext(nullptr), arenaLeft(0) {}
+
+    std::mutex mutex;
+    FreeBlock* lists[kClassCount];
+    char* arenaNext;
+    size_t arenaLeft;
+};
+
+// Free blocks this thread can reuse without locking
+struct ThreadCache {
+    ThreadCache() : lists(), counts(), retired(false) {}
+
+    // Hands everything to the shared pool when the thread ends
+    ~ThreadCache() {
+        for (int c = 0; c < kClassCount; ++c) {
+            release(c, counts[c]);
+        }
+        retired = true;
+    }
+
+    // Most blocks of class c kept before half go back: 128 KiB worth, at least 8
+    static uint32_t limit(int c) { return static_cast<uint32_t>(std::max<size_t>(8, 128 * 1024 / kClassSizes[c])); }
+
+    void release(int c, uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+        FreeBlock* first = lists[c];
+        FreeBlock* last = first;
+        for (uint32_t i = 1; i < count; ++i) {
+            last = last->next;
+        }
+        lists[c] = last->next;
+        counts[c] -= count;
+        SharedPool::instance().give(c, first, last);
+    }
+
+    FreeBlock* lists[kClassCount];
+    uint32_t counts[kClassCount];
+    bool retired; // Destroyed already: frees during thread exit go to the shared pool
+};
+
+static thread_local ThreadCache threadCache;
+
+static void* pooledMalloc(int n) {
+    size_t size = static_cast<size_t>(n);
+    if (size > kLargestClass) {
+        void* base = std::malloc(size + kHeaderBytes);
+        if (!base) {
+            return nullptr;
+        }
+        countAllocation(size);
+        return finishBlock(base, size);
+    }
+    int c = sizeClass(size);
+    ThreadCache& cache = threadCache;
+    FreeBlock* block = nullptr;
+    if (cache.retired) {
+        uint32_t taken;
+        if (!SharedPool::instance().take(c, block, taken, 1)) {
+            return nullptr;
+        }
+    } else {
+        if (!cache.lists[c]) {
+            uint32_t taken;
+            uint32_t batch = std::max<uint32_t>(1, ThreadCache::limit(c) / 2);
+            if (!SharedPool::instance().take(c, cache.lists[c], taken, batch)) {
+                return nullptr;
+            }
+            cache.counts[c] += taken;
+        }
+        block = cache.lists[c];
+        cache.lists[c] = block->next;
+        --cache.counts[c];
+    }
+    countAllocation(size);
+    return finishBlock(reinterpret_cast<char*>(block) - kHeaderBytes, kClassSizes[c]);
+}
+
+static void pooledFree(void* p) {
+    size_t size = blockSize(p);
+    if (size > kLargestClass) {
+        std::free(static_cast<char*>(p) - kHeaderBytes);
+        return;
+    }
+    int c = sizeClass(size);
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    ThreadCache& cache = threadCache;
+    if (cache.retired) {
+        SharedPool::instance().give(c, block, block);
+        return;
+    }
+    block->next = cache.lists[c];
+    cache.lists[c] = block;
+    if (++cache.counts[c] > ThreadCache::limit(c)) {
+        cache.release(c, cache.counts[c] / 2);
+    }
+}
+
+static void* pooledRealloc(void* p, int n) {
+    size_t size = blockSize(p);
+    size_t wanted = static_cast<size_t>(n);
+    if (size <= kLargestClass && wanted <= size && sizeClass(wanted) == sizeClass(size)) {
+        return p; // Still the right class
+    }
+    void* moved = pooledMalloc(n);
+    if (moved) {
+        std::memcpy(moved, p, std::min(size, wanted));
+        pooledFree(p);
+    }
+    return moved;
+}
+
+static int pooledRoundup(int n) {
+    size_t size = static_cast<size_t>(n);
+    return size > kLargestClass ? countingRoundup(n) : static_cast<int>(kClassSizes[sizeClass(size)]);
+}
+
+
+// --- Installation ---
+
+static const sqlite3_mem_methods kCountingMethods = {
+    countingMalloc, countingFree, countingRealloc, memorySize, countingRoundup, noInit, noShutdown, nullptr,
+};
+
+static const sqlite3_mem_methods kPooledMethods = {
+    pooledMalloc, pooledFree, pooledRealloc, memorySize, pooledRoundup, noInit, noShutdown, nullptr,
+};
+
+static std::mutex allocatorMutex;   // Guards everything below
+static SqliteAllocator chosenAllocator = ALLOCATOR_SYSTEM;
+static SqliteAllocator activeAllocator = ALLOCATOR_SYSTEM;
+static bool allocatorInstalled = false;
+static bool systemMethodsSaved = false;
+static sqlite3_mem_methods systemMethods; // SQLite's own, to go back to
+static void* pageCache = nullptr;
+static int pageCacheSlotBytes = 0;
+static std::atomic<bool> countingActive(false); // activeAllocator counts, read without the lock
+
+// Configures SQLite (which must be shut down) for allocator
+static bool configureAllocator(SqliteAllocator allocator, std::string& error) {
+    if (!systemMethodsSaved) {
+        if (sqlite3_config(SQLITE_CONFIG_GETMALLOC, &systemMethods) != SQLITE_OK) {
+            error = "SQLite has already started";
+            return false;
+        }
+        systemMethodsSaved = true;
+    }
+    bool pooled = allocator == ALLOCATOR_POOLED;
+    if (pooled && !pageCache) {
+        int headerBytes = 0;
+        sqlite3_config(SQLITE_CONFIG_PCACHE_HDRSZ, &headerBytes);
+        pageCacheSlotBytes = (kPageCachePageBytes + headerBytes + 7) & ~7;
+        void* memory = ::mmap(nullptr, static_cast<size_t>(pageCacheSlotBytes) * kPageCacheSlots,
+                              PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            error = "can't reserve the page cache";
+            return false;
+        }
+        pageCache = memory;
+    }
+    const sqlite3_mem_methods* methods = allocator == ALLOCATOR_POOLED     ? &kPooledMethods
+                                         : allocator == ALLOCATOR_COUNTING ? &kCountingMethods
+                                                                           : &systemMethods;
+    // SQLite's defaults come back for the system and counting allocators
+    int rc = sqlite3_config(SQLITE_CONFIG_MALLOC, methods);
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_config(SQLITE_CONFIG_MEMSTATUS, pooled ? 0 : 1);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pooled ? sqlite3_config(SQLITE_CONFIG_PAGECACHE, pageCache, pageCacheSlotBytes, kPageCacheSlots)
+                    : sqlite3_config(SQLITE_CONFIG_PAGECACHE, nullptr, 0, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pooled ? sqlite3_config(SQLITE_CONFIG_LOOKASIDE, kLookasideSlotBytes, kLookasideSlots)
+                    : sqlite3_config(SQLITE_CONFIG_LOOKASIDE, 1200, 100);
+    }
+    if (rc != SQLITE_OK) {
+        error = std::string("can't configure SQLite's memory: ") + sqlite3_errstr(rc);
+        sqlite3_config(SQLITE_CONFIG_MALLOC, &systemMethods);
+        return false;
+    }
+    activeAllocator = allocator;
+    countingActive = allocator != ALLOCATOR_SYSTEM;
+    return true;
+}
+
+bool setSqliteAllocator(SqliteAllocator allocator, std::string& error) {
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    if (allocatorInstalled) {
+        error = "SQLite has already started";
+        return false;
+    }
+    chosenAllocator = allocator;
+    return true;
+}
+
+SqliteAllocator sqliteAllocator() {
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    return allocatorInstalled ? activeAllocator : chosenAllocator;
+}
+
+void installSqliteAllocator() {
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    if (allocatorInstalled) {
+        return;
+    }
+    allocatorInstalled = true;
+    std::string error;
+    if (chosenAllocator != ALLOCATOR_SYSTEM && !configureAllocator(chosenAllocator, error)) {
+        logMessage(LOG_LEVEL_ERROR, "Keeping SQLite's own allocator: " + error);
+    }
+}
+
+bool reinstallSqliteAllocator(SqliteAllocator allocator, std::string& error) {
+    std::lock_guard<std::mutex> lock(allocatorMutex);
+    allocatorInstalled = true;
+    int rc = sqlite3_shutdown();
+    if (rc != SQLITE_OK) {
+        error = std::string("can't shut SQLite down: ") + sqlite3_errstr(rc);
+        return false;
+    }
+    bool configured = configureAllocator(allocator, error);
+    sqlite3_initialize();
+    return configured;
+}
+
+bool allocationsCounted() {
+    return countingActive;
+}
+
+AllocationCounters threadAllocationCounters() {
+    AllocationCounters counters;
+    counters.allocations = threadAllocations;
+    counters.bytes = threadBytes;
+    return counters;
+}
+
+void recordAllocations(const char* operation, const AllocationCounters& start) {
+    if (!allocationsCounted()) {
+        return;
+    }
+    AllocationCounters end = threadAllocationCounters();
+    std::string prefix = std::string("alloc.") + operation;
+    Metrics::instance().increment(prefix + ".calls");
+    Metrics::instance().increment(prefix + ".allocations", end.allocations - start.allocations);
+    Metrics::instance().increment(prefix + ".bytes", end.bytes - start.bytes);
+}
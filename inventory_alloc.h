@@ -0,0 +1,23 @@
+#ifndef INVENTORY_ALLOC_H
+#define INVENTORY_ALLOC_H
+
+// Memory allocators for SQLite inside the inventory library. SQLite takes its allocator once,
+// when it starts, so the choice made here is installed right before the first database is
+// opened (by initializeDatabase, InventoryDB::open or enableMemoryStorage) and stays for the
+// life of the process.
+
+#include <string>   // For using string objects
+
+enum SqliteAllocator {
+    ALLOCATOR_SYSTEM = 0,   // SQLite's default: malloc, no statistics
+    ALLOCATOR_COUNTING = 1, // malloc, counting allocations and bytes per operation
+    ALLOCATOR_POOLED = 2,   // Size-class pools carved from arenas, with per-thread free lists, a
+                            // preallocated page cache and lookaside slots; counts like COUNTING.
+                            // Freed memory is kept for reuse, never returned to the system.
+};
+
+// Chooses the allocator; false (with the reason) once SQLite has started
+bool setSqliteAllocator(SqliteAllocator allocator, std::string& error);
+SqliteAllocator sqliteAllocator();
+
+#endif // INVENTORY_ALLOC_H
@@ -0,0 +1,206 @@
+// Coroutine interface of the inventory library (see inventory_async.h)
+
+#include "inventory_async.h"
+#include "inventory_sqlite.h"
+
+#include <set>      // For the stores a cancellation source interrupts
+
+// --- Cancellation ---
+
+// running holds the stores the source's requests are executing on, so cancel() can interrupt
+// each of them (with their scan connections); one source may be passed to requests on
+// several I/O threads
+struct CancellationSource::State {
+    State() : cancelled(false) {}
+    std::mutex mutex;
+    bool cancelled;
+    std::set<InventoryDB*> running;
+};
+
+CancellationSource::CancellationSource() : state(std::make_shared<State>()) {}
+
+void CancellationSource::cancel() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->cancelled = true;
+    for (InventoryDB* store : state->running) {
+        store->interrupt();
+    }
+}
+
+bool CancellationSource::cancelled() const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->cancelled;
+}
+
+
+// --- I/O Thread Pool ---
+
+AsyncInventoryDB::AsyncInventoryDB() : stopping(false) {}
+
+AsyncInventoryDB::~AsyncInventoryDB() {
+    close();
+}
+
+bool AsyncInventoryDB::open(const std::string& fileName, int ioThreads) {
+    close();
+    stopping = false;
+    // The first connection brings the schema up to date before the others open the file
+    for (int i = 0; i < std::max(ioThreads, 1); ++i) {
+        std::unique_ptr<InventoryDB> store(new InventoryDB());
+        if (!store->open(fileName) || (i == 0 && !executeSQL(store->handle(), "PRAGMA journal_mode = WAL;"))) {
+            error = store->lastError().empty() ? "can't enable WAL on " + fileName : store->lastError();
+            stores.clear();
+            return false;
+        }
+        stores.push_back(std::move(store));
+    }
+    for (const std::unique_ptr<InventoryDB>& store : stores) {
+        workers.emplace_back(&AsyncInventoryDB::run, this, std::ref(*store));
+    }
+    error.clear();
+    return true;
+}
+
+void AsyncInventoryDB::close() {
+    std::deque<Job> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        abandoned.swap(jobs);
+    }
+    wakeup.notify_all();
+    for (Job& job : abandoned) {
+        job.resume(true);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    stores.clear();
+}
+
+bool AsyncInventoryDB::submit(const std::shared_ptr<CancellationSource::State>& cancel,
+                              std::function<bool(InventoryDB&)> work, std::function<void(bool)> resume) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || workers.empty()) {
+            return false;
+        }
+        Job job;
+        job.cancel = cancel;
+        job.work = std::move(work);
+        job.resume = std::move(resume);
+        jobs.push_back(std::move(job));
+    }
+    wakeup.notify_one();
+    return true;
+}
+
+// I/O thread loop: runs queued requests on this thread's connection and resumes their
+// callers here. A cancelled request is not started; one cancelled while running has its
+// statement interrupted and reports cancelled unless it still succeeded.
+void AsyncInventoryDB::run(InventoryDB& store) {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        bool cancelled;
+        {
+            std::lock_guard<std::mutex> lock(job.cancel->mutex);
+            cancelled = job.cancel->cancelled;
+            if (!cancelled) {
+                job.cancel->running.insert(&store);
+            }
+        }
+        if (!cancelled) {
+            bool ok = job.work(store);
+            std::lock_guard<std::mutex> lock(job.cancel->mutex);
+            job.cancel->running.erase(&store);
+            cancelled = !ok && job.cancel->cancelled;
+        }
+        job.resume(cancelled);
+    }
+}
+
+
+// --- Requests ---
+
+AsyncInventoryDB::Request<std::vector<Product>> AsyncInventoryDB::search(const std::string& nameContains,
+                                                                        const CancellationSource& cancel) {
+    return Request<std::vector<Product>>(this, [nameContains](InventoryDB& store, std::vector<Product>& products) {
+        return store.searchProducts(nameContains, products);
+    }, cancel);
+}
+
+AsyncInventoryDB::Request<std::vector<Product>> AsyncInventoryDB::searchByPrefix(const std::string& prefix,
+                                                                                const CancellationSource& cancel) {
+    return Request<std::vector<Product>>(this, [prefix](InventoryDB& store, std::vector<Product>& products) {
+        return store.searchProductsByPrefix(prefix, products);
+    }, cancel);
+}
+
+AsyncInventoryDB::Request<std::vector<Product>> AsyncInventoryDB::filterByQuantity(int below,
+                                                                                  const CancellationSource& cancel) {
+    return Request<std::vector<Product>>(this, [below](InventoryDB& store, std::vector<Product>& products) {
+        return store.filterProductsByQuantity(below, products);
+    }, cancel);
+}
+
+AsyncInventoryDB::Request<std::vector<Product>> AsyncInventoryDB::list(const CancellationSource& cancel) {
+    return Request<std::vector<Product>>(this, [](InventoryDB& store, std::vector<Product>& products) {
+        return store.listProducts(products);
+    }, cancel);
+}
+
+AsyncInventoryDB::Request<std::optional<Product>> AsyncInventoryDB::get(int id, const CancellationSource& cancel) {
+    return Request<std::optional<Product>>(this, [id](InventoryDB& store, std::optional<Product>& product) {
+        Product found;
+        bool exists = false;
+        if (!store.getProduct(id, found, exists)) {
+            return false;
+        }
+        if (exists) {
+            product = found;
+        }
+        return true;
+    }, cancel);
+}
+
+AsyncInventoryDB::Request<InventoryReport> AsyncInventoryDB::report(const CancellationSource& cancel) {
+    return Request<InventoryReport>(this, [](InventoryDB& store, InventoryReport& report) {
+        return store.generateReport(report);
+    }, cancel);
+}
+
+AsyncInventoryDB::Request<int> AsyncInventoryDB::add(const Product& product, const CancellationSource& cancel) {
+    return Request<int>(this, [product](InventoryDB& store, int& newId) {
+        return store.addProduct(product, newId);
+    }, cancel);
+}
+
+AsyncInventoryDB::Request<bool> AsyncInventoryDB::update(const Product& product, const CancellationSource& cancel) {
+    return Request<bool>(this, [product](InventoryDB& store, bool& found) {
+        return store.updateProduct(product, found);
+    }, cancel);
+}
+
+AsyncInventoryDB::Request<bool> AsyncInventoryDB::remove(int id, const CancellationSource& cancel) {
+    return Request<bool>(this, [id](InventoryDB& store, bool& found) {
+        return store.deleteProduct(id, found);
+    }, cancel);
+}
+
+AsyncInventoryDB::Request<long long> AsyncInventoryDB::bulk(const BulkRequest& request,
+                                                            const CancellationSource& cancel) {
+    return Request<long long>(this, [request](InventoryDB& store, long long& affected) {
+        return store.bulkOperation(request, affected);
+    }, cancel);
+}
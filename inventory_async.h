@@ -0,0 +1,144 @@
+#ifndef INVENTORY_ASYNC_H
+#define INVENTORY_ASYNC_H
+
+// Coroutine interface of the inventory library (needs C++20). `co_await db.search(term)`
+// queues the query to a small pool of I/O threads, each with its own connection, and the
+// caller is resumed on that I/O thread once the result is ready. Thousands of requests can
+// be in flight on a few threads; a CancellationSource stops requests that are queued or
+// running (via InventoryDB::interrupt).
+
+#include "inventory.h"
+
+#include <condition_variable> // For waking the I/O threads
+#include <coroutine> // For std::coroutine_handle
+#include <deque>    // For the request queue
+#include <functional> // For std::function
+#include <memory>   // For std::shared_ptr
+#include <mutex>    // For std::mutex
+#include <optional> // For lookups that may find nothing
+#include <string>   // For using string objects
+#include <thread>   // For the I/O threads
+#include <vector>   // For using vector containers
+
+// Outcome of an asynchronous call
+template <typename T>
+struct AsyncResult {
+    AsyncResult() : ok(false), cancelled(false), value() {}
+    bool ok;
+    bool cancelled; // Cancelled before it ran, or interrupted while running
+    std::string error;
+    T value;
+};
+
+// Cancels every request it was passed to. Copies share the same state, so keep one and
+// hand copies to the requests.
+class CancellationSource {
+public:
+    CancellationSource();
+
+    // Queued requests complete as cancelled without running; running ones are interrupted
+    void cancel();
+    bool cancelled() const;
+
+    struct State; // Internal
+
+private:
+    friend class AsyncInventoryDB;
+    std::shared_ptr<State> state;
+};
+
+class AsyncInventoryDB {
+public:
+    // What every call returns: awaiting it queues the request and suspends the caller
+    template <typename T>
+    class Request {
+    public:
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> caller) {
+            bool queued = owner->submit(cancel,
+                [this](InventoryDB& store) {
+                    result.ok = work(store, result.value);
+                    if (!result.ok) {
+                        result.error = store.lastError();
+                    }
+                    return result.ok;
+                },
+                [this, caller](bool cancelled) {
+                    result.cancelled = cancelled;
+                    if (cancelled && result.error.empty()) {
+                        result.error = "request cancelled";
+                    }
+                    caller.resume();
+                });
+            if (!queued) {
+                result.cancelled = true;
+                result.error = "inventory is closed";
+            }
+            return queued; // Resume right away if it could not be queued
+        }
+
+        AsyncResult<T> await_resume() { return std::move(result); }
+
+    private:
+        friend class AsyncInventoryDB;
+        Request(AsyncInventoryDB* owner, std::function<bool(InventoryDB&, T&)> work,
+                const CancellationSource& source)
+            : owner(owner), work(std::move(work)), cancel(source.state) {}
+
+        AsyncInventoryDB* owner;
+        std::function<bool(InventoryDB&, T&)> work;
+        std::shared_ptr<CancellationSource::State> cancel;
+        AsyncResult<T> result;
+    };
+
+    AsyncInventoryDB();
+    ~AsyncInventoryDB();
+
+    // Opens fileName (switching it to WAL so the I/O threads can read while one writes) with
+    // one connection per I/O thread
+    bool open(const std::string& fileName, int ioThreads = 4);
+    // Completes the queued requests as cancelled, then joins the threads and closes the file
+    void close();
+    const std::string& lastError() const { return error; }
+
+    Request<std::vector<Product>> search(const std::string& nameContains,
+                                         const CancellationSource& cancel = CancellationSource());
+    Request<std::vector<Product>> searchByPrefix(const std::string& prefix,
+                                                 const CancellationSource& cancel = CancellationSource());
+    Request<std::vector<Product>> filterByQuantity(int below, const CancellationSource& cancel = CancellationSource());
+    Request<std::vector<Product>> list(const CancellationSource& cancel = CancellationSource());
+    Request<std::optional<Product>> get(int id, const CancellationSource& cancel = CancellationSource());
+    Request<InventoryReport> report(const CancellationSource& cancel = CancellationSource());
+    Request<int> add(const Product& product, const CancellationSource& cancel = CancellationSource()); // New id
+    // The value tells whether the product existed
+    Request<bool> update(const Product& product, const CancellationSource& cancel = CancellationSource());
+    Request<bool> remove(int id, const CancellationSource& cancel = CancellationSource());
+    // The value is the number of matching (dry run) or changed products
+    Request<long long> bulk(const BulkRequest& request, const CancellationSource& cancel = CancellationSource());
+
+private:
+    AsyncInventoryDB(const AsyncInventoryDB&) = delete;
+    AsyncInventoryDB& operator=(const AsyncInventoryDB&) = delete;
+
+    struct Job {
+        std::shared_ptr<CancellationSource::State> cancel;
+        std::function<bool(InventoryDB&)> work;
+        std::function<void(bool cancelled)> resume;
+    };
+
+    // Queues a job for the I/O threads; false (and nothing queued) once closed
+    bool submit(const std::shared_ptr<CancellationSource::State>& cancel, std::function<bool(InventoryDB&)> work,
+                std::function<void(bool)> resume);
+    void run(InventoryDB& store);
+
+    std::vector<std::unique_ptr<InventoryDB>> stores; // One per I/O thread
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<Job> jobs;
+    bool stopping;
+    std::string error;
+};
+
+#endif // INVENTORY_ASYNC_H
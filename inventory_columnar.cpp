@@ -0,0 +1,495 @@
+// Columnar copy of the products as an SQLite virtual table (see registerColumnarProducts)
+//
+// The copy holds each column in its own array, ordered by id, plus the row numbers ordered by
+// quantity. xBestIndex takes the constraints on id, quantity and price and name LIKE; xFilter
+// turns id and quantity bounds into binary searches and checks the rest while it walks the
+// arrays, so the queries read no B-tree pages. The copy is rebuilt by the first query after
+// the data version of the underlying database(s) changed, which includes this connection's
+// own writes.
+
+#include "inventory_sqlite.h"
+
+#include <cmath>    // For std::floor
+#include <cstdlib>  // For std::strtol
+#include <cstring>  // For memmem, std::memset
+#include <limits>   // For std::numeric_limits
+#include <memory>   // For std::shared_ptr
+
+// One loaded copy; cursors keep theirs alive while the store moves on to a newer one
+struct ColumnarSnapshot {
+    std::vector<sqlite3_int64> ids;        // Ascending
+    std::vector<sqlite3_int64> quantities;
+    std::vector<sqlite3_int64> priceCents;
+    std::string names;                     // All names back to back
+    std::string foldedNames;               // The same case-folded (foldCaseUtf8), for LIKE
+    std::vector<size_t> nameOffsets;       // Row r's name is [nameOffsets[r], nameOffsets[r + 1])
+    std::vector<size_t> foldedOffsets;     // Folding may change a name's length
+    std::vector<size_t> byQuantity;        // Rows ordered by quantity, then id
+
+    size_t size() const { return ids.size(); }
+};
+
+// Per connection and table: which products it mirrors and the current copy
+struct ColumnarStore {
+    ColumnarStore(sqlite3* db, bool includeArchive) : db(db), includeArchive(includeArchive) {}
+
+    // Data versions of the databases the copy was loaded from; changed by any commit
+    std::vector<unsigned> currentVersions() const {
+        std::vector<unsigned> versions;
+        for (const char* schema : {"main", "archive"}) {
+            if (schema[0] == 'a' && !includeArchive) {
+                break;
+            }
+            unsigned version = 0;
+            sqlite3_file_control(db, schema, SQLITE_FCNTL_DATA_VERSION, &version);
+            versions.push_back(version);
+        }
+        return versions;
+    }
+
+    // Makes snapshot current, reloading it if the products changed; false with error set
+    bool refresh(std::string& error) {
+        std::vector<unsigned> versions = currentVersions();
+        if (snapshot && versions == loadedVersions) {
+            return true;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::shared_ptr<ColumnarSnapshot> loaded(new ColumnarSnapshot());
+        std::string sql =
+            "SELECT id, name, quantity, price_cents FROM " + productsSource(includeArchive) + " ORDER BY id;";
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            error = sqlite3_errmsg(db);
+            return false;
+        }
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            loaded->ids.push_back(sqlite3_column_int64(stmt, 0));
+            loaded->nameOffsets.push_back(loaded->names.size());
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            loaded->names.append(name ? name : "", static_cast<size_t>(sqlite3_column_bytes(stmt, 1)));
+            loaded->quantities.push_back(sqlite3_column_int64(stmt, 2));
+            loaded->priceCents.push_back(sqlite3_column_int64(stmt, 3));
+        }
+        if (rc != SQLITE_DONE) {
+            error = sqlite3_errmsg(db);
+            sqlite3_finalize(stmt);
+            return false;
+        }
+        sqlite3_finalize(stmt);
+        loaded->nameOffsets.push_back(loaded->names.size());
+        loaded->foldedNames.resize(foldedCapacity(loaded->names.size()));
+        loaded->foldedOffsets.reserve(loaded->nameOffsets.size());
+        size_t folded = 0;
+        for (size_t row = 0; row < loaded->size(); ++row) {
+            loaded->foldedOffsets.push_back(folded);
+            size_t offset = loaded->nameOffsets[row];
+            folded += foldCaseUtf8(loaded->names.data() + offset, loaded->nameOffsets[row + 1] - offset,
+                                   &loaded->foldedNames[folded]);
+        }
+        loaded->foldedOffsets.push_back(folded);
+        loaded->foldedNames.resize(folded);
+        loaded->byQuantity.resize(loaded->size());
+        for (size_t row = 0; row < loaded->size(); ++row) {
+            loaded->byQuantity[row] = row;
+        }
+        const std::vector<sqlite3_int64>& quantities = loaded->quantities;
+        std::stable_sort(loaded->byQuantity.begin(), loaded->byQuantity.end(),
+                         [&quantities](size_t a, size_t b) { return quantities[a] < quantities[b]; });
+        snapshot = loaded;
+        loadedVersions = versions;
+        Metrics::instance().increment("columnar.loads");
+        Metrics::instance().recordDuration("columnar.load", elapsedMs(start));
+        return true;
+    }
+
+    sqlite3* db;
+    bool includeArchive;
+    std::shared_ptr<const ColumnarSnapshot> snapshot;
+    std::vector<unsigned> loadedVersions;
+};
+
+enum ColumnarColumn { COLUMN_ID = 0, COLUMN_NAME = 1, COLUMN_QUANTITY = 2, COLUMN_PRICE = 3 };
+
+// Walk order of a scan, the idxNum of a plan
+enum ColumnarOrder { ORDER_BY_ID = 0, ORDER_BY_QUANTITY = 1 };
+
+struct ColumnarTable {
+    sqlite3_vtab base;
+    ColumnarStore* store;
+};
+
+// Inclusive bounds on an integer column; empty once lo > hi
+struct ColumnarBounds {
+    sqlite3_int64 lo = std::numeric_limits<sqlite3_int64>::min();
+    sqlite3_int64 hi = std::numeric_limits<sqlite3_int64>::max();
+
+    bool contains(sqlite3_int64 value) const { return value >= lo && value <= hi; }
+    bool empty() const { return lo > hi; }
+    void clear() {
+        lo = 1;
+        hi = 0;
+    }
+
+    // Narrows to the values v for which "v op value" holds, with SQLite's comparison rules:
+    // NULL matches nothing, and every number sorts before text and blobs
+    void apply(unsigned char op, sqlite3_value* value) {
+        bool less = op == SQLITE_INDEX_CONSTRAINT_LT || op == SQLITE_INDEX_CONSTRAINT_LE;
+        int type = sqlite3_value_numeric_type(value);
+        if (type == SQLITE_NULL) {
+            clear();
+            return;
+        }
+        if (type == SQLITE_TEXT || type == SQLITE_BLOB) {
+            if (!less) {
+                clear();
+            }
+            return;
+        }
+        // floor(value), and whether value is exactly that integer
+        const sqlite3_int64 min = std::numeric_limits<sqlite3_int64>::min();
+        const sqlite3_int64 max = std::numeric_limits<sqlite3_int64>::max();
+        sqlite3_int64 floor = sqlite3_value_int64(value);
+        bool exact = true;
+        if (type == SQLITE_FLOAT) {
+            double d = sqlite3_value_double(value);
+            floor = d >= 9.2e18 ? max : d <= -9.2e18 ? min : static_cast<sqlite3_int64>(std::floor(d));
+            exact = static_cast<double>(floor) == d;
+        }
+        if (op == SQLITE_INDEX_CONSTRAINT_EQ && !exact) {
+            clear();
+        } else if (op == SQLITE_INDEX_CONSTRAINT_EQ) {
+            lo = std::max(lo, floor);
+            hi = std::min(hi, floor);
+        } else if (op == SQLITE_INDEX_CONSTRAINT_GE && exact) {
+            lo = std::max(lo, floor);
+        } else if (op == SQLITE_INDEX_CONSTRAINT_GT || op == SQLITE_INDEX_CONSTRAINT_GE) {
+            if (floor == max) {
+                clear();
+            } else {
+                lo = std::max(lo, floor + 1);
+            }
+        } else if (op == SQLITE_INDEX_CONSTRAINT_LT && exact) {
+            if (floor == min) {
+                clear();
+            } else {
+                hi = std::min(hi, floor - 1);
+            }
+        } else {
+            hi = std::min(hi, floor);
+        }
+    }
+};
+
+// Skips one UTF-8 character
+static const char* nextCharacter(const char* s, const char* end) {
+    ++s;
+    while (s < end && (static_cast<unsigned char>(*s) & 0xC0) == 0x80) {
+        ++s;
+    }
+    return s;
+}
+
+// SQL LIKE without ESCAPE on case-folded text: '%' matches any run, '_' one character
+static bool likeMatches(const char* p, const char* pEnd, const char* s, const char* sEnd) {
+    const char* star = nullptr;     // Pattern position after the last '%'
+    const char* starText = nullptr; // Where the text that '%' absorbs currently ends
+    while (s < sEnd) {
+        if (p < pEnd && *p == '%') {
+            star = ++p;
+            starText = s;
+        } else if (p < pEnd && *p == '_') {
+            ++p;
+            s = nextCharacter(s, sEnd);
+        } else if (p < pEnd && *p == *s) {
+            ++p;
+            ++s;
+        } else if (star) {
+            p = star;
+            starText = nextCharacter(starText, sEnd);
+            s = starText;
+        } else {
+            return false;
+        }
+    }
+    while (p < pEnd && *p == '%') {
+        ++p;
+    }
+    return p == pEnd;
+}
+
+// A LIKE constraint, with the common "%text%" case reduced to a substring search
+struct ColumnarPattern {
+    explicit ColumnarPattern(const std::string& pattern) : folded(foldCase(pattern)), substring(false) {
+        substring = folded.size() >= 2 && folded.front() == '%' && folded.back() == '%' &&
+                    folded.find_first_of("%_", 1) == folded.size() - 1;
+    }
+
+    bool matches(const char* text, size_t length) const {
+        if (substring) {
+            size_t needle = folded.size() - 2;
+            return needle == 0 || (length >= needle && ::memmem(text, length, folded.data() + 1, needle) != nullptr);
+        }
+        return likeMatches(folded.data(), folded.data() + folded.size(), text, text + length);
+    }
+
+    std::string folded;
+    bool substring;
+};
+
+struct ColumnarCursor {
+    sqlite3_vtab_cursor base;
+    std::shared_ptr<const ColumnarSnapshot> snapshot;
+    int order;
+    size_t position; // Into ids (ORDER_BY_ID) or byQuantity (ORDER_BY_QUANTITY)
+    size_t end;
+    ColumnarBounds ids;
+    ColumnarBounds quantities;
+    ColumnarBounds prices;
+    std::vector<ColumnarPattern> patterns;
+
+    size_t row() const { return order == ORDER_BY_QUANTITY ? snapshot->byQuantity[position] : position; }
+
+    bool matches(size_t r) const {
+        const ColumnarSnapshot& s = *snapshot;
+        if (!ids.contains(s.ids[r]) || !quantities.contains(s.quantities[r]) || !prices.contains(s.priceCents[r])) {
+            return false;
+        }
+        for (const ColumnarPattern& pattern : patterns) {
+            size_t offset = s.foldedOffsets[r];
+            if (!pattern.matches(s.foldedNames.data() + offset, s.foldedOffsets[r + 1] - offset)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Moves forward to the first matching row at or after position
+    void settle() {
+        while (position < end && !matches(row())) {
+            ++position;
+        }
+    }
+};
+
+static int columnarConnect(sqlite3* db, void* aux, int, const char* const*, sqlite3_vtab** vtab, char**) {
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(id INTEGER, name TEXT, quantity INTEGER, price_cents INTEGER)");
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    ColumnarTable* table = new ColumnarTable();
+    table->store = static_cast<ColumnarStore*>(aux);
+    *vtab = &table->base;
+    return SQLITE_OK;
+}
+
+static int columnarDisconnect(sqlite3_vtab* vtab) {
+    delete reinterpret_cast<ColumnarTable*>(vtab);
+    return SQLITE_OK;
+}
+
+// The plan's idxStr lists the constraints passed to xFilter, three characters each: the
+// column (ColumnarColumn) as a digit and the SQLITE_INDEX_CONSTRAINT_* operator in hex
+static int columnarBestIndex(sqlite3_vtab* vtab, sqlite3_index_info* info) {
+    ColumnarStore* store = reinterpret_cast<ColumnarTable*>(vtab)->store;
+    std::string plan;
+    bool idEquals = false;
+    bool idRange = false;
+    bool quantityRange = false;
+    bool nameLike = false;
+    for (int i = 0; i < info->nConstraint; ++i) {
+        const sqlite3_index_info::sqlite3_index_constraint& c = info->aConstraint[i];
+        int column = c.iColumn < 0 ? COLUMN_ID : c.iColumn; // The rowid is the id
+        bool comparison = c.op == SQLITE_INDEX_CONSTRAINT_EQ || c.op == SQLITE_INDEX_CONSTRAINT_GT ||
+                          c.op == SQLITE_INDEX_CONSTRAINT_LE || c.op == SQLITE_INDEX_CONSTRAINT_LT ||
+                          c.op == SQLITE_INDEX_CONSTRAINT_GE;
+        bool like = c.op == SQLITE_INDEX_CONSTRAINT_LIKE && column == COLUMN_NAME;
+        if (!c.usable || (column == COLUMN_NAME ? !like : !comparison)) {
+            continue;
+        }
+        // column is a single digit and the accepted operators are below 0x100, so every entry
+        // is exactly three characters
+        static const char kHexDigits[] = "0123456789abcdef";
+        plan += static_cast<char>('0' + column);
+        plan += kHexDigits[(c.op >> 4) & 0xf];
+        plan += kHexDigits[c.op & 0xf];
+        info->aConstraintUsage[i].argvIndex = static_cast<int>(plan.size() / 3);
+        // The bounds are exact, and so is the LIKE pass, which unlike SQLite's own LIKE folds
+        // case beyond ASCII (PRAGMA case_sensitive_like does not apply to it)
+        info->aConstraintUsage[i].omit = 1;
+        idEquals = idEquals || (column == COLUMN_ID && c.op == SQLITE_INDEX_CONSTRAINT_EQ);
+        idRange = idRange || column == COLUMN_ID;
+        quantityRange = quantityRange || column == COLUMN_QUANTITY;
+        nameLike = nameLike || like;
+    }
+
+    // Rows come out by id, or by quantity then id
+    bool wantsQuantityOrder = info->nOrderBy >= 1 && info->aOrderBy[0].iColumn == COLUMN_QUANTITY;
+    bool orderConsumed = true;
+    for (int i = 0; i < info->nOrderBy; ++i) {
+        int column = info->aOrderBy[i].iColumn < 0 ? COLUMN_ID : info->aOrderBy[i].iColumn;
+        int expected = wantsQuantityOrder && i == 0 ? COLUMN_QUANTITY : COLUMN_ID;
+        orderConsumed = orderConsumed && !info->aOrderBy[i].desc && column == expected &&
+                        i < (wantsQuantityOrder ? 2 : 1);
+    }
+    bool byQuantity = !idEquals && (wantsQuantityOrder || (quantityRange && !idRange && info->nOrderBy == 0));
+    info->idxNum = byQuantity ? ORDER_BY_QUANTITY : ORDER_BY_ID;
+    info->orderByConsumed = orderConsumed && (info->nOrderBy == 0 || byQuantity == wantsQuantityOrder);
+
+    double rows = store->snapshot ? static_cast<double>(std::max<size_t>(store->snapshot->size(), 1)) : 100000.0;
+    if (idEquals) {
+        info->estimatedRows = 1;
+        info->estimatedCost = 1;
+        info->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+    } else {
+        double narrowed = (idRange || (quantityRange && byQuantity)) ? rows / 4 : rows;
+        info->estimatedRows = static_cast<sqlite3_int64>(nameLike ? narrowed / 10 + 1 : narrowed);
+        info->estimatedCost = narrowed;
+    }
+    info->idxStr = sqlite3_mprintf("%s", plan.c_str());
+    info->needToFreeIdxStr = 1;
+    return SQLITE_OK;
+}
+
+static int columnarOpen(sqlite3_vtab*, sqlite3_vtab_cursor** cursor) {
+    ColumnarCursor* c = new ColumnarCursor();
+    c->order = ORDER_BY_ID;
+    c->position = c->end = 0;
+    *cursor = &c->base;
+    return SQLITE_OK;
+}
+
+static int columnarClose(sqlite3_vtab_cursor* cursor) {
+    delete reinterpret_cast<ColumnarCursor*>(cursor);
+    return SQLITE_OK;
+}
+
+static int columnarFilter(sqlite3_vtab_cursor* cursor, int idxNum, const char* idxStr, int argc, sqlite3_value** argv) {
+    ColumnarCursor* c = reinterpret_cast<ColumnarCursor*>(cursor);
+    ColumnarTable* table = reinterpret_cast<ColumnarTable*>(cursor->pVtab);
+    std::string error;
+    if (!table->store->refresh(error)) {
+        sqlite3_free(table->base.zErrMsg);
+        table->base.zErrMsg = sqlite3_mprintf("%s", error.c_str());
+        return SQLITE_ERROR;
+    }
+    c->snapshot = table->store->snapshot;
+    c->order = idxNum;
+    c->ids = ColumnarBounds();
+    c->quantities = ColumnarBounds();
+    c->prices = ColumnarBounds();
+    c->patterns.clear();
+    for (int i = 0; i < argc && idxStr[3 * i]; ++i) {
+        int column = idxStr[3 * i] - '0';
+        char hex[3] = {idxStr[3 * i + 1], idxStr[3 * i + 2], '\0'};
+        unsigned char op = static_cast<unsigned char>(std::strtol(hex, nullptr, 16));
+        if (column == COLUMN_NAME) {
+            const unsigned char* pattern = sqlite3_value_text(argv[i]);
+            if (!pattern) {
+                c->ids.clear(); // LIKE NULL matches nothing
+            } else {
+                c->patterns.push_back(ColumnarPattern(reinterpret_cast<const char*>(pattern)));
+            }
+        } else {
+            (column == COLUMN_ID ? c->ids : column == COLUMN_QUANTITY ? c->quantities : c->prices).apply(op, argv[i]);
+        }
+    }
+
+    const ColumnarSnapshot& s = *c->snapshot;
+    if (c->ids.empty() || c->quantities.empty() || c->prices.empty()) {
+        c->position = c->end = 0;
+    } else if (c->order == ORDER_BY_QUANTITY) {
+        const ColumnarBounds& q = c->quantities;
+        c->position = std::partition_point(s.byQuantity.begin(), s.byQuantity.end(),
+                                           [&](size_t r) { return s.quantities[r] < q.lo; }) - s.byQuantity.begin();
+        c->end = std::partition_point(s.byQuantity.begin(), s.byQuantity.end(),
+                                      [&](size_t r) { return s.quantities[r] <= q.hi; }) - s.byQuantity.begin();
+    } else {
+        c->position = std::lower_bound(s.ids.begin(), s.ids.end(), c->ids.lo) - s.ids.begin();
+        c->end = std::upper_bound(s.ids.begin(), s.ids.end(), c->ids.hi) - s.ids.begin();
+    }
+    c->settle();
+    return SQLITE_OK;
+}
+
+static int columnarNext(sqlite3_vtab_cursor* cursor) {
+    ColumnarCursor* c = reinterpret_cast<ColumnarCursor*>(cursor);
+    ++c->position;
+    c->settle();
+    return SQLITE_OK;
+}
+
+static int columnarEof(sqlite3_vtab_cursor* cursor) {
+    ColumnarCursor* c = reinterpret_cast<ColumnarCursor*>(cursor);
+    return c->position >= c->end;
+}
+
+static int columnarColumn(sqlite3_vtab_cursor* cursor, sqlite3_context* context, int column) {
+    ColumnarCursor* c = reinterpret_cast<ColumnarCursor*>(cursor);
+    const ColumnarSnapshot& s = *c->snapshot;
+    size_t r = c->row();
+    switch (column) {
+        case COLUMN_ID:
+            sqlite3_result_int64(context, s.ids[r]);
+            break;
+        case COLUMN_NAME:
+            sqlite3_result_text(context, s.names.data() + s.nameOffsets[r],
+                                static_cast<int>(s.nameOffsets[r + 1] - s.nameOffsets[r]), SQLITE_TRANSIENT);
+            break;
+        case COLUMN_QUANTITY:
+            sqlite3_result_int64(context, s.quantities[r]);
+            break;
+        default:
+            sqlite3_result_int64(context, s.priceCents[r]);
+            break;
+    }
+    return SQLITE_OK;
+}
+
+static int columnarRowid(sqlite3_vtab_cursor* cursor, sqlite3_int64* rowid) {
+    ColumnarCursor* c = reinterpret_cast<ColumnarCursor*>(cursor);
+    *rowid = c->snapshot->ids[c->row()];
+    return SQLITE_OK;
+}
+
+static const sqlite3_module& columnarModule() {
+    static sqlite3_module module;
+    static bool initialized = false;
+    if (!initialized) {
+        std::memset(&module, 0, sizeof(module));
+        module.iVersion = 1;
+        module.xCreate = nullptr; // Eponymous only: the table exists as soon as the module does
+        module.xConnect = columnarConnect;
+        module.xBestIndex = columnarBestIndex;
+        module.xDisconnect = columnarDisconnect;
+        module.xDestroy = columnarDisconnect;
+        module.xOpen = columnarOpen;
+        module.xClose = columnarClose;
+        module.xFilter = columnarFilter;
+        module.xNext = columnarNext;
+        module.xEof = columnarEof;
+        module.xColumn = columnarColumn;
+        module.xRowid = columnarRowid;
+        initialized = true;
+    }
+    return module;
+}
+
+static void deleteColumnarStore(void* store) {
+    delete static_cast<ColumnarStore*>(store);
+}
+
+bool registerColumnarProducts(sqlite3* db) {
+    static std::mutex moduleMutex; // Connections of any thread may register at once
+    std::lock_guard<std::mutex> lock(moduleMutex);
+    const sqlite3_module& module = columnarModule();
+    for (bool includeArchive : {false, true}) {
+        const char* name = includeArchive ? "products_columnar_all" : "products_columnar";
+        if (sqlite3_create_module_v2(db, name, &module, new ColumnarStore(db, includeArchive), deleteColumnarStore) !=
+            SQLITE_OK) {
+            logMessage(LOG_LEVEL_ERROR, std::string("Failed to register ") + name + ": " + sqlite3_errmsg(db));
+            return false;
+        }
+    }
+    return true;
+}
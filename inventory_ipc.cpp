@@ -0,0 +1,422 @@
+// Line protocol and shared-memory transport (see inventory_ipc.h)
+
+#include "inventory_ipc.h"
+
+#include <algorithm> // For std::min
+#include <cerrno>   // For errno
+#include <cstdlib>  // For std::strtol
+#include <cstring>  // For std::memcpy
+#include <istream>  // For reading batches
+#include <ostream>  // For writing batch responses
+#include <new>      // For placement new
+#include <sstream>  // For formatting fields
+#include <thread>   // For std::thread::hardware_concurrency
+#include <linux/futex.h> // For FUTEX_WAIT, FUTEX_WAKE
+#include <poll.h>   // For checking the socket
+#include <sys/mman.h> // For memfd_create, mmap
+#include <sys/socket.h> // For sendmsg, recvmsg
+#include <sys/syscall.h> // For SYS_futex
+#include <unistd.h> // For ftruncate, close
+
+// --- Line Protocol ---
+
+// Escapes tabs, newlines and backslashes so a field fits on one protocol line
+std::string escapeField(const std::string& field) {
+    std::string escaped;
+    for (char c : field) {
+        if (c == '\\') {
+            escaped += "\\\\";
+        } else if (c == '\t') {
+            escaped += "\\t";
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+// Reverses escapeField
+std::string unescapeField(const std::string& field) {
+    std::string plain;
+    for (std::string::size_type i = 0; i < field.size(); ++i) {
+        if (field[i] == '\\' && i + 1 < field.size()) {
+            char next = field[++i];
+            plain += next == 't' ? '\t' : next == 'n' ? '\n' : next;
+        } else {
+            plain += field[i];
+        }
+    }
+    return plain;
+}
+
+// Splits a protocol line into its unescaped tab-separated fields
+std::vector<std::string> splitFields(const std::string& line) {
+    std::vector<std::string> fields;
+    std::string::size_type start = 0;
+    for (;;) {
+        std::string::size_type tab = line.find('\t', start);
+        fields.push_back(unescapeField(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start)));
+        if (tab == std::string::npos) {
+            break;
+        }
+        start = tab + 1;
+    }
+    return fields;
+}
+
+// Formats a product as the fields of an ADD/UPDATE request or a ROW response
+std::string productFields(const Product& p) {
+    std::ostringstream out;
+    out << p.id << '\t' << escapeField(p.name) << '\t' << p.quantity << '\t' << p.priceCents;
+    return out.str();
+}
+
+// Parses the four product fields starting at fields[first]
+bool parseProductFields(const std::vector<std::string>& fields, size_t first, Product& p) {
+    if (fields.size() < first + 4) {
+        return false;
+    }
+    p.id = static_cast<int>(std::strtol(fields[first].c_str(), nullptr, 10));
+    p.name = fields[first + 1];
+    p.quantity = static_cast<int>(std::strtol(fields[first + 2].c_str(), nullptr, 10));
+    p.priceCents = std::strtoll(fields[first + 3].c_str(), nullptr, 10);
+    return true;
+}
+
+// Formats a bulk request as the fields of a BULK request
+std::string bulkRequestFields(const BulkRequest& r) {
+    std::ostringstream out;
+    out << r.action << '\t' << r.amount << '\t' << r.dryRun << '\t'
+        << escapeField(r.filter.nameContains) << '\t' << r.filter.hasQuantityRange << '\t' << r.filter.minQuantity
+        << '\t' << r.filter.maxQuantity << '\t' << r.filter.hasPriceRange << '\t' << r.filter.minPrice << '\t'
+        << r.filter.maxPrice;
+    return out.str();
+}
+
+// Parses the bulk request fields starting at fields[first]
+bool parseBulkRequestFields(const std::vector<std::string>& fields, size_t first, BulkRequest& r) {
+    if (fields.size() < first + 10) {
+        return false;
+    }
+    r.action = static_cast<BulkAction>(std::strtol(fields[first].c_str(), nullptr, 10));
+    r.amount = std::strtoll(fields[first + 1].c_str(), nullptr, 10);
+    r.dryRun = fields[first + 2] == "1";
+    r.filter.nameContains = fields[first + 3];
+    r.filter.hasQuantityRange = fields[first + 4] == "1";
+    r.filter.minQuantity = static_cast<int>(std::strtol(fields[first + 5].c_str(), nullptr, 10));
+    r.filter.maxQuantity = static_cast<int>(std::strtol(fields[first + 6].c_str(), nullptr, 10));
+    r.filter.hasPriceRange = fields[first + 7] == "1";
+    r.filter.minPrice = std::strtoll(fields[first + 8].c_str(), nullptr, 10);
+    r.filter.maxPrice = std::strtoll(fields[first + 9].c_str(), nullptr, 10);
+    return true;
+}
+
+
+// --- Batch Envelopes ---
+
+// Reads a little-endian integer of size bytes
+static bool readLittleEndian(std::istream& in, int size, uint64_t& value) {
+    unsigned char bytes[8];
+    if (!in.read(reinterpret_cast<char*>(bytes), size)) {
+        return false;
+    }
+    value = 0;
+    for (int i = size - 1; i >= 0; --i) {
+        value = (value << 8) | bytes[i];
+    }
+    return true;
+}
+
+static void writeLittleEndian(std::ostream& out, int size, uint64_t value) {
+    unsigned char bytes[8];
+    for (int i = 0; i < size; ++i) {
+        bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+    out.write(reinterpret_cast<const char*>(bytes), size);
+}
+
+static bool readInt32(std::istream& in, int& value) {
+    uint64_t raw = 0;
+    if (!readLittleEndian(in, 4, raw)) {
+        return false;
+    }
+    value = static_cast<int32_t>(static_cast<uint32_t>(raw));
+    return true;
+}
+
+// Reads the name, quantity and price of an ADD or UPDATE
+static bool readProductFields(std::istream& in, Product& p) {
+    uint64_t price = 0;
+    uint64_t nameLength = 0;
+    if (!readInt32(in, p.quantity) || !readLittleEndian(in, 8, price) || !readLittleEndian(in, 2, nameLength)) {
+        return false;
+    }
+    p.priceCents = static_cast<Cents>(price);
+    p.name.resize(nameLength);
+    return nameLength == 0 || static_cast<bool>(in.read(&p.name[0], static_cast<std::streamsize>(nameLength)));
+}
+
+// Operations reserved up front; a batch announcing more grows as its operations arrive
+static const uint64_t kBatchReserveOperations = 1024;
+
+bool readBatchRequest(std::istream& in, std::vector<BatchOperation>& operations, std::string& error) {
+    operations.clear();
+    error.clear();
+    if (in.peek() == std::char_traits<char>::eof()) {
+        return false;
+    }
+    char magic[4];
+    uint64_t count = 0;
+    if (!in.read(magic, 4) || std::memcmp(magic, "INVB", 4) != 0 || !readLittleEndian(in, 4, count)) {
+        error = "not a batch request";
+        return false;
+    }
+    if (count > kMaxBatchOperations) {
+        error = "batch of " + std::to_string(count) + " operations is over the limit of " +
+                std::to_string(kMaxBatchOperations);
+        return false;
+    }
+    operations.reserve(std::min<uint64_t>(count, kBatchReserveOperations));
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t type = 0;
+        if (!readLittleEndian(in, 1, type)) {
+            error = "batch request ends in the middle of an operation";
+            return false;
+        }
+        BatchOperation operation;
+        operation.type = static_cast<BatchOperationType>(type);
+        bool complete;
+        if (operation.type == BATCH_ADD) {
+            complete = readProductFields(in, operation.product);
+        } else if (operation.type == BATCH_UPDATE) {
+            complete = readInt32(in, operation.product.id) && readProductFields(in, operation.product);
+        } else if (operation.type == BATCH_DELETE) {
+            complete = readInt32(in, operation.product.id);
+        } else if (operation.type == BATCH_ADJUST) {
+            complete = readInt32(in, operation.product.id) && readInt32(in, operation.quantityDelta);
+        } else {
+            error = "unknown operation type " + std::to_string(type);
+            return false;
+        }
+        if (!complete) {
+            error = "batch request ends in the middle of an operation";
+            return false;
+        }
+        operations.push_back(std::move(operation));
+    }
+    return true;
+}
+
+void writeBatchResponse(std::ostream& out, const BatchResult& result) {
+    out.write("INVR", 4);
+    writeLittleEndian(out, 4, result.statuses.size());
+    writeLittleEndian(out, 1, result.committed ? 1 : 0);
+    for (BatchStatus status : result.statuses) {
+        writeLittleEndian(out, 1, static_cast<uint64_t>(status));
+    }
+    for (int newId : result.newIds) {
+        writeLittleEndian(out, 4, static_cast<uint32_t>(newId));
+    }
+}
+
+
+// --- Shared-Memory Rings ---
+
+// The futex words are shared between processes, so no FUTEX_PRIVATE_FLAG
+static long futex(std::atomic<uint32_t>& word, int op, uint32_t value, const timespec* timeout) {
+    return ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, value, timeout, nullptr, 0);
+}
+
+// Polls before sleeping; that only pays off when the peer can run on another core meanwhile
+static int spinIterations() {
+    static const int iterations = std::thread::hardware_concurrency() > 1 ? 20000 : 0;
+    return iterations;
+}
+
+bool ShmRing::waitForChange(std::atomic<uint32_t>& word, std::atomic<uint32_t>& sleeping, uint32_t seen,
+                            const std::function<bool()>& peerAlive) {
+    for (int i = 0; i < spinIterations(); ++i) {
+        if (word.load(std::memory_order_acquire) != seen) {
+            return true;
+        }
+    }
+    for (;;) {
+        // Announce the sleep before the last look, so a peer moving word now sees it and wakes us
+        sleeping.store(1, std::memory_order_seq_cst);
+        if (word.load(std::memory_order_seq_cst) != seen) {
+            sleeping.store(0, std::memory_order_relaxed);
+            return true;
+        }
+        timespec timeout = {0, kCheckIntervalMs * 1000000L};
+        futex(word, FUTEX_WAIT, seen, &timeout);
+        sleeping.store(0, std::memory_order_relaxed);
+        if (word.load(std::memory_order_acquire) != seen) {
+            return true;
+        }
+        if (!peerAlive()) {
+            return false;
+        }
+    }
+}
+
+bool ShmRing::write(const char* bytes, size_t size, const std::function<bool()>& peerAlive) {
+    const uint32_t capacity = ShmChannelLayout::kRingBytes;
+    while (size > 0) {
+        uint32_t tail = header->tail.load(std::memory_order_relaxed);
+        uint32_t head = header->head.load(std::memory_order_acquire);
+        uint32_t space = capacity - (tail - head);
+        if (space == 0) {
+            if (!waitForChange(header->head, header->producerSleeping, head, peerAlive)) {
+                return false;
+            }
+            continue;
+        }
+        uint32_t offset = tail & (capacity - 1);
+        uint32_t chunk = static_cast<uint32_t>(std::min<size_t>(size, std::min(space, capacity - offset)));
+        std::memcpy(data + offset, bytes, chunk);
+        header->tail.store(tail + chunk, std::memory_order_seq_cst);
+        if (header->consumerSleeping.load(std::memory_order_seq_cst)) {
+            futex(header->tail, FUTEX_WAKE, 1, nullptr);
+        }
+        bytes += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool ShmRing::read(char* bytes, size_t size, const std::function<bool()>& peerAlive) {
+    const uint32_t capacity = ShmChannelLayout::kRingBytes;
+    while (size > 0) {
+        uint32_t head = header->head.load(std::memory_order_relaxed);
+        uint32_t tail = header->tail.load(std::memory_order_acquire);
+        uint32_t available = tail - head;
+        if (available == 0) {
+            if (!waitForChange(header->tail, header->consumerSleeping, tail, peerAlive)) {
+                return false;
+            }
+            continue;
+        }
+        uint32_t offset = head & (capacity - 1);
+        uint32_t chunk = static_cast<uint32_t>(std::min<size_t>(size, std::min(available, capacity - offset)));
+        std::memcpy(bytes, data + offset, chunk);
+        header->head.store(head + chunk, std::memory_order_seq_cst);
+        if (header->producerSleeping.load(std::memory_order_seq_cst)) {
+            futex(header->head, FUTEX_WAKE, 1, nullptr);
+        }
+        bytes += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+// Length and bytes go in as one write, so a small message is published (and wakes the
+// consumer) once
+bool ShmRing::writeMessage(const std::string& message, const std::function<bool()>& peerAlive) {
+    uint32_t length = static_cast<uint32_t>(message.size());
+    std::string framed(sizeof(length) + message.size(), '\0');
+    std::memcpy(&framed[0], &length, sizeof(length));
+    std::memcpy(&framed[sizeof(length)], message.data(), message.size());
+    return write(framed.data(), framed.size(), peerAlive);
+}
+
+bool ShmRing::readMessage(std::string& message, uint32_t maxLength, const std::function<bool()>& peerAlive) {
+    uint32_t length = 0;
+    if (!read(reinterpret_cast<char*>(&length), sizeof(length), peerAlive) || length > maxLength) {
+        return false;
+    }
+    message.resize(length);
+    return length == 0 || read(&message[0], length, peerAlive);
+}
+
+bool createShmChannel(int& fd, ShmChannelLayout*& channel, std::string& error) {
+    fd = ::memfd_create("inventory-shm", MFD_CLOEXEC);
+    if (fd < 0 || ::ftruncate(fd, sizeof(ShmChannelLayout)) != 0) {
+        error = std::string("can't create shared memory: ") + std::strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    if (!mapShmChannel(fd, channel, error)) {
+        ::close(fd);
+        return false;
+    }
+    new (channel) ShmChannelLayout(); // Starts both rings empty
+    return true;
+}
+
+bool mapShmChannel(int fd, ShmChannelLayout*& channel, std::string& error) {
+    void* mapping = ::mmap(nullptr, sizeof(ShmChannelLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        error = std::string("can't map shared memory: ") + std::strerror(errno);
+        return false;
+    }
+    channel = static_cast<ShmChannelLayout*>(mapping);
+    return true;
+}
+
+void unmapShmChannel(ShmChannelLayout* channel) {
+    if (channel) {
+        ::munmap(channel, sizeof(ShmChannelLayout));
+    }
+}
+
+bool sendWithDescriptor(int socketFd, const std::string& data, int fd) {
+    iovec part = {const_cast<char*>(data.data()), data.size()};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message = {};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* attached = CMSG_FIRSTHDR(&message);
+    attached->cmsg_level = SOL_SOCKET;
+    attached->cmsg_type = SCM_RIGHTS;
+    attached->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(attached), &fd, sizeof(int));
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(socketFd, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent == static_cast<ssize_t>(data.size());
+}
+
+bool receiveLineWithDescriptor(int socketFd, std::string& line, int& fd) {
+    line.clear();
+    fd = -1;
+    for (;;) {
+        char chunk[256];
+        iovec part = {chunk, sizeof(chunk)};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr message = {};
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t n = ::recvmsg(socketFd, &message, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        for (cmsghdr* attached = CMSG_FIRSTHDR(&message); attached; attached = CMSG_NXTHDR(&message, attached)) {
+            if (attached->cmsg_level == SOL_SOCKET && attached->cmsg_type == SCM_RIGHTS && fd < 0) {
+                std::memcpy(&fd, CMSG_DATA(attached), sizeof(int));
+            }
+        }
+        line.append(chunk, static_cast<size_t>(n));
+        std::string::size_type newline = line.find('\n');
+        if (newline != std::string::npos) {
+            line.erase(newline);
+            return true;
+        }
+    }
+}
+
+bool socketPeerAlive(int socketFd) {
+    pollfd check = {socketFd, POLLRDHUP, 0};
+    return ::poll(&check, 1, 0) >= 0 && !(check.revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL));
+}
@@ -0,0 +1,118 @@
+#ifndef INVENTORY_IPC_H
+#define INVENTORY_IPC_H
+
+// The line protocol spoken by cluster nodes and the daemon, and the shared-memory transport
+// that co-located daemon clients use instead of the socket. Not part of the stable API.
+
+#include "inventory.h"
+
+#include <atomic>   // For the ring positions
+#include <cstddef>  // For std::size_t
+#include <cstdint>  // For uint32_t
+#include <functional> // For std::function
+#include <iosfwd>   // For the batch streams
+#include <string>   // For using string objects
+#include <vector>   // For using vector containers
+
+// --- Line Protocol ---
+
+// Escapes tabs, newlines and backslashes so a field fits on one protocol line
+std::string escapeField(const std::string& field);
+// Reverses escapeField
+std::string unescapeField(const std::string& field);
+// Splits a protocol line into its unescaped tab-separated fields
+std::vector<std::string> splitFields(const std::string& line);
+// Formats a product as the fields of an ADD/UPDATE request or a ROW response
+std::string productFields(const Product& p);
+// Parses the four product fields starting at fields[first]
+bool parseProductFields(const std::vector<std::string>& fields, size_t first, Product& p);
+// Formats a bulk request as the fields of a BULK request
+std::string bulkRequestFields(const BulkRequest& r);
+// Parses the bulk request fields starting at fields[first]
+bool parseBulkRequestFields(const std::vector<std::string>& fields, size_t first, BulkRequest& r);
+
+// --- Batch Envelopes ---
+// Binary framing of --batch mode; integers are little-endian.
+//   request:  "INVB", u32 operation count, then per operation a u8 type (BatchOperationType) and
+//             ADD:    i32 quantity, i64 price in cents, u16 name length, name bytes
+//             UPDATE: i32 id, then the ADD fields
+//             DELETE: i32 id
+//             ADJUST: i32 id, i32 quantity delta
+//   response: "INVR", u32 operation count, u8 committed, one status byte (BatchStatus) per
+//             operation, then an i32 new id per ADD operation (0 if it was not added)
+
+static const uint32_t kMaxBatchOperations = 1000000;
+
+// Reads the next request; false at the end of the input (error empty) or on a malformed
+// request (error set)
+bool readBatchRequest(std::istream& in, std::vector<BatchOperation>& operations, std::string& error);
+void writeBatchResponse(std::ostream& out, const BatchResult& result);
+
+// --- Shared-Memory Rings ---
+// A client that sends "SHM" on the daemon socket gets back "OK size" and, attached to it
+// (SCM_RIGHTS), a memfd holding a request ring and a response ring. Each ring is a
+// single-producer, single-consumer byte queue; a message is its 32-bit length followed by
+// its bytes. A response may be larger than the ring, in which case it streams through; a
+// request must fit in the ring, and the daemon drops a client that announces a longer one. A side that
+// finds nothing to do spins briefly (on multi-core machines), then sleeps on a futex on the
+// other side's position; the other side only makes the wake-up call when someone sleeps.
+// The socket stays open as the liveness signal: either side stops when it is closed.
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared-memory rings need lock-free atomics");
+
+// Ring positions count bytes forever and wrap at 2^32; only their difference matters
+struct ShmRingHeader {
+    alignas(64) std::atomic<uint32_t> head; // Consumer position, futex word of a full producer
+    std::atomic<uint32_t> producerSleeping;
+    alignas(64) std::atomic<uint32_t> tail; // Producer position, futex word of an idle consumer
+    std::atomic<uint32_t> consumerSleeping;
+};
+
+// Layout of the memfd: both headers, then the two data areas
+struct ShmChannelLayout {
+    static const uint32_t kRingBytes = 256 * 1024; // Per direction, a power of two
+    ShmRingHeader requests;
+    ShmRingHeader responses;
+    char requestData[kRingBytes];
+    char responseData[kRingBytes];
+};
+
+// One direction of a channel, seen from the producer or the consumer side
+class ShmRing {
+public:
+    ShmRing(ShmRingHeader* header, char* data) : header(header), data(data) {}
+
+    // Both wait as long as it takes unless peerAlive() (asked every kCheckIntervalMs while
+    // asleep) returns false, in which case they fail
+    bool writeMessage(const std::string& message, const std::function<bool()>& peerAlive);
+    // A message announced as longer than maxLength fails the read before anything is allocated
+    bool readMessage(std::string& message, uint32_t maxLength, const std::function<bool()>& peerAlive);
+
+private:
+    static const int kCheckIntervalMs = 100;
+
+    bool write(const char* bytes, size_t size, const std::function<bool()>& peerAlive);
+    bool read(char* bytes, size_t size, const std::function<bool()>& peerAlive);
+    // Waits until word no longer holds seen; false if the peer went away meanwhile
+    bool waitForChange(std::atomic<uint32_t>& word, std::atomic<uint32_t>& sleeping, uint32_t seen,
+                       const std::function<bool()>& peerAlive);
+
+    ShmRingHeader* header;
+    char* data;
+};
+
+// Creates and maps a channel in a new memfd; returns the descriptor and mapping
+bool createShmChannel(int& fd, ShmChannelLayout*& channel, std::string& error);
+// Maps a channel received from the daemon
+bool mapShmChannel(int fd, ShmChannelLayout*& channel, std::string& error);
+void unmapShmChannel(ShmChannelLayout* channel);
+
+// Sends data on a Unix socket with fd attached (SCM_RIGHTS)
+bool sendWithDescriptor(int socketFd, const std::string& data, int fd);
+// Reads one '\n'-terminated line from a Unix socket along with a descriptor attached to it
+// (-1 if none)
+bool receiveLineWithDescriptor(int socketFd, std::string& line, int& fd);
+// True while the other end of a connected socket is open
+bool socketPeerAlive(int socketFd);
+
+#endif // INVENTORY_IPC_H
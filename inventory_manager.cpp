@@ -2,356 +2,2772 @@
 #include <string>   // For using string objects
 #include <vector>   // For using vector containers
 #include <limits>   // For numeric_limits (used for clearing input buffer)
-#include <sqlite3.h> // For SQLite C API
 #include <stdexcept> // For standard exceptions
 #include <iomanip>  // For std::setprecision, std::fixed
 #include <sstream> // For string streams (used in search)
+#include <memory>   // For std::unique_ptr
+#include <thread>   // For shard worker threads
+#include <mutex>    // For std::mutex, std::unique_lock
+#include <condition_variable> // For waking shard worker threads
+#include <future>   // For std::future, std::packaged_task
+#include <functional> // For std::function
+#include <deque>    // For shard task queues
+#include <algorithm> // For std::sort
+#include <atomic>   // For std::atomic
+#include <cstdlib>  // For std::strtol, realpath
+#include <cstdio>   // For std::remove
+#include <cstring>  // For std::strcmp
+#include <map>      // For the consistent-hash ring
+#include <cerrno>   // For errno
+#include <cstdint>  // For uint64_t
+#include <cmath>    // For std::llround
+#include <climits>  // For INT_MAX
+#include <chrono>   // For replication lag timing
+#include <fstream>  // For the change stream file
+#include <iterator> // For std::istreambuf_iterator
+#include <sys/socket.h> // For cluster sockets
+#include <sys/un.h> // For Unix domain socket addresses
+#include <unistd.h> // For read, close, unlink
+#include <signal.h> // For sigaction (Ctrl-C cancels the running query)
+
+#include "inventory.h"        // The inventory library
+#include "inventory_async.h"  // Its coroutine interface, for the async benchmark
+#include "inventory_sqlite.h" // Its SQLite layer, for the distributed modes
+#include "inventory_ipc.h"    // Node/daemon protocol and shared-memory rings
+#include "inventory_shm.h"    // Shared-memory daemon client, for the IPC benchmark
+#include "inventory_vfs.h"    // Memory-backed storage (--memory-storage)
+
+// --- Inventory Commands ---
+// The menu commands: each runs one InventoryDB call and prints its result or error.
+
+// Prints where the time before the first command went
+void printStartupReport(const StartupTimings& t, std::chrono::steady_clock::time_point processStart) {
+    std::cout << "Startup: open " << std::fixed << std::setprecision(3) << t.openMs << " ms, schema "
+              << (t.fastPath ? "check " : "migration ") << t.schemaMs << " ms, ready after "
+              << elapsedMs(processStart) << " ms" << std::endl;
+}
 
-// Structure to hold product data
-struct Product {
-    int id;
-    std::string name;
-    int quantity;
-    double price;
-};
 
-// --- Database Interaction Functions ---
+// Prints the inventory table header
+void printInventoryHeader() {
+     std::cout << "+-------+---------------------------+------------+------------+" << std::endl;
+     std::cout << "| ID    | Name                      | Quantity   | Price      |" << std::endl;
+     std::cout << "+-------+---------------------------+------------+------------+" << std::endl;
+}
+
+
+// Prints the inventory table footer
+void printInventoryFooter() {
+     std::cout << "+-------+---------------------------+------------+------------+" << std::endl;
+}
+
 
-// Callback function for SELECT queries (used by sqlite3_exec for multi-row results)
-// Prints rows matching the inventory table format.
-static int selectCallbackPrint(void* data, int argc, char** argv, char** azColName) {
-    // Print the row data formatted
-    std::cout << "| " << std::left << std::setw(5) << (argv[0] ? argv[0] : "NULL"); // ID
-    std::cout << "| " << std::left << std::setw(25) << (argv[1] ? argv[1] : "NULL"); // Name
-    std::cout << "| " << std::right << std::setw(10) << (argv[2] ? argv[2] : "NULL"); // Quantity
-    std::cout << "| $" << std::right << std::setw(9) << std::fixed << std::setprecision(2) << (argv[3] ? std::stod(argv[3]) : 0.00); // Price
+// Prints a single product as a row of the inventory table
+void printProductRow(const ProductView& p) {
+    std::cout << "| " << std::left << std::setw(5) << p.id; // ID
+    std::cout << "| " << std::left << std::setw(25) << p.name; // Name
+    std::cout << "| " << std::right << std::setw(10) << p.quantity; // Quantity
+    std::cout << "| $" << std::right << std::setw(9) << formatCents(p.priceCents); // Price
     std::cout << " |" << std::endl;
-    return 0; // Return 0 to continue processing rows
 }
 
-// Executes a non-SELECT SQL statement and handles errors
-bool executeSQL(sqlite3* db, const std::string& sql, const std::string& successMsg = "", bool printErrors = true) {
-    char* errMsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg); // Use null callback for non-SELECT
 
-    if (rc != SQLITE_OK) {
-        if (printErrors) {
-            std::cerr << "SQL error: " << errMsg << std::endl;
-        }
-        sqlite3_free(errMsg); // Free error message memory
+// Prints products as an inventory table; emptyMessage is shown when there are none
+void printProductTable(const std::string& title, const std::vector<Product>& products,
+                       const std::string& emptyMessage) {
+    std::cout << "\n--- " << title << " ---" << std::endl;
+    printInventoryHeader();
+    for (const Product& p : products) {
+        printProductRow(p);
+    }
+    printInventoryFooter();
+    if (products.empty() && !emptyMessage.empty()) {
+        std::cout << emptyMessage << std::endl;
+    }
+}
+
+// Adds a new product to the inventory
+bool addProduct(InventoryDB& store, const Product& product) {
+    int newId = 0;
+    if (!store.addProduct(product, newId)) {
+        std::cerr << "Execution failed (INSERT): " << store.lastError() << std::endl;
         return false;
-    } else if (!successMsg.empty()) {
-        std::cout << successMsg << std::endl;
     }
+    std::cout << "Product '" << product.name << "' added successfully." << std::endl;
     return true;
 }
 
-// Executes a SELECT SQL statement using sqlite3_exec (suitable for simple display)
-bool executeSQLSelectAndPrint(sqlite3* db, const std::string& sql) {
-    char* errMsg = nullptr;
-    int rc = sqlite3_exec(db, sql.c_str(), selectCallbackPrint, nullptr, &errMsg);
+// Views all products in the inventory
+bool viewProducts(InventoryDB& store) {
+    std::vector<Product> products;
+    if (!store.listProducts(products)) {
+        std::cerr << "Failed to retrieve products: " << store.lastError() << std::endl;
+        return false;
+    }
+    printProductTable("Current Inventory", products, "");
+    return true;
+}
 
-    if (rc != SQLITE_OK) {
-        std::cerr << "SQL error executing select: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
+// Updates an existing product
+bool updateProduct(InventoryDB& store, const Product& product) {
+    bool found = false;
+    if (!store.updateProduct(product, found)) {
+        std::cerr << "Update failed: " << store.lastError() << std::endl;
         return false;
     }
-     if (sqlite3_changes(db) == 0 && rc == SQLITE_OK) {
-         // Check if the query ran ok but returned no rows (sqlite3_changes isn't reliable for SELECT)
-         // A more robust way is needed if we want to specifically detect "no rows found" vs error
-         // For now, the callback simply won't print anything if no rows are returned.
+    if (!found) {
+        std::cout << "No product found with ID " << product.id << ". Update failed." << std::endl;
+        return false;
+    }
+    std::cout << "Product updated successfully." << std::endl;
+    return true;
+}
+
+// Deletes a product by ID
+bool deleteProduct(InventoryDB& store, int id) {
+    bool found = false;
+    if (!store.deleteProduct(id, found)) {
+        std::cerr << "Deletion failed: " << store.lastError() << std::endl;
+        return false;
     }
+    if (!found) {
+        std::cout << "No product found with ID " << id << ". Deletion failed." << std::endl;
+        return false;
+    }
+    std::cout << "Product deleted successfully." << std::endl;
     return true;
 }
 
+// Prints the rows of a query as they are stepped; false if the query failed
+bool printProductRange(const std::string& title, ProductRange& range, const std::string& emptyMessage) {
+    std::cout << "\n--- " << title << " ---" << std::endl;
+    printInventoryHeader();
+    bool found = false;
+    for (const ProductView& p : range) {
+        found = true;
+        printProductRow(p);
+    }
+    printInventoryFooter();
+    if (!range.ok()) {
+        return false;
+    }
+    if (!found) {
+        std::cout << emptyMessage << std::endl;
+    }
+    return true;
+}
 
-// Initializes the database and creates the products table if it doesn't exist
-bool initializeDatabase(sqlite3*& db, const std::string& dbName) {
-    int rc = sqlite3_open(dbName.c_str(), &db); // Open the database file
+// Searches for products by name (case-insensitive partial match)
+bool searchProducts(InventoryDB& store, const std::string& searchTerm) {
+    if (store.parallelScans() > 0) {
+        // The partitions are scanned in parallel and merged, so print the merged rows
+        std::vector<Product> products;
+        if (!store.searchProducts(searchTerm, products)) {
+            std::cerr << "Error searching products: " << store.lastError() << std::endl;
+            return false;
+        }
+        printProductTable("Search Results for \"" + searchTerm + "\"", products,
+                          "No products found matching \"" + searchTerm + "\".");
+        return true;
+    }
+    ProductRange results = store.searchProducts(searchTerm);
+    if (!printProductRange("Search Results for \"" + searchTerm + "\"", results,
+                           "No products found matching \"" + searchTerm + "\".")) {
+        std::cerr << "Error searching products: " << results.error() << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    if (rc != SQLITE_OK) { // Use SQLITE_OK check
-        std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_close(db); // Close DB if open failed partially
-        db = nullptr;
+// Searches for products whose name starts with a prefix (case-insensitive, whitespace collapsed)
+bool searchProductsByPrefix(InventoryDB& store, const std::string& prefix) {
+    ProductRange results = store.searchProductsByPrefix(prefix);
+    if (!printProductRange("Products Starting with \"" + prefix + "\"", results,
+                           "No products found starting with \"" + prefix + "\".")) {
+        std::cerr << "Error searching products: " << results.error() << std::endl;
         return false;
-    } else {
-        std::cout << "Opened database successfully" << std::endl;
     }
+    return true;
+}
+
+// Filters products by quantity less than a threshold
+bool filterProductsByQuantity(InventoryDB& store, int threshold) {
+    if (store.parallelScans() > 0) {
+        std::vector<Product> products;
+        if (!store.filterProductsByQuantity(threshold, products)) {
+            std::cerr << "Error filtering products: " << store.lastError() << std::endl;
+            return false;
+        }
+        printProductTable("Products with Quantity Less Than " + std::to_string(threshold), products,
+                          "No products found with quantity less than " + std::to_string(threshold) + ".");
+        return true;
+    }
+    ProductRange results = store.filterProductsByQuantity(threshold);
+    if (!printProductRange("Products with Quantity Less Than " + std::to_string(threshold), results,
+                           "No products found with quantity less than " + std::to_string(threshold) + ".")) {
+        std::cerr << "Error filtering products: " << results.error() << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    // SQL statement to create the products table
-    std::string createTableSQL =
-        "CREATE TABLE IF NOT EXISTS products ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "name TEXT NOT NULL,"
-        "quantity INTEGER NOT NULL,"
-        "price REAL NOT NULL);";
+// Prints the inventory report for already computed totals
+void printReport(int totalItems, Cents totalValue) {
+    std::cout << "\n--- Inventory Report ---" << std::endl;
+    std::cout << "Total unique products: " << totalItems << std::endl;
+    std::cout << "Total inventory value: $" << formatCents(totalValue) << std::endl;
+    std::cout << "------------------------" << std::endl;
+}
+
+
+// Generates a simple inventory report (total items, total value)
+bool generateReport(InventoryDB& store) {
+    InventoryReport report;
+    bool success = store.generateReport(report);
+    printReport(report.totalItems, report.totalValue);
+    if (!success) {
+        std::cerr << "Report incomplete: " << store.lastError() << std::endl;
+    }
+    return success;
+}
 
-    return executeSQL(db, createTableSQL, "Table 'products' checked/created successfully.");
+// Prints the result of a lookup by ID
+void printProductLookup(int id, const Product& product, bool found) {
+    if (!found) {
+        std::cout << "No product found with ID " << id << "." << std::endl;
+        return;
+    }
+    std::cout << "\n--- Product " << id << " ---" << std::endl;
+    printInventoryHeader();
+    printProductRow(product);
+    printInventoryFooter();
 }
 
-// Adds a new product to the database using prepared statements
-bool addProduct(sqlite3* db, const Product& product) {
-    sqlite3_stmt* stmt;
-    std::string sql = "INSERT INTO products (name, quantity, price) VALUES (?, ?, ?);";
 
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement (INSERT): " << sqlite3_errmsg(db) << std::endl;
+// Displays a single product by ID
+bool getProduct(InventoryDB& store, int id) {
+    Product product;
+    bool found = false;
+    if (!store.getProduct(id, product, found)) {
+        std::cerr << "Failed to retrieve product: " << store.lastError() << std::endl;
         return false;
     }
+    printProductLookup(id, product, found);
+    return found;
+}
 
-    // Bind values
-    sqlite3_bind_text(stmt, 1, product.name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, product.quantity);
-    sqlite3_bind_double(stmt, 3, product.price);
 
-    // Execute
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        std::cerr << "Execution failed (INSERT): " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmt);
+// --- Online Backup ---
+// Menu option 9 and --backup-every; the copying itself is backupDatabase in the library.
+
+// Prints the summary line of a completed backup
+void printBackupStats(const std::string& destName, const BackupStats& stats) {
+    double mebibytes = stats.bytesCopied / (1024.0 * 1024.0);
+    std::cout << "Backup to " << destName << " complete: " << stats.totalPages << " pages ("
+              << std::fixed << std::setprecision(2) << mebibytes << " MiB) in " << stats.elapsedSeconds << " s, "
+              << (stats.elapsedSeconds > 0 ? mebibytes / stats.elapsedSeconds : 0.0) << " MiB/s, longest step "
+              << stats.longestStepMs << " ms, " << stats.busyRetries << " busy retries" << std::endl;
+}
+
+// Default backup file for a database, e.g. "inventory.db" -> "inventory.backup.db"
+std::string backupFileName(const std::string& dbName) {
+    return fileNameWithSuffix(dbName, ".backup");
+}
+
+// Backs up db to destName and prints a progress line every 10% and the summary
+bool backupAndReport(sqlite3* db, const std::string& destName) {
+    BackupStats stats;
+    int nextReportPercent = 10;
+    std::function<void(int, int)> progress = [&nextReportPercent](int copied, int total) {
+        int percent = total > 0 ? 100 * copied / total : 0;
+        if (percent >= nextReportPercent) {
+            std::cout << "Backup progress: " << percent << "% (" << copied << "/" << total << " pages)" << std::endl;
+            nextReportPercent = percent / 10 * 10 + 10;
+        }
+    };
+    if (!backupDatabase(db, destName, stats, progress)) {
         return false;
     }
-
-    std::cout << "Product '" << product.name << "' added successfully." << std::endl;
-    sqlite3_finalize(stmt);
+    printBackupStats(destName, stats);
     return true;
 }
 
-// Prints the inventory table header
-void printInventoryHeader() {
-     std::cout << "+-------+---------------------------+------------+------------+" << std::endl;
-     std::cout << "| ID    | Name                      | Quantity   | Price      |" << std::endl;
-     std::cout << "+-------+---------------------------+------------+------------+" << std::endl;
+// Takes a backup of db every interval on a background thread
+class BackupScheduler {
+public:
+    BackupScheduler() : db(nullptr), stopping(false) {}
+    ~BackupScheduler() { stop(); }
+
+    void start(sqlite3* connection, const std::string& destination, int intervalSeconds) {
+        db = connection;
+        destName = destination;
+        interval = std::chrono::seconds(intervalSeconds);
+        worker = std::thread(&BackupScheduler::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wakeup.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            BackupStats stats;
+            if (backupDatabase(db, destName, stats, nullptr)) {
+                std::cout << "\n[scheduled] ";
+                printBackupStats(destName, stats);
+            }
+            lock.lock();
+        }
+    }
+
+    sqlite3* db;
+    std::string destName;
+    std::chrono::seconds interval;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+};
+
+
+// --- Background Maintenance ---
+// Large deletes leave free pages behind and WAL files grow until checkpointed. Instead of
+// letting SQLite auto-checkpoint in the middle of a user's write, a WAL hook on the main
+// connection only records the WAL size, and the maintenance thread runs short paced steps
+// whenever the session has been idle for a while: incremental vacuum of free pages and
+// PASSIVE checkpoints, followed by a TRUNCATE once a large WAL is fully checkpointed. Every
+// step's duration is recorded in the metrics, since that is how long it could have delayed
+// a user operation.
+
+class MaintenanceScheduler {
+public:
+    static const int kIdleThresholdMs = 500;       // Quiet time required before maintenance runs
+    static const int kVacuumPagesPerStep = 256;    // Free pages released per incremental_vacuum step
+    static const int kStepPauseMs = 20;            // Pause between consecutive steps
+    static const int kTruncateThresholdFrames = 4096; // WAL size (frames) that warrants a TRUNCATE
+    static const int kForcedCheckpointFrames = 16384; // Checkpoint even without idle time beyond this
+
+    MaintenanceScheduler()
+        : mainDb(nullptr), db(nullptr), vacuumEnabled(false), walFrames(0), walDirty(false), stopping(false) {}
+    ~MaintenanceScheduler() { stop(); }
+
+    // Switches the main connection to WAL, replaces its auto-checkpoint with the WAL hook
+    // and starts the maintenance thread on its own connection to the same file
+    bool start(sqlite3* mainConnection, const std::string& dbName) {
+        if (!executeSQL(mainConnection, "PRAGMA journal_mode = WAL;")) {
+            return false;
+        }
+        mainDb = mainConnection;
+        sqlite3_wal_hook(mainDb, &MaintenanceScheduler::onWalCommit, this);
+        if (sqlite3_open(dbName.c_str(), &db) != SQLITE_OK) {
+            std::cerr << "Can't open maintenance connection: " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_close(db);
+            db = nullptr;
+            return false;
+        }
+        sqlite3_busy_timeout(db, 10); // Give up quickly rather than queue behind a writer
+
+        long long autoVacuum = 0;
+        queryInt64(db, "PRAGMA auto_vacuum;", autoVacuum);
+        vacuumEnabled = autoVacuum == 2; // INCREMENTAL
+        if (!vacuumEnabled) {
+            std::cout << "Note: incremental vacuum needs auto_vacuum = INCREMENTAL; run VACUUM once to convert "
+                         "this database. Only checkpoints will be scheduled." << std::endl;
+        }
+        worker = std::thread(&MaintenanceScheduler::run, this);
+        return true;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (mainDb) {
+            sqlite3_wal_autocheckpoint(mainDb, 1000); // Restore SQLite's default checkpointing
+            mainDb = nullptr;
+        }
+        if (db) {
+            // Leave a small WAL behind on a clean shutdown
+            sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+            sqlite3_close(db);
+            db = nullptr;
+        }
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wakeup.wait_for(lock, std::chrono::milliseconds(kStepPauseMs), [this] { return stopping; })) {
+            lock.unlock();
+            runStep();
+            lock.lock();
+        }
+    }
+
+    // Called after every commit on the main connection with the WAL's size in frames
+    static int onWalCommit(void* self, sqlite3* /*db*/, const char* /*dbName*/, int frames) {
+        MaintenanceScheduler* scheduler = static_cast<MaintenanceScheduler*>(self);
+        scheduler->walFrames = frames;
+        scheduler->walDirty = true;
+        return SQLITE_OK;
+    }
+
+    // Runs at most one paced maintenance step
+    void runStep() {
+        bool idle = ActivityTracker::instance().idleMs() >= kIdleThresholdMs;
+
+        if (idle && vacuumEnabled) {
+            long long freePages = 0;
+            if (queryInt64(db, "PRAGMA freelist_count;", freePages) && freePages > 0) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                bool vacuumed = executeSQL(db, "PRAGMA incremental_vacuum(" + std::to_string(kVacuumPagesPerStep) + ");",
+                                           "", false);
+                Metrics::instance().recordDuration("maintenance.vacuum_pause_ms", elapsedMs(start));
+                if (vacuumed) {
+                    Metrics::instance().increment("maintenance.pages_vacuumed",
+                                                  std::min<long long>(freePages, kVacuumPagesPerStep));
+                } else {
+                    Metrics::instance().increment("maintenance.steps_busy");
+                }
+                return; // One step per pause
+            }
+        }
+
+        // Checkpoint when idle, or regardless once the WAL has grown far too large
+        if (!walDirty || (!idle && walFrames < kForcedCheckpointFrames)) {
+            return;
+        }
+        walDirty = false;
+        int logFrames = 0;
+        int checkpointedFrames = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int rc = sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, &logFrames, &checkpointedFrames);
+        Metrics::instance().recordDuration("maintenance.checkpoint_pause_ms", elapsedMs(start));
+        if (rc != SQLITE_OK) {
+            walDirty = true; // Retry on the next step
+            Metrics::instance().increment("maintenance.steps_busy");
+            return;
+        }
+        Metrics::instance().increment("maintenance.checkpoints");
+        if (checkpointedFrames < logFrames) {
+            walDirty = true; // A reader held back part of the WAL
+            return;
+        }
+
+        // Everything is in the database file: reset a large WAL so it stops taking disk space
+        if (idle && logFrames >= kTruncateThresholdFrames) {
+            start = std::chrono::steady_clock::now();
+            rc = sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+            Metrics::instance().recordDuration("maintenance.truncate_pause_ms", elapsedMs(start));
+            Metrics::instance().increment(rc == SQLITE_OK ? "maintenance.wal_truncations" : "maintenance.steps_busy");
+        }
+    }
+
+    sqlite3* mainDb; // The user's connection, whose commits feed the WAL hook
+    sqlite3* db;     // The maintenance thread's own connection
+    bool vacuumEnabled;
+    std::atomic<int> walFrames;  // WAL size reported by the last commit
+    std::atomic<bool> walDirty;  // Commits happened since the last complete checkpoint
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+};
+
+const int MaintenanceScheduler::kIdleThresholdMs;
+const int MaintenanceScheduler::kVacuumPagesPerStep;
+const int MaintenanceScheduler::kStepPauseMs;
+const int MaintenanceScheduler::kTruncateThresholdFrames;
+const int MaintenanceScheduler::kForcedCheckpointFrames;
+
+
+// --- Bulk Operations ---
+// Output of menu option 11; the operations themselves are executeBulkOperation in the library.
+
+// Prints the outcome of a bulk operation
+void printBulkResult(const BulkRequest& request, long long affected, double elapsed) {
+    if (request.dryRun) {
+        std::cout << affected << " product(s) match the filter." << std::endl;
+    } else {
+        std::cout << (request.action == BULK_DELETE ? "Deleted " : "Updated ") << affected << " product(s) in "
+                  << std::fixed << std::setprecision(2) << elapsed << " ms." << std::endl;
+    }
 }
 
-// Prints the inventory table footer
-void printInventoryFooter() {
-     std::cout << "+-------+---------------------------+------------+------------+" << std::endl;
+// Runs a bulk operation and prints the outcome
+bool bulkOperation(InventoryDB& store, const BulkRequest& request) {
+    long long affected = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!store.bulkOperation(request, affected)) {
+        std::cerr << "Bulk operation failed: " << store.lastError() << std::endl;
+        return false;
+    }
+    printBulkResult(request, affected, elapsedMs(start));
+    return true;
 }
 
-// Views all products in the database
-bool viewProducts(sqlite3* db) {
-    std::string sql = "SELECT id, name, quantity, price FROM products;";
-    std::cout << "\n--- Current Inventory ---" << std::endl;
-    printInventoryHeader();
-    bool success = executeSQLSelectAndPrint(db, sql);
-    if (success) {
-        printInventoryFooter();
+
+// --- Cold Archive ---
+// Output of menu option 12; the archive policy itself is archiveProducts in the library.
+
+// Prints the outcome of running the archive policy
+void printArchiveResult(long long moved, int minDays, bool dryRun, double elapsed) {
+    if (dryRun) {
+        std::cout << moved << " product(s) have been out of stock for " << minDays << " day(s) or more." << std::endl;
     } else {
-        std::cerr << "Failed to retrieve products." << std::endl;
+        std::cout << "Archived " << moved << " product(s) in " << std::fixed << std::setprecision(2) << elapsed
+                  << " ms." << std::endl;
     }
-    return success;
 }
 
-// Updates an existing product in the database using prepared statements
-bool updateProduct(sqlite3* db, const Product& product) {
+// Runs the archive policy and prints the outcome
+bool archiveAndReport(InventoryDB& store, int minDays, bool dryRun) {
+    long long moved = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!store.archiveProducts(minDays, dryRun, moved)) {
+        std::cerr << "Archiving failed: " << store.lastError() << std::endl;
+        return false;
+    }
+    printArchiveResult(moved, minDays, dryRun, elapsedMs(start));
+    return true;
+}
+
+
+// --- Inventory Backends ---
+
+// The operations behind the menu. The CLI drives a single database file, a sharded set
+// of database files or a cluster of node processes through this interface.
+class InventoryBackend {
+public:
+    virtual ~InventoryBackend() {}
+    virtual bool addProduct(const Product& product) = 0;
+    virtual bool viewProducts() = 0;
+    virtual bool updateProduct(const Product& product) = 0;
+    virtual bool deleteProduct(int id) = 0;
+    virtual bool getProduct(int id) = 0;
+    virtual bool searchProducts(const std::string& searchTerm) = 0;
+    virtual bool searchProductsByPrefix(const std::string& prefix) = 0;
+    virtual bool filterProductsByQuantity(int threshold) = 0;
+    virtual bool generateReport() = 0;
+    virtual bool backupDatabase(const std::string& destName) = 0;
+    virtual bool bulkOperation(const BulkRequest& request) = 0;
+    virtual bool archiveProducts(int minDays, bool dryRun) = 0;
+};
+
+// Backend for the classic single inventory.db file, served by one InventoryDB
+class SingleDatabaseBackend : public InventoryBackend {
+public:
+    explicit SingleDatabaseBackend(InventoryDB& store) : store(store) {}
+    bool addProduct(const Product& product) override { return ::addProduct(store, product); }
+    bool viewProducts() override { return ::viewProducts(store); }
+    bool updateProduct(const Product& product) override { return ::updateProduct(store, product); }
+    bool deleteProduct(int id) override { return ::deleteProduct(store, id); }
+    bool getProduct(int id) override { return ::getProduct(store, id); }
+    bool searchProducts(const std::string& searchTerm) override { return ::searchProducts(store, searchTerm); }
+    bool searchProductsByPrefix(const std::string& prefix) override { return ::searchProductsByPrefix(store, prefix); }
+    bool filterProductsByQuantity(int threshold) override { return ::filterProductsByQuantity(store, threshold); }
+    bool generateReport() override { return ::generateReport(store); }
+    bool backupDatabase(const std::string& destName) override { return backupAndReport(store.handle(), destName); }
+    bool bulkOperation(const BulkRequest& request) override { return ::bulkOperation(store, request); }
+    bool archiveProducts(int minDays, bool dryRun) override { return archiveAndReport(store, minDays, dryRun); }
+
+private:
+    InventoryDB& store;
+};
+
+// --- Sharded Database Mode ---
+
+// Builds the file name of one shard, e.g. "inventory.db" -> "inventory.shard2.db"
+std::string shardFileName(const std::string& dbName, int shardIndex) {
+    return fileNameWithSuffix(dbName, ".shard" + std::to_string(shardIndex));
+}
+
+// Inserts a product into one shard. Shard k of N hands out the ids k+N, k+2N, ..., so ids stay
+// unique across all shards and (id % N) always names the owning shard.
+bool addProductToShard(sqlite3* db, const Product& product, int shardIndex, int shardCount) {
     sqlite3_stmt* stmt;
-    std::string sql = "UPDATE products SET name = ?, quantity = ?, price = ? WHERE id = ?;";
+    // sqlite_sequence remembers the largest id ever used, even after it was deleted or archived
+    std::string sql = "INSERT INTO products (id, name, quantity, price_cents) "
+                      "VALUES (MAX(COALESCE((SELECT seq FROM sqlite_sequence WHERE name = 'products'), ?4), ?4) + ?5,"
+                      " ?1, ?2, ?3);";
 
     int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
     if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement (UPDATE): " << sqlite3_errmsg(db) << std::endl;
+        std::cerr << "Failed to prepare statement (INSERT): " << sqlite3_errmsg(db) << std::endl;
         return false;
     }
 
     // Bind values
     sqlite3_bind_text(stmt, 1, product.name.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 2, product.quantity);
-    sqlite3_bind_double(stmt, 3, product.price);
-    sqlite3_bind_int(stmt, 4, product.id);
+    sqlite3_bind_int64(stmt, 3, product.priceCents);
+    sqlite3_bind_int(stmt, 4, shardIndex);
+    sqlite3_bind_int(stmt, 5, shardCount);
 
     // Execute
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
-        std::cerr << "Update failed: " << sqlite3_errmsg(db) << std::endl;
+        std::cerr << "Execution failed (INSERT): " << sqlite3_errmsg(db) << std::endl;
         sqlite3_finalize(stmt);
         return false;
     }
 
-    // Check if any row was actually updated
-    if (sqlite3_changes(db) == 0) {
-         std::cout << "No product found with ID " << product.id << ". Update failed." << std::endl;
-         sqlite3_finalize(stmt);
-         return false; // Indicate that no update occurred
-    }
-
-    std::cout << "Product updated successfully." << std::endl;
+    std::cout << "Product '" << product.name << "' added successfully (ID " << sqlite3_last_insert_rowid(db)
+              << ", shard " << shardIndex << ")." << std::endl;
     sqlite3_finalize(stmt);
     return true;
 }
 
-// Deletes a product from the database by ID using prepared statements
-bool deleteProduct(sqlite3* db, int id) {
+// Records in a shard file which shard of how many it is, or checks the record on later opens.
+// Routing relies on id % N, so opening the files with a different shard count would send
+// single-id operations to the wrong file; that is refused instead.
+bool claimShardFile(sqlite3* db, const std::string& fileName, int shardIndex, int shardCount) {
+    if (!executeSQL(db, "CREATE TABLE IF NOT EXISTS shard_layout ("
+                        "shard_index INTEGER NOT NULL, shard_count INTEGER NOT NULL);")) {
+        return false;
+    }
     sqlite3_stmt* stmt;
-    std::string sql = "DELETE FROM products WHERE id = ?;";
-
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement (DELETE): " << sqlite3_errmsg(db) << std::endl;
+    if (sqlite3_prepare_v2(db, "SELECT shard_index, shard_count FROM shard_layout;", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Failed to read the shard layout of " << fileName << ": " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    bool recorded = sqlite3_step(stmt) == SQLITE_ROW;
+    int recordedIndex = recorded ? sqlite3_column_int(stmt, 0) : shardIndex;
+    int recordedCount = recorded ? sqlite3_column_int(stmt, 1) : shardCount;
+    sqlite3_finalize(stmt);
+    if (!recorded) {
+        return executeSQL(db, "INSERT INTO shard_layout (shard_index, shard_count) VALUES (" +
+                              std::to_string(shardIndex) + ", " + std::to_string(shardCount) + ");");
+    }
+    if (recordedIndex != shardIndex || recordedCount != shardCount) {
+        std::cerr << fileName << " is shard " << recordedIndex << " of " << recordedCount << ", but was opened as shard "
+                  << shardIndex << " of " << shardCount << ". Start with --shards " << recordedCount << "." << std::endl;
         return false;
     }
+    return true;
+}
 
-    // Bind the ID
-    sqlite3_bind_int(stmt, 1, id);
+// One shard: a database file whose connection is owned by a dedicated worker thread.
+// Every operation on the shard is queued to that thread, so each file has exactly one
+// writer and different shards make progress in parallel.
+class Shard {
+public:
+    Shard() : db(nullptr), stopping(false) {}
+    ~Shard() { stop(); }
+
+    // Opens the shard's database file and starts its worker thread
+    bool start(const std::string& fileName) {
+        if (!initializeDatabase(db, fileName, false)) {
+            return false;
+        }
+        worker = std::thread(&Shard::run, this);
+        return true;
+    }
 
-    // Execute
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        std::cerr << "Deletion failed: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmt);
-        return false;
+    // Finishes the queued tasks, joins the worker thread and closes the connection
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (db) {
+            sqlite3_close(db);
+            db = nullptr;
+        }
     }
 
-     // Check if any row was actually deleted
-    if (sqlite3_changes(db) == 0) {
-         std::cout << "No product found with ID " << id << ". Deletion failed." << std::endl;
-         sqlite3_finalize(stmt);
-         return false; // Indicate that no deletion occurred
+    // The shard's connection, for work that must not occupy the worker thread (e.g. backups).
+    // SQLite serializes access to it with the worker's own use.
+    sqlite3* connection() const { return db; }
+
+    // Queues a task for the worker thread; the future holds the task's result
+    template <typename Result>
+    std::future<Result> submit(std::function<Result(sqlite3*)> task) {
+        std::shared_ptr<std::packaged_task<Result(sqlite3*)>> packaged =
+            std::make_shared<std::packaged_task<Result(sqlite3*)>>(task);
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back([packaged](sqlite3* conn) { (*packaged)(conn); });
+        }
+        wakeup.notify_one();
+        return result;
     }
 
-    std::cout << "Product deleted successfully." << std::endl;
-    sqlite3_finalize(stmt);
-    return true;
-}
+private:
+    // Worker loop: runs queued tasks in order until stop() is called and the queue is empty
+    void run() {
+        for (;;) {
+            std::function<void(sqlite3*)> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task(db);
+        }
+    }
 
-// Searches for products by name (case-insensitive partial match)
-bool searchProducts(sqlite3* db, const std::string& searchTerm) {
-    sqlite3_stmt* stmt;
-    // Use LOWER() for case-insensitive search and LIKE with % for partial match
-    std::string sql = "SELECT id, name, quantity, price FROM products WHERE LOWER(name) LIKE LOWER(?);";
+    sqlite3* db;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<std::function<void(sqlite3*)>> tasks;
+    bool stopping;
+};
 
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement (SEARCH): " << sqlite3_errmsg(db) << std::endl;
-        return false;
+// Products hash-partitioned by id across N database files. Single-id operations are routed
+// to the owning shard; view, search, filter and report fan out to all shards in parallel
+// and merge the partial results.
+class ShardedInventory : public InventoryBackend {
+public:
+    ShardedInventory() : nextInsertShard(0) {}
+
+    // Opens (or creates) all shard files derived from dbName
+    bool open(const std::string& dbName, int shardCount) {
+        archiveName = fileNameWithSuffix(dbName, ".archive");
+        for (int i = 0; i < shardCount; ++i) {
+            std::unique_ptr<Shard> shard(new Shard());
+            std::string fileName = shardFileName(dbName, i);
+            if (!shard->start(fileName) || !claimShardFile(shard->connection(), fileName, i, shardCount)) {
+                shards.clear();
+                return false;
+            }
+            shards.push_back(std::move(shard));
+        }
+        std::cout << "Opened " << shardCount << " database shards successfully" << std::endl;
+        return true;
+    }
+
+    // New products are spread over the shards round-robin
+    bool addProduct(const Product& product) override {
+        int shardIndex = static_cast<int>(nextInsertShard++ % shards.size());
+        int shardCount = static_cast<int>(shards.size());
+        return shards[shardIndex]->submit<bool>([product, shardIndex, shardCount](sqlite3* db) {
+            return addProductToShard(db, product, shardIndex, shardCount);
+        }).get();
+    }
+
+    bool viewProducts() override {
+        std::vector<Product> products;
+        bool success = fanOutQuery("SELECT id, name, quantity, price_cents FROM products;", nullptr, products);
+        std::sort(products.begin(), products.end(), compareById);
+
+        std::cout << "\n--- Current Inventory ---" << std::endl;
+        printInventoryHeader();
+        for (const Product& p : products) {
+            printProductRow(p);
+        }
+        printInventoryFooter();
+        if (!success) {
+            std::cerr << "Failed to retrieve products." << std::endl;
+        }
+        return success;
+    }
+
+    bool updateProduct(const Product& product) override {
+        return shardForId(product.id).submit<bool>([product](sqlite3* db) {
+            InventoryDB store(db, "");
+            return ::updateProduct(store, product);
+        }).get();
+    }
+
+    bool deleteProduct(int id) override {
+        return shardForId(id).submit<bool>([id](sqlite3* db) {
+            InventoryDB store(db, "");
+            return ::deleteProduct(store, id);
+        }).get();
+    }
+
+    bool getProduct(int id) override {
+        return shardForId(id).submit<bool>([id](sqlite3* db) {
+            InventoryDB store(db, "");
+            return ::getProduct(store, id);
+        }).get();
+    }
+
+    bool searchProducts(const std::string& searchTerm) override {
+        std::string searchPattern = "%" + searchTerm + "%";
+        std::vector<Product> products;
+        bool success = fanOutQuery(
+            "SELECT id, name, quantity, price_cents FROM products WHERE " + std::string(kNameLikeCondition) + ";",
+            [searchPattern](sqlite3_stmt* stmt) {
+                sqlite3_bind_text(stmt, 1, searchPattern.c_str(), -1, SQLITE_TRANSIENT);
+            },
+            products);
+        std::sort(products.begin(), products.end(), compareById);
+
+        std::cout << "\n--- Search Results for \"" << searchTerm << "\" ---" << std::endl;
+        printInventoryHeader();
+        for (const Product& p : products) {
+            printProductRow(p);
+        }
+        printInventoryFooter();
+        if (products.empty() && success) {
+            std::cout << "No products found matching \"" << searchTerm << "\"." << std::endl;
+        }
+        return success;
+    }
+
+    bool searchProductsByPrefix(const std::string& prefix) override {
+        std::vector<Product> products;
+        bool success = fanOut([prefix](sqlite3* db, std::vector<Product>& rows) {
+            return queryProductsByPrefix(db, prefix, rows);
+        }, products);
+        std::sort(products.begin(), products.end(), compareById);
+        printProductTable("Products Starting with \"" + prefix + "\"", products,
+                          success ? "No products found starting with \"" + prefix + "\"." : "");
+        return success;
+    }
+
+    bool filterProductsByQuantity(int threshold) override {
+        std::vector<Product> products;
+        bool success = fanOutQuery(
+            "SELECT id, name, quantity, price_cents FROM products WHERE quantity < ? ORDER BY quantity;",
+            [threshold](sqlite3_stmt* stmt) { sqlite3_bind_int(stmt, 1, threshold); },
+            products);
+        // Each shard returns its rows ordered by quantity; restore the global order
+        std::sort(products.begin(), products.end(), [](const Product& a, const Product& b) {
+            return a.quantity != b.quantity ? a.quantity < b.quantity : a.id < b.id;
+        });
+
+        std::cout << "\n--- Products with Quantity Less Than " << threshold << " ---" << std::endl;
+        printInventoryHeader();
+        for (const Product& p : products) {
+            printProductRow(p);
+        }
+        printInventoryFooter();
+        if (products.empty() && success) {
+            std::cout << "No products found with quantity less than " << threshold << "." << std::endl;
+        }
+        return success;
+    }
+
+    bool generateReport() override {
+        struct Totals {
+            bool success;
+            int totalItems;
+            Cents totalValue;
+        };
+        std::vector<std::future<Totals>> partials;
+        for (std::unique_ptr<Shard>& shard : shards) {
+            partials.push_back(shard->submit<Totals>([](sqlite3* db) {
+                Totals t;
+                t.success = queryReportTotals(db, t.totalItems, t.totalValue);
+                return t;
+            }));
+        }
+
+        bool success = true;
+        int totalItems = 0;
+        Cents totalValue = 0;
+        for (std::future<Totals>& partial : partials) {
+            Totals t = partial.get();
+            success = success && t.success;
+            totalItems += t.totalItems;
+            totalValue += t.totalValue;
+        }
+        printReport(totalItems, totalValue);
+        return success;
+    }
+
+    // Runs the bulk operation on every shard in parallel; each shard commits its own transaction
+    bool bulkOperation(const BulkRequest& request) override {
+        std::string invalid;
+        if (!checkBulkRequest(request, invalid)) {
+            std::cerr << "Bulk operation failed: " << invalid << std::endl;
+            return false;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        typedef std::pair<bool, long long> Partial;
+        std::vector<std::future<Partial>> partials;
+        for (std::unique_ptr<Shard>& shard : shards) {
+            partials.push_back(shard->submit<Partial>([request](sqlite3* db) {
+                Partial partial(false, 0);
+                partial.first = executeBulkOperation(db, request, partial.second);
+                return partial;
+            }));
+        }
+        bool success = true;
+        long long affected = 0;
+        for (std::future<Partial>& partial : partials) {
+            Partial result = partial.get();
+            success = success && result.first;
+            affected += result.second;
+        }
+        printBulkResult(request, affected, elapsedMs(start));
+        return success;
+    }
+
+    // Archives every shard in parallel into its own archive file
+    bool archiveProducts(int minDays, bool dryRun) override {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        typedef std::pair<bool, long long> Partial;
+        std::vector<std::future<Partial>> partials;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            std::string shardArchive = shardFileName(archiveName, static_cast<int>(i));
+            partials.push_back(shards[i]->submit<Partial>([shardArchive, minDays, dryRun](sqlite3* db) {
+                Partial partial(false, 0);
+                partial.first = ::archiveProducts(db, shardArchive, minDays, dryRun, partial.second);
+                return partial;
+            }));
+        }
+        bool success = true;
+        long long moved = 0;
+        for (std::future<Partial>& partial : partials) {
+            Partial result = partial.get();
+            success = success && result.first;
+            moved += result.second;
+        }
+        printArchiveResult(moved, minDays, dryRun, elapsedMs(start));
+        return success;
+    }
+
+    // Backs up every shard in parallel to destName's shard files. The copies run on their
+    // own threads so the shard workers keep serving writes between backup steps.
+    bool backupDatabase(const std::string& destName) override {
+        std::vector<std::future<bool>> copies;
+        std::vector<BackupStats> stats(shards.size());
+        for (size_t i = 0; i < shards.size(); ++i) {
+            sqlite3* db = shards[i]->connection();
+            std::string shardDest = shardFileName(destName, static_cast<int>(i));
+            BackupStats* shardStats = &stats[i];
+            copies.push_back(std::async(std::launch::async, [db, shardDest, shardStats]() {
+                return ::backupDatabase(db, shardDest, *shardStats, nullptr);
+            }));
+        }
+        bool success = true;
+        for (size_t i = 0; i < copies.size(); ++i) {
+            if (copies[i].get()) {
+                printBackupStats(shardFileName(destName, static_cast<int>(i)), stats[i]);
+            } else {
+                success = false;
+            }
+        }
+        return success;
+    }
+
+private:
+    static bool compareById(const Product& a, const Product& b) { return a.id < b.id; }
+
+    Shard& shardForId(int id) {
+        return *shards[static_cast<size_t>(id) % shards.size()];
+    }
+
+    // Runs the same query on every shard in parallel and concatenates the rows
+    bool fanOutQuery(const std::string& sql, const std::function<void(sqlite3_stmt*)>& bindParams,
+                     std::vector<Product>& results) {
+        return fanOut([sql, bindParams](sqlite3* db, std::vector<Product>& rows) {
+            return collectProducts(db, sql, bindParams, rows);
+        }, results);
+    }
+
+    // Runs query on every shard's connection in parallel and concatenates the rows
+    bool fanOut(const std::function<bool(sqlite3*, std::vector<Product>&)>& query, std::vector<Product>& results) {
+        typedef std::pair<bool, std::vector<Product>> Partial;
+        std::vector<std::future<Partial>> partials;
+        for (std::unique_ptr<Shard>& shard : shards) {
+            partials.push_back(shard->submit<Partial>([query](sqlite3* db) {
+                Partial partial;
+                partial.first = query(db, partial.second);
+                return partial;
+            }));
+        }
+
+        bool success = true;
+        for (std::future<Partial>& future : partials) {
+            Partial partial = future.get();
+            success = success && partial.first;
+            results.insert(results.end(), partial.second.begin(), partial.second.end());
+        }
+        return success;
+    }
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<unsigned> nextInsertShard;
+    std::string archiveName; // Shard i archives into shardFileName(archiveName, i)
+};
+
+
+// --- Cluster Mode ---
+// Several node processes (--serve-node) each own a subset of the products in their own
+// database file. A router (--cluster) places ids on a consistent-hash ring, forwards
+// single-id operations to the owning node and scatters/gathers everything else.
+//
+// Nodes and router talk over Unix domain sockets with a line protocol. Requests are
+// tab-separated fields (ADD/UPDATE id name quantity price-in-cents, DELETE/GET id, SEARCH term,
+// PREFIX prefix, FILTER threshold, BULK request, ARCHIVE days dry-run, VIEW, REPORT, MAXID);
+// responses are zero or more "ROW" lines followed by "OK" (optionally with values), "NOTFOUND"
+// or "ERR message". ADD with id 0 lets the database assign the id and answers "OK id". The
+// field encoding is in inventory_ipc.h.
+
+// Writes the whole buffer to a socket, retrying on partial writes
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Buffered line reader over a socket
+class SocketLineReader {
+public:
+    explicit SocketLineReader(int fd) : fd(fd) {}
+
+    // Reads the next '\n'-terminated line (without the terminator); false on EOF or error
+    bool readLine(std::string& line) {
+        for (;;) {
+            std::string::size_type newline = buffer.find('\n');
+            if (newline != std::string::npos) {
+                line = buffer.substr(0, newline);
+                buffer.erase(0, newline + 1);
+                return true;
+            }
+            char chunk[4096];
+            ssize_t n = ::read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+    }
+
+private:
+    int fd;
+    std::string buffer;
+};
+
+// Fills a sockaddr_un for the given path; false if the path is too long
+bool makeUnixAddress(const std::string& socketPath, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return false;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    return true;
+}
+
+// Connects to a node's Unix socket; returns the socket or -1
+int connectUnixSocket(const std::string& socketPath) {
+    sockaddr_un address;
+    if (!makeUnixAddress(socketPath, address)) {
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Executes an INSERT/UPDATE/DELETE with bound parameters; returns the number of changed rows or -1
+int executeProductWrite(sqlite3* db, const std::string& sql, const std::function<void(sqlite3_stmt*)>& bindParams) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        return -1;
+    }
+    bindParams(stmt);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? sqlite3_changes(db) : -1;
+}
+
+// Executes one protocol request against a node's database and builds the response lines
+std::string handleNodeRequest(sqlite3* db, const std::string& archiveName, const std::string& line) {
+    std::vector<std::string> fields = splitFields(line);
+    const std::string& command = fields[0];
+    std::vector<Product> rows;
+    bool success = true;
+    std::ostringstream response;
+
+    if (command == "ADD" || command == "UPDATE") {
+        Product p;
+        if (!parseProductFields(fields, 1, p)) {
+            return "ERR\tmalformed request\n";
+        }
+        std::string sql = command == "ADD"
+            ? "INSERT INTO products (id, name, quantity, price_cents) VALUES (?4, ?1, ?2, ?3);"
+            : "UPDATE products SET name = ?1, quantity = ?2, price_cents = ?3 WHERE id = ?4;";
+        bool assignId = command == "ADD" && p.id <= 0;
+        int changes = executeProductWrite(db, sql, [&p, assignId](sqlite3_stmt* stmt) {
+            sqlite3_bind_text(stmt, 1, p.name.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 2, p.quantity);
+            sqlite3_bind_int64(stmt, 3, p.priceCents);
+            if (assignId) {
+                sqlite3_bind_null(stmt, 4);
+            } else {
+                sqlite3_bind_int(stmt, 4, p.id);
+            }
+        });
+        if (changes < 0) {
+            return "ERR\t" + escapeField(sqlite3_errmsg(db)) + "\n";
+        }
+        if (assignId) {
+            response << "OK\t" << sqlite3_last_insert_rowid(db) << '\n';
+            return response.str();
+        }
+        return changes == 0 ? "NOTFOUND\n" : "OK\n";
+    } else if (command == "DELETE" && fields.size() == 2) {
+        int id = static_cast<int>(std::strtol(fields[1].c_str(), nullptr, 10));
+        int changes = executeProductWrite(db, "DELETE FROM products WHERE id = ?;",
+                                          [id](sqlite3_stmt* stmt) { sqlite3_bind_int(stmt, 1, id); });
+        if (changes < 0) {
+            return "ERR\t" + escapeField(sqlite3_errmsg(db)) + "\n";
+        }
+        return changes == 0 ? "NOTFOUND\n" : "OK\n";
+    } else if (command == "GET" && fields.size() == 2) {
+        int id = static_cast<int>(std::strtol(fields[1].c_str(), nullptr, 10));
+        Product p;
+        bool found = false;
+        success = queryProductById(db, id, p, found);
+        if (success && !found) {
+            return "NOTFOUND\n";
+        }
+        if (found) {
+            rows.push_back(p);
+        }
+    } else if (command == "SEARCH" && fields.size() == 2) {
+        std::string searchPattern = "%" + fields[1] + "%";
+        success = collectProducts(db, "SELECT id, name, quantity, price_cents FROM products WHERE " +
+                                      std::string(kNameLikeCondition) + ";",
+                                  [&searchPattern](sqlite3_stmt* stmt) {
+                                      sqlite3_bind_text(stmt, 1, searchPattern.c_str(), -1, SQLITE_STATIC);
+                                  }, rows);
+    } else if (command == "PREFIX" && fields.size() == 2) {
+        success = queryProductsByPrefix(db, fields[1], rows);
+    } else if (command == "FILTER" && fields.size() == 2) {
+        int threshold = static_cast<int>(std::strtol(fields[1].c_str(), nullptr, 10));
+        success = collectProducts(db, "SELECT id, name, quantity, price_cents FROM products WHERE quantity < ? ORDER BY quantity;",
+                                  [threshold](sqlite3_stmt* stmt) { sqlite3_bind_int(stmt, 1, threshold); }, rows);
+    } else if (command == "VIEW") {
+        success = collectProducts(db, "SELECT id, name, quantity, price_cents FROM products;", nullptr, rows);
+    } else if (command == "REPORT") {
+        int totalItems = 0;
+        Cents totalValue = 0;
+        if (!queryReportTotals(db, totalItems, totalValue)) {
+            return "ERR\t" + escapeField(sqlite3_errmsg(db)) + "\n";
+        }
+        response << "OK\t" << totalItems << '\t' << totalValue << '\n';
+        return response.str();
+    } else if (command == "BULK") {
+        BulkRequest request;
+        long long affected = 0;
+        std::string invalid;
+        if (!parseBulkRequestFields(fields, 1, request)) {
+            return "ERR\tmalformed request\n";
+        }
+        if (!checkBulkRequest(request, invalid)) {
+            return "ERR\t" + escapeField(invalid) + "\n";
+        }
+        if (!executeBulkOperation(db, request, affected)) {
+            return "ERR\t" + escapeField(sqlite3_errmsg(db)) + "\n";
+        }
+        response << "OK\t" << affected << '\n';
+        return response.str();
+    } else if (command == "ARCHIVE" && fields.size() == 3) {
+        int minDays = static_cast<int>(std::strtol(fields[1].c_str(), nullptr, 10));
+        long long moved = 0;
+        if (!archiveProducts(db, archiveName, minDays, fields[2] == "1", moved)) {
+            return "ERR\t" + escapeField(sqlite3_errmsg(db)) + "\n";
+        }
+        response << "OK\t" << moved << '\n';
+        return response.str();
+    } else if (command == "MAXID") {
+        sqlite3_stmt* stmt;
+        long long maxId = 0;
+        if (sqlite3_prepare_v2(db, "SELECT COALESCE((SELECT seq FROM sqlite_sequence WHERE name = 'products'), 0);",
+                               -1, &stmt, nullptr) != SQLITE_OK) {
+            return "ERR\t" + escapeField(sqlite3_errmsg(db)) + "\n";
+        }
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            maxId = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        response << "OK\t" << maxId << '\n';
+        return response.str();
+    } else {
+        return "ERR\tunknown request\n";
+    }
+
+    if (!success) {
+        return "ERR\t" + escapeField(sqlite3_errmsg(db)) + "\n";
+    }
+    for (const Product& p : rows) {
+        response << "ROW\t" << productFields(p) << '\n';
+    }
+    response << "OK\n";
+    return response.str();
+}
+
+// Runs a cluster node: serves protocol requests for its database on a Unix socket.
+// Each client connection gets its own thread; requests are serialized on the connection.
+int runNodeServer(sqlite3* db, const std::string& dbName, const std::string& socketPath) {
+    std::string archiveName = fileNameWithSuffix(dbName, ".archive");
+    sockaddr_un address;
+    if (!makeUnixAddress(socketPath, address)) {
+        return 1;
+    }
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(socketPath.c_str()); // Remove a stale socket from a previous run
+    if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd, 16) != 0) {
+        std::cerr << "Failed to listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    std::cout << "Node listening on " << socketPath << std::endl;
+
+    std::mutex dbMutex;
+    std::mutex clientsMutex;
+    std::condition_variable clientsDone;
+    std::vector<int> clients; // Sockets of the connected clients
+    for (;;) {
+        int clientFd = ::accept(listenFd, nullptr, nullptr);
+        if (clientFd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            clients.push_back(clientFd);
+        }
+        std::thread([db, archiveName, clientFd, &dbMutex, &clients, &clientsMutex, &clientsDone]() {
+            SocketLineReader reader(clientFd);
+            std::string line;
+            while (reader.readLine(line)) {
+                std::string response;
+                {
+                    std::lock_guard<std::mutex> lock(dbMutex);
+                    response = handleNodeRequest(db, archiveName, line);
+                }
+                if (!writeAll(clientFd, response)) {
+                    break;
+                }
+            }
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            clients.erase(std::find(clients.begin(), clients.end(), clientFd));
+            ::close(clientFd);
+            clientsDone.notify_all();
+        }).detach();
+    }
+
+    // Hang up on the clients and wait for their threads before the caller closes db
+    ::close(listenFd);
+    std::unique_lock<std::mutex> lock(clientsMutex);
+    for (int clientFd : clients) {
+        ::shutdown(clientFd, SHUT_RDWR);
+    }
+    clientsDone.wait(lock, [&clients] { return clients.empty(); });
+    return 1;
+}
+
+// 64-bit hash with good avalanche (FNV-1a followed by a SplitMix64 finalizer)
+uint64_t hashKey(const std::string& key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : key) {
+        h = (h ^ c) * 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+// Consistent-hash ring with virtual nodes: each node is placed at many points on the ring so
+// keys spread evenly, and adding or removing a node only moves the keys adjacent to its points.
+class HashRing {
+public:
+    void addNode(int node, const std::string& name, int virtualNodes) {
+        for (int v = 0; v < virtualNodes; ++v) {
+            ring[hashKey(name + "#" + std::to_string(v))] = node;
+        }
+    }
+
+    // The node owning a key is the first ring point at or after the key's hash
+    int nodeFor(const std::string& key) const {
+        std::map<uint64_t, int>::const_iterator it = ring.lower_bound(hashKey(key));
+        if (it == ring.end()) {
+            it = ring.begin();
+        }
+        return it->second;
+    }
+
+private:
+    std::map<uint64_t, int> ring;
+};
+
+// Router backend: owns a connection to every node. Product ids are assigned by the router
+// (one router per cluster) and placed on the ring, so every operation on an id reaches the
+// same node.
+class ClusterRouter : public InventoryBackend {
+public:
+    static const int kVirtualNodesPerNode = 128;
+
+    ClusterRouter() : nextId(1) {}
+
+    ~ClusterRouter() {
+        for (Node& node : nodes) {
+            if (node.fd >= 0) {
+                ::close(node.fd);
+            }
+        }
+    }
+
+    // Connects to every node socket and continues the id sequence after the largest id
+    bool connect(const std::vector<std::string>& socketPaths) {
+        for (size_t i = 0; i < socketPaths.size(); ++i) {
+            int fd = connectUnixSocket(socketPaths[i]);
+            if (fd < 0) {
+                std::cerr << "Can't connect to node " << socketPaths[i] << ": " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            nodes.push_back(Node(socketPaths[i], fd));
+            ring.addNode(static_cast<int>(i), socketPaths[i], kVirtualNodesPerNode);
+        }
+
+        std::vector<Response> responses;
+        if (!scatter("MAXID", responses)) {
+            return false;
+        }
+        for (const Response& r : responses) {
+            if (r.status.size() > 1) {
+                nextId = std::max(nextId, std::strtoll(r.status[1].c_str(), nullptr, 10) + 1);
+            }
+        }
+        std::cout << "Connected to " << nodes.size() << " cluster nodes" << std::endl;
+        return true;
+    }
+
+    // The id is only used up once its node confirms the insert. After a failure the node is
+    // asked for its largest id: if the insert did land (and only its reply was lost) the id is
+    // skipped, otherwise the next add reuses it.
+    bool addProduct(const Product& product) override {
+        Product placed = product;
+        placed.id = static_cast<int>(nextId);
+        int node = nodeForId(placed.id);
+        Response r;
+        if (!request(node, "ADD\t" + productFields(placed), r)) {
+            Response maxId;
+            if (request(node, "MAXID", maxId) && maxId.status.size() > 1) {
+                nextId = std::max(nextId, std::strtoll(maxId.status[1].c_str(), nullptr, 10) + 1);
+            }
+            return false;
+        }
+        nextId = placed.id + 1LL;
+        std::cout << "Product '" << placed.name << "' added successfully (ID " << placed.id << ", node "
+                  << nodes[node].socketPath << ")." << std::endl;
+        return true;
+    }
+
+    bool viewProducts() override {
+        std::vector<Product> products;
+        bool success = gatherRows("VIEW", products);
+        std::sort(products.begin(), products.end(), compareById);
+
+        std::cout << "\n--- Current Inventory ---" << std::endl;
+        printInventoryHeader();
+        for (const Product& p : products) {
+            printProductRow(p);
+        }
+        printInventoryFooter();
+        if (!success) {
+            std::cerr << "Failed to retrieve products." << std::endl;
+        }
+        return success;
+    }
+
+    bool updateProduct(const Product& product) override {
+        Response r;
+        if (!request(nodeForId(product.id), "UPDATE\t" + productFields(product), r)) {
+            return false;
+        }
+        if (r.notFound) {
+            std::cout << "No product found with ID " << product.id << ". Update failed." << std::endl;
+            return false;
+        }
+        std::cout << "Product updated successfully." << std::endl;
+        return true;
+    }
+
+    bool deleteProduct(int id) override {
+        Response r;
+        if (!request(nodeForId(id), "DELETE\t" + std::to_string(id), r)) {
+            return false;
+        }
+        if (r.notFound) {
+            std::cout << "No product found with ID " << id << ". Deletion failed." << std::endl;
+            return false;
+        }
+        std::cout << "Product deleted successfully." << std::endl;
+        return true;
+    }
+
+    bool getProduct(int id) override {
+        Response r;
+        if (!request(nodeForId(id), "GET\t" + std::to_string(id), r)) {
+            return false;
+        }
+        printProductLookup(id, r.rows.empty() ? Product() : r.rows.front(), !r.notFound && !r.rows.empty());
+        return !r.notFound;
+    }
+
+    bool searchProducts(const std::string& searchTerm) override {
+        std::vector<Product> products;
+        bool success = gatherRows("SEARCH\t" + escapeField(searchTerm), products);
+        std::sort(products.begin(), products.end(), compareById);
+
+        std::cout << "\n--- Search Results for \"" << searchTerm << "\" ---" << std::endl;
+        printInventoryHeader();
+        for (const Product& p : products) {
+            printProductRow(p);
+        }
+        printInventoryFooter();
+        if (products.empty() && success) {
+            std::cout << "No products found matching \"" << searchTerm << "\"." << std::endl;
+        }
+        return success;
+    }
+
+    bool searchProductsByPrefix(const std::string& prefix) override {
+        std::vector<Product> products;
+        bool success = gatherRows("PREFIX\t" + escapeField(prefix), products);
+        std::sort(products.begin(), products.end(), compareById);
+        printProductTable("Products Starting with \"" + prefix + "\"", products,
+                          success ? "No products found starting with \"" + prefix + "\"." : "");
+        return success;
+    }
+
+    bool filterProductsByQuantity(int threshold) override {
+        std::vector<Product> products;
+        bool success = gatherRows("FILTER\t" + std::to_string(threshold), products);
+        std::sort(products.begin(), products.end(), [](const Product& a, const Product& b) {
+            return a.quantity != b.quantity ? a.quantity < b.quantity : a.id < b.id;
+        });
+
+        std::cout << "\n--- Products with Quantity Less Than " << threshold << " ---" << std::endl;
+        printInventoryHeader();
+        for (const Product& p : products) {
+            printProductRow(p);
+        }
+        printInventoryFooter();
+        if (products.empty() && success) {
+            std::cout << "No products found with quantity less than " << threshold << "." << std::endl;
+        }
+        return success;
+    }
+
+    bool generateReport() override {
+        std::vector<Response> responses;
+        bool success = scatter("REPORT", responses);
+        int totalItems = 0;
+        Cents totalValue = 0;
+        for (const Response& r : responses) {
+            if (r.status.size() > 2) {
+                totalItems += static_cast<int>(std::strtol(r.status[1].c_str(), nullptr, 10));
+                totalValue += std::strtoll(r.status[2].c_str(), nullptr, 10);
+            }
+        }
+        printReport(totalItems, totalValue);
+        return success;
+    }
+
+    bool bulkOperation(const BulkRequest& request) override {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<Response> responses;
+        bool success = scatter("BULK\t" + bulkRequestFields(request), responses);
+        long long affected = 0;
+        for (const Response& r : responses) {
+            if (r.status.size() > 1) {
+                affected += std::strtoll(r.status[1].c_str(), nullptr, 10);
+            }
+        }
+        printBulkResult(request, affected, elapsedMs(start));
+        return success;
+    }
+
+    bool archiveProducts(int minDays, bool dryRun) override {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<Response> responses;
+        bool success = scatter("ARCHIVE\t" + std::to_string(minDays) + "\t" + (dryRun ? "1" : "0"), responses);
+        long long moved = 0;
+        for (const Response& r : responses) {
+            if (r.status.size() > 1) {
+                moved += std::strtoll(r.status[1].c_str(), nullptr, 10);
+            }
+        }
+        printArchiveResult(moved, minDays, dryRun, elapsedMs(start));
+        return success;
+    }
+
+    bool backupDatabase(const std::string& /*destName*/) override {
+        std::cout << "Backups are taken on each node (run the node's database with the backup options)." << std::endl;
+        return false;
+    }
+
+private:
+    struct Node {
+        Node(const std::string& socketPath, int fd) : socketPath(socketPath), fd(fd), reader(new SocketLineReader(fd)) {}
+        std::string socketPath;
+        int fd;
+        std::shared_ptr<SocketLineReader> reader;
+    };
+
+    // A node's reply: the ROW lines plus the fields of the final status line
+    struct Response {
+        Response() : notFound(false) {}
+        std::vector<Product> rows;
+        std::vector<std::string> status;
+        bool notFound;
+    };
+
+    static bool compareById(const Product& a, const Product& b) { return a.id < b.id; }
+
+    int nodeForId(int id) const {
+        return ring.nodeFor(std::to_string(id));
+    }
+
+    bool send(int node, const std::string& line) {
+        if (!writeAll(nodes[node].fd, line + "\n")) {
+            std::cerr << "Node " << nodes[node].socketPath << " unavailable." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool receive(int node, Response& response) {
+        std::string line;
+        while (nodes[node].reader->readLine(line)) {
+            std::vector<std::string> fields = splitFields(line);
+            if (fields[0] == "ROW") {
+                Product p;
+                if (parseProductFields(fields, 1, p)) {
+                    response.rows.push_back(p);
+                }
+                continue;
+            }
+            response.status = fields;
+            if (fields[0] == "NOTFOUND") {
+                response.notFound = true;
+            } else if (fields[0] != "OK") {
+                std::cerr << "Node " << nodes[node].socketPath << " error: "
+                          << (fields.size() > 1 ? fields[1] : line) << std::endl;
+                return false;
+            }
+            return true;
+        }
+        std::cerr << "Node " << nodes[node].socketPath << " unavailable." << std::endl;
+        return false;
+    }
+
+    // Sends a request to one node and waits for its reply
+    bool request(int node, const std::string& line, Response& response) {
+        return send(node, line) && receive(node, response);
+    }
+
+    // Sends a request to every node before reading any reply, so the nodes work in parallel
+    bool scatter(const std::string& line, std::vector<Response>& responses) {
+        std::vector<bool> sent(nodes.size());
+        bool success = true;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            sent[i] = send(static_cast<int>(i), line);
+            success = success && sent[i];
+        }
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            Response r;
+            if (sent[i] && receive(static_cast<int>(i), r)) {
+                responses.push_back(r);
+            } else {
+                success = false;
+            }
+        }
+        return success;
+    }
+
+    // Scatters a row-returning request and concatenates the rows of every node
+    bool gatherRows(const std::string& line, std::vector<Product>& products) {
+        std::vector<Response> responses;
+        bool success = scatter(line, responses);
+        for (const Response& r : responses) {
+            products.insert(products.end(), r.rows.begin(), r.rows.end());
+        }
+        return success;
+    }
+
+    std::vector<Node> nodes;
+    HashRing ring;
+    long long nextId;
+};
+
+const int ClusterRouter::kVirtualNodesPerNode;
+
+
+// --- Daemon Mode ---
+// A long-running server (--daemon SOCKET) for many clients of one database. It speaks the
+// cluster node protocol plus STATS. Each request goes to a lane by its kind: writes (ADD,
+// UPDATE, DELETE, BULK, ARCHIVE), point reads (GET, MAXID) or scans (SEARCH, PREFIX, FILTER,
+// VIEW, REPORT). Every lane has its own queue, concurrency limit, weight, queue deadline and
+// latency objective, so a pile of reports cannot hold up the scanners' adds and updates:
+//  - a shared pool of workers, each with its own connection, takes the next request from
+//    the lane (with queued work and below its limit) that has had the least service for its
+//    weight (stride scheduling);
+//  - a request is refused with "ERR overloaded ..." when its expected queue wait is past the
+//    lane's deadline, or when it has actually waited that long by the time a worker is free;
+//  - each lane counts the requests answered within and over its latency objective, and STATS
+//    lists them with the p50/p99 of recent latencies.
+// Clients on the same machine can switch their connection to shared-memory rings ("SHM",
+// see inventory_ipc.h) to skip the socket round trip for small requests.
+
+enum DaemonLane {
+    LANE_WRITES,
+    LANE_POINT_READS,
+    LANE_SCANS,
+    LANE_COUNT
+};
+
+struct LaneConfig {
+    std::string name;
+    int concurrency;     // Requests of this lane running at once
+    int weight;          // Share of the workers while lanes compete for them
+    int queueDeadlineMs; // Longest a request may wait in the queue before it is shed
+    int sloMs;           // Latency objective, queue wait included
+};
+
+// Writes are short and latency sensitive, scans may be slow; together the lanes may use more
+// workers than the default pool has, which is where the weights come in
+std::vector<LaneConfig> defaultLaneConfigs() {
+    std::vector<LaneConfig> lanes(LANE_COUNT);
+    lanes[LANE_WRITES] = {"writes", 1, 4, 200, 50};
+    lanes[LANE_POINT_READS] = {"point-reads", 2, 4, 100, 20};
+    lanes[LANE_SCANS] = {"scans", 1, 1, 10000, 5000};
+    return lanes;
+}
+
+// Parses a --lane option, NAME=CONCURRENCY,WEIGHT,DEADLINE_MS,SLO_MS, into lanes
+bool parseLaneOption(const std::string& option, std::vector<LaneConfig>& lanes) {
+    std::string::size_type equals = option.find('=');
+    if (equals == std::string::npos) {
+        return false;
+    }
+    std::string name = option.substr(0, equals);
+    int values[4];
+    std::stringstream list(option.substr(equals + 1));
+    std::string value;
+    int count = 0;
+    while (count < 4 && std::getline(list, value, ',')) {
+        values[count++] = static_cast<int>(std::strtol(value.c_str(), nullptr, 10));
+    }
+    if (count != 4 || !list.eof() || values[0] < 1 || values[1] < 1 || values[2] < 0 || values[3] < 1) {
+        return false;
+    }
+    for (LaneConfig& lane : lanes) {
+        if (lane.name == name) {
+            lane.concurrency = values[0];
+            lane.weight = values[1];
+            lane.queueDeadlineMs = values[2];
+            lane.sloMs = values[3];
+            return true;
+        }
+    }
+    return false;
+}
+
+// The lane a protocol request is scheduled in
+DaemonLane laneForCommand(const std::string& command) {
+    if (command == "GET" || command == "MAXID") {
+        return LANE_POINT_READS;
+    }
+    if (command == "SEARCH" || command == "PREFIX" || command == "FILTER" || command == "VIEW" || command == "REPORT") {
+        return LANE_SCANS;
+    }
+    return LANE_WRITES; // Including unknown commands, which handleNodeRequest refuses
+}
+
+class DaemonScheduler {
+public:
+    static const size_t kMaxQueued = 4096;       // Per lane, beyond any deadline
+    static const size_t kLatencyWindow = 1024;   // Recent latencies kept for the percentiles
+    static constexpr double kStride = 1000000.0; // Pass advance of a weight-1 lane per request
+
+    explicit DaemonScheduler(const std::vector<LaneConfig>& configs) : stopping(false) {
+        for (const LaneConfig& config : configs) {
+            lanes.push_back(Lane(config));
+        }
+    }
+
+    ~DaemonScheduler() {
+        stop();
+    }
+
+    // Opens one connection per worker and starts the workers
+    bool start(const std::string& dbName, int workerCount) {
+        archiveName = fileNameWithSuffix(dbName, ".archive");
+        for (int i = 0; i < workerCount; ++i) {
+            sqlite3* conn = nullptr;
+            if (sqlite3_open_v2(dbName.c_str(), &conn, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+                std::cerr << "Can't open worker connection: " << sqlite3_errmsg(conn) << std::endl;
+                sqlite3_close(conn);
+                stop();
+                return false;
+            }
+            sqlite3_busy_timeout(conn, 5000);
+            connections.push_back(conn);
+        }
+        for (sqlite3* conn : connections) {
+            workers.emplace_back(&DaemonScheduler::workerLoop, this, conn);
+        }
+        return true;
+    }
+
+    // Refuses the queued requests, lets the running ones finish and closes the connections
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            for (Lane& lane : lanes) {
+                for (const std::shared_ptr<PendingRequest>& request : lane.queue) {
+                    request->response.set_value("ERR\tshutting down\n");
+                }
+                lane.queue.clear();
+            }
+        }
+        wakeup.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+        for (sqlite3* conn : connections) {
+            sqlite3_close(conn);
+        }
+        connections.clear();
+    }
+
+    // Queues a protocol request in its lane and waits for the response lines
+    std::string execute(const std::string& line) {
+        Lane& lane = lanes[laneForCommand(line.substr(0, line.find('\t')))];
+        std::shared_ptr<PendingRequest> request(new PendingRequest());
+        request->line = line;
+        request->enqueued = std::chrono::steady_clock::now();
+        std::future<std::string> response = request->response.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                return "ERR\tshutting down\n";
+            }
+            // Requests ahead of this one drain at the lane's concurrency
+            double expectedWaitMs = lane.running < lane.config.concurrency && lane.queue.empty()
+                ? 0.0 : lane.serviceMs * (lane.queue.size() + 1) / lane.config.concurrency;
+            if (expectedWaitMs > lane.config.queueDeadlineMs || lane.queue.size() >= kMaxQueued) {
+                return shed(lane, "queue wait would exceed");
+            }
+            if (lane.queue.empty() && lane.running == 0) {
+                // A lane coming back from idle gets no credit for the time it was not competing
+                lane.pass = std::max(lane.pass, minimumActivePass());
+            }
+            lane.queue.push_back(request);
+        }
+        wakeup.notify_one();
+        return response.get();
+    }
+
+    // One "LANE name queued running completed shed within-slo over-slo p50-ms p99-ms" line per
+    // lane, then OK
+    std::string stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        for (const Lane& lane : lanes) {
+            out << "LANE\t" << lane.config.name << '\t' << lane.queue.size() << '\t' << lane.running << '\t'
+                << lane.completed << '\t' << lane.shed << '\t' << lane.withinSlo << '\t' << lane.overSlo << '\t'
+                << percentile(lane, 0.50) << '\t' << percentile(lane, 0.99) << '\n';
+        }
+        out << "OK\n";
+        return out.str();
+    }
+
+    void printStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cout << "\n--- Lanes ---" << std::endl;
+        std::cout << std::left << std::setw(13) << "Lane" << std::setw(11) << "Completed" << std::setw(8) << "Shed"
+                  << std::setw(12) << "Within SLO" << std::setw(10) << "Over SLO" << std::setw(12) << "p50 (ms)"
+                  << "p99 (ms)" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+        for (const Lane& lane : lanes) {
+            std::cout << std::left << std::setw(13) << lane.config.name << std::setw(11) << lane.completed
+                      << std::setw(8) << lane.shed << std::setw(12) << lane.withinSlo << std::setw(10)
+                      << lane.overSlo << std::setw(12) << percentile(lane, 0.50) << percentile(lane, 0.99)
+                      << std::endl;
+        }
+        std::cout << "-------------" << std::endl;
+    }
+
+private:
+    struct PendingRequest {
+        std::string line;
+        std::chrono::steady_clock::time_point enqueued;
+        std::promise<std::string> response;
+    };
+
+    struct Lane {
+        explicit Lane(const LaneConfig& config)
+            : config(config), running(0), pass(0.0), serviceMs(0.0), completed(0), shed(0), withinSlo(0),
+              overSlo(0), nextLatency(0) {}
+        LaneConfig config;
+        std::deque<std::shared_ptr<PendingRequest>> queue;
+        int running;
+        double pass;      // Service received so far, scaled by 1 / weight
+        double serviceMs; // Moving average of the execution time, for the expected queue wait
+        long long completed;
+        long long shed;
+        long long withinSlo;
+        long long overSlo;
+        std::vector<double> latencies; // Ring of the last kLatencyWindow latencies
+        size_t nextLatency;
+    };
+
+    // Counts and answers a refused request (mutex held)
+    std::string shed(Lane& lane, const std::string& reason) {
+        ++lane.shed;
+        Metrics::instance().increment("daemon." + lane.config.name + ".shed");
+        std::ostringstream error;
+        error << "ERR\toverloaded: " << lane.config.name << ' ' << reason << ' ' << lane.config.queueDeadlineMs
+              << " ms\n";
+        return error.str();
+    }
+
+    // Smallest pass among the lanes with work queued or running (mutex held)
+    double minimumActivePass() const {
+        double minimum = -1.0;
+        for (const Lane& lane : lanes) {
+            if ((!lane.queue.empty() || lane.running > 0) && (minimum < 0.0 || lane.pass < minimum)) {
+                minimum = lane.pass;
+            }
+        }
+        return std::max(minimum, 0.0);
+    }
+
+    // The lane to serve next, or -1 if none may run (mutex held)
+    int pickLane() const {
+        int chosen = -1;
+        for (int i = 0; i < static_cast<int>(lanes.size()); ++i) {
+            const Lane& lane = lanes[i];
+            if (!lane.queue.empty() && lane.running < lane.config.concurrency &&
+                (chosen < 0 || lane.pass < lanes[chosen].pass)) {
+                chosen = i;
+            }
+        }
+        return chosen;
+    }
+
+    // Latency at quantile q of the lane's recent requests (mutex held)
+    static double percentile(const Lane& lane, double q) {
+        if (lane.latencies.empty()) {
+            return 0.0;
+        }
+        std::vector<double> sorted(lane.latencies);
+        size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+
+    void workerLoop(sqlite3* conn) {
+        for (;;) {
+            std::shared_ptr<PendingRequest> request;
+            Lane* lane = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                int chosen = -1;
+                wakeup.wait(lock, [this, &chosen] { return stopping || (chosen = pickLane()) >= 0; });
+                if (stopping) {
+                    return;
+                }
+                lane = &lanes[chosen];
+                request = lane->queue.front();
+                lane->queue.pop_front();
+                if (elapsedMs(request->enqueued) > lane->config.queueDeadlineMs) {
+                    request->response.set_value(shed(*lane, "waited longer than"));
+                    continue;
+                }
+                ++lane->running;
+                lane->pass += kStride / lane->config.weight;
+            }
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::string response = handleNodeRequest(conn, archiveName, request->line);
+            double serviceMs = elapsedMs(start);
+            double latencyMs = elapsedMs(request->enqueued);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --lane->running;
+                lane->serviceMs = lane->completed == 0 ? serviceMs : 0.8 * lane->serviceMs + 0.2 * serviceMs;
+                ++lane->completed;
+                bool withinSlo = latencyMs <= lane->config.sloMs;
+                ++(withinSlo ? lane->withinSlo : lane->overSlo);
+                if (lane->latencies.size() < kLatencyWindow) {
+                    lane->latencies.push_back(latencyMs);
+                } else {
+                    lane->latencies[lane->nextLatency] = latencyMs;
+                }
+                lane->nextLatency = (lane->nextLatency + 1) % kLatencyWindow;
+                Metrics::instance().increment("daemon." + lane->config.name + (withinSlo ? ".within_slo" : ".over_slo"));
+                Metrics::instance().recordDuration("daemon." + lane->config.name + ".latency", latencyMs);
+            }
+            wakeup.notify_all(); // A slot of this lane is free again
+            request->response.set_value(response);
+        }
+    }
+
+    std::vector<Lane> lanes;
+    std::string archiveName;
+    std::vector<sqlite3*> connections; // One per worker
+    std::vector<std::thread> workers;
+    std::mutex mutex; // Guards the lanes and stopping
+    std::condition_variable wakeup;
+    bool stopping;
+};
+
+// Answers one daemon request; PING (transport check) and STATS bypass the lanes
+std::string answerDaemonRequest(DaemonScheduler& scheduler, const std::string& line) {
+    if (line == "PING") {
+        return "OK\n";
+    }
+    return line == "STATS" ? scheduler.stats() : scheduler.execute(line);
+}
+
+// Moves a client to a shared-memory channel and serves its requests from the rings until it
+// closes the socket
+void serveShmClient(int clientFd, DaemonScheduler& scheduler) {
+    int channelFd = -1;
+    ShmChannelLayout* channel = nullptr;
+    std::string error;
+    if (!createShmChannel(channelFd, channel, error)) {
+        writeAll(clientFd, "ERR\t" + escapeField(error) + "\n");
+        return;
+    }
+    bool sent = sendWithDescriptor(clientFd, "OK\t" + std::to_string(sizeof(ShmChannelLayout)) + "\n", channelFd);
+    ::close(channelFd); // The client has its own copy
+    ShmRing requests(&channel->requests, channel->requestData);
+    ShmRing responses(&channel->responses, channel->responseData);
+    std::function<bool()> clientAlive = [clientFd] { return socketPeerAlive(clientFd); };
+    std::string line;
+    // A request longer than the ring is not a request this protocol has; the client is dropped
+    while (sent && requests.readMessage(line, ShmChannelLayout::kRingBytes, clientAlive)) {
+        if (!responses.writeMessage(answerDaemonRequest(scheduler, line), clientAlive)) {
+            break;
+        }
+    }
+    unmapShmChannel(channel);
+}
+
+// Set by SIGINT/SIGTERM; the handler also shuts the listening socket so accept() returns
+static volatile sig_atomic_t daemonStopRequested = 0;
+static int daemonListenFd = -1;
+
+extern "C" void requestDaemonStop(int) {
+    daemonStopRequested = 1;
+    if (daemonListenFd >= 0) {
+        ::shutdown(daemonListenFd, SHUT_RDWR);
+    }
+}
+
+// Runs the multi-client daemon on socketPath until SIGINT or SIGTERM, then prints the
+// per-lane results and metrics
+int runDaemon(sqlite3* db, const std::string& dbName, const std::string& socketPath, int workerCount,
+              const std::vector<LaneConfig>& laneConfigs) {
+    // WAL so the scans' readers never block the writes lane
+    if (!executeSQL(db, "PRAGMA journal_mode = WAL;")) {
+        return 1;
+    }
+    DaemonScheduler scheduler(laneConfigs);
+    if (!scheduler.start(dbName, workerCount)) {
+        return 1;
+    }
+    sockaddr_un address;
+    if (!makeUnixAddress(socketPath, address)) {
+        return 1;
+    }
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(socketPath.c_str()); // Remove a stale socket from a previous run
+    if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd, 128) != 0) {
+        std::cerr << "Failed to listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    daemonListenFd = listenFd;
+    struct sigaction action = {};
+    action.sa_handler = requestDaemonStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::cout << "Daemon listening on " << socketPath << " with " << workerCount << " workers" << std::endl;
+
+    std::mutex clientsMutex;
+    std::condition_variable clientsDone;
+    std::vector<int> clients; // Sockets of the connected clients
+    while (!daemonStopRequested) {
+        int clientFd = ::accept(listenFd, nullptr, nullptr);
+        if (clientFd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (!daemonStopRequested) {
+                std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            }
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            clients.push_back(clientFd);
+        }
+        std::thread([clientFd, &scheduler, &clients, &clientsMutex, &clientsDone]() {
+            SocketLineReader reader(clientFd);
+            std::string line;
+            while (reader.readLine(line)) {
+                if (line == "SHM") {
+                    serveShmClient(clientFd, scheduler);
+                    break;
+                }
+                if (!writeAll(clientFd, answerDaemonRequest(scheduler, line))) {
+                    break;
+                }
+            }
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            clients.erase(std::find(clients.begin(), clients.end(), clientFd));
+            ::close(clientFd);
+            clientsDone.notify_all();
+        }).detach();
+    }
+
+    // Hang up on the clients, finish what is running and wait for their threads
+    daemonListenFd = -1;
+    ::close(listenFd);
+    ::unlink(socketPath.c_str());
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (int clientFd : clients) {
+            ::shutdown(clientFd, SHUT_RDWR);
+        }
+    }
+    scheduler.stop();
+    {
+        std::unique_lock<std::mutex> lock(clientsMutex);
+        clientsDone.wait(lock, [&clients] { return clients.empty(); });
+    }
+    std::cout << "\nDaemon stopped." << std::endl;
+    scheduler.printStats();
+    Metrics::instance().print(std::cout);
+    return 0;
+}
+
+
+// --- Batch Mode ---
+// --batch lets an integration submit many changes per invocation: binary batch envelopes
+// (see inventory_ipc.h) are read from stdin until it closes, each runs in one transaction,
+// and its status vector is written to stdout. Diagnostics go to stderr only.
+
+int runBatchMode(const std::string& dbName) {
+    std::ios::sync_with_stdio(false); // Plain buffered binary streams
+    InventoryDB store;
+    if (!store.open(dbName)) {
+        std::cerr << "Can't open " << dbName << ": " << store.lastError() << std::endl;
+        return 1;
+    }
+    std::vector<BatchOperation> operations;
+    BatchResult result;
+    std::string error;
+    while (readBatchRequest(std::cin, operations, error)) {
+        if (!store.executeBatch(operations, result)) {
+            std::cerr << "Batch of " << operations.size() << " operations rolled back: " << store.lastError()
+                      << std::endl;
+        }
+        writeBatchResponse(std::cout, result);
+        std::cout.flush();
+    }
+    if (!error.empty()) {
+        std::cerr << "Malformed batch request: " << error << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+// --- Replication Mode ---
+// The primary's products triggers append every committed change to a sequenced change log
+// in the same transaction. A replica tails that log from its own connection and applies it
+// in batches to a separate database file, which then serves the read-heavy operations.
+// Each replica records on the primary how far it got; entries every replica has applied are
+// pruned, and so is anything beyond kMaxRetainedChanges, so an abandoned replica cannot make
+// the log grow forever. A replica that finds its next entries pruned starts over from a copy.
+
+static const long long kMaxRetainedChanges = 100000;
+
+// Creates the change log, its capture triggers and the replica progress table on the
+// primary. When the log is first created, the existing rows are seeded into it so a new
+// replica starts from a full copy.
+bool enableChangeLog(sqlite3* db) {
+    long long logExists = 0;
+    if (!executeSQL(db, "BEGIN IMMEDIATE;") ||
+        !queryInt64(db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'change_log';", logExists)) {
+        executeSQL(db, "ROLLBACK;", "", false);
+        return false;
+    }
+
+    std::string sql =
+        "CREATE TABLE IF NOT EXISTS change_log ("
+        "seq INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "op TEXT NOT NULL," // 'I'nsert, 'U'pdate or 'D'elete
+        "product_id INTEGER NOT NULL,"
+        "name TEXT,"
+        "quantity INTEGER,"
+        "price_cents INTEGER,"
+        "committed_at INTEGER NOT NULL);"
+        "CREATE TABLE IF NOT EXISTS replica_progress ("
+        "replica TEXT PRIMARY KEY," // Path of the replica database file
+        "applied_seq INTEGER NOT NULL);" + changeLogTriggersSQL();
+    if (logExists == 0) {
+        sql += "INSERT INTO change_log (op, product_id, name, quantity, price_cents, committed_at) "
+               "SELECT 'I', id, name, quantity, price_cents, "
+               "CAST((julianday('now') - 2440587.5) * 86400000 AS INTEGER) FROM products ORDER BY id;";
+    }
+
+    if (!executeSQL(db, sql) || !executeSQL(db, "COMMIT;")) {
+        executeSQL(db, "ROLLBACK;", "", false);
+        return false;
+    }
+    return true;
+}
+
+// Opens a connection for replication use: WAL journaling so readers never block the writer,
+// and a busy timeout so short lock waits are retried instead of failing
+bool openReplicationConnection(sqlite3*& db, const std::string& fileName, int flags) {
+    registerNameFunctions();
+    if (sqlite3_open_v2(fileName.c_str(), &db, flags, nullptr) != SQLITE_OK) {
+        std::cerr << "Can't open database " << fileName << ": " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        db = nullptr;
+        return false;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    if ((flags & SQLITE_OPEN_READWRITE) && !executeSQL(db, "PRAGMA journal_mode = WAL;")) {
+        return false;
+    }
+    return true;
+}
+
+// Replication lag as observed by the replica
+struct ReplicaLag {
+    long long appliedSeq;      // Last change log entry applied to the replica
+    long long pendingChanges;  // Entries committed on the primary but not yet applied
+    long long stalenessMs;     // Time since the replica was last known to be caught up (-1 before the first sync)
+    long long lastApplyLagMs;  // Commit-to-apply delay of the most recently applied entry
+    long long maxApplyLagMs;   // Largest commit-to-apply delay seen so far
+};
+
+// Tails the primary's change log on a background thread and applies it to the replica
+class ReplicaApplier {
+public:
+    static const int kBatchSize = 500;
+    static const int kPollIntervalMs = 50;
+
+    ReplicaApplier() : primary(nullptr), replica(nullptr), stopping(false), lagStats(), caughtUpAtMs(0),
+                       oldestPendingMs(0) {}
+    ~ReplicaApplier() { stop(); }
+
+    // Opens the primary (written only to record progress and prune the log) and the replica,
+    // registers the replica on the primary, then starts tailing
+    bool start(const std::string& primaryName, const std::string& replicaName) {
+        if (!openReplicationConnection(primary, primaryName, SQLITE_OPEN_READWRITE) ||
+            !initializeDatabase(replica, replicaName, false)) {
+            return false;
+        }
+        sqlite3_busy_timeout(replica, 5000);
+        if (!executeSQL(replica, "PRAGMA journal_mode = WAL;") ||
+            !executeSQL(replica, "CREATE TABLE IF NOT EXISTS replica_state ("
+                                 "id INTEGER PRIMARY KEY CHECK (id = 1),"
+                                 "applied_seq INTEGER NOT NULL);"
+                                 "INSERT OR IGNORE INTO replica_state (id, applied_seq) VALUES (1, 0);") ||
+            !queryInt64(replica, "SELECT applied_seq FROM replica_state;", lagStats.appliedSeq)) {
+            return false;
+        }
+        // The same file must register under one name however it was named on the command line
+        char* resolved = ::realpath(replicaName.c_str(), nullptr);
+        replicaPath = resolved ? resolved : replicaName;
+        std::free(resolved);
+        long long appliedSeq = lagStats.appliedSeq;
+        if (executeProductWrite(primary, "INSERT OR IGNORE INTO replica_progress (replica, applied_seq) VALUES (?, ?);",
+                                [this, appliedSeq](sqlite3_stmt* stmt) {
+                                    sqlite3_bind_text(stmt, 1, replicaPath.c_str(), -1, SQLITE_TRANSIENT);
+                                    sqlite3_bind_int64(stmt, 2, appliedSeq);
+                                }) < 0) {
+            std::cerr << "Can't register the replica: " << sqlite3_errmsg(primary) << std::endl;
+            return false;
+        }
+        worker = std::thread(&ReplicaApplier::run, this);
+        return true;
+    }
+
+    void stop() {
+        stopping = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
+        sqlite3_close(primary);
+        sqlite3_close(replica);
+        primary = replica = nullptr;
+    }
+
+    ReplicaLag lag() {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        ReplicaLag snapshot = lagStats;
+        if (caughtUpAtMs == 0) {
+            snapshot.stalenessMs = -1;
+        } else {
+            snapshot.stalenessMs = currentTimeMs() - (snapshot.pendingChanges == 0 ? caughtUpAtMs : oldestPendingMs);
+        }
+        return snapshot;
+    }
+
+private:
+    void run() {
+        while (!stopping) {
+            bool caughtUp = false;
+            if (!applyBatch(caughtUp) || caughtUp) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(kPollIntervalMs));
+            }
+        }
+    }
+
+    // Applies the next batch of change log entries in one replica transaction
+    bool applyBatch(bool& caughtUp) {
+        long long pollStartMs = currentTimeMs();
+        long long appliedSeq = lagStats.appliedSeq; // Only this thread writes appliedSeq
+        long long firstRetained = 0;
+        if (queryInt64(primary, "SELECT COALESCE((SELECT MIN(seq) FROM change_log), "
+                                "(SELECT seq + 1 FROM sqlite_sequence WHERE name = 'change_log'), 1);",
+                       firstRetained) && firstRetained > appliedSeq + 1) {
+            return resynchronize();
+        }
+        sqlite3_stmt* read;
+        if (sqlite3_prepare_v2(primary,
+                               "SELECT seq, op, product_id, name, quantity, price_cents, committed_at FROM change_log "
+                               "WHERE seq > ? ORDER BY seq LIMIT ?;", -1, &read, nullptr) != SQLITE_OK) {
+            return false; // The primary has no change log yet
+        }
+        sqlite3_bind_int64(read, 1, appliedSeq);
+        sqlite3_bind_int(read, 2, kBatchSize);
+
+        // Nothing is applied, and appliedSeq stays put, unless both statements prepare and the
+        // transaction starts
+        sqlite3_stmt* upsert = nullptr;
+        sqlite3_stmt* remove = nullptr;
+        if (sqlite3_prepare_v2(replica,
+                               "INSERT OR REPLACE INTO products (id, name, quantity, price_cents) VALUES (?, ?, ?, ?);",
+                               -1, &upsert, nullptr) != SQLITE_OK ||
+            sqlite3_prepare_v2(replica, "DELETE FROM products WHERE id = ?;", -1, &remove, nullptr) != SQLITE_OK ||
+            !executeSQL(replica, "BEGIN;")) {
+            std::cerr << "Replica apply failed: " << sqlite3_errmsg(replica) << std::endl;
+            sqlite3_finalize(read);
+            sqlite3_finalize(upsert);
+            sqlite3_finalize(remove);
+            return false;
+        }
+        int applied = 0;
+        long long lastCommittedAt = 0;
+        int rc;
+        bool success = true;
+        while ((rc = sqlite3_step(read)) == SQLITE_ROW) {
+            appliedSeq = sqlite3_column_int64(read, 0);
+            const char* op = reinterpret_cast<const char*>(sqlite3_column_text(read, 1));
+            sqlite3_stmt* apply = (op && op[0] == 'D') ? remove : upsert;
+            sqlite3_reset(apply);
+            sqlite3_bind_int64(apply, 1, sqlite3_column_int64(read, 2));
+            if (apply == upsert) {
+                sqlite3_bind_value(apply, 2, sqlite3_column_value(read, 3));
+                sqlite3_bind_int(apply, 3, sqlite3_column_int(read, 4));
+                sqlite3_bind_int64(apply, 4, sqlite3_column_int64(read, 5));
+            }
+            if (sqlite3_step(apply) != SQLITE_DONE) {
+                std::cerr << "Replica apply failed: " << sqlite3_errmsg(replica) << std::endl;
+                success = false;
+                break;
+            }
+            lastCommittedAt = sqlite3_column_int64(read, 6);
+            ++applied;
+        }
+        success = success && rc == SQLITE_DONE;
+        sqlite3_finalize(read);
+        sqlite3_finalize(upsert);
+        sqlite3_finalize(remove);
+
+        if (success && applied > 0) {
+            success = executeSQL(replica, "UPDATE replica_state SET applied_seq = " + std::to_string(appliedSeq) + ";") &&
+                      executeSQL(replica, "COMMIT;");
+        }
+        if (!success || applied == 0) {
+            executeSQL(replica, "ROLLBACK;", "", false);
+        }
+        if (!success) {
+            return false;
+        }
+        if (applied > 0) {
+            reportProgress(appliedSeq);
+        }
+
+        // Measure how far the replica is behind after this batch
+        long long primarySeq = appliedSeq;
+        long long oldestPending = 0;
+        queryInt64(primary, "SELECT COALESCE(MAX(seq), 0) FROM change_log;", primarySeq);
+        if (primarySeq > appliedSeq) {
+            queryInt64(primary, "SELECT committed_at FROM change_log WHERE seq = " + std::to_string(appliedSeq + 1) + ";",
+                       oldestPending);
+        }
+        long long nowMs = currentTimeMs();
+        std::lock_guard<std::mutex> lock(statsMutex);
+        lagStats.appliedSeq = appliedSeq;
+        lagStats.pendingChanges = std::max(0LL, primarySeq - appliedSeq);
+        if (applied > 0) {
+            lagStats.lastApplyLagMs = nowMs - lastCommittedAt;
+            lagStats.maxApplyLagMs = std::max(lagStats.maxApplyLagMs, lagStats.lastApplyLagMs);
+        }
+        if (lagStats.pendingChanges == 0) {
+            caughtUpAtMs = pollStartMs;
+        } else {
+            oldestPendingMs = oldestPending;
+        }
+        caughtUp = applied < kBatchSize;
+        return true;
+    }
+
+    // Records on the primary that this replica has applied everything up to appliedSeq, and
+    // prunes the entries no replica needs any more (or that exceed the retention bound). A
+    // failure only delays pruning until the next batch.
+    void reportProgress(long long appliedSeq) {
+        runInTransaction(primary, [this, appliedSeq]() {
+            return executeProductWrite(primary, "UPDATE replica_progress SET applied_seq = ? WHERE replica = ?;",
+                                       [this, appliedSeq](sqlite3_stmt* stmt) {
+                                           sqlite3_bind_int64(stmt, 1, appliedSeq);
+                                           sqlite3_bind_text(stmt, 2, replicaPath.c_str(), -1, SQLITE_TRANSIENT);
+                                       }) >= 0 &&
+                   executeSQL(primary, "DELETE FROM change_log WHERE seq <= MAX("
+                                       "(SELECT MIN(applied_seq) FROM replica_progress), "
+                                       "(SELECT MAX(seq) FROM change_log) - " + std::to_string(kMaxRetainedChanges) + ");");
+        });
+    }
+
+    // Replaces the replica's products with a copy of the primary's, read in one snapshot
+    // together with the log position it corresponds to, and continues from there
+    bool resynchronize() {
+        long long lastSeq = 0;
+        sqlite3_stmt* read = nullptr;
+        sqlite3_stmt* insert = nullptr;
+        bool success = executeSQL(primary, "BEGIN;") &&
+                       queryInt64(primary, "SELECT COALESCE((SELECT seq FROM sqlite_sequence "
+                                           "WHERE name = 'change_log'), 0);", lastSeq) &&
+                       sqlite3_prepare_v2(primary, "SELECT id, name, quantity, price_cents FROM products;", -1, &read,
+                                          nullptr) == SQLITE_OK &&
+                       sqlite3_prepare_v2(replica, "INSERT INTO products (id, name, quantity, price_cents) "
+                                                   "VALUES (?, ?, ?, ?);", -1, &insert, nullptr) == SQLITE_OK &&
+                       executeSQL(replica, "BEGIN; DELETE FROM products;");
+        int rc = SQLITE_DONE;
+        while (success && (rc = sqlite3_step(read)) == SQLITE_ROW) {
+            sqlite3_reset(insert);
+            for (int column = 0; column < 4; ++column) {
+                sqlite3_bind_value(insert, column + 1, sqlite3_column_value(read, column));
+            }
+            success = sqlite3_step(insert) == SQLITE_DONE;
+        }
+        success = success && rc == SQLITE_DONE &&
+                  executeSQL(replica, "UPDATE replica_state SET applied_seq = " + std::to_string(lastSeq) + ";") &&
+                  executeSQL(replica, "COMMIT;");
+        sqlite3_finalize(read);
+        sqlite3_finalize(insert);
+        if (!success) {
+            std::cerr << "Replica resynchronization failed: " << sqlite3_errmsg(replica) << std::endl;
+            executeSQL(replica, "ROLLBACK;", "", false);
+        }
+        executeSQL(primary, "COMMIT;", "", false); // Ends the read snapshot
+        if (!success) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            lagStats.appliedSeq = lastSeq;
+        }
+        reportProgress(lastSeq);
+        return true;
+    }
+
+    sqlite3* primary;
+    sqlite3* replica;
+    std::string replicaPath; // How the replica is registered in the primary's replica_progress
+    std::thread worker;
+    std::atomic<bool> stopping;
+    std::mutex statsMutex;
+    ReplicaLag lagStats;
+    long long caughtUpAtMs;
+    long long oldestPendingMs;
+};
+
+const int ReplicaApplier::kBatchSize;
+const int ReplicaApplier::kPollIntervalMs;
+
+// Backend for a replica process: writes go to the primary (whose triggers log them), while
+// view, search, filter, report and lookups are served from the replica as long as its
+// staleness stays within maxLagMs; otherwise they fall back to the primary.
+class ReplicatedInventory : public InventoryBackend {
+public:
+    ReplicatedInventory() : primary(nullptr), replica(nullptr), maxLagMs(1000) {}
+
+    ~ReplicatedInventory() {
+        applier.stop();
+        sqlite3_close(primary);
+        sqlite3_close(replica);
+    }
+
+    bool open(const std::string& primaryName, const std::string& replicaName, long long maxLag) {
+        maxLagMs = maxLag;
+        archiveName = fileNameWithSuffix(primaryName, ".archive");
+        if (!initializeDatabase(primary, primaryName, false) || !enableChangeLog(primary)) {
+            return false;
+        }
+        sqlite3_busy_timeout(primary, 5000);
+        if (!executeSQL(primary, "PRAGMA journal_mode = WAL;") || !applier.start(primaryName, replicaName) ||
+            !openReplicationConnection(replica, replicaName, SQLITE_OPEN_READONLY)) {
+            return false;
+        }
+        primaryStore.reset(new InventoryDB(primary, archiveName));
+        replicaStore.reset(new InventoryDB(replica, ""));
+        std::cout << "Replicating " << primaryName << " to " << replicaName << " (max lag " << maxLagMs << " ms)"
+                  << std::endl;
+        return true;
     }
 
-    // Construct the search pattern (e.g., "%term%")
-    std::string searchPattern = "%" + searchTerm + "%";
-    sqlite3_bind_text(stmt, 1, searchPattern.c_str(), -1, SQLITE_STATIC);
+    bool addProduct(const Product& product) override { return ::addProduct(*primaryStore, product); }
+    bool updateProduct(const Product& product) override { return ::updateProduct(*primaryStore, product); }
+    bool deleteProduct(int id) override { return ::deleteProduct(*primaryStore, id); }
 
-    std::cout << "\n--- Search Results for \"" << searchTerm << "\" ---" << std::endl;
-    printInventoryHeader();
-    bool found = false;
-    // Loop through results
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        found = true;
-        std::cout << "| " << std::left << std::setw(5) << sqlite3_column_int(stmt, 0); // ID
-        std::cout << "| " << std::left << std::setw(25) << reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)); // Name
-        std::cout << "| " << std::right << std::setw(10) << sqlite3_column_int(stmt, 2); // Quantity
-        std::cout << "| $" << std::right << std::setw(9) << std::fixed << std::setprecision(2) << sqlite3_column_double(stmt, 3); // Price
-        std::cout << " |" << std::endl;
+    bool viewProducts() override { return ::viewProducts(readStore()); }
+    bool getProduct(int id) override { return ::getProduct(readStore(), id); }
+    bool searchProducts(const std::string& searchTerm) override { return ::searchProducts(readStore(), searchTerm); }
+    bool searchProductsByPrefix(const std::string& prefix) override {
+        return ::searchProductsByPrefix(readStore(), prefix);
     }
-    printInventoryFooter();
+    bool filterProductsByQuantity(int threshold) override { return ::filterProductsByQuantity(readStore(), threshold); }
 
-    if (!found && rc == SQLITE_DONE) {
-        std::cout << "No products found matching \"" << searchTerm << "\"." << std::endl;
-    } else if (rc != SQLITE_DONE) {
-        // Error occurred during step
-        std::cerr << "Error stepping through search results: " << sqlite3_errmsg(db) << std::endl;
+    bool generateReport() override {
+        bool success = ::generateReport(readStore());
+        ReplicaLag lag = applier.lag();
+        if (lag.stalenessMs < 0) {
+            std::cout << "Replica lag: not synchronized yet" << std::endl;
+        } else {
+            std::cout << "Replica lag: " << lag.pendingChanges << " pending changes, " << lag.stalenessMs
+                      << " ms stale (last apply " << lag.lastApplyLagMs << " ms, max " << lag.maxApplyLagMs << " ms)"
+                      << std::endl;
+        }
+        return success;
     }
 
-    sqlite3_finalize(stmt);
-    return rc == SQLITE_DONE; // Return true if loop completed without error
-}
+    bool backupDatabase(const std::string& destName) override { return backupAndReport(primary, destName); }
+    bool bulkOperation(const BulkRequest& request) override { return ::bulkOperation(*primaryStore, request); }
+    bool archiveProducts(int minDays, bool dryRun) override { return archiveAndReport(*primaryStore, minDays, dryRun); }
 
-// Filters products by quantity less than a threshold
-bool filterProductsByQuantity(sqlite3* db, int threshold) {
-     sqlite3_stmt* stmt;
-    std::string sql = "SELECT id, name, quantity, price FROM products WHERE quantity < ? ORDER BY quantity;";
+private:
+    // The replica while it is within the lag bound, the primary otherwise
+    InventoryDB& readStore() {
+        ReplicaLag lag = applier.lag();
+        if (lag.stalenessMs >= 0 && lag.stalenessMs <= maxLagMs) {
+            return *replicaStore;
+        }
+        if (lag.stalenessMs < 0) {
+            std::cout << "(Replica not synchronized yet; reading from the primary)" << std::endl;
+        } else {
+            std::cout << "(Replica is " << lag.stalenessMs << " ms behind; reading from the primary)" << std::endl;
+        }
+        return *primaryStore;
+    }
 
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement (FILTER): " << sqlite3_errmsg(db) << std::endl;
-        return false;
+    sqlite3* primary;
+    sqlite3* replica;
+    std::unique_ptr<InventoryDB> primaryStore; // Borrow the connections above
+    std::unique_ptr<InventoryDB> replicaStore;
+    ReplicaApplier applier;
+    long long maxLagMs;
+    std::string archiveName; // The primary's archive
+};
+
+
+// --- Change Data Capture ---
+// TEMP triggers on main.products copy each changed row into a TEMP table inside the writing
+// transaction. Both exist only on the capturing connection, so other connections and later
+// sessions write nothing extra. sqlite3_update_hook records which captured rows a
+// transaction added, the commit hook seals them and the rollback hook discards them. Hooks
+// may not run SQL on their own connection, so flush() publishes the sealed events once the
+// write has returned: it appends them to a file that other processes tail, then deletes them
+// from the TEMP table.
+
+// Capture table and triggers, created on the capturing connection only
+static const char* const kCdcCaptureSQL =
+    "CREATE TEMP TABLE IF NOT EXISTS cdc_pending ("
+    "seq INTEGER PRIMARY KEY,"
+    "op TEXT NOT NULL," // 'I'nsert, 'U'pdate or 'D'elete
+    "product_id INTEGER NOT NULL,"
+    "name TEXT,"
+    "quantity INTEGER,"
+    "price_cents INTEGER);"
+    "CREATE TEMP TRIGGER IF NOT EXISTS cdc_insert AFTER INSERT ON main.products BEGIN "
+    "INSERT INTO cdc_pending (op, product_id, name, quantity, price_cents) "
+    "VALUES ('I', NEW.id, NEW.name, NEW.quantity, NEW.price_cents); END;"
+    "CREATE TEMP TRIGGER IF NOT EXISTS cdc_update AFTER UPDATE ON main.products BEGIN "
+    "INSERT INTO cdc_pending (op, product_id, name, quantity, price_cents) "
+    "VALUES ('U', NEW.id, NEW.name, NEW.quantity, NEW.price_cents); END;"
+    "CREATE TEMP TRIGGER IF NOT EXISTS cdc_delete AFTER DELETE ON main.products BEGIN "
+    "INSERT INTO cdc_pending (op, product_id) VALUES ('D', OLD.id); END;";
+
+// One captured change; row holds the new row image for inserts and updates
+struct CdcEvent {
+    unsigned long long seq;
+    char op; // 'I'nsert, 'U'pdate or 'D'elete
+    long long id;
+    bool hasRow;
+    Product row;
+};
+
+// Captures the committed changes of one connection and publishes them in commit order
+class ChangeCapture {
+public:
+    ChangeCapture() : db(nullptr), nextSeq(1) {}
+    ~ChangeCapture() { detach(); }
+
+    // Installs the capture triggers and hooks on db and opens (or continues) the append-only
+    // event file
+    bool attach(sqlite3* connection, const std::string& logFileName) {
+        if (!executeSQL(connection, kCdcCaptureSQL)) {
+            std::cerr << "Can't install the change capture triggers: " << sqlite3_errmsg(connection) << std::endl;
+            return false;
+        }
+        nextSeq = lastLoggedSeq(logFileName) + 1;
+        log.open(logFileName.c_str(), std::ios::app);
+        if (!log) {
+            std::cerr << "Can't open change stream file " << logFileName << std::endl;
+            return false;
+        }
+        db = connection;
+        sqlite3_update_hook(db, &ChangeCapture::onUpdate, this);
+        sqlite3_commit_hook(db, &ChangeCapture::onCommit, this);
+        sqlite3_rollback_hook(db, &ChangeCapture::onRollback, this);
+        return true;
     }
 
-    // Bind the threshold value
-    sqlite3_bind_int(stmt, 1, threshold);
+    void detach() {
+        if (db) {
+            flush();
+            sqlite3_update_hook(db, nullptr, nullptr);
+            sqlite3_commit_hook(db, nullptr, nullptr);
+            sqlite3_rollback_hook(db, nullptr, nullptr);
+            executeSQL(db, "DROP TRIGGER IF EXISTS temp.cdc_insert; DROP TRIGGER IF EXISTS temp.cdc_update;"
+                           "DROP TRIGGER IF EXISTS temp.cdc_delete; DROP TABLE IF EXISTS temp.cdc_pending;");
+            db = nullptr;
+        }
+        log.close();
+    }
 
-    std::cout << "\n--- Products with Quantity Less Than " << threshold << " ---" << std::endl;
-    printInventoryHeader();
-    bool found = false;
-    // Loop through results
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        found = true;
-        std::cout << "| " << std::left << std::setw(5) << sqlite3_column_int(stmt, 0); // ID
-        std::cout << "| " << std::left << std::setw(25) << reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)); // Name
-        std::cout << "| " << std::right << std::setw(10) << sqlite3_column_int(stmt, 2); // Quantity
-        std::cout << "| $" << std::right << std::setw(9) << std::fixed << std::setprecision(2) << sqlite3_column_double(stmt, 3); // Price
-        std::cout << " |" << std::endl;
+    // Publishes the events of all transactions committed since the last flush, with the row
+    // images as they were committed, then trims them from the capture table
+    bool flush() {
+        if (committed.empty()) {
+            return true;
+        }
+        std::vector<long long> entries;
+        entries.swap(committed);
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT op, product_id, name, quantity, price_cents FROM temp.cdc_pending "
+                                   "WHERE seq = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed to read the captured changes: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        bool success = true;
+        for (long long entry : entries) {
+            sqlite3_bind_int64(stmt, 1, entry);
+            if (sqlite3_step(stmt) != SQLITE_ROW) {
+                success = false;
+                sqlite3_reset(stmt);
+                continue;
+            }
+            CdcEvent event;
+            event.seq = nextSeq++;
+            event.op = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))[0];
+            event.id = sqlite3_column_int64(stmt, 1);
+            event.hasRow = event.op != 'D';
+            if (event.hasRow) {
+                event.row.id = static_cast<int>(event.id);
+                const unsigned char* name = sqlite3_column_text(stmt, 2);
+                event.row.name = name ? reinterpret_cast<const char*>(name) : "";
+                event.row.quantity = sqlite3_column_int(stmt, 3);
+                event.row.priceCents = sqlite3_column_int64(stmt, 4);
+            }
+            sqlite3_reset(stmt);
+            log << event.seq << '\t' << event.op << '\t' << event.id;
+            if (event.hasRow) {
+                log << '\t' << escapeField(event.row.name) << '\t' << event.row.quantity << '\t'
+                    << event.row.priceCents;
+            }
+            log << '\n';
+        }
+        sqlite3_finalize(stmt);
+        log.flush();
+        // Entries are sealed in rowid order, so everything up to the last one is published
+        success = executeSQL(db, "DELETE FROM temp.cdc_pending WHERE seq <= " + std::to_string(entries.back()) + ";") &&
+                  success;
+        return success && static_cast<bool>(log);
     }
-     printInventoryFooter();
 
-    if (!found && rc == SQLITE_DONE) {
-        std::cout << "No products found with quantity less than " << threshold << "." << std::endl;
-    } else if (rc != SQLITE_DONE) {
-        // Error occurred during step
-        std::cerr << "Error stepping through filter results: " << sqlite3_errmsg(db) << std::endl;
+private:
+    // Every change to main.products adds one capture row; its rowid identifies the change.
+    // Attached databases (the archive) have no capture triggers.
+    static void onUpdate(void* self, int op, const char* dbName, const char* table, sqlite3_int64 rowid) {
+        if (op != SQLITE_INSERT || std::strcmp(dbName, "temp") != 0 || std::strcmp(table, "cdc_pending") != 0) {
+            return;
+        }
+        static_cast<ChangeCapture*>(self)->pending.push_back(static_cast<long long>(rowid));
     }
 
-    sqlite3_finalize(stmt);
-    return rc == SQLITE_DONE;
-}
+    static int onCommit(void* self) {
+        ChangeCapture* capture = static_cast<ChangeCapture*>(self);
+        capture->committed.insert(capture->committed.end(), capture->pending.begin(), capture->pending.end());
+        capture->pending.clear();
+        return 0; // Non-zero would turn the commit into a rollback
+    }
 
-// Generates a simple inventory report (total items, total value)
-bool generateReport(sqlite3* db) {
-    sqlite3_stmt* stmt_count;
-    sqlite3_stmt* stmt_value;
-    std::string sql_count = "SELECT COUNT(*) FROM products;";
-    std::string sql_value = "SELECT SUM(quantity * price) FROM products;";
-    int totalItems = 0;
-    double totalValue = 0.0;
-    bool success = true;
+    static void onRollback(void* self) {
+        static_cast<ChangeCapture*>(self)->pending.clear();
+    }
 
-    // Get total item count
-    int rc_count = sqlite3_prepare_v2(db, sql_count.c_str(), -1, &stmt_count, nullptr);
-    if (rc_count == SQLITE_OK) {
-        if (sqlite3_step(stmt_count) == SQLITE_ROW) {
-            totalItems = sqlite3_column_int(stmt_count, 0);
-        } else {
-             std::cerr << "Failed to get item count: " << sqlite3_errmsg(db) << std::endl;
-             success = false;
+    // Finds the sequence number of the last event already in the file, so a restarted
+    // publisher continues the sequence
+    static unsigned long long lastLoggedSeq(const std::string& logFileName) {
+        std::ifstream in(logFileName.c_str(), std::ios::binary);
+        if (!in) {
+            return 0;
         }
-    } else {
-        std::cerr << "Failed to prepare count statement: " << sqlite3_errmsg(db) << std::endl;
-        success = false;
-    }
-    sqlite3_finalize(stmt_count);
-
-    // Get total inventory value
-    int rc_value = sqlite3_prepare_v2(db, sql_value.c_str(), -1, &stmt_value, nullptr);
-     if (rc_value == SQLITE_OK) {
-        if (sqlite3_step(stmt_value) == SQLITE_ROW) {
-            // Check if the result is NULL (happens if table is empty)
-            if (sqlite3_column_type(stmt_value, 0) != SQLITE_NULL) {
-                 totalValue = sqlite3_column_double(stmt_value, 0);
-            } else {
-                totalValue = 0.0; // Set to 0 if SUM returns NULL
-            }
-        } else {
-             std::cerr << "Failed to get total value: " << sqlite3_errmsg(db) << std::endl;
-             success = false;
+        in.seekg(0, std::ios::end);
+        std::streamoff size = in.tellg();
+        std::streamoff start = size > 4096 ? size - 4096 : 0;
+        in.seekg(start);
+        std::string tail((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::string::size_type end = tail.find_last_not_of('\n');
+        if (end == std::string::npos) {
+            return 0;
         }
-    } else {
-        std::cerr << "Failed to prepare value statement: " << sqlite3_errmsg(db) << std::endl;
-        success = false;
+        std::string::size_type lineStart = tail.rfind('\n', end);
+        lineStart = lineStart == std::string::npos ? 0 : lineStart + 1;
+        return std::strtoull(tail.c_str() + lineStart, nullptr, 10);
     }
-    sqlite3_finalize(stmt_value);
 
-    // Display the report
-    std::cout << "\n--- Inventory Report ---" << std::endl;
-    std::cout << "Total unique products: " << totalItems << std::endl;
-    std::cout << "Total inventory value: $" << std::fixed << std::setprecision(2) << totalValue << std::endl;
-    std::cout << "------------------------" << std::endl;
+    sqlite3* db;
+    std::vector<long long> pending;   // Capture rows of the open transaction
+    std::vector<long long> committed; // Sealed entries awaiting publication
+    std::ofstream log;
+    unsigned long long nextSeq;
+};
 
-    return success;
-}
+// Decorator that publishes captured changes after every operation of the wrapped backend
+class CdcInventory : public InventoryBackend {
+public:
+    CdcInventory(InventoryBackend& inner, ChangeCapture& capture) : inner(inner), capture(capture) {}
+
+    bool addProduct(const Product& product) override { return published(inner.addProduct(product)); }
+    bool viewProducts() override { return inner.viewProducts(); }
+    bool updateProduct(const Product& product) override { return published(inner.updateProduct(product)); }
+    bool deleteProduct(int id) override { return published(inner.deleteProduct(id)); }
+    bool getProduct(int id) override { return inner.getProduct(id); }
+    bool searchProducts(const std::string& searchTerm) override { return inner.searchProducts(searchTerm); }
+    bool searchProductsByPrefix(const std::string& prefix) override { return inner.searchProductsByPrefix(prefix); }
+    bool filterProductsByQuantity(int threshold) override { return inner.filterProductsByQuantity(threshold); }
+    bool generateReport() override { return inner.generateReport(); }
+    bool backupDatabase(const std::string& destName) override { return inner.backupDatabase(destName); }
+    bool bulkOperation(const BulkRequest& request) override { return published(inner.bulkOperation(request)); }
+    bool archiveProducts(int minDays, bool dryRun) override { return published(inner.archiveProducts(minDays, dryRun)); }
+
+private:
+    bool published(bool result) {
+        if (!capture.flush()) {
+            std::cerr << "Failed to publish change events." << std::endl;
+        }
+        return result;
+    }
+
+    InventoryBackend& inner;
+    ChangeCapture& capture;
+};
 
 
 // --- Helper Functions for CLI ---
 
+// The store whose running query Ctrl-C stops (single-database mode)
+static InventoryDB* interruptibleStore = nullptr;
+
+// Ctrl-C cancels the query in progress and the menu carries on; with no query running it
+// ends the program as before
+extern "C" void handleInterrupt(int signalNumber) {
+    if (!interruptibleStore || !interruptibleStore->interrupt()) {
+        signal(signalNumber, SIG_DFL);
+        raise(signalNumber);
+    }
+}
+
+// Routes Ctrl-C to store's running query
+void cancelQueriesOnInterrupt(InventoryDB& store) {
+    interruptibleStore = &store;
+    struct sigaction action = {};
+    action.sa_handler = handleInterrupt;
+    action.sa_flags = SA_RESTART; // Keep the menu's pending read going
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+}
+
 // Clears the input buffer after reading input
 void clearInputBuffer() {
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -389,12 +2805,13 @@ Product getProductDetails(bool includeId = false) {
     clearInputBuffer(); // Consume newline
 
     std::cout << "Enter Price: ";
-    while (!(std::cin >> p.price) || p.price < 0.0) {
-        std::cout << "Invalid input. Please enter a non-negative number for price: ";
-        std::cin.clear();
-        clearInputBuffer();
+    std::string price;
+    while (!std::getline(std::cin, price) || !parseCents(price, p.priceCents) || p.priceCents < 0) {
+        std::cout << "Invalid input. Please enter a non-negative price with at most 2 decimals: ";
+        if (!std::cin) {
+            std::cin.clear();
+        }
     }
-    clearInputBuffer(); // Consume newline
 
     return p;
 }
@@ -412,6 +2829,81 @@ int getProductId(const std::string& action = "delete") {
     return id;
 }
 
+// Reads one bound of a range; Cents bounds are decimal amounts such as 9.99
+bool readRangeValue(std::istream& in, int& value) {
+    return static_cast<bool>(in >> value);
+}
+
+bool readRangeValue(std::istream& in, Cents& value) {
+    std::string text;
+    return in >> text && parseCents(text, value);
+}
+
+// Reads an optional inclusive "min max" range; an empty line means no range
+template <typename T>
+bool getOptionalRange(const std::string& prompt, T& minValue, T& maxValue) {
+    for (;;) {
+        std::string line;
+        std::cout << prompt;
+        std::getline(std::cin, line);
+        if (line.find_first_not_of(" \t") == std::string::npos) {
+            return false;
+        }
+        std::istringstream in(line);
+        if (readRangeValue(in, minValue) && readRangeValue(in, maxValue) && minValue <= maxValue) {
+            return true;
+        }
+        std::cout << "Invalid range. Enter two numbers (min max) or leave empty." << std::endl;
+    }
+}
+
+// Gets the action and the product filter of a bulk operation from the user
+BulkRequest getBulkRequest() {
+    BulkRequest request;
+    int action;
+    std::cout << "1. Adjust price by percentage" << std::endl;
+    std::cout << "2. Adjust price by amount" << std::endl;
+    std::cout << "3. Set quantity" << std::endl;
+    std::cout << "4. Delete products" << std::endl;
+    std::cout << "Choose an action: ";
+    while (!(std::cin >> action) || action < 1 || action > 4) {
+        std::cout << "Invalid choice. Please enter a number between 1 and 4: ";
+        std::cin.clear();
+        clearInputBuffer();
+    }
+    clearInputBuffer();
+    request.action = static_cast<BulkAction>(action - 1);
+
+    if (request.action == BULK_ADJUST_PRICE_PERCENT || request.action == BULK_ADJUST_PRICE_ABSOLUTE) {
+        // Both are read with two decimals: a percentage becomes basis points, an amount cents
+        std::cout << (request.action == BULK_ADJUST_PRICE_PERCENT ? "Enter percentage (e.g. 5 or -12.5): "
+                                                                  : "Enter amount (e.g. 0.50 or -1.25): ");
+        std::string amount;
+        while (!std::getline(std::cin, amount) || !parseCents(amount, request.amount)) {
+            std::cout << "Invalid input. Please enter a number with at most 2 decimals: ";
+            if (!std::cin) {
+                std::cin.clear();
+            }
+        }
+    } else if (request.action == BULK_SET_QUANTITY) {
+        std::cout << "Enter new quantity: ";
+        while (!(std::cin >> request.amount) || request.amount < 0 || request.amount > INT_MAX) {
+            std::cout << "Invalid input. Please enter a non-negative number for quantity: ";
+            std::cin.clear();
+            clearInputBuffer();
+        }
+        clearInputBuffer();
+    }
+
+    std::cout << "Filter by name containing (leave empty for any): ";
+    std::getline(std::cin, request.filter.nameContains);
+    request.filter.hasQuantityRange = getOptionalRange("Quantity range \"min max\" (leave empty for any): ",
+                                                       request.filter.minQuantity, request.filter.maxQuantity);
+    request.filter.hasPriceRange = getOptionalRange("Price range \"min max\" (leave empty for any): ",
+                                                    request.filter.minPrice, request.filter.maxPrice);
+    return request;
+}
+
 
 // Displays the main menu
 void displayMenu() {
@@ -423,64 +2915,464 @@ void displayMenu() {
     std::cout << "5. Search Products by Name" << std::endl;
     std::cout << "6. Filter Products by Quantity" << std::endl;
     std::cout << "7. Generate Report" << std::endl;
-    std::cout << "8. Exit" << std::endl;
+    std::cout << "8. View Product by ID" << std::endl;
+    std::cout << "9. Back Up Database" << std::endl;
+    std::cout << "10. Show Metrics" << std::endl;
+    std::cout << "11. Bulk Update or Delete" << std::endl;
+    std::cout << "12. Archive Out-of-Stock Products" << std::endl;
+    std::cout << "13. Exit" << std::endl;
     std::cout << "Enter your choice: ";
 }
 
-// --- Main Application Logic ---
+// --- Benchmarks ---
+
+// Compares summing inventory value over double prices with the integer-cents kernel on
+// synthetic columns of the given size, and checks how far the double total drifts
+void runAggregationBenchmark(size_t rows) {
+    std::vector<int32_t> quantities(rows);
+    std::vector<Cents> priceCents(rows);
+    std::vector<double> prices(rows);
+    uint64_t state = 88172645463325252ULL; // xorshift64, deterministic input
+    for (size_t i = 0; i < rows; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        quantities[i] = static_cast<int32_t>(state % 1000);
+        priceCents[i] = static_cast<Cents>((state >> 16) % 100000);
+        prices[i] = priceCents[i] / 100.0;
+    }
 
-int main() {
-    sqlite3* db = nullptr; // Pointer to the SQLite database connection
-    std::string dbName = "inventory.db"; // Database file name
+    const int runs = 10;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double doubleTotal = 0.0;
+    for (int run = 0; run < runs; ++run) {
+        doubleTotal = 0.0;
+        for (size_t i = 0; i < rows; ++i) {
+            doubleTotal += quantities[i] * prices[i];
+        }
+    }
+    double doubleMs = elapsedMs(start) / runs;
 
-    // Initialize the database connection and table
-    if (!initializeDatabase(db, dbName)) {
-        return 1; // Exit if database initialization fails
+    start = std::chrono::steady_clock::now();
+    Cents centsTotal = 0;
+    for (int run = 0; run < runs; ++run) {
+        centsTotal = sumInventoryValue(quantities.data(), priceCents.data(), rows);
+    }
+    double centsMs = elapsedMs(start) / runs;
+
+    std::cout << "Aggregated " << rows << " products (average of " << runs << " runs):" << std::endl;
+    std::cout << "  double prices:  " << std::fixed << std::setprecision(3) << doubleMs << " ms, total "
+              << std::setprecision(2) << doubleTotal << std::endl;
+    std::cout << "  integer cents:  " << std::setprecision(3) << centsMs << " ms, total "
+              << formatCents(centsTotal) << std::endl;
+    std::cout << "  double drift:   " << std::llround(doubleTotal * 100) - centsTotal << " cent(s)" << std::endl;
+}
+
+// Compares the Unicode case folding of product names with ASCII-only lowercasing, on
+// synthetic ASCII names (where the two agree) and on names in several scripts: first the
+// routines alone, then as the search condition of an in-memory table. The contenders take
+// turns and each reports its fastest run, which keeps a busy machine from favoring either.
+void runCaseFoldBenchmark(size_t rows) {
+    static const char* const asciiWords[] = {"Steel", "BOLT", "copper", "Washer", "Hinge", "M8", "Oak", "Panel"};
+    static const char* const mixedWords[] = {"Écrou", "Schraube", "ÖLFILTER", "Гайка", "ШАЙБА", "Βίδα", "Straße", "Kühler"};
+    std::vector<std::string> asciiNames(rows);
+    std::vector<std::string> mixedNames(rows);
+    uint64_t state = 88172645463325252ULL; // xorshift64, deterministic input
+    for (size_t i = 0; i < rows; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        asciiNames[i] = std::string(asciiWords[state % 8]) + " " + asciiWords[(state >> 8) % 8] + " " +
+                        std::to_string(i);
+        mixedNames[i] = std::string(mixedWords[state % 8]) + " " + asciiWords[(state >> 8) % 8] + " " +
+                        std::to_string(i);
+    }
+
+    const int runs = 10;
+    std::string out;
+    auto timeFolding = [&](const std::vector<std::string>& names, bool unicode) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (const std::string& name : names) {
+            out.resize(foldedCapacity(name.size()));
+            if (unicode) {
+                out.resize(foldCaseUtf8(name.data(), name.size(), &out[0]));
+            } else {
+                for (size_t c = 0; c < name.size(); ++c) {
+                    char ch = name[c];
+                    out[c] = ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch - 'A' + 'a') : ch;
+                }
+            }
+        }
+        return elapsedMs(start);
+    };
+    double asciiOnlyMs = 0.0;
+    double unicodeAsciiMs = 0.0;
+    double unicodeMixedMs = 0.0;
+    for (int run = 0; run < runs; ++run) {
+        double asciiOnly = timeFolding(asciiNames, false);
+        double unicodeAscii = timeFolding(asciiNames, true);
+        double unicodeMixed = timeFolding(mixedNames, true);
+        asciiOnlyMs = run == 0 ? asciiOnly : std::min(asciiOnlyMs, asciiOnly);
+        unicodeAsciiMs = run == 0 ? unicodeAscii : std::min(unicodeAsciiMs, unicodeAscii);
+        unicodeMixedMs = run == 0 ? unicodeMixed : std::min(unicodeMixedMs, unicodeMixed);
+    }
+
+    // The search condition before and after, on the same rows
+    sqlite3* db = nullptr;
+    installSqliteAllocator();
+    registerNameFunctions();
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK ||
+        !executeSQL(db, "CREATE TABLE names (name TEXT NOT NULL); BEGIN;")) {
+        std::cerr << "Can't create the benchmark table: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return;
+    }
+    sqlite3_stmt* insert = nullptr;
+    sqlite3_prepare_v2(db, "INSERT INTO names (name) VALUES (?);", -1, &insert, nullptr);
+    for (const std::string& name : asciiNames) {
+        sqlite3_bind_text(insert, 1, name.c_str(), static_cast<int>(name.size()), SQLITE_STATIC);
+        sqlite3_step(insert);
+        sqlite3_reset(insert);
+    }
+    sqlite3_finalize(insert);
+    executeSQL(db, "COMMIT;");
+    auto timeSearch = [&](const std::string& condition, long long& matches) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        sqlite3_stmt* stmt = nullptr;
+        sqlite3_prepare_v2(db, ("SELECT COUNT(*) FROM names WHERE " + condition + ";").c_str(), -1, &stmt, nullptr);
+        sqlite3_bind_text(stmt, 1, "%bolt 1%", -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            matches = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        return elapsedMs(start);
+    };
+    long long lowerMatches = 0;
+    long long casefoldMatches = 0;
+    double lowerMs = 0.0;
+    double casefoldMs = 0.0;
+    for (int run = 0; run < runs; ++run) {
+        double lower = timeSearch("LOWER(name) LIKE LOWER(?)", lowerMatches);
+        double casefold = timeSearch(kNameLikeCondition, casefoldMatches);
+        lowerMs = run == 0 ? lower : std::min(lowerMs, lower);
+        casefoldMs = run == 0 ? casefold : std::min(casefoldMs, casefold);
+    }
+    sqlite3_close(db);
+
+    std::cout << "Folded " << rows << " product names (fastest of " << runs << " runs):" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "  ASCII-only, ASCII names:   " << asciiOnlyMs << " ms" << std::endl;
+    std::cout << "  Unicode, ASCII names:      " << unicodeAsciiMs << " ms (" << std::setprecision(1)
+              << 100.0 * unicodeAsciiMs / asciiOnlyMs << "% of ASCII-only)" << std::endl;
+    std::cout << "  Unicode, mixed scripts:    " << std::setprecision(3) << unicodeMixedMs << " ms" << std::endl;
+    std::cout << "Searched " << rows << " ASCII names for \"bolt 1\":" << std::endl;
+    std::cout << "  LOWER(name) LIKE LOWER(?): " << lowerMs << " ms, " << lowerMatches << " matches" << std::endl;
+    std::cout << "  " << kNameLikeCondition << ": " << std::setprecision(3) << casefoldMs << " ms, "
+              << casefoldMatches << " matches (" << std::setprecision(1) << 100.0 * casefoldMs / lowerMs
+              << "% of LOWER)" << std::endl;
+}
+
+// One operation's cost under one allocator
+struct AllocatorRun {
+    double ms;
+    long long allocations;
+    long long bytes;
+};
+
+// Runs the product operations on a fresh copy of rows products in fileName under each
+// SQLite allocator in turn and compares their times and allocation counts
+void runAllocatorBenchmark(const std::string& fileName, size_t rows) {
+    const SqliteAllocator allocators[] = {ALLOCATOR_SYSTEM, ALLOCATOR_COUNTING, ALLOCATOR_POOLED};
+    const char* const operations[] = {"insert", "get", "search", "filter", "report"};
+    const int gets = 2000;
+    const int scans = 10;
+    AllocatorRun results[3][5] = {};
+    for (int a = 0; a < 3; ++a) {
+        std::string error;
+        if (!reinstallSqliteAllocator(allocators[a], error)) {
+            std::cerr << "Allocator benchmark: " << error << std::endl;
+            return;
+        }
+        std::remove(fileName.c_str());
+        sqlite3* db = nullptr;
+        if (!initializeDatabase(db, fileName, false)) {
+            sqlite3_close(db);
+            return;
+        }
+        uint64_t state = 88172645463325252ULL; // xorshift64, the same input for every allocator
+        auto next = [&state]() {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        };
+        // Measures body as operation op of this allocator
+        auto measure = [&](int op, const std::function<void()>& body) {
+            AllocationCounters before = threadAllocationCounters();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            body();
+            results[a][op].ms = elapsedMs(start);
+            results[a][op].allocations = threadAllocationCounters().allocations - before.allocations;
+            results[a][op].bytes = threadAllocationCounters().bytes - before.bytes;
+        };
+        measure(0, [&]() {
+            runInTransaction(db, [&]() {
+                for (size_t i = 0; i < rows; ++i) {
+                    int id;
+                    uint64_t r = next();
+                    Product p{0, "Product " + std::to_string(r % 1000000), static_cast<int>(r % 1000),
+                              static_cast<Cents>((r >> 16) % 100000)};
+                    if (!insertProduct(db, p, id)) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+        });
+        measure(1, [&]() {
+            for (int i = 0; i < gets; ++i) {
+                Product p;
+                bool found;
+                queryProductById(db, static_cast<int>(next() % rows) + 1, p, found);
+            }
+        });
+        measure(2, [&]() {
+            for (int i = 0; i < scans; ++i) {
+                sqlite3_stmt* stmt = prepareProductsByName(db, std::to_string(i * 7));
+                while (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+                    readProductRow(stmt);
+                }
+                sqlite3_finalize(stmt);
+            }
+        });
+        measure(3, [&]() {
+            for (int i = 0; i < scans; ++i) {
+                sqlite3_stmt* stmt = prepareProductsBelowQuantity(db, 10 + i);
+                while (stmt && sqlite3_step(stmt) == SQLITE_ROW) {
+                    readProductRow(stmt);
+                }
+                sqlite3_finalize(stmt);
+            }
+        });
+        measure(4, [&]() {
+            for (int i = 0; i < scans; ++i) {
+                int totalItems;
+                Cents totalValue;
+                queryReportTotals(db, totalItems, totalValue);
+            }
+        });
+        sqlite3_close(db);
+    }
+    std::remove(fileName.c_str());
+    std::string error;
+    reinstallSqliteAllocator(ALLOCATOR_SYSTEM, error);
+
+    const int counts[] = {1, gets, scans, scans, scans};
+    std::cout << "SQLite allocators on " << rows << " products (ms per call; allocations and bytes per call):"
+              << std::endl;
+    std::cout << std::left << std::setw(10) << "operation" << std::right << std::setw(12) << "system"
+              << std::setw(12) << "counting" << std::setw(12) << "pooled" << std::setw(14) << "allocations"
+              << std::setw(14) << "(pooled)" << std::setw(14) << "bytes" << std::endl;
+    for (int op = 0; op < 5; ++op) {
+        double n = counts[op];
+        std::cout << std::left << std::setw(10) << operations[op] << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << results[0][op].ms / n << std::setw(12) << results[1][op].ms / n << std::setw(12)
+                  << results[2][op].ms / n << std::setprecision(0) << std::setw(14) << results[1][op].allocations / n
+                  << std::setw(14) << results[2][op].allocations / n << std::setw(14) << results[1][op].bytes / n
+                  << std::endl;
+    }
+    std::cout << "(allocations served from SQLite's lookaside slots are not counted)" << std::endl;
+}
+
+// Coroutine that starts right away and frees itself when it finishes
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return DetachedTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Tallies the outcomes of a batch of async requests and lets the benchmark wait for them
+class RequestTally {
+public:
+    explicit RequestTally(int requests) : remaining(requests), succeeded(0), cancelled(0), failed(0) {}
+
+    void record(bool ok, bool wasCancelled) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ok) {
+            ++succeeded;
+        } else if (wasCancelled) {
+            ++cancelled;
+        } else {
+            ++failed;
+        }
+        if (--remaining == 0) {
+            done.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return remaining == 0; });
+    }
+
+    int remaining;
+    int succeeded;
+    int cancelled;
+    int failed;
+
+private:
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+DetachedTask searchAsync(AsyncInventoryDB& db, std::string term, CancellationSource cancel, RequestTally& tally) {
+    AsyncResult<std::vector<Product>> result = co_await db.search(term, cancel);
+    tally.record(result.ok, result.cancelled);
+}
+
+// Puts requests concurrent searches in flight on a few I/O threads, then does it again and
+// cancels the whole batch right after issuing it
+void runAsyncBenchmark(const std::string& dbName, int requests) {
+    const int ioThreads = 4;
+    AsyncInventoryDB db;
+    if (!db.open(dbName, ioThreads)) {
+        std::cerr << "Can't open " << dbName << ": " << db.lastError() << std::endl;
+        return;
     }
 
+    RequestTally completed(requests);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < requests; ++i) {
+        searchAsync(db, "a", CancellationSource(), completed);
+    }
+    completed.wait();
+    double ms = elapsedMs(start);
+    std::cout << requests << " concurrent searches on " << ioThreads << " I/O threads: " << std::fixed
+              << std::setprecision(2) << ms << " ms (" << std::setprecision(0) << requests * 1000.0 / ms
+              << " requests/s), " << completed.failed << " failed" << std::endl;
+
+    RequestTally interrupted(requests);
+    CancellationSource cancel;
+    for (int i = 0; i < requests; ++i) {
+        searchAsync(db, "a", cancel, interrupted);
+    }
+    cancel.cancel();
+    interrupted.wait();
+    std::cout << "Cancelled batch: " << interrupted.cancelled << " of " << requests << " cancelled, "
+              << interrupted.succeeded << " finished first" << std::endl;
+}
+
+// Average round trip in microseconds of count calls of send
+double averageRoundTripUs(int count, const std::function<bool()>& send) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        if (!send()) {
+            return -1.0;
+        }
+    }
+    return elapsedMs(start) * 1000.0 / count;
+}
+
+// Compares the daemon's socket and shared-memory transports: PING measures the transport
+// alone, UPDATE (rewriting product 1 unchanged) a small write through the writes lane
+void runIpcBenchmark(const std::string& socketPath) {
+    const int pings = 20000;
+    const int updates = 2000;
+    int socketFd = connectUnixSocket(socketPath);
+    ShmInventoryClient client;
+    if (socketFd < 0 || !client.connect(socketPath)) {
+        std::cerr << "Can't connect to the daemon at " << socketPath << ": "
+                  << (socketFd < 0 ? std::strerror(errno) : client.lastError()) << std::endl;
+        if (socketFd >= 0) {
+            ::close(socketFd);
+        }
+        return;
+    }
+    Product product;
+    bool found = false;
+    if (!client.getProduct(1, product, found) || !found) {
+        std::cerr << "The benchmark rewrites product 1, which was not found." << std::endl;
+        ::close(socketFd);
+        return;
+    }
+
+    SocketLineReader reader(socketFd);
+    std::string line;
+    std::string response;
+    std::string updateLine = "UPDATE\t" + productFields(product);
+    double socketPingUs = averageRoundTripUs(pings, [&] { return writeAll(socketFd, "PING\n") && reader.readLine(line); });
+    double shmPingUs = averageRoundTripUs(pings, [&] { return client.request("PING", response); });
+    double socketUpdateUs = averageRoundTripUs(updates, [&] {
+        return writeAll(socketFd, updateLine + "\n") && reader.readLine(line) && line == "OK";
+    });
+    double shmUpdateUs = averageRoundTripUs(updates, [&] { return client.updateProduct(product, found); });
+    ::close(socketFd);
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Round trip     Socket (us)   Shared memory (us)" << std::endl;
+    std::cout << std::left << std::setw(15) << "PING" << std::setw(14) << socketPingUs << shmPingUs << std::endl;
+    std::cout << std::left << std::setw(15) << "UPDATE" << std::setw(14) << socketUpdateUs << shmUpdateUs << std::endl;
+}
+
+// --- Main Application Logic ---
+
+// Runs the interactive menu loop against the given backend until the user exits
+void runMenu(InventoryBackend& inventory, const std::string& defaultBackupName) {
     int choice;
     do {
         displayMenu();
         // Input validation for menu choice
-        while (!(std::cin >> choice) || choice < 1 || choice > 8) { // Updated range
-             std::cout << "Invalid choice. Please enter a number between 1 and 8: ";
+        while (!(std::cin >> choice) || choice < 1 || choice > 13) { // Updated range
+             std::cout << "Invalid choice. Please enter a number between 1 and 13: ";
              std::cin.clear(); // Clear error flags
              clearInputBuffer(); // Discard invalid input
         }
         clearInputBuffer(); // Consume the newline character left by std::cin
 
+        ActivityScope activity; // Background maintenance waits while the command runs
         switch (choice) {
             case 1: { // Add Product
                 std::cout << "\n--- Add New Product ---" << std::endl;
                 Product newProduct = getProductDetails();
-                addProduct(db, newProduct);
+                inventory.addProduct(newProduct);
                 break;
             }
             case 2: { // View Products
-                viewProducts(db);
+                inventory.viewProducts();
                 break;
             }
             case 3: { // Update Product
                 std::cout << "\n--- Update Product ---" << std::endl;
-                viewProducts(db); // Show products first to help user choose ID
+                inventory.viewProducts(); // Show products first to help user choose ID
                 Product updatedProduct = getProductDetails(true); // Get ID and new details
-                updateProduct(db, updatedProduct);
+                inventory.updateProduct(updatedProduct);
                 break;
             }
             case 4: { // Delete Product
                 std::cout << "\n--- Delete Product ---" << std::endl;
-                viewProducts(db); // Show products first
+                inventory.viewProducts(); // Show products first
                 int idToDelete = getProductId("delete");
-                deleteProduct(db, idToDelete);
+                inventory.deleteProduct(idToDelete);
                 break;
             }
             case 5: { // Search Products
                  std::cout << "\n--- Search Products by Name ---" << std::endl;
+                 std::string mode;
+                 std::cout << "Match 1. anywhere in the name or 2. at the start (default 1): ";
+                 std::getline(std::cin, mode);
                  std::string searchTerm;
                  std::cout << "Enter search term: ";
                  std::getline(std::cin, searchTerm);
                  if (!searchTerm.empty()) {
-                     searchProducts(db, searchTerm);
+                     if (mode == "2") {
+                         inventory.searchProductsByPrefix(searchTerm);
+                     } else {
+                         inventory.searchProducts(searchTerm);
+                     }
                  } else {
                      std::cout << "Search term cannot be empty." << std::endl;
                  }
@@ -496,14 +3388,73 @@ int main() {
                      clearInputBuffer();
                  }
                  clearInputBuffer();
-                 filterProductsByQuantity(db, threshold);
+                 inventory.filterProductsByQuantity(threshold);
                  break;
             }
              case 7: { // Generate Report
-                 generateReport(db);
+                 inventory.generateReport();
+                 break;
+            }
+            case 8: { // View Product by ID
+                 std::cout << "\n--- View Product by ID ---" << std::endl;
+                 int idToView = getProductId("view");
+                 inventory.getProduct(idToView);
+                 break;
+            }
+            case 9: { // Back Up Database
+                 std::cout << "\n--- Back Up Database ---" << std::endl;
+                 std::string destName;
+                 std::cout << "Enter backup file name [" << defaultBackupName << "]: ";
+                 std::getline(std::cin, destName);
+                 inventory.backupDatabase(destName.empty() ? defaultBackupName : destName);
+                 break;
+            }
+            case 10: { // Show Metrics
+                 Metrics::instance().print(std::cout);
+                 break;
+            }
+            case 11: { // Bulk Update or Delete
+                 std::cout << "\n--- Bulk Update or Delete ---" << std::endl;
+                 BulkRequest request = getBulkRequest();
+                 request.dryRun = true;
+                 if (!inventory.bulkOperation(request)) {
+                     break;
+                 }
+                 std::string confirm;
+                 std::cout << "Apply to all matching products? (y/n): ";
+                 std::getline(std::cin, confirm);
+                 if (confirm == "y" || confirm == "Y") {
+                     request.dryRun = false;
+                     inventory.bulkOperation(request);
+                 } else {
+                     std::cout << "Bulk operation cancelled." << std::endl;
+                 }
+                 break;
+            }
+            case 12: { // Archive Out-of-Stock Products
+                 std::cout << "\n--- Archive Out-of-Stock Products ---" << std::endl;
+                 int minDays;
+                 std::cout << "Archive products out of stock for at least how many days? ";
+                 while (!(std::cin >> minDays) || minDays < 0) {
+                     std::cout << "Invalid input. Please enter a non-negative number of days: ";
+                     std::cin.clear();
+                     clearInputBuffer();
+                 }
+                 clearInputBuffer();
+                 if (!inventory.archiveProducts(minDays, true)) {
+                     break;
+                 }
+                 std::string confirm;
+                 std::cout << "Move them to the archive? (y/n): ";
+                 std::getline(std::cin, confirm);
+                 if (confirm == "y" || confirm == "Y") {
+                     inventory.archiveProducts(minDays, false);
+                 } else {
+                     std::cout << "Archiving cancelled." << std::endl;
+                 }
                  break;
             }
-            case 8: { // Exit
+            case 13: { // Exit
                 std::cout << "Exiting program." << std::endl;
                 break;
             }
@@ -512,14 +3463,333 @@ int main() {
                 std::cout << "Invalid choice. Please try again." << std::endl;
                 break;
         }
-    } while (choice != 8); // Updated exit choice
+    } while (choice != 13); // Updated exit choice
+}
+
+// SIGUSR1 writes a memory-backed database to disk now instead of at the next interval
+extern "C" void requestFlushOnSignal(int) {
+    requestMemoryFlush();
+}
+
+// Closes the session's connection when main returns. Declared before the background threads
+// and everything else that uses the connection, so on every exit path those are stopped and
+// joined (destroyed in reverse order) before the connection goes away.
+class ConnectionCloser {
+public:
+    explicit ConnectionCloser(sqlite3*& db) : db(db) {}
+    ~ConnectionCloser() {
+        if (db) {
+            sqlite3_close(db);
+            db = nullptr;
+        }
+    }
+
+private:
+    ConnectionCloser(const ConnectionCloser&) = delete;
+    ConnectionCloser& operator=(const ConnectionCloser&) = delete;
+
+    sqlite3*& db;
+};
+
+// Ends the library's background work when main returns, on every exit path of every mode:
+// stops the online schema rebuilds and, with --memory-storage, flushes the databases one
+// last time. Declared before any database is opened, so it runs after they are all closed.
+class SessionShutdown {
+public:
+    explicit SessionShutdown(bool memoryStorage) : memoryStorage(memoryStorage) {}
+    ~SessionShutdown() {
+        stopSchemaRebuilds();
+        if (memoryStorage) {
+            stopMemoryStorage();
+        }
+    }
+
+private:
+    SessionShutdown(const SessionShutdown&) = delete;
+    SessionShutdown& operator=(const SessionShutdown&) = delete;
+
+    bool memoryStorage;
+};
+
+int main(int argc, char* argv[]) {
+    std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+    sqlite3* db = nullptr; // Pointer to the SQLite database connection
+    std::string dbName = "inventory.db"; // Database file name
+    int shardCount = 1; // Number of database files products are partitioned across
+    std::string nodeSocket; // Serve this database as a cluster node on this socket
+    std::string daemonSocket; // Serve this database to many clients on this socket
+    int daemonWorkers = 3; // Worker connections shared by the daemon's lanes
+    std::vector<LaneConfig> laneConfigs = defaultLaneConfigs(); // Daemon lane limits, weights and deadlines
+    std::vector<std::string> clusterSockets; // Route to these cluster node sockets
+    std::string primaryName; // Replicate from this primary database into dbName
+    long long maxReplicaLagMs = 1000; // Serve reads from the replica only within this staleness
+    std::string cdcFileName; // Publish committed changes to this append-only file
+    int backupIntervalSeconds = 0; // Take a scheduled background backup this often (0 = never)
+    std::string backupName; // Destination of scheduled backups
+    bool maintenance = false; // Run background vacuum and checkpoints during idle periods
+    bool includeArchive = false; // Reads also cover the archived products
+    long long benchmarkRows = 0; // Run the price aggregation benchmark instead of the menu
+    int asyncRequests = 0; // Run the coroutine API benchmark with this many requests instead of the menu
+    std::string ipcBenchmarkSocket; // Benchmark the transports of the daemon on this socket instead of the menu
+    bool batchMode = false; // Execute binary batches from stdin instead of the menu
+    bool startupReport = false; // Print where the startup time went before the first command
+    int scanPartitions = 0; // Split search, filter and report into this many parallel id-range scans
+    bool columnarReads = false; // Answer the reads from an in-memory columnar copy of the products
+    long long allocatorBenchmarkRows = 0; // Compare SQLite's allocators on this many products instead of the menu
+    long long caseFoldBenchmarkRows = 0; // Compare Unicode and ASCII-only case folding on this many names
+    int queryTimeoutMs = 0; // Stop any single-database operation that runs longer than this (0 = no limit)
+    bool memoryStorage = false; // Serve the database files from memory, flushing them periodically
+    int flushIntervalMs = 1000; // With memoryStorage, the most time a change stays in memory only
+
+    // Parse command-line options
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--db") == 0 && i + 1 < argc) {
+            dbName = argv[++i];
+        } else if (std::strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shardCount = static_cast<int>(std::strtol(argv[++i], nullptr, 10));
+            if (shardCount < 1) {
+                std::cerr << "--shards expects a positive number." << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--serve-node") == 0 && i + 1 < argc) {
+            nodeSocket = argv[++i];
+        } else if (std::strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            daemonSocket = argv[++i];
+        } else if (std::strcmp(argv[i], "--daemon-workers") == 0 && i + 1 < argc) {
+            daemonWorkers = static_cast<int>(std::strtol(argv[++i], nullptr, 10));
+            if (daemonWorkers < 1) {
+                std::cerr << "--daemon-workers expects a positive number." << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--lane") == 0 && i + 1 < argc) {
+            if (!parseLaneOption(argv[++i], laneConfigs)) {
+                std::cerr << "--lane expects writes|point-reads|scans=CONCURRENCY,WEIGHT,DEADLINE_MS,SLO_MS." << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--cluster") == 0 && i + 1 < argc) {
+            std::stringstream socketList(argv[++i]);
+            std::string socketPath;
+            while (std::getline(socketList, socketPath, ',')) {
+                if (!socketPath.empty()) {
+                    clusterSockets.push_back(socketPath);
+                }
+            }
+        } else if (std::strcmp(argv[i], "--replica-of") == 0 && i + 1 < argc) {
+            primaryName = argv[++i];
+        } else if (std::strcmp(argv[i], "--max-lag-ms") == 0 && i + 1 < argc) {
+            maxReplicaLagMs = std::strtoll(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--cdc") == 0 && i + 1 < argc) {
+            cdcFileName = argv[++i];
+        } else if (std::strcmp(argv[i], "--backup-every") == 0 && i + 1 < argc) {
+            backupIntervalSeconds = static_cast<int>(std::strtol(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--backup-file") == 0 && i + 1 < argc) {
+            backupName = argv[++i];
+        } else if (std::strcmp(argv[i], "--maintenance") == 0) {
+            maintenance = true;
+        } else if (std::strcmp(argv[i], "--include-archive") == 0) {
+            includeArchive = true;
+        } else if (std::strcmp(argv[i], "--startup-report") == 0) {
+            startupReport = true;
+        } else if (std::strcmp(argv[i], "--benchmark-aggregation") == 0 && i + 1 < argc) {
+            benchmarkRows = std::strtoll(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--query-timeout") == 0 && i + 1 < argc) {
+            queryTimeoutMs = static_cast<int>(std::strtol(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--parallel-scans") == 0 && i + 1 < argc) {
+            scanPartitions = static_cast<int>(std::strtol(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--sqlite-allocator") == 0 && i + 1 < argc) {
+            const std::string name = argv[++i];
+            std::string error;
+            SqliteAllocator allocator = name == "pooled" ? ALLOCATOR_POOLED
+                                        : name == "counting" ? ALLOCATOR_COUNTING : ALLOCATOR_SYSTEM;
+            if ((name != "system" && name != "counting" && name != "pooled") || !setSqliteAllocator(allocator, error)) {
+                std::cerr << "--sqlite-allocator expects system, counting or pooled." << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--benchmark-allocator") == 0 && i + 1 < argc) {
+            allocatorBenchmarkRows = std::strtoll(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--benchmark-casefold") == 0 && i + 1 < argc) {
+            caseFoldBenchmarkRows = std::strtoll(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--columnar-reads") == 0) {
+            columnarReads = true;
+        } else if (std::strcmp(argv[i], "--benchmark-async") == 0 && i + 1 < argc) {
+            asyncRequests = static_cast<int>(std::strtol(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--batch") == 0) {
+            batchMode = true;
+        } else if (std::strcmp(argv[i], "--benchmark-ipc") == 0 && i + 1 < argc) {
+            ipcBenchmarkSocket = argv[++i];
+        } else if (std::strcmp(argv[i], "--memory-storage") == 0) {
+            memoryStorage = true;
+        } else if (std::strcmp(argv[i], "--flush-interval") == 0 && i + 1 < argc) {
+            flushIntervalMs = static_cast<int>(std::strtol(argv[++i], nullptr, 10));
+            if (flushIntervalMs < 0) {
+                std::cerr << "--flush-interval expects a non-negative number of milliseconds." << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--db FILE] [--cdc FILE] [--backup-every SECONDS [--backup-file FILE]] [--maintenance] [--include-archive] [--startup-report] [--memory-storage [--flush-interval MS]] [--batch] [--query-timeout MS] [--parallel-scans N] [--columnar-reads] [--sqlite-allocator system|counting|pooled] [--benchmark-aggregation ROWS] [--benchmark-allocator ROWS] [--benchmark-casefold ROWS] [--benchmark-async REQUESTS] [--benchmark-ipc SOCKET] [--shards N | --serve-node SOCKET | --daemon SOCKET [--daemon-workers N] [--lane NAME=CONCURRENCY,WEIGHT,DEADLINE_MS,SLO_MS]... | --cluster SOCKET,SOCKET,..."
+                         " | --replica-of PRIMARY [--max-lag-ms MS]]" << std::endl;
+            return 1;
+        }
+    }
+
+    // The library's diagnostics: information on stdout next to the menu's own messages,
+    // errors on stderr. Batch mode keeps stdout for its binary responses.
+    setLogHandler([batchMode](LogLevel level, const std::string& message) {
+        (level == LOG_LEVEL_ERROR || batchMode ? std::cerr : std::cout) << message << std::endl;
+    });
+
+    // Switches SQLite's allocator back and forth, so nothing else may have opened a database
+    if (allocatorBenchmarkRows > 0) {
+        runAllocatorBenchmark(fileNameWithSuffix(dbName, ".allocbench"), static_cast<size_t>(allocatorBenchmarkRows));
+        return 0;
+    }
+
+    // Before anything opens a database, so every mode below runs on it
+    if (memoryStorage) {
+        std::string error;
+        if (!enableMemoryStorage(flushIntervalMs, error)) {
+            std::cerr << "Failed to enable memory storage: " << error << std::endl;
+            return 1;
+        }
+        struct sigaction action = {};
+        action.sa_handler = requestFlushOnSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, nullptr);
+    }
+    SessionShutdown sessionShutdown(memoryStorage);
+
+    if (benchmarkRows > 0) {
+        runAggregationBenchmark(static_cast<size_t>(benchmarkRows));
+        return 0;
+    }
+    if (caseFoldBenchmarkRows > 0) {
+        runCaseFoldBenchmark(static_cast<size_t>(caseFoldBenchmarkRows));
+        return 0;
+    }
+    if (asyncRequests > 0) {
+        runAsyncBenchmark(dbName, asyncRequests);
+        return 0;
+    }
+    if (!ipcBenchmarkSocket.empty()) {
+        runIpcBenchmark(ipcBenchmarkSocket);
+        return 0;
+    }
+    if (batchMode) {
+        return runBatchMode(dbName);
+    }
+
+    // Cluster router: every operation is forwarded to the node processes
+    if (!clusterSockets.empty()) {
+        ClusterRouter router;
+        if (!router.connect(clusterSockets)) {
+            return 1;
+        }
+        runMenu(router, backupFileName(dbName));
+        return 0;
+    }
+
+    // Replica: dbName is kept in sync with the primary's change log and serves the reads
+    if (!primaryName.empty()) {
+        ReplicatedInventory replicated;
+        if (!replicated.open(primaryName, dbName, maxReplicaLagMs)) {
+            return 1;
+        }
+        runMenu(replicated, backupFileName(dbName));
+        return 0;
+    }
+
+    // Sharded mode: products are partitioned across shardCount database files
+    if (shardCount > 1) {
+        ShardedInventory sharded;
+        if (!sharded.open(dbName, shardCount)) {
+            return 1;
+        }
+        runMenu(sharded, backupFileName(dbName));
+        std::cout << "Database shards closed." << std::endl;
+        return 0;
+    }
+
+    // Initialize the database connection and table
+    StartupTimings startupTimings;
+    if (!initializeDatabase(db, dbName, true, &startupTimings)) {
+        return 1; // Exit if database initialization fails
+    }
+
+    // Cluster node: serve this database to a router instead of running the menu
+    if (!nodeSocket.empty()) {
+        int status = runNodeServer(db, dbName, nodeSocket);
+        sqlite3_close(db);
+        return status;
+    }
+
+    // Daemon: serve this database to many clients through the scheduling lanes
+    if (!daemonSocket.empty()) {
+        int status = runDaemon(db, dbName, daemonSocket, daemonWorkers, laneConfigs);
+        sqlite3_close(db);
+        return status;
+    }
+
+    // From here on the connection is closed by closer, after the threads below are stopped
+    ConnectionCloser closer(db);
+
+    // Scheduled online backups of the database while the menu is in use
+    BackupScheduler backupScheduler;
+    if (backupIntervalSeconds > 0) {
+        backupScheduler.start(db, backupName.empty() ? backupFileName(dbName) : backupName, backupIntervalSeconds);
+    }
+
+    // Background vacuum and checkpoints while the session is idle
+    MaintenanceScheduler maintenanceScheduler;
+    if (maintenance && !maintenanceScheduler.start(db, dbName)) {
+        return 1;
+    }
+
+    // Opt-in: let the reads see archived products as well
+    InventoryDB store(db, fileNameWithSuffix(dbName, ".archive"));
+    if (includeArchive && !store.setIncludeArchive(true)) {
+        return 1;
+    }
+    // Opt-in: scan search, filter and report in parallel id ranges
+    if (scanPartitions > 1 && !store.setParallelScans(scanPartitions)) {
+        std::cerr << "Can't set up parallel scans: " << store.lastError() << std::endl;
+        return 1;
+    }
+    // Opt-in: serve the reads from the in-memory columnar copy
+    if (columnarReads && !store.setColumnarReads(true)) {
+        std::cerr << "Can't set up columnar reads: " << store.lastError() << std::endl;
+        return 1;
+    }
+    store.setTimeout(queryTimeoutMs);
+    cancelQueriesOnInterrupt(store);
+
+    SingleDatabaseBackend inventory(store);
+    if (startupReport) {
+        printStartupReport(startupTimings, processStart);
+    }
+    if (!cdcFileName.empty()) {
+        // Change data capture: publish every committed change of this session
+        ChangeCapture capture;
+        if (!capture.attach(db, cdcFileName)) {
+            return 1;
+        }
+        CdcInventory published(inventory, capture);
+        runMenu(published, backupFileName(dbName));
+    } else {
+        runMenu(inventory, backupFileName(dbName));
+    }
+
+    backupScheduler.stop();
+    maintenanceScheduler.stop();
+    interruptibleStore = nullptr;
 
     // Close the database connection before exiting
     if (db) {
         sqlite3_close(db);
+        db = nullptr;
         std::cout << "Database connection closed." << std::endl;
     }
 
-
     return 0; // Successful execution
 }
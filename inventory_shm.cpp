@@ -0,0 +1,176 @@
+// Shared-memory client of the inventory daemon (see inventory_shm.h)
+
+#include "inventory_shm.h"
+#include "inventory_ipc.h"
+
+#include <cerrno>   // For errno
+#include <cstdlib>  // For std::strtol
+#include <cstring>  // For std::strerror
+#include <sys/socket.h> // For the handshake socket
+#include <sys/un.h> // For Unix domain socket addresses
+#include <unistd.h> // For close
+
+struct ShmInventoryClient::Impl {
+    Impl() : socketFd(-1), channel(nullptr) {}
+
+    // Sent requests and received responses, from this side
+    ShmRing requests() { return ShmRing(&channel->requests, channel->requestData); }
+    ShmRing responses() { return ShmRing(&channel->responses, channel->responseData); }
+
+    int socketFd; // Kept open while connected: closing it tells the daemon we are gone
+    ShmChannelLayout* channel;
+    std::string error;
+};
+
+ShmInventoryClient::ShmInventoryClient() : impl(new Impl()) {}
+
+ShmInventoryClient::~ShmInventoryClient() {
+    close();
+}
+
+bool ShmInventoryClient::connect(const std::string& socketPath) {
+    close();
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        impl->error = "socket path too long: " + socketPath;
+        return false;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    impl->socketFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (impl->socketFd < 0 ||
+        ::connect(impl->socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        impl->error = "can't connect to " + socketPath + ": " + std::strerror(errno);
+        close();
+        return false;
+    }
+
+    // Ask for a channel; the daemon answers with its memfd attached
+    std::string line;
+    int channelFd = -1;
+    if (::send(impl->socketFd, "SHM\n", 4, MSG_NOSIGNAL) != 4 ||
+        !receiveLineWithDescriptor(impl->socketFd, line, channelFd)) {
+        impl->error = "daemon closed the connection during the handshake";
+        close();
+        return false;
+    }
+    if (line.compare(0, 2, "OK") != 0 || channelFd < 0) {
+        std::vector<std::string> fields = splitFields(line);
+        impl->error = fields.size() > 1 ? fields[1] : "daemon did not send shared memory";
+        if (channelFd >= 0) {
+            ::close(channelFd);
+        }
+        close();
+        return false;
+    }
+    bool mapped = mapShmChannel(channelFd, impl->channel, impl->error);
+    ::close(channelFd); // The mapping keeps the memory
+    if (!mapped) {
+        close();
+        return false;
+    }
+    impl->error.clear();
+    return true;
+}
+
+void ShmInventoryClient::close() {
+    unmapShmChannel(impl->channel);
+    impl->channel = nullptr;
+    if (impl->socketFd >= 0) {
+        ::close(impl->socketFd);
+        impl->socketFd = -1;
+    }
+}
+
+bool ShmInventoryClient::isConnected() const {
+    return impl->channel != nullptr;
+}
+
+const std::string& ShmInventoryClient::lastError() const {
+    return impl->error;
+}
+
+bool ShmInventoryClient::request(const std::string& line, std::string& response) {
+    if (!impl->channel) {
+        impl->error = "not connected to a daemon";
+        return false;
+    }
+    if (line.size() > ShmChannelLayout::kRingBytes) {
+        impl->error = "request is longer than the " + std::to_string(ShmChannelLayout::kRingBytes) + "-byte ring";
+        return false;
+    }
+    int socketFd = impl->socketFd;
+    std::function<bool()> daemonAlive = [socketFd] { return socketPeerAlive(socketFd); };
+    if (!impl->requests().writeMessage(line, daemonAlive) ||
+        !impl->responses().readMessage(response, UINT32_MAX, daemonAlive)) {
+        impl->error = "connection to the daemon lost";
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool ShmInventoryClient::call(const std::string& line, std::vector<std::string>& status, bool& found,
+                              std::vector<Product>* rows) {
+    std::string response;
+    if (!request(line, response)) {
+        return false;
+    }
+    std::string::size_type start = 0;
+    while (start < response.size()) {
+        std::string::size_type end = response.find('\n', start);
+        std::vector<std::string> fields = splitFields(response.substr(start, end - start));
+        start = end == std::string::npos ? response.size() : end + 1;
+        if (fields[0] == "ROW") {
+            Product p;
+            if (rows && parseProductFields(fields, 1, p)) {
+                rows->push_back(p);
+            }
+        } else if (fields[0] == "OK" || fields[0] == "NOTFOUND") {
+            found = fields[0] == "OK";
+            status = fields;
+            impl->error.clear();
+            return true;
+        } else {
+            impl->error = fields.size() > 1 ? fields[1] : "unexpected response from the daemon";
+            return false;
+        }
+    }
+    impl->error = "incomplete response from the daemon";
+    return false;
+}
+
+bool ShmInventoryClient::addProduct(const Product& product, int& newId) {
+    Product unplaced = product;
+    unplaced.id = 0; // The daemon assigns the id
+    std::vector<std::string> status;
+    bool found = false;
+    if (!call("ADD\t" + productFields(unplaced), status, found)) {
+        return false;
+    }
+    newId = status.size() > 1 ? static_cast<int>(std::strtol(status[1].c_str(), nullptr, 10)) : 0;
+    return true;
+}
+
+bool ShmInventoryClient::updateProduct(const Product& product, bool& found) {
+    std::vector<std::string> status;
+    return call("UPDATE\t" + productFields(product), status, found);
+}
+
+bool ShmInventoryClient::deleteProduct(int id, bool& found) {
+    std::vector<std::string> status;
+    return call("DELETE\t" + std::to_string(id), status, found);
+}
+
+bool ShmInventoryClient::getProduct(int id, Product& product, bool& found) {
+    std::vector<std::string> status;
+    std::vector<Product> rows;
+    if (!call("GET\t" + std::to_string(id), status, found, &rows)) {
+        return false;
+    }
+    found = found && !rows.empty();
+    if (found) {
+        product = rows[0];
+    }
+    return true;
+}
@@ -0,0 +1,310 @@
+#ifndef INVENTORY_SQLITE_H
+#define INVENTORY_SQLITE_H
+
+// The SQLite layer under InventoryDB, shared by the library and the CLI's sharded, cluster
+// and replication modes, which work on raw connections. Not part of the stable API.
+
+#include "inventory.h"
+#include "inventory_alloc.h"
+
+#include <sqlite3.h> // For SQLite C API
+#include <algorithm> // For std::max
+#include <atomic>   // For std::atomic
+#include <chrono>   // For operation timing
+#include <cstdint>  // For int32_t
+#include <functional> // For std::function
+#include <iomanip>  // For std::setw
+#include <ostream>  // For printing the metrics
+#include <map>      // For metric names
+#include <mutex>    // For std::mutex
+#include <string>   // For using string objects
+#include <vector>   // For using vector containers
+
+// --- Metrics ---
+
+// Process-wide counters and timings, shown by the "Show Metrics" menu entry
+class Metrics {
+public:
+    static Metrics& instance() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    void increment(const std::string& name, long long delta = 1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters[name] += delta;
+    }
+
+    void recordDuration(const std::string& name, double ms) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Timing& timing = timings[name];
+        ++timing.count;
+        timing.totalMs += ms;
+        timing.maxMs = std::max(timing.maxMs, ms);
+    }
+
+    void print(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "\n--- Metrics ---" << std::endl;
+        if (counters.empty() && timings.empty()) {
+            out << "No metrics recorded yet." << std::endl;
+        }
+        for (const std::pair<const std::string, long long>& counter : counters) {
+            out << std::left << std::setw(36) << counter.first << counter.second << std::endl;
+        }
+        for (const std::pair<const std::string, Timing>& timing : timings) {
+            const Timing& t = timing.second;
+            out << std::left << std::setw(36) << timing.first << t.count << " x, avg " << std::fixed
+                      << std::setprecision(3) << t.totalMs / t.count << " ms, max " << t.maxMs << " ms" << std::endl;
+        }
+        out << "---------------" << std::endl;
+    }
+
+private:
+    struct Timing {
+        Timing() : count(0), totalMs(0.0), maxMs(0.0) {}
+        long long count;
+        double totalMs;
+        double maxMs;
+    };
+
+    std::mutex mutex;
+    std::map<std::string, long long> counters;
+    std::map<std::string, Timing> timings;
+};
+
+// Milliseconds elapsed since start on the monotonic clock
+inline double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Tracks whether the user is working, so background maintenance can wait for idle periods
+class ActivityTracker {
+public:
+    static ActivityTracker& instance() {
+        static ActivityTracker tracker;
+        return tracker;
+    }
+
+    void begin() {
+        ++inFlight;
+        touch();
+    }
+
+    void end() {
+        touch();
+        --inFlight;
+    }
+
+    // How long nothing has been running; zero while an operation is in flight
+    double idleMs() const {
+        if (inFlight > 0) {
+            return 0.0;
+        }
+        std::chrono::steady_clock::time_point last(std::chrono::steady_clock::duration(lastActivity.load()));
+        return elapsedMs(last);
+    }
+
+private:
+    ActivityTracker() : inFlight(0), lastActivity(std::chrono::steady_clock::now().time_since_epoch().count()) {}
+
+    void touch() { lastActivity = std::chrono::steady_clock::now().time_since_epoch().count(); }
+
+    std::atomic<int> inFlight;
+    std::atomic<std::chrono::steady_clock::rep> lastActivity;
+};
+
+// Marks an operation as in flight for the lifetime of the scope
+class ActivityScope {
+public:
+    ActivityScope() { ActivityTracker::instance().begin(); }
+    ~ActivityScope() { ActivityTracker::instance().end(); }
+};
+
+// --- Allocators ---
+
+// Installs the allocator chosen with setSqliteAllocator (inventory_alloc.h) the first time it
+// is called; initializeDatabase and enableMemoryStorage call it before SQLite starts. If
+// SQLite was started by someone else first, it warns and SQLite keeps its own allocator.
+void installSqliteAllocator();
+
+// Shuts SQLite down and starts it again with allocator, for benchmarks; no connection may be open
+bool reinstallSqliteAllocator(SqliteAllocator allocator, std::string& error);
+
+// Allocations SQLite made on the calling thread so far (counted by all but ALLOCATOR_SYSTEM)
+struct AllocationCounters {
+    long long allocations;
+    long long bytes;
+};
+AllocationCounters threadAllocationCounters();
+bool allocationsCounted();
+
+// Adds the calling thread's SQLite allocations since start to the metrics
+// alloc.<operation>.calls, .allocations and .bytes (when they are counted)
+void recordAllocations(const char* operation, const AllocationCounters& start);
+
+// Records the allocations made during the scope. Allocations on other threads, such as
+// parallel scan partitions, are not included.
+class AllocationScope {
+public:
+    explicit AllocationScope(const char* operation) : operation(operation), start(threadAllocationCounters()) {}
+    ~AllocationScope() { recordAllocations(operation, start); }
+
+private:
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+    const char* operation;
+    AllocationCounters start;
+};
+
+// --- Case Folding ---
+
+// Writes the simple Unicode case folding of UTF-8 text to out, which must have room for
+// foldedCapacity(length) bytes, and returns the folded length. Bytes that are not UTF-8 are
+// copied unchanged. Names fold the same way in every name-matching path.
+size_t foldCaseUtf8(const char* text, size_t length, char* out);
+inline size_t foldedCapacity(size_t length) {
+    return length + length / 2 + 1; // A few 2-byte letters fold to 3-byte ones
+}
+std::string foldCase(const std::string& text);
+
+// Registers casefold(text), foldCaseUtf8 as a SQL function, on db
+int registerCaseFoldFunction(sqlite3* db);
+
+// --- Normalized Names ---
+
+// The form of a product name that name_normalized stores and prefix searches compare:
+// case-folded (foldCase), whitespace runs collapsed to one space, both ends trimmed
+std::string normalizeProductName(const std::string& name);
+
+// Makes the SQL functions normalize_name(text) and casefold(text) available on every
+// connection opened from now on. Writing to the products table and searching by name need
+// them, so call it before opening a database.
+void registerNameFunctions();
+
+// Matches name against the LIKE pattern bound to the next parameter, ignoring case in
+// every script
+static const char* const kNameLikeCondition = "casefold(name) LIKE casefold(?)";
+
+// Passes a line to the handler given to setLogHandler, if any
+void logMessage(LogLevel level, const std::string& message);
+
+// --- Database Interaction Functions ---
+
+// Executes a non-SELECT SQL statement and logs its errors; successMsg (if any) is logged as
+// information when it succeeds
+bool executeSQL(sqlite3* db, const std::string& sql, const std::string& successMsg = "", bool logErrors = true);
+
+// Runs a single-value integer query (e.g. COUNT or MAX); false on error
+bool queryInt64(sqlite3* db, const std::string& sql, long long& value);
+
+// Runs body inside a write transaction, committing if it succeeds and rolling back otherwise
+bool runInTransaction(sqlite3* db, const std::function<bool()>& body);
+
+// Milliseconds since the Unix epoch
+long long currentTimeMs();
+
+// Inserts a suffix before a file name's extension, e.g. ("inventory.db", ".backup") -> "inventory.backup.db"
+std::string fileNameWithSuffix(const std::string& fileName, const std::string& suffix);
+
+// The table expression read queries select from: the hot products, optionally with the
+// archived ones, or the columnar copy of either (registerColumnarProducts)
+std::string productsSource(bool includeArchive, bool columnar = false);
+
+// Total value of a set of products, sum(quantity * price), in exact integer arithmetic
+Cents sumInventoryValue(const int32_t* quantities, const Cents* priceCents, size_t count);
+
+// Triggers recording every product write in the change log (see Replication Mode)
+std::string changeLogTriggersSQL();
+
+// Where the time to open a database went, for the --startup-report option
+struct StartupTimings {
+    StartupTimings() : openMs(0.0), schemaMs(0.0), fastPath(false) {}
+    double openMs;   // sqlite3_open and connection settings
+    double schemaMs; // Schema version check and any migrations
+    bool fastPath;   // The schema was current, so no DDL ran
+};
+
+// Opens dbName and brings its schema up to date (verbose = false suppresses the success
+// messages, e.g. when opening many shard files)
+bool initializeDatabase(sqlite3*& db, const std::string& dbName, bool verbose = true,
+                        StartupTimings* timings = nullptr);
+
+// Stops the background schema rebuilds started by initializeDatabase
+void stopSchemaRebuilds();
+
+// Reads the current row of a "SELECT id, name, quantity, price_cents" statement into a Product
+Product readProductRow(sqlite3_stmt* stmt);
+
+// Runs a "SELECT id, name, quantity, price_cents" query and appends every row to results.
+// bindParams (optional) binds the statement's parameters before it is stepped.
+bool collectProducts(sqlite3* db, const std::string& sql, const std::function<void(sqlite3_stmt*)>& bindParams,
+                     std::vector<Product>& results);
+
+// Structured product operations; found reports whether the id exists
+bool insertProduct(sqlite3* db, const Product& product, int& newId);
+bool updateProductById(sqlite3* db, const Product& product, bool& found);
+bool deleteProductById(sqlite3* db, int id, bool& found);
+// The reads take their rows from productsSource(includeArchive, columnar)
+bool queryProductById(sqlite3* db, int id, Product& product, bool& found, bool includeArchive = false,
+                      bool columnar = false);
+bool queryAllProducts(sqlite3* db, std::vector<Product>& products, bool includeArchive = false, bool columnar = false);
+
+// Prepared (and bound) statements for a ProductRange; nullptr if preparing failed
+sqlite3_stmt* prepareProductsByName(sqlite3* db, const std::string& nameContains, bool includeArchive = false,
+                                    bool columnar = false);
+sqlite3_stmt* prepareProductsBelowQuantity(sqlite3* db, int threshold, bool includeArchive = false,
+                                           bool columnar = false);
+// Products whose normalized name starts with the normalized prefix, ordered by id; an index
+// range scan on name_normalized once schema version 5 is in place
+sqlite3_stmt* prepareProductsByPrefix(sqlite3* db, const std::string& prefix, bool includeArchive = false);
+bool queryProductsByPrefix(sqlite3* db, const std::string& prefix, std::vector<Product>& products,
+                           bool includeArchive = false);
+
+// Computes the report aggregates (total items, total value) without printing them
+bool queryReportTotals(sqlite3* db, int& totalItems, Cents& totalValue, bool includeArchive = false,
+                       bool columnar = false);
+
+// --- Columnar Products ---
+
+// Registers the eponymous virtual tables products_columnar (the products) and
+// products_columnar_all (with the archive attached, products and archived products) on db.
+// Each keeps an in-memory copy of its rows, one array per column, which the first query
+// after a commit to the underlying database(s) reloads. Constraints on id, quantity and
+// price_cents and "name LIKE ?" are answered from the arrays, id and quantity ranges by
+// binary search, and rows come out ordered by id or by quantity.
+bool registerColumnarProducts(sqlite3* db);
+
+// --- Online Backup ---
+
+// Copies db into destName while the database stays in use, a few pages per step. The copy is
+// written to destName + ".tmp" and renamed when complete. progress (optional) is called after
+// every step with the pages copied so far and the total.
+bool backupDatabase(sqlite3* db, const std::string& destName, BackupStats& stats,
+                    const std::function<void(int, int)>& progress, int pagesPerStep = 64, int pauseMs = 2);
+
+// --- Bulk Operations ---
+
+// Runs a bulk operation in a single transaction. affected receives the number of matching
+// products (dry run) or changed products.
+bool executeBulkOperation(sqlite3* db, const BulkRequest& request, long long& affected);
+
+// --- Batches ---
+
+// Runs a batch in one write transaction with one prepared statement per operation type,
+// filling result. Operations that are rejected, not found or refused by SQLite get their
+// status and the batch goes on; an error that ends the transaction marks the remaining
+// operations not run and returns false.
+bool executeBatchOperations(sqlite3* db, const std::vector<BatchOperation>& operations, BatchResult& result);
+
+// --- Cold Archive ---
+
+// Attaches the archive database as "archive", creating its products table if needed
+bool attachArchive(sqlite3* db, const std::string& archiveName);
+
+// Moves products that have been out of stock for at least minDays into the archive, in
+// batched transactions. dryRun only counts them.
+bool archiveProducts(sqlite3* db, const std::string& archiveName, int minDays, bool dryRun, long long& moved);
+
+#endif // INVENTORY_SQLITE_H
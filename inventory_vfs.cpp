@@ -0,0 +1,806 @@
+// Memory-backed SQLite VFS (see inventory_vfs.h)
+//
+// Main database files are read into 64 KiB blocks of anonymous memory when first opened and
+// shared by every connection of the process, which lock them against each other in memory
+// the way the unix VFS locks through the file system. Rollback journals are in-memory files
+// too. Everything else (temporary files, super-journals) goes to the default VFS.
+//
+// A flush copies the dirty blocks while no connection holds PENDING or EXCLUSIVE (so the
+// copy only contains committed transactions), writes them to "<file>-flush" with a
+// checksum, syncs it, applies it to the file and syncs again, then deletes the redo file.
+// Opening a file finishes a complete redo file left by a crash and discards a torn one.
+
+#include "inventory_vfs.h"
+#include "inventory_sqlite.h"
+
+#include <cerrno>   // For errno
+#include <cstring>  // For std::memcpy, std::strerror
+#include <fcntl.h>  // For open
+#include <memory>   // For std::shared_ptr
+#include <new>      // For placement new
+#include <semaphore.h> // For waking the flusher from a signal handler
+#include <sys/mman.h> // For anonymous memory blocks
+#include <sys/stat.h> // For fstat
+#include <thread>   // For the flusher
+#include <time.h>   // For clock_gettime
+#include <unistd.h> // For pread, pwrite, fsync
+
+static const char* const kMemoryVfsName = "inventory-memory";
+static const size_t kBlockSize = 64 * 1024; // Unit of allocation and of dirty tracking
+static const uint64_t kRedoEnd = ~0ULL;     // Offset of the record that ends a redo file
+
+// One file kept in memory, shared by every connection that has it open
+struct MemoryFile {
+    MemoryFile(const std::string& path, bool persistent)
+        : path(path), persistent(persistent), size(0), sizeChanged(false), opens(0), closingFlushes(0),
+          sharedLocks(0), reserved(nullptr), pending(nullptr) {}
+
+    ~MemoryFile() {
+        for (char* block : blocks) {
+            if (block) {
+                ::munmap(block, kBlockSize);
+            }
+        }
+    }
+
+    // Block index of byte offset, allocating the blocks up to it; nullptr when out of memory
+    char* block(size_t index) {
+        if (index >= blocks.size()) {
+            blocks.resize(index + 1, nullptr);
+            dirty.resize(index + 1, false);
+        }
+        if (!blocks[index]) {
+            void* memory = ::mmap(nullptr, kBlockSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            blocks[index] = memory == MAP_FAILED ? nullptr : static_cast<char*>(memory);
+        }
+        return blocks[index];
+    }
+
+    const std::string path;
+    const bool persistent;      // A database file, flushed to disk; journals only live in memory
+    std::mutex mutex;           // Guards everything below
+    std::vector<char*> blocks;  // nullptr until written (reads as zeros)
+    std::vector<bool> dirty;    // Blocks changed since the last flush
+    sqlite3_int64 size;
+    bool sizeChanged;
+    int opens;                  // Guarded by the VFS mutex, like closingFlushes
+    int closingFlushes;         // Flushes by last closes still running
+    int sharedLocks;            // Handles holding SHARED or more
+    const void* reserved;       // Handle holding RESERVED
+    const void* pending;        // Handle holding PENDING or EXCLUSIVE, which may be writing pages
+    std::mutex flushMutex;      // One flush of this file at a time
+};
+
+// What SQLite allocates for each file it opens through the VFS. Files handed to the default
+// VFS are opened in the same memory instead and never touch these fields.
+struct MemoryHandle {
+    sqlite3_file base;
+    std::shared_ptr<MemoryFile> file;
+    int lock;
+};
+
+// 64-bit FNV-1a, the redo file checksum
+static uint64_t checksum(const std::string& bytes, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(bytes[i])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool readWholeFile(const std::string& path, std::string& contents) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    bool ok = ::fstat(fd, &info) == 0;
+    contents.resize(ok ? static_cast<size_t>(info.st_size) : 0);
+    size_t done = 0;
+    while (ok && done < contents.size()) {
+        ssize_t n = ::pread(fd, &contents[done], contents.size() - done, static_cast<off_t>(done));
+        ok = n > 0 || (n < 0 && errno == EINTR);
+        done += n > 0 ? static_cast<size_t>(n) : 0;
+    }
+    ::close(fd);
+    return ok;
+}
+
+static bool writeAt(int fd, const char* bytes, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t n = ::pwrite(fd, bytes, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        length -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+// A redo file is "IVFL", then records (u64 offset, u32 length, bytes), then the end record
+// (kRedoEnd, u64 file size) and the u64 checksum of everything before it
+struct RedoRecord {
+    uint64_t offset;
+    size_t start; // Of the bytes in the redo buffer
+    uint32_t length;
+};
+
+static void appendRaw(std::string& redo, const void* bytes, size_t length) {
+    redo.append(static_cast<const char*>(bytes), length);
+}
+
+// Writes the records of redo into the file at path, cuts it to size and syncs it
+static bool applyRedo(const std::string& path, const std::string& redo, const std::vector<RedoRecord>& records,
+                      uint64_t size, std::string& error) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    bool ok = fd >= 0;
+    for (size_t i = 0; ok && i < records.size(); ++i) {
+        ok = writeAt(fd, redo.data() + records[i].start, records[i].length, records[i].offset);
+    }
+    ok = ok && ::ftruncate(fd, static_cast<off_t>(size)) == 0 && ::fsync(fd) == 0;
+    if (!ok) {
+        error = "can't write " + path + ": " + std::strerror(errno);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    return ok;
+}
+
+// Completes a flush that crashed after its redo file was written, or drops a torn redo file
+static bool recoverFlush(const std::string& path, std::string& error) {
+    std::string redoPath = path + "-flush";
+    std::string redo;
+    if (!readWholeFile(redoPath, redo)) {
+        return true; // No interrupted flush
+    }
+    std::vector<RedoRecord> records;
+    size_t position = 4;
+    bool complete = redo.compare(0, 4, "IVFL") == 0;
+    uint64_t size = 0;
+    while (complete) {
+        uint64_t offset;
+        if (position + sizeof(offset) > redo.size()) {
+            complete = false;
+            break;
+        }
+        std::memcpy(&offset, &redo[position], sizeof(offset));
+        position += sizeof(offset);
+        if (offset == kRedoEnd) {
+            uint64_t expected;
+            complete = position + sizeof(size) + sizeof(expected) == redo.size();
+            if (complete) {
+                std::memcpy(&size, &redo[position], sizeof(size));
+                std::memcpy(&expected, &redo[position + sizeof(size)], sizeof(expected));
+                complete = checksum(redo, position + sizeof(size)) == expected;
+            }
+            break;
+        }
+        RedoRecord record;
+        record.offset = offset;
+        if (position + sizeof(record.length) > redo.size()) {
+            complete = false;
+            break;
+        }
+        std::memcpy(&record.length, &redo[position], sizeof(record.length));
+        record.start = position + sizeof(record.length);
+        position = record.start + record.length;
+        complete = position <= redo.size();
+        records.push_back(record);
+    }
+    if (complete && !applyRedo(path, redo, records, size, error)) {
+        return false;
+    }
+    ::unlink(redoPath.c_str());
+    return true;
+}
+
+// Reads the database at path into file; creates an empty one if allowed
+static bool loadFile(MemoryFile& file, bool create, std::string& error) {
+    if (!recoverFlush(file.path, error)) {
+        return false;
+    }
+    std::string contents;
+    if (!readWholeFile(file.path, contents)) {
+        if (errno != ENOENT || !create) {
+            error = "can't read " + file.path + ": " + std::strerror(errno);
+            return false;
+        }
+        int fd = ::open(file.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            error = "can't create " + file.path + ": " + std::strerror(errno);
+            return false;
+        }
+        ::close(fd);
+    }
+    // A WAL database can be served from memory once its log is checkpointed away: switch the
+    // header back to rollback journaling, which is all this VFS supports
+    if (contents.size() >= 20 && (contents[18] == 2 || contents[19] == 2)) {
+        std::string wal;
+        if (readWholeFile(file.path + "-wal", wal) && !wal.empty()) {
+            error = file.path + " has an unmerged write-ahead log; open it once without memory storage first";
+            return false;
+        }
+        contents[18] = contents[19] = 1;
+        file.sizeChanged = true; // Flush the header change
+    }
+    for (size_t offset = 0; offset < contents.size(); offset += kBlockSize) {
+        char* block = file.block(offset / kBlockSize);
+        if (!block) {
+            error = "out of memory loading " + file.path;
+            return false;
+        }
+        std::memcpy(block, &contents[offset], std::min(kBlockSize, contents.size() - offset));
+    }
+    file.size = static_cast<sqlite3_int64>(contents.size());
+    if (file.sizeChanged && !file.dirty.empty()) {
+        file.dirty[0] = true;
+    }
+    return true;
+}
+
+// Writes the dirty blocks of file to disk. Returns true without writing while a connection
+// holds PENDING or EXCLUSIVE; the next flush catches up.
+static bool flushFile(MemoryFile& file, std::string& error) {
+    std::lock_guard<std::mutex> flushing(file.flushMutex);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string redo = "IVFL";
+    std::vector<RedoRecord> records;
+    std::vector<size_t> flushed;
+    uint64_t size;
+    {
+        std::lock_guard<std::mutex> lock(file.mutex);
+        if (file.pending) {
+            return true;
+        }
+        size = static_cast<uint64_t>(file.size);
+        for (size_t i = 0; i < file.blocks.size(); ++i) {
+            if (!file.dirty[i]) {
+                continue;
+            }
+            file.dirty[i] = false;
+            uint64_t offset = static_cast<uint64_t>(i) * kBlockSize;
+            if (offset >= size) {
+                continue; // Cut off by a truncate
+            }
+            RedoRecord record;
+            record.offset = offset;
+            record.length = static_cast<uint32_t>(std::min<uint64_t>(kBlockSize, size - offset));
+            appendRaw(redo, &record.offset, sizeof(record.offset));
+            appendRaw(redo, &record.length, sizeof(record.length));
+            record.start = redo.size();
+            if (file.blocks[i]) {
+                appendRaw(redo, file.blocks[i], record.length);
+            } else {
+                redo.append(record.length, '\0');
+            }
+            records.push_back(record);
+            flushed.push_back(i);
+        }
+        if (records.empty() && !file.sizeChanged) {
+            return true;
+        }
+        file.sizeChanged = false;
+    }
+    appendRaw(redo, &kRedoEnd, sizeof(kRedoEnd));
+    appendRaw(redo, &size, sizeof(size));
+    uint64_t sum = checksum(redo, redo.size());
+    appendRaw(redo, &sum, sizeof(sum));
+
+    std::string redoPath = file.path + "-flush";
+    int fd = ::open(redoPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && writeAt(fd, redo.data(), redo.size(), 0) && ::fsync(fd) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!ok) {
+        error = "can't write " + redoPath + ": " + std::strerror(errno);
+    }
+    ok = ok && applyRedo(file.path, redo, records, size, error);
+    if (ok) {
+        ::unlink(redoPath.c_str());
+        Metrics::instance().increment("vfs.flushes");
+        Metrics::instance().increment("vfs.bytes_flushed", static_cast<long long>(redo.size()));
+        Metrics::instance().recordDuration("vfs.flush", elapsedMs(start));
+        return true;
+    }
+    // Try again next time
+    std::lock_guard<std::mutex> lock(file.mutex);
+    for (size_t i : flushed) {
+        file.dirty[i] = true;
+    }
+    file.sizeChanged = true;
+    Metrics::instance().increment("vfs.flush_errors");
+    return false;
+}
+
+class MemoryVfs {
+public:
+    static MemoryVfs& instance() {
+        static MemoryVfs memoryVfs;
+        return memoryVfs;
+    }
+
+    bool enable(int flushIntervalMs, std::string& error);
+    void requestFlush() { ::sem_post(&wake); }
+    bool flushAll(std::string& error);
+    void stop();
+
+    // The shared file for path, loaded on first open; nullptr (with rc) if it can't be read
+    std::shared_ptr<MemoryFile> open(const std::string& path, bool persistent, bool create, int& rc) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<MemoryFile>& file = files[path];
+        if (!file) {
+            std::shared_ptr<MemoryFile> loaded(new MemoryFile(path, persistent));
+            std::string error;
+            // A journal left on disk by a crash without memory storage is loaded so SQLite can roll it back
+            std::string contents;
+            bool ok = persistent ? loadFile(*loaded, create, error)
+                                 : !readWholeFile(path, contents) || writeContents(*loaded, contents);
+            if (!ok) {
+                logMessage(LOG_LEVEL_ERROR, "Memory storage: " + error);
+                files.erase(path);
+                rc = SQLITE_CANTOPEN;
+                return nullptr;
+            }
+            file = loaded;
+        }
+        ++file->opens;
+        return file;
+    }
+
+    // Drops a handle's reference; the last close of a database file flushes it. The flush runs
+    // without the VFS mutex, so other opens and closes don't wait for its disk syncs; the file
+    // stays listed until it is done, so an open meanwhile picks up the memory copy instead of
+    // reading the file being written.
+    void close(const std::shared_ptr<MemoryFile>& file) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--file->opens > 0 || !file->persistent) {
+                return;
+            }
+            ++file->closingFlushes;
+        }
+        std::string error;
+        if (!flushFile(*file, error)) {
+            logMessage(LOG_LEVEL_ERROR, "Memory storage: " + error);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--file->closingFlushes == 0 && file->opens == 0) {
+            files.erase(file->path);
+        }
+    }
+
+    // Forgets an in-memory journal; false if path is not one
+    bool remove(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, std::shared_ptr<MemoryFile>>::iterator it = files.find(path);
+        if (it == files.end() || it->second->persistent) {
+            return false;
+        }
+        files.erase(it);
+        return true;
+    }
+
+    bool exists(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return files.count(path) > 0;
+    }
+
+    sqlite3_vfs* base; // The default VFS, for everything not kept in memory
+
+private:
+    MemoryVfs() : base(nullptr), registered(false), stopping(false), intervalMs(0) {
+        Metrics::instance(); // Constructed first, so it outlives the flusher
+        ::sem_init(&wake, 0, 0);
+    }
+
+    ~MemoryVfs() { stop(); }
+
+    static bool writeContents(MemoryFile& file, const std::string& contents) {
+        for (size_t offset = 0; offset < contents.size(); offset += kBlockSize) {
+            char* block = file.block(offset / kBlockSize);
+            if (!block) {
+                return false;
+            }
+            std::memcpy(block, &contents[offset], std::min(kBlockSize, contents.size() - offset));
+        }
+        file.size = static_cast<sqlite3_int64>(contents.size());
+        return true;
+    }
+
+    void runFlusher();
+
+    std::mutex mutex; // Guards files
+    std::map<std::string, std::shared_ptr<MemoryFile>> files;
+    sqlite3_vfs vfs;
+    bool registered;
+    std::atomic<bool> stopping;
+    int intervalMs;
+    sem_t wake;
+    std::thread flusher;
+};
+
+
+// --- VFS Methods ---
+
+static int memoryClose(sqlite3_file* file);
+static int memoryRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset);
+static int memoryWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset);
+static int memoryTruncate(sqlite3_file* file, sqlite3_int64 size);
+static int memorySync(sqlite3_file*, int) { return SQLITE_OK; } // Durability is the flusher's job
+static int memoryFileSize(sqlite3_file* file, sqlite3_int64* size);
+static int memoryLock(sqlite3_file* file, int level);
+static int memoryUnlock(sqlite3_file* file, int level);
+static int memoryCheckReservedLock(sqlite3_file* file, int* reserved);
+static int memoryFileControl(sqlite3_file*, int, void*) { return SQLITE_NOTFOUND; }
+static int memorySectorSize(sqlite3_file*) { return 4096; }
+static int memoryDeviceCharacteristics(sqlite3_file*) { return SQLITE_IOCAP_POWERSAFE_OVERWRITE; }
+
+// Version 1: no shared memory (so no WAL) and no memory-mapped I/O
+static const sqlite3_io_methods kMemoryIoMethods = {
+    1,                            // iVersion
+    memoryClose,                  // xClose
+    memoryRead,                   // xRead
+    memoryWrite,                  // xWrite
+    memoryTruncate,               // xTruncate
+    memorySync,                   // xSync
+    memoryFileSize,               // xFileSize
+    memoryLock,                   // xLock
+    memoryUnlock,                 // xUnlock
+    memoryCheckReservedLock,      // xCheckReservedLock
+    memoryFileControl,            // xFileControl
+    memorySectorSize,             // xSectorSize
+    memoryDeviceCharacteristics,  // xDeviceCharacteristics
+    nullptr,                      // xShmMap
+    nullptr,                      // xShmLock
+    nullptr,                      // xShmBarrier
+    nullptr,                      // xShmUnmap
+    nullptr,                      // xFetch
+    nullptr,                      // xUnfetch
+};
+
+static MemoryFile& fileOf(sqlite3_file* file) {
+    return *reinterpret_cast<MemoryHandle*>(file)->file;
+}
+
+static int memoryClose(sqlite3_file* file) {
+    MemoryHandle* handle = reinterpret_cast<MemoryHandle*>(file);
+    memoryUnlock(file, SQLITE_LOCK_NONE);
+    MemoryVfs::instance().close(handle->file);
+    handle->~MemoryHandle();
+    return SQLITE_OK;
+}
+
+static int memoryRead(sqlite3_file* file, void* buffer, int amount, sqlite3_int64 offset) {
+    MemoryFile& f = fileOf(file);
+    std::lock_guard<std::mutex> lock(f.mutex);
+    char* out = static_cast<char*>(buffer);
+    sqlite3_int64 available = std::max<sqlite3_int64>(0, std::min<sqlite3_int64>(amount, f.size - offset));
+    for (sqlite3_int64 done = 0; done < available;) {
+        size_t index = static_cast<size_t>((offset + done) / kBlockSize);
+        size_t within = static_cast<size_t>((offset + done) % kBlockSize);
+        size_t chunk = std::min<size_t>(kBlockSize - within, static_cast<size_t>(available - done));
+        if (index < f.blocks.size() && f.blocks[index]) {
+            std::memcpy(out + done, f.blocks[index] + within, chunk);
+        } else {
+            std::memset(out + done, 0, chunk);
+        }
+        done += static_cast<sqlite3_int64>(chunk);
+    }
+    if (available < amount) {
+        std::memset(out + available, 0, static_cast<size_t>(amount - available));
+        return SQLITE_IOERR_SHORT_READ;
+    }
+    return SQLITE_OK;
+}
+
+static int memoryWrite(sqlite3_file* file, const void* buffer, int amount, sqlite3_int64 offset) {
+    MemoryFile& f = fileOf(file);
+    std::lock_guard<std::mutex> lock(f.mutex);
+    const char* in = static_cast<const char*>(buffer);
+    for (sqlite3_int64 done = 0; done < amount;) {
+        size_t index = static_cast<size_t>((offset + done) / kBlockSize);
+        size_t within = static_cast<size_t>((offset + done) % kBlockSize);
+        size_t chunk = std::min<size_t>(kBlockSize - within, static_cast<size_t>(amount - done));
+        char* block = f.block(index);
+        if (!block) {
+            return SQLITE_IOERR_NOMEM;
+        }
+        std::memcpy(block + within, in + done, chunk);
+        f.dirty[index] = true;
+        done += static_cast<sqlite3_int64>(chunk);
+    }
+    f.size = std::max(f.size, offset + amount);
+    return SQLITE_OK;
+}
+
+static int memoryTruncate(sqlite3_file* file, sqlite3_int64 size) {
+    MemoryFile& f = fileOf(file);
+    std::lock_guard<std::mutex> lock(f.mutex);
+    if (size < f.size) {
+        size_t keep = static_cast<size_t>((size + kBlockSize - 1) / kBlockSize);
+        for (size_t i = keep; i < f.blocks.size(); ++i) {
+            if (f.blocks[i]) {
+                ::munmap(f.blocks[i], kBlockSize);
+                f.blocks[i] = nullptr;
+            }
+        }
+        // The rest of the last block must read as zeros if the file grows again
+        size_t within = static_cast<size_t>(size % kBlockSize);
+        if (within > 0 && keep - 1 < f.blocks.size() && f.blocks[keep - 1]) {
+            std::memset(f.blocks[keep - 1] + within, 0, kBlockSize - within);
+        }
+        f.size = size;
+        f.sizeChanged = true;
+    }
+    return SQLITE_OK;
+}
+
+static int memoryFileSize(sqlite3_file* file, sqlite3_int64* size) {
+    MemoryFile& f = fileOf(file);
+    std::lock_guard<std::mutex> lock(f.mutex);
+    *size = f.size;
+    return SQLITE_OK;
+}
+
+// The unix VFS's locking protocol, between the connections of this process
+static int memoryLock(sqlite3_file* file, int level) {
+    MemoryHandle* handle = reinterpret_cast<MemoryHandle*>(file);
+    MemoryFile& f = *handle->file;
+    std::lock_guard<std::mutex> lock(f.mutex);
+    if (handle->lock >= level) {
+        return SQLITE_OK;
+    }
+    if (level == SQLITE_LOCK_SHARED) {
+        if (f.pending) {
+            return SQLITE_BUSY; // A writer is waiting for the readers to leave
+        }
+        ++f.sharedLocks;
+    } else if (level == SQLITE_LOCK_RESERVED) {
+        if (f.reserved) {
+            return SQLITE_BUSY;
+        }
+        f.reserved = handle;
+    } else {
+        if ((f.reserved && f.reserved != handle) || (f.pending && f.pending != handle)) {
+            return SQLITE_BUSY;
+        }
+        f.pending = handle; // Keeps new readers out while the others finish
+        if (f.sharedLocks > 1) {
+            handle->lock = SQLITE_LOCK_PENDING;
+            return SQLITE_BUSY;
+        }
+    }
+    handle->lock = level;
+    return SQLITE_OK;
+}
+
+static int memoryUnlock(sqlite3_file* file, int level) {
+    MemoryHandle* handle = reinterpret_cast<MemoryHandle*>(file);
+    MemoryFile& f = *handle->file;
+    std::lock_guard<std::mutex> lock(f.mutex);
+    if (handle->lock <= level) {
+        return SQLITE_OK;
+    }
+    if (f.reserved == handle) {
+        f.reserved = nullptr;
+    }
+    if (f.pending == handle) {
+        f.pending = nullptr;
+    }
+    if (level == SQLITE_LOCK_NONE) {
+        --f.sharedLocks;
+    }
+    handle->lock = level;
+    return SQLITE_OK;
+}
+
+static int memoryCheckReservedLock(sqlite3_file* file, int* reserved) {
+    MemoryFile& f = fileOf(file);
+    std::lock_guard<std::mutex> lock(f.mutex);
+    *reserved = f.reserved != nullptr || f.pending != nullptr;
+    return SQLITE_OK;
+}
+
+static int memoryOpen(sqlite3_vfs*, const char* name, sqlite3_file* file, int flags, int* outFlags) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    bool database = (flags & SQLITE_OPEN_MAIN_DB) != 0;
+    if (!name || !(database || (flags & SQLITE_OPEN_MAIN_JOURNAL))) {
+        return base->xOpen(base, name, file, flags, outFlags);
+    }
+    int rc = SQLITE_OK;
+    bool create = (flags & SQLITE_OPEN_CREATE) != 0;
+    std::shared_ptr<MemoryFile> shared = MemoryVfs::instance().open(name, database, create, rc);
+    if (!shared) {
+        file->pMethods = nullptr; // Nothing to close
+        return rc;
+    }
+    MemoryHandle* handle = new (file) MemoryHandle();
+    handle->base.pMethods = &kMemoryIoMethods;
+    handle->file = shared;
+    handle->lock = SQLITE_LOCK_NONE;
+    if (outFlags) {
+        *outFlags = flags;
+    }
+    return SQLITE_OK;
+}
+
+// Deleting an in-memory journal also deletes a leftover copy on disk
+static int memoryDelete(sqlite3_vfs*, const char* name, int syncDir) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    if (!MemoryVfs::instance().remove(name)) {
+        return base->xDelete(base, name, syncDir);
+    }
+    int onDisk = 0;
+    if (base->xAccess(base, name, SQLITE_ACCESS_EXISTS, &onDisk) == SQLITE_OK && onDisk) {
+        return base->xDelete(base, name, syncDir);
+    }
+    return SQLITE_OK;
+}
+
+static int memoryAccess(sqlite3_vfs*, const char* name, int flags, int* result) {
+    if (MemoryVfs::instance().exists(name)) {
+        *result = 1;
+        return SQLITE_OK;
+    }
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    return base->xAccess(base, name, flags, result);
+}
+
+// The rest is the default VFS's
+static int memoryFullPathname(sqlite3_vfs*, const char* name, int size, char* out) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    return base->xFullPathname(base, name, size, out);
+}
+static void* memoryDlOpen(sqlite3_vfs*, const char* path) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    return base->xDlOpen(base, path);
+}
+static void memoryDlError(sqlite3_vfs*, int size, char* message) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    base->xDlError(base, size, message);
+}
+static void (*memoryDlSym(sqlite3_vfs*, void* library, const char* symbol))(void) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    return base->xDlSym(base, library, symbol);
+}
+static void memoryDlClose(sqlite3_vfs*, void* library) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    base->xDlClose(base, library);
+}
+static int memoryRandomness(sqlite3_vfs*, int size, char* out) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    return base->xRandomness(base, size, out);
+}
+static int memorySleep(sqlite3_vfs*, int microseconds) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    return base->xSleep(base, microseconds);
+}
+static int memoryCurrentTime(sqlite3_vfs*, double* now) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    return base->xCurrentTime(base, now);
+}
+static int memoryGetLastError(sqlite3_vfs*, int size, char* message) {
+    sqlite3_vfs* base = MemoryVfs::instance().base;
+    return base->xGetLastError ? base->xGetLastError(base, size, message) : 0;
+}
+
+
+// --- Flusher ---
+
+bool MemoryVfs::enable(int flushIntervalMs, std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (registered) {
+        error = "memory storage is already enabled";
+        return false;
+    }
+    installSqliteAllocator(); // sqlite3_vfs_find starts SQLite
+    base = sqlite3_vfs_find(nullptr);
+    if (!base) {
+        error = "SQLite has no default VFS";
+        return false;
+    }
+    std::memset(&vfs, 0, sizeof(vfs));
+    vfs.iVersion = 1;
+    vfs.szOsFile = std::max(static_cast<int>(sizeof(MemoryHandle)), base->szOsFile);
+    vfs.mxPathname = base->mxPathname;
+    vfs.zName = kMemoryVfsName;
+    vfs.xOpen = memoryOpen;
+    vfs.xDelete = memoryDelete;
+    vfs.xAccess = memoryAccess;
+    vfs.xFullPathname = memoryFullPathname;
+    vfs.xDlOpen = memoryDlOpen;
+    vfs.xDlError = memoryDlError;
+    vfs.xDlSym = memoryDlSym;
+    vfs.xDlClose = memoryDlClose;
+    vfs.xRandomness = memoryRandomness;
+    vfs.xSleep = memorySleep;
+    vfs.xCurrentTime = memoryCurrentTime;
+    vfs.xGetLastError = memoryGetLastError;
+    int rc = sqlite3_vfs_register(&vfs, 1);
+    if (rc != SQLITE_OK) {
+        error = std::string("can't register the memory VFS: ") + sqlite3_errstr(rc);
+        return false;
+    }
+    registered = true;
+    intervalMs = std::max(flushIntervalMs, 0);
+    flusher = std::thread(&MemoryVfs::runFlusher, this);
+    return true;
+}
+
+// Flushes every intervalMs (or only when woken, for 0) until stopped
+void MemoryVfs::runFlusher() {
+    while (!stopping) {
+        if (intervalMs > 0) {
+            timespec deadline;
+            ::clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += intervalMs / 1000;
+            deadline.tv_nsec += (intervalMs % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                ++deadline.tv_sec;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            while (::sem_timedwait(&wake, &deadline) != 0 && errno == EINTR) {
+            }
+        } else {
+            while (::sem_wait(&wake) != 0 && errno == EINTR) {
+            }
+        }
+        std::string error;
+        if (!stopping && !flushAll(error)) {
+            logMessage(LOG_LEVEL_ERROR, "Memory storage: " + error);
+        }
+    }
+}
+
+bool MemoryVfs::flushAll(std::string& error) {
+    std::vector<std::shared_ptr<MemoryFile>> databases;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::pair<const std::string, std::shared_ptr<MemoryFile>>& entry : files) {
+            if (entry.second->persistent) {
+                databases.push_back(entry.second);
+            }
+        }
+    }
+    bool ok = true;
+    for (const std::shared_ptr<MemoryFile>& file : databases) {
+        ok = flushFile(*file, error) && ok;
+    }
+    return ok;
+}
+
+void MemoryVfs::stop() {
+    if (!flusher.joinable()) {
+        return;
+    }
+    stopping = true;
+    requestFlush();
+    flusher.join();
+    std::string error;
+    if (!flushAll(error)) {
+        logMessage(LOG_LEVEL_ERROR, "Memory storage: " + error);
+    }
+}
+
+bool enableMemoryStorage(int flushIntervalMs, std::string& error) {
+    return MemoryVfs::instance().enable(flushIntervalMs, error);
+}
+
+void requestMemoryFlush() {
+    MemoryVfs::instance().requestFlush();
+}
+
+bool flushMemoryStorage(std::string& error) {
+    return MemoryVfs::instance().flushAll(error);
+}
+
+void stopMemoryStorage() {
+    MemoryVfs::instance().stop();
+}
@@ -0,0 +1,30 @@
+#ifndef INVENTORY_VFS_H
+#define INVENTORY_VFS_H
+
+// Memory-backed storage for the inventory library, for caches that can afford to lose the
+// last few seconds of changes but not the whole database. Once enabled, every database file
+// opened in the process (by InventoryDB or directly through SQLite) is read into anonymous
+// memory and served from there; a background flusher writes the changed pages back to the
+// file on a timer, on request and when the last connection to it closes. A flush goes
+// through a checksummed redo file next to the database, so a crash mid-flush leaves the
+// previous or the new state, never a mix. Rollback journals stay in memory, WAL is not
+// available, and no other process may open the files meanwhile. Linux only.
+
+#include <string>   // For using string objects
+
+// Registers the memory VFS as SQLite's default; call it before opening any database.
+// flushIntervalMs is the most time changes stay in memory only (0: flush only on request
+// and at close).
+bool enableMemoryStorage(int flushIntervalMs, std::string& error);
+
+// Wakes the flusher to write the changed pages now, without waiting for it. Safe to call
+// from a signal handler.
+void requestMemoryFlush();
+
+// Writes the changed pages of every open file now; false (with the reason) if one failed
+bool flushMemoryStorage(std::string& error);
+
+// Flushes one last time and stops the flusher; files still open are flushed when closed
+void stopMemoryStorage();
+
+#endif // INVENTORY_VFS_H
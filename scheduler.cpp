@@ -0,0 +1,154 @@
+// Work-stealing executor (see scheduler.h)
+
+#include "scheduler.h"
+
+#include <algorithm> // For std::max
+
+// The worker the current thread is, or -1 outside the pool
+static thread_local const TaskScheduler* currentScheduler = nullptr;
+static thread_local int currentWorker = -1;
+
+TaskScheduler& TaskScheduler::instance() {
+    static TaskScheduler scheduler(std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+    return scheduler;
+}
+
+TaskScheduler::TaskScheduler(int threads) : queued(0), waiters(0), stopping(false) {
+    for (int i = 0; i < std::max(threads, 1); ++i) {
+        workers.emplace_back(new Worker());
+    }
+    for (int i = 0; i < static_cast<int>(workers.size()); ++i) {
+        workers[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (const std::unique_ptr<Worker>& worker : workers) {
+        worker->thread.join();
+    }
+    // Tasks nobody picked up before shutdown are dropped
+    for (int p = 0; p < PRIORITY_COUNT; ++p) {
+        for (Task* task : injected[p]) {
+            delete task;
+        }
+        for (const std::unique_ptr<Worker>& worker : workers) {
+            while (Task* task = worker->deques[p].steal()) {
+                delete task;
+            }
+        }
+    }
+}
+
+void TaskScheduler::submit(std::function<void()> task, TaskPriority priority, TaskGroup* group) {
+    Task* queuedTask = new Task();
+    queuedTask->run = std::move(task);
+    queuedTask->group = group;
+    if (group) {
+        group->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    queued.fetch_add(1, std::memory_order_release);
+
+    bool wakeWaiters;
+    if (currentScheduler == this) {
+        // From inside the pool: stays on this worker, where its data is likely cached
+        workers[currentWorker]->deques[priority].push(queuedTask);
+        std::lock_guard<std::mutex> lock(mutex); // Pairs with the parked workers' check
+        wakeWaiters = waiters > 0;
+    } else {
+        std::lock_guard<std::mutex> lock(mutex);
+        injected[priority].push_back(queuedTask);
+        wakeWaiters = waiters > 0;
+    }
+    wakeup.notify_one();
+    if (wakeWaiters) {
+        progress.notify_all();
+    }
+}
+
+// Highest priority first: the worker's own deque (newest task), then the injection queue,
+// then stealing the oldest task of the other workers, starting with the next one over
+TaskScheduler::Task* TaskScheduler::findTask(int self) {
+    if (queued.load(std::memory_order_acquire) == 0) {
+        return nullptr;
+    }
+    int count = static_cast<int>(workers.size());
+    for (int p = 0; p < PRIORITY_COUNT; ++p) {
+        Task* task = self >= 0 ? workers[self]->deques[p].take() : nullptr;
+        if (!task) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!injected[p].empty()) {
+                task = injected[p].front();
+                injected[p].pop_front();
+            }
+        }
+        for (int i = 1; !task && i <= count; ++i) {
+            int victim = (std::max(self, 0) + i) % count;
+            if (victim != self) {
+                task = workers[victim]->deques[p].steal();
+            }
+        }
+        if (task) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void TaskScheduler::execute(Task* task) {
+    task->run();
+    // The group may be gone as soon as its count reaches zero; only the scheduler is touched after
+    bool groupDone = task->group && task->group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    delete task;
+    if (groupDone) {
+        std::lock_guard<std::mutex> lock(mutex); // Pairs with the waiters' check
+        progress.notify_all();
+    }
+}
+
+void TaskScheduler::workerLoop(int self) {
+    currentScheduler = this;
+    currentWorker = self;
+    for (;;) {
+        if (Task* task = findTask(self)) {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeup.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void TaskScheduler::wait(TaskGroup& group) {
+    int self = currentScheduler == this ? currentWorker : -1;
+    while (group.pending.load(std::memory_order_acquire) > 0) {
+        if (Task* task = findTask(self)) {
+            execute(task);
+            continue;
+        }
+        // The rest of the group is running elsewhere: sleep until it finishes or new work
+        // arrives that this thread could help with
+        std::unique_lock<std::mutex> lock(mutex);
+        ++waiters;
+        progress.wait(lock, [this, &group] {
+            return group.pending.load(std::memory_order_acquire) == 0 || queued.load(std::memory_order_acquire) > 0;
+        });
+        --waiters;
+    }
+}
+
+void TaskScheduler::parallelFor(int count, TaskPriority priority, const std::function<void(int)>& body) {
+    TaskGroup group;
+    for (int i = 0; i < count; ++i) {
+        submit([&body, i] { body(i); }, priority, &group);
+    }
+    wait(group);
+}
@@ -0,0 +1,167 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Shared work-stealing executor for parallel scans. Each worker thread owns one Chase-Lev
+// deque per priority: it pushes and pops its own tasks at the bottom (LIFO, so they are
+// still in its cache) and idle workers steal the oldest tasks from the top, trying their
+// neighbours first. Interactive tasks always run before batch tasks.
+
+#include <atomic>   // For the deque indices
+#include <condition_variable> // For parking idle workers
+#include <cstddef>  // For std::size_t
+#include <deque>    // For the injection queues
+#include <functional> // For std::function
+#include <memory>   // For std::unique_ptr
+#include <mutex>    // For std::mutex
+#include <thread>   // For the worker threads
+#include <vector>   // For using vector containers
+
+enum TaskPriority {
+    PRIORITY_INTERACTIVE, // Someone is waiting for it (menu commands, API calls)
+    PRIORITY_BATCH,       // Background work that may wait
+    PRIORITY_COUNT
+};
+
+// Chase-Lev work-stealing deque ("Correct and Efficient Work-Stealing for Weak Memory
+// Models", Lê et al. 2013). push() and take() are only called by the owning worker,
+// steal() by any thread. The ring grows when full; outgrown rings are kept until the deque
+// is destroyed because a concurrent thief may still be reading them.
+template <typename T>
+class ChaseLevDeque {
+public:
+    explicit ChaseLevDeque(std::size_t capacity = 256) : top(0), bottom(0), ring(new Ring(capacity)) {
+        retired.emplace_back(ring.load(std::memory_order_relaxed));
+    }
+
+    void push(T* item) {
+        long b = bottom.load(std::memory_order_relaxed);
+        long t = top.load(std::memory_order_acquire);
+        Ring* r = ring.load(std::memory_order_relaxed);
+        if (b - t > static_cast<long>(r->capacity) - 1) {
+            r = grow(r, t, b);
+        }
+        r->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Newest item, or nullptr if empty
+    T* take() {
+        long b = bottom.load(std::memory_order_relaxed) - 1;
+        Ring* r = ring.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T* item = r->get(b);
+        if (t == b) {
+            // Last item: race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Oldest item, or nullptr if empty or another thread won the race for it
+    T* steal() {
+        long t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+        T* item = ring.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+private:
+    struct Ring {
+        explicit Ring(std::size_t capacity) : capacity(capacity), items(new std::atomic<T*>[capacity]) {}
+        T* get(long i) const { return items[i & (capacity - 1)].load(std::memory_order_relaxed); }
+        void put(long i, T* item) { items[i & (capacity - 1)].store(item, std::memory_order_relaxed); }
+        std::size_t capacity; // A power of two
+        std::unique_ptr<std::atomic<T*>[]> items;
+    };
+
+    Ring* grow(Ring* old, long t, long b) {
+        Ring* bigger = new Ring(old->capacity * 2);
+        for (long i = t; i < b; ++i) {
+            bigger->put(i, old->get(i));
+        }
+        retired.emplace_back(bigger);
+        ring.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    // Owner and thieves write different ends; keep them on separate cache lines
+    alignas(64) std::atomic<long> top;
+    alignas(64) std::atomic<long> bottom;
+    alignas(64) std::atomic<Ring*> ring;
+    std::vector<std::unique_ptr<Ring>> retired; // Only touched by the owner
+};
+
+// Counts the outstanding tasks of one parallel operation
+class TaskGroup {
+public:
+    TaskGroup() : pending(0) {}
+    std::atomic<int> pending;
+};
+
+class TaskScheduler {
+public:
+    // The process-wide executor, one worker per hardware thread
+    static TaskScheduler& instance();
+
+    explicit TaskScheduler(int threads);
+    ~TaskScheduler();
+
+    int threadCount() const { return static_cast<int>(workers.size()); }
+
+    // Queues a task; group (optional) is signalled when it has run
+    void submit(std::function<void()> task, TaskPriority priority, TaskGroup* group = nullptr);
+
+    // Runs tasks until every task of group has finished. The caller works while there is
+    // work and only sleeps when there is none, so waiting from inside a task cannot deadlock
+    // the pool.
+    void wait(TaskGroup& group);
+
+    // Runs body(0) ... body(count - 1) as tasks and waits for all of them
+    void parallelFor(int count, TaskPriority priority, const std::function<void(int)>& body);
+
+private:
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    struct Task {
+        std::function<void()> run;
+        TaskGroup* group;
+    };
+
+    struct Worker {
+        ChaseLevDeque<Task> deques[PRIORITY_COUNT];
+        std::thread thread;
+    };
+
+    Task* findTask(int self);
+    void execute(Task* task);
+    void workerLoop(int self);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex; // Guards the injection queues, parking and waiters
+    std::condition_variable wakeup;   // Parked workers: a task was queued
+    std::condition_variable progress; // Sleeping wait() callers: a group finished or a task was queued
+    std::deque<Task*> injected[PRIORITY_COUNT]; // Tasks submitted from outside the pool
+    std::atomic<int> queued; // Tasks submitted and not yet picked up
+    int waiters;             // Callers asleep in wait()
+    bool stopping;
+};
+
+#endif // SCHEDULER_H
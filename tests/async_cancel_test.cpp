@@ -0,0 +1,102 @@
+// Cancellation of coroutine requests (see inventory_async.h): cancelling one request stops it
+// even while it shares another's execution, and never fails the requests it shares with.
+
+#include "catalog.h"
+#include "check.h"
+#include "inventory_async.h"
+
+#include <condition_variable> // For waiting on the requests
+#include <mutex>    // For the outcome
+#include <thread>   // For sleeping between the requests
+
+static const char* const kDbName = "async_cancel_test.db";
+
+// Fire-and-forget coroutine: starts at once and frees itself when done
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return DetachedTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Results of the requests of one test, by the order they were issued, and when each finished
+class Outcomes {
+public:
+    explicit Outcomes(int requests)
+        : results(requests), finishedMs(requests), start(std::chrono::steady_clock::now()) {}
+
+    void record(int index, const AsyncResult<std::vector<Product>>& result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        results[index] = result;
+        finishedMs[index] = elapsedSince(start);
+        ++finished;
+        done.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return finished == static_cast<int>(results.size()); });
+    }
+
+    std::vector<AsyncResult<std::vector<Product>>> results;
+    std::vector<double> finishedMs;
+
+private:
+    std::chrono::steady_clock::time_point start;
+    std::mutex mutex;
+    std::condition_variable done;
+    int finished = 0;
+};
+
+static DetachedTask search(AsyncInventoryDB& db, CancellationSource cancel, Outcomes& outcomes, int index) {
+    outcomes.record(index, co_await db.search(kMissing, cancel));
+}
+
+// The first request is cancelled while a second one, not cancelled, waits on its execution
+static void testCancelledLeaderIsNotShared(AsyncInventoryDB& db, double scanMs) {
+    CancellationSource cancel;
+    Outcomes outcomes(2);
+    search(db, cancel, outcomes, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    search(db, CancellationSource(), outcomes, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(scanMs / 4)));
+    cancel.cancel();
+    outcomes.wait();
+    CHECK(!outcomes.results[0].ok && outcomes.results[0].cancelled);
+    CHECK(outcomes.results[1].ok);
+}
+
+// A cancelled request that waits on another's execution returns well before that one does
+static void testCancelledFollowerStops(AsyncInventoryDB& db, double scanMs) {
+    CancellationSource cancel;
+    Outcomes outcomes(2);
+    search(db, CancellationSource(), outcomes, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    search(db, cancel, outcomes, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(scanMs / 8)));
+    cancel.cancel();
+    outcomes.wait();
+    CHECK(outcomes.results[0].ok);
+    CHECK(!outcomes.results[1].ok && outcomes.results[1].cancelled);
+    CHECK(outcomes.finishedMs[1] < outcomes.finishedMs[0]);
+}
+
+int main() {
+    double scanMs = 0;
+    if (!createSlowCatalog(kDbName, scanMs)) {
+        std::cerr << "Can't create " << kDbName << std::endl;
+        return 1;
+    }
+    AsyncInventoryDB db;
+    CHECK(db.open(kDbName, 2));
+    testCancelledLeaderIsNotShared(db, scanMs);
+    testCancelledFollowerStops(db, scanMs);
+    db.close();
+    std::remove(kDbName);
+    std::remove((std::string(kDbName) + "-wal").c_str());
+    std::remove((std::string(kDbName) + "-shm").c_str());
+    return checkResult();
+}
@@ -0,0 +1,107 @@
+// Bulk operations (see BulkRequest in inventory.h): each action changes exactly the products
+// its filter matches, and malformed requests change nothing.
+
+#include "check.h"
+#include "inventory.h"
+
+#include <climits>  // For INT_MAX
+#include <cstdio>   // For std::remove
+
+static const char* const kDbName = "bulk_operations_test.db";
+
+static Product productWithId(InventoryDB& store, int id) {
+    Product p = {0, "", 0, 0};
+    bool found = false;
+    CHECK(store.getProduct(id, p, found) && found);
+    return p;
+}
+
+static long long countProducts(InventoryDB& store) {
+    std::vector<Product> products;
+    CHECK(store.listProducts(products));
+    return static_cast<long long>(products.size());
+}
+
+static BulkRequest bolts(BulkAction action, long long amount) {
+    BulkRequest request;
+    request.action = action;
+    request.amount = amount;
+    request.dryRun = false;
+    request.filter.nameContains = "bolt";
+    return request;
+}
+
+static void testActions(InventoryDB& store, int boltId, int bigBoltId, int nutId) {
+    long long affected = 0;
+    BulkRequest dryRun = bolts(BULK_DELETE, 0);
+    dryRun.dryRun = true;
+    CHECK(store.bulkOperation(dryRun, affected) && affected == 2);
+    CHECK(countProducts(store) == 3);
+
+    // +12.5% of 1.99 is 2.23875, rounded half up to 2.24; 0.05 becomes 0.05625 -> 0.06
+    CHECK(store.bulkOperation(bolts(BULK_ADJUST_PRICE_PERCENT, 1250), affected) && affected == 2);
+    CHECK(productWithId(store, boltId).priceCents == 224);
+    CHECK(productWithId(store, bigBoltId).priceCents == 6);
+    CHECK(productWithId(store, nutId).priceCents == 100);
+
+    // Prices stop at zero
+    CHECK(store.bulkOperation(bolts(BULK_ADJUST_PRICE_ABSOLUTE, -100), affected) && affected == 2);
+    CHECK(productWithId(store, boltId).priceCents == 124);
+    CHECK(productWithId(store, bigBoltId).priceCents == 0);
+
+    BulkRequest lowStock = bolts(BULK_SET_QUANTITY, 40);
+    lowStock.filter.hasQuantityRange = true;
+    lowStock.filter.minQuantity = 0;
+    lowStock.filter.maxQuantity = 10;
+    CHECK(store.bulkOperation(lowStock, affected) && affected == 1);
+    CHECK(productWithId(store, boltId).quantity == 40);
+    CHECK(productWithId(store, bigBoltId).quantity == 20);
+
+    CHECK(store.bulkOperation(bolts(BULK_DELETE, 0), affected) && affected == 2);
+    CHECK(countProducts(store) == 1);
+}
+
+// An action value from outside the enum (as a malformed IPC request would carry) and a
+// quantity that does not fit an int are refused, dry run or not
+static void testInvalidRequests(InventoryDB& store) {
+    long long affected = -1;
+    BulkRequest unknown = bolts(static_cast<BulkAction>(7), 0);
+    unknown.filter.nameContains.clear();
+    CHECK(!store.bulkOperation(unknown, affected));
+    CHECK(store.lastError() == "unknown bulk action 7");
+    unknown.dryRun = true;
+    CHECK(!store.bulkOperation(unknown, affected));
+
+    BulkRequest negative = bolts(BULK_SET_QUANTITY, -1);
+    negative.filter.nameContains.clear();
+    CHECK(!store.bulkOperation(negative, affected));
+    BulkRequest tooLarge = bolts(BULK_SET_QUANTITY, static_cast<long long>(INT_MAX) + 1);
+    tooLarge.filter.nameContains.clear();
+    CHECK(!store.bulkOperation(tooLarge, affected));
+    CHECK(store.lastError().find("out of range") != std::string::npos);
+    CHECK(affected == -1);
+
+    CHECK(countProducts(store) == 1);
+    std::vector<Product> products;
+    CHECK(store.listProducts(products) && products.size() == 1 && products[0].quantity == 30);
+}
+
+int main() {
+    std::remove(kDbName);
+    InventoryDB store;
+    if (!store.open(kDbName)) {
+        std::cerr << "Can't open " << kDbName << ": " << store.lastError() << std::endl;
+        return 1;
+    }
+    int boltId = 0;
+    int bigBoltId = 0;
+    int nutId = 0;
+    CHECK(store.addProduct(Product{0, "Bolt", 5, 199}, boltId));
+    CHECK(store.addProduct(Product{0, "Big bolt", 20, 5}, bigBoltId));
+    CHECK(store.addProduct(Product{0, "Nut", 30, 100}, nutId));
+    testActions(store, boltId, bigBoltId, nutId);
+    testInvalidRequests(store);
+    store.close();
+    std::remove(kDbName);
+    return checkResult();
+}
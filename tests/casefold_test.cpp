@@ -0,0 +1,110 @@
+// Case folding (see "Searching by name" in README.md): names match regardless of case in
+// every script, and migration 6 refolds the normalized names that version 5 stored with only
+// A-Z folded, without writing to the replication change log.
+
+#include "check.h"
+#include "inventory.h"
+#include "inventory_sqlite.h"
+
+#include <cstdio>   // For std::remove
+
+static const char* const kDbName = "casefold_test.db";
+
+static void testFoldCase() {
+    CHECK(foldCase("ÉCROU Inox") == "écrou inox");
+    CHECK(foldCase("Гайка M8") == "гайка m8");
+    CHECK(foldCase("ΣΊΔΗΡΟ") == "σίδηρο");
+    CHECK(foldCase("STRASSE Straße") == "strasse straße"); // Simple folding: ß stays ß
+    CHECK(foldCase("plain ascii 123") == "plain ascii 123");
+    CHECK(foldCase(std::string("bad \xC3 byte \xFF")) == std::string("bad \xC3 byte \xFF"));
+    std::string longName(100, 'A');
+    CHECK(foldCase(longName + "É") == std::string(100, 'a') + "é"); // Past the 16-byte ASCII runs
+}
+
+static std::string namesOf(const std::vector<Product>& products) {
+    std::string names;
+    for (const Product& p : products) {
+        names += (names.empty() ? "" : ",") + p.name;
+    }
+    return names;
+}
+
+static void testSearches(InventoryDB& store) {
+    std::vector<Product> found;
+    CHECK(store.searchProducts("écrou", found) && namesOf(found) == "ÉCROU INOX");
+    CHECK(store.searchProducts("M8", found) && namesOf(found) == "Гайка M8");
+    CHECK(store.searchProducts("гайка", found) && namesOf(found) == "Гайка M8");
+    CHECK(store.searchProducts("STRASSE", found) && found.empty());
+    CHECK(store.searchProductsByPrefix("écrou   inox", found) && namesOf(found) == "ÉCROU INOX");
+    CHECK(store.searchProductsByPrefix("ГАЙ", found) && namesOf(found) == "Гайка M8");
+    CHECK(store.filterProductsByQuantity(100, found) && found.size() == 3);
+}
+
+// normalize_name as version 5 computed it: only A-Z lowercased
+static void asciiNormalizeName(sqlite3_context* context, int, sqlite3_value** args) {
+    std::string name(reinterpret_cast<const char*>(sqlite3_value_text(args[0])), sqlite3_value_bytes(args[0]));
+    std::string normalized;
+    for (char c : name) {
+        normalized += c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+    sqlite3_result_text(context, normalized.data(), static_cast<int>(normalized.size()), SQLITE_TRANSIENT);
+}
+
+// Turns the file back into version 5: ASCII-folded names and a change log with one entry
+static bool downgradeToVersion5() {
+    sqlite3* db = nullptr;
+    long long stale = 0;
+    bool done = sqlite3_open(kDbName, &db) == SQLITE_OK &&
+                sqlite3_create_function_v2(db, "normalize_name", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
+                                           asciiNormalizeName, nullptr, nullptr, nullptr) == SQLITE_OK &&
+                executeSQL(db, "UPDATE products SET name = name;"
+                               "CREATE TABLE change_log (seq INTEGER PRIMARY KEY AUTOINCREMENT, op TEXT NOT NULL, "
+                               "product_id INTEGER NOT NULL, name TEXT, quantity INTEGER, price_cents INTEGER, "
+                               "committed_at INTEGER NOT NULL);"
+                               "INSERT INTO change_log (op, product_id, committed_at) VALUES ('D', 99, 0);" +
+                               changeLogTriggersSQL() + "PRAGMA user_version = 5;") &&
+                queryInt64(db, "SELECT COUNT(*) FROM products WHERE name_normalized IN ('Écrou inox', 'Гайка m8');",
+                           stale);
+    sqlite3_close(db);
+    return done && stale == 2;
+}
+
+static long long queryOnce(InventoryDB& store, const std::string& sql) {
+    long long value = -1;
+    queryInt64(store.handle(), sql, value);
+    return value;
+}
+
+static void testMigration6() {
+    CHECK(downgradeToVersion5());
+    InventoryDB store;
+    CHECK(store.open(kDbName));
+    CHECK(queryOnce(store, "PRAGMA user_version;") == 6);
+    CHECK(queryOnce(store, "SELECT COUNT(*) FROM products WHERE name_normalized = normalize_name(name);") == 3);
+    CHECK(queryOnce(store, "SELECT COUNT(*) FROM change_log;") == 1);
+    CHECK(queryOnce(store, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'trigger' "
+                           "AND name = 'products_log_update';") == 1);
+    testSearches(store);
+
+    // The log triggers are back: later writes are logged again
+    bool found = false;
+    CHECK(store.updateProduct(Product{3, "Plain washer", 5, 10}, found) && found);
+    CHECK(queryOnce(store, "SELECT COUNT(*) FROM change_log;") == 2);
+}
+
+int main() {
+    testFoldCase();
+    std::remove(kDbName);
+    {
+        InventoryDB store;
+        CHECK(store.open(kDbName));
+        int id = 0;
+        CHECK(store.addProduct(Product{0, "ÉCROU INOX", 40, 120}, id));
+        CHECK(store.addProduct(Product{0, "Гайка M8", 30, 15}, id));
+        CHECK(store.addProduct(Product{0, "Straße sign", 2, 900}, id));
+        testSearches(store);
+    }
+    testMigration6();
+    std::remove(kDbName);
+    return checkResult();
+}
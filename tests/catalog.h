@@ -0,0 +1,47 @@
+#ifndef TESTS_CATALOG_H
+#define TESTS_CATALOG_H
+
+// A catalog large enough that a full search takes a few hundred milliseconds, so a test can
+// start a second caller, interrupt or cancel while the search is still running
+
+#include "inventory.h"
+#include "inventory_sqlite.h"
+
+#include <chrono>   // For timing the searches
+#include <cstdio>   // For std::remove
+
+static const char* const kMissing = "no such product"; // Scans every row, finds nothing
+
+static double elapsedSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Doubles the number of rows until a search for kMissing takes at least 300 ms; scanMs is
+// how long the last one took
+static bool createSlowCatalog(const char* fileName, double& scanMs) {
+    std::remove(fileName);
+    InventoryDB store;
+    if (!store.open(fileName)) {
+        return false;
+    }
+    std::vector<Product> found;
+    for (long long rows = 100000; rows <= 3200000; rows *= 2) {
+        if (!executeSQL(store.handle(),
+                        "WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM n WHERE x < " +
+                        std::to_string(rows) + ") INSERT INTO products (name, quantity, price_cents) "
+                        "SELECT 'Item ' || x, x % 50, 100 FROM n;")) {
+            return false;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!store.searchProducts(kMissing, found)) {
+            return false;
+        }
+        scanMs = elapsedSince(start);
+        if (scanMs >= 300) {
+            break;
+        }
+    }
+    return true;
+}
+
+#endif // TESTS_CATALOG_H
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Change data capture (see "Change data capture" in README.md): events carry the row as
+# committed, moves into the archive database publish only the delete, and capturing leaves
+# nothing behind in the database file.
+# Usage: change_capture_test.sh path/to/inventory
+
+inventory=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+fail() { echo "FAIL: $1"; exit 1; }
+
+# Add an out-of-stock product and another one, update the second, archive the first
+printf '1\nAnvil\n0\n1.00\n1\nBell\n5\n2.00\n3\n2\nBell XL\n6\n2.50\n12\n0\ny\n13\n' |
+    "$inventory" --db inv.db --cdc changes.log >menu.out 2>&1 || fail "menu session"
+
+printf '1\tI\t1\tAnvil\t0\t100\n2\tI\t2\tBell\t5\t200\n3\tU\t2\tBell XL\t6\t250\n4\tD\t1\n' >expected.log
+cmp -s expected.log changes.log || { echo "Got:"; cat changes.log; fail "unexpected change stream"; }
+if cat inv.db* | grep -q -e change_log -e cdc_; then fail "capture tables or triggers left in inv.db"; fi
+
+# A restarted session continues the sequence
+printf '4\n2\n13\n' | "$inventory" --db inv.db --cdc changes.log >restart.out 2>&1 || fail "second session"
+[ "$(tail -n 1 changes.log)" = "$(printf '5\tD\t2')" ] || fail "sequence not continued after restart"
+echo "PASS"
@@ -0,0 +1,26 @@
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+// Minimal assertions for the test programs: a failed CHECK reports where it failed and the
+// program carries on; main returns checkResult(), non-zero if any check failed.
+
+#include <iostream> // For reporting failures
+
+static int checkFailures = 0;
+
+#define CHECK(condition)                                                                        \
+    do {                                                                                        \
+        if (!(condition)) {                                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            ++checkFailures;                                                                    \
+        }                                                                                       \
+    } while (0)
+
+static int checkResult() {
+    if (checkFailures > 0) {
+        std::cerr << checkFailures << " check(s) failed" << std::endl;
+    }
+    return checkFailures == 0 ? 0 : 1;
+}
+
+#endif // TESTS_CHECK_H
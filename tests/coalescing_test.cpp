@@ -0,0 +1,112 @@
+// Shared reads (see InventoryDB in inventory.h): a caller that joins another's execution must
+// not inherit that caller's timeout or interruption, and must keep its own limits.
+
+#include "catalog.h"
+#include "check.h"
+
+#include <thread>   // For concurrent callers
+
+static const char* const kDbName = "coalescing_test.db";
+
+struct Outcome {
+    bool ok = false;
+    std::string error;
+    double ms = 0;
+};
+
+// Runs a search on its own connection, as another client of the same file would
+static std::thread searchInBackground(InventoryDB& store, Outcome& outcome) {
+    return std::thread([&store, &outcome] {
+        std::vector<Product> found;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        outcome.ok = store.searchProducts(kMissing, found);
+        outcome.ms = elapsedSince(start);
+        outcome.error = outcome.ok ? "" : store.lastError();
+    });
+}
+
+// The first caller times out; one that arrives meanwhile without a timeout still succeeds
+static void testLeaderTimeoutIsNotShared(double scanMs) {
+    InventoryDB leader;
+    InventoryDB follower;
+    CHECK(leader.open(kDbName) && follower.open(kDbName));
+    leader.setTimeout(static_cast<int>(scanMs / 2));
+    Outcome first;
+    Outcome second;
+    std::thread a = searchInBackground(leader, first);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::thread b = searchInBackground(follower, second);
+    a.join();
+    b.join();
+    CHECK(!first.ok && first.error.find("timed out") != std::string::npos);
+    CHECK(second.ok);
+}
+
+// The first caller is interrupted; one that joined it still gets its result
+static void testLeaderInterruptIsNotShared(double scanMs) {
+    InventoryDB leader;
+    InventoryDB follower;
+    CHECK(leader.open(kDbName) && follower.open(kDbName));
+    Outcome first;
+    Outcome second;
+    std::thread a = searchInBackground(leader, first);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::thread b = searchInBackground(follower, second);
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(scanMs / 4)));
+    leader.interrupt();
+    a.join();
+    b.join();
+    CHECK(!first.ok && first.error.find("interrupted") != std::string::npos);
+    CHECK(second.ok);
+}
+
+// A caller with a short timeout that joins a longer execution gives up at its own deadline
+static void testFollowerKeepsItsTimeout(double scanMs) {
+    InventoryDB leader;
+    InventoryDB follower;
+    CHECK(leader.open(kDbName) && follower.open(kDbName));
+    follower.setTimeout(static_cast<int>(scanMs / 8) + 1);
+    Outcome first;
+    Outcome second;
+    std::thread a = searchInBackground(leader, first);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::thread b = searchInBackground(follower, second);
+    b.join();
+    a.join();
+    CHECK(first.ok);
+    CHECK(!second.ok && second.error.find("timed out") != std::string::npos);
+    CHECK(second.ms < scanMs);
+}
+
+// interrupt() stops a caller that is waiting on someone else's execution
+static void testFollowerCanBeInterrupted(double scanMs) {
+    InventoryDB leader;
+    InventoryDB follower;
+    CHECK(leader.open(kDbName) && follower.open(kDbName));
+    Outcome first;
+    Outcome second;
+    std::thread a = searchInBackground(leader, first);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::thread b = searchInBackground(follower, second);
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(scanMs / 8)));
+    follower.interrupt();
+    b.join();
+    a.join();
+    CHECK(first.ok);
+    CHECK(!second.ok && second.error.find("interrupted") != std::string::npos);
+    CHECK(second.ms < scanMs);
+}
+
+int main() {
+    double scanMs = 0;
+    if (!createSlowCatalog(kDbName, scanMs)) {
+        std::cerr << "Can't create " << kDbName << std::endl;
+        return 1;
+    }
+    testLeaderTimeoutIsNotShared(scanMs);
+    testLeaderInterruptIsNotShared(scanMs);
+    testFollowerKeepsItsTimeout(scanMs);
+    testFollowerCanBeInterrupted(scanMs);
+    std::remove(kDbName);
+    return checkResult();
+}
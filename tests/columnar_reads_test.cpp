@@ -0,0 +1,124 @@
+// Columnar reads (see "Columnar reads" in README.md): the products_columnar virtual table
+// answers the same queries as the products B-tree, with and without pushed-down constraints,
+// and the first read after a write sees the write.
+
+#include "check.h"
+#include "inventory.h"
+#include "inventory_sqlite.h"
+
+#include <cstdio>   // For std::remove
+
+static const char* const kDbName = "columnar_reads_test.db";
+
+// The rows of a query as "id|name|quantity|price" lines, or "error" if it failed
+static std::string rowsOf(sqlite3* db, const std::string& sql) {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        return "error";
+    }
+    std::string rows;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        for (int column = 0; column < sqlite3_column_count(stmt); ++column) {
+            const unsigned char* text = sqlite3_column_text(stmt, column);
+            rows += text ? reinterpret_cast<const char*>(text) : "NULL";
+            rows += column + 1 < sqlite3_column_count(stmt) ? "|" : "\n";
+        }
+    }
+    bool done = sqlite3_errcode(db) == SQLITE_DONE || sqlite3_errcode(db) == SQLITE_OK;
+    sqlite3_finalize(stmt);
+    return done ? rows : "error";
+}
+
+// Runs the query on products and on products_columnar and compares the rows
+static bool sameAsBtree(sqlite3* db, const std::string& whereAndOrder) {
+    std::string columns = "SELECT id, name, quantity, price_cents FROM ";
+    std::string btree = rowsOf(db, columns + "products " + whereAndOrder);
+    std::string columnar = rowsOf(db, columns + "products_columnar " + whereAndOrder);
+    if (btree != columnar || btree == "error") {
+        std::cerr << whereAndOrder << ": B-tree and columnar rows differ" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static void testPushedDownConstraints(sqlite3* db) {
+    CHECK(sameAsBtree(db, "ORDER BY id"));
+    CHECK(sameAsBtree(db, "WHERE id = 777"));
+    CHECK(sameAsBtree(db, "WHERE id = 999999"));
+    CHECK(sameAsBtree(db, "WHERE id BETWEEN 100 AND 140 ORDER BY id"));
+    CHECK(sameAsBtree(db, "WHERE id > 2990 ORDER BY id"));
+    CHECK(sameAsBtree(db, "WHERE quantity < 3 ORDER BY quantity, id"));
+    CHECK(sameAsBtree(db, "WHERE quantity >= 10 AND quantity <= 12 AND price_cents > 2500 ORDER BY id"));
+    CHECK(sameAsBtree(db, "WHERE price_cents = 1234"));
+    CHECK(sameAsBtree(db, "WHERE name LIKE '%item 12%' ORDER BY id"));
+    CHECK(sameAsBtree(db, "WHERE name LIKE '%12%' AND quantity < 20 ORDER BY id"));
+    CHECK(sameAsBtree(db, "WHERE name LIKE 'no such%'"));
+}
+
+static bool sameProducts(const std::vector<Product>& a, const std::vector<Product>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].id != b[i].id || a[i].name != b[i].name || a[i].quantity != b[i].quantity ||
+            a[i].priceCents != b[i].priceCents) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Reads {
+    std::vector<Product> all;
+    std::vector<Product> found;
+    std::vector<Product> low;
+    Product one;
+    bool oneFound = false;
+};
+
+static bool read(InventoryDB& store, int id, Reads& reads) {
+    return store.listProducts(reads.all) && store.searchProducts("item 2", reads.found) &&
+           store.filterProductsByQuantity(4, reads.low) && store.getProduct(id, reads.one, reads.oneFound);
+}
+
+static bool sameReads(const Reads& a, const Reads& b) {
+    return sameProducts(a.all, b.all) && sameProducts(a.found, b.found) && sameProducts(a.low, b.low) &&
+           a.oneFound == b.oneFound && (!a.oneFound || a.one.quantity == b.one.quantity);
+}
+
+// The store's reads agree with the B-tree, also right after each kind of write
+static void testStoreReads(InventoryDB& store) {
+    Reads btree;
+    Reads columnar;
+    CHECK(read(store, 20, btree) && !btree.low.empty() && !btree.found.empty());
+    CHECK(store.setColumnarReads(true) && store.columnarReads());
+    CHECK(read(store, 20, columnar) && sameReads(columnar, btree));
+
+    int id = 0;
+    bool found = false;
+    CHECK(store.addProduct(Product{0, "Item 2 new", 1, 50}, id));
+    CHECK(store.updateProduct(Product{20, "Item 20", 0, 2000}, found) && found);
+    CHECK(store.deleteProduct(21, found) && found);
+    CHECK(read(store, 20, columnar));
+    CHECK(columnar.one.quantity == 0 && columnar.all.size() == btree.all.size());
+    CHECK(store.setColumnarReads(false));
+    CHECK(read(store, 20, btree) && sameReads(columnar, btree));
+    CHECK(sameAsBtree(store.handle(), "WHERE quantity < 4 ORDER BY quantity, id"));
+}
+
+int main() {
+    std::remove(kDbName);
+    InventoryDB store;
+    CHECK(store.open(kDbName));
+    CHECK(executeSQL(store.handle(),
+                     "WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM n WHERE x < 3000) "
+                     "INSERT INTO products (name, quantity, price_cents) "
+                     "SELECT 'Item ' || x, (x * 7) % 40, (x * 37) % 5000 FROM n;"));
+    CHECK(store.setColumnarReads(true));
+    testPushedDownConstraints(store.handle());
+    CHECK(store.setColumnarReads(false));
+    testStoreReads(store);
+    store.close();
+    std::remove(kDbName);
+    return checkResult();
+}
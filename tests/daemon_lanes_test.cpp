@@ -0,0 +1,129 @@
+// Daemon lanes (see "Daemon mode" in README.md): a point read is answered while a scan holds
+// the scans lane, scans that wait past the lane's queue deadline are refused as overloaded,
+// and STATS counts them.
+// Usage: daemon_lanes_test path/to/inventory
+
+#include "catalog.h"
+#include "check.h"
+#include "inventory_shm.h"
+
+#include <csignal>  // For SIGTERM
+#include <fcntl.h>  // For open
+#include <sys/wait.h> // For waitpid
+#include <thread>   // For the concurrent clients
+#include <unistd.h> // For fork, execv
+
+static const char* const kDbName = "daemon_lanes_test.db";
+static const char* const kSocketPath = "daemon_lanes_test.sock";
+
+// Starts the daemon with a scans lane that runs one request and lets none wait
+static pid_t startDaemon(const char* program) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        dup2(devNull, STDERR_FILENO);
+        execl(program, program, "--db", kDbName, "--daemon", kSocketPath, "--lane", "scans=1,1,1,60000",
+              static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+
+static bool connectWithRetry(ShmInventoryClient& client) {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        if (client.connect(kSocketPath)) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+static bool startsWith(const std::string& text, const std::string& prefix) {
+    return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Field of the scans lane's STATS line: 0 name, 1 queued, 2 running, 3 completed, 4 shed
+static long long scansStat(const std::string& stats, size_t field) {
+    std::string::size_type start = stats.find("LANE\tscans\t");
+    if (start == std::string::npos) {
+        return -1;
+    }
+    start += 5;
+    for (size_t i = 0; i < field; ++i) {
+        start = stats.find('\t', start) + 1;
+    }
+    return std::strtoll(stats.c_str() + start, nullptr, 10);
+}
+
+// A full scan on a connection of its own; response stays empty if the request failed
+static void searchMissing(std::string& response) {
+    ShmInventoryClient own;
+    if (!own.connect(kSocketPath) || !own.request(std::string("SEARCH\t") + kMissing, response)) {
+        response.clear();
+    }
+}
+
+static void testLanes() {
+    ShmInventoryClient client;
+    CHECK(connectWithRetry(client));
+    std::string response;
+    CHECK(client.request("PING", response) && response == "OK\n");
+    int id = 0;
+    CHECK(client.addProduct(Product{0, "Gauge", 4, 900}, id) && id > 0);
+
+    // Each client thread only records its response; the checks run once they have joined
+    std::string leader;
+    std::thread scan([&leader] { searchMissing(leader); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::string waiting[2];
+    std::vector<std::thread> waiters;
+    for (std::string& result : waiting) {
+        waiters.emplace_back([&result] { searchMissing(result); });
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Product product;
+    bool found = false;
+    CHECK(client.getProduct(id, product, found) && found && product.name == "Gauge");
+    double getMs = elapsedSince(start);
+
+    scan.join();
+    for (std::thread& waiter : waiters) {
+        waiter.join();
+    }
+    CHECK(leader == "OK\n");
+    CHECK(getMs < 100);
+    for (const std::string& result : waiting) {
+        CHECK(startsWith(result, "ERR\toverloaded: scans"));
+    }
+
+    CHECK(client.request("STATS", response));
+    CHECK(scansStat(response, 3) == 1 && scansStat(response, 4) == 2);
+    CHECK(response.find("LANE\twrites\t") != std::string::npos && response.find("\nOK\n") != std::string::npos);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: daemon_lanes_test path/to/inventory" << std::endl;
+        return 2;
+    }
+    double scanMs = 0;
+    CHECK(createSlowCatalog(kDbName, scanMs));
+    std::remove(kSocketPath);
+    pid_t daemon = startDaemon(argv[1]);
+    CHECK(daemon > 0);
+    if (daemon > 0) {
+        testLanes();
+        kill(daemon, SIGTERM);
+        int status = 0;
+        CHECK(waitpid(daemon, &status, 0) == daemon && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    std::remove(kSocketPath);
+    std::remove(kDbName);
+    std::remove((std::string(kDbName) + "-wal").c_str());
+    std::remove((std::string(kDbName) + "-shm").c_str());
+    return checkResult();
+}
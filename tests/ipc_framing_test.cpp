@@ -0,0 +1,112 @@
+// Framing limits of the batch envelopes and the shared-memory rings (see inventory_ipc.h)
+
+#include "check.h"
+#include "inventory_ipc.h"
+
+#include <cstring>  // For std::memcpy
+#include <memory>   // For std::unique_ptr
+#include <sstream>  // For in-memory batch streams
+
+static void appendLittleEndian(std::string& out, int size, uint64_t value) {
+    for (int i = 0; i < size; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static std::string batchHeader(uint32_t count) {
+    std::string header = "INVB";
+    appendLittleEndian(header, 4, count);
+    return header;
+}
+
+static void testWellFormedBatch() {
+    std::string request = batchHeader(2);
+    appendLittleEndian(request, 1, BATCH_ADD);
+    appendLittleEndian(request, 4, 5);   // Quantity
+    appendLittleEndian(request, 8, 250); // Price in cents
+    appendLittleEndian(request, 2, 3);
+    request += "Nut";
+    appendLittleEndian(request, 1, BATCH_ADJUST);
+    appendLittleEndian(request, 4, 7);                      // Id
+    appendLittleEndian(request, 4, static_cast<uint32_t>(-2)); // Delta
+
+    std::istringstream in(request);
+    std::vector<BatchOperation> operations;
+    std::string error;
+    CHECK(readBatchRequest(in, operations, error));
+    CHECK(error.empty());
+    CHECK(operations.size() == 2);
+    CHECK(operations[0].type == BATCH_ADD && operations[0].product.name == "Nut" &&
+          operations[0].product.quantity == 5 && operations[0].product.priceCents == 250);
+    CHECK(operations[1].type == BATCH_ADJUST && operations[1].product.id == 7 && operations[1].quantityDelta == -2);
+    CHECK(!readBatchRequest(in, operations, error) && error.empty()); // End of input
+}
+
+static void testOversizedCount() {
+    std::istringstream in(batchHeader(kMaxBatchOperations + 1));
+    std::vector<BatchOperation> operations;
+    std::string error;
+    CHECK(!readBatchRequest(in, operations, error));
+    CHECK(error.find("over the limit") != std::string::npos);
+}
+
+// A header announcing the largest allowed batch, with no operations behind it, must not
+// allocate for all of them
+static void testHeaderWithoutPayload() {
+    std::istringstream in(batchHeader(kMaxBatchOperations));
+    std::vector<BatchOperation> operations;
+    std::string error;
+    CHECK(!readBatchRequest(in, operations, error));
+    CHECK(error == "batch request ends in the middle of an operation");
+    CHECK(operations.capacity() < 4096);
+}
+
+static void testTruncatedAndUnknownOperations() {
+    std::string truncated = batchHeader(1);
+    appendLittleEndian(truncated, 1, BATCH_DELETE);
+    appendLittleEndian(truncated, 2, 9); // Half an id
+    std::istringstream truncatedIn(truncated);
+    std::vector<BatchOperation> operations;
+    std::string error;
+    CHECK(!readBatchRequest(truncatedIn, operations, error));
+    CHECK(error == "batch request ends in the middle of an operation");
+
+    std::string unknown = batchHeader(1);
+    appendLittleEndian(unknown, 1, 99);
+    std::istringstream unknownIn(unknown);
+    CHECK(!readBatchRequest(unknownIn, operations, error));
+    CHECK(error == "unknown operation type 99");
+}
+
+static void testShmMessageLimits() {
+    std::unique_ptr<ShmChannelLayout> channel(new ShmChannelLayout());
+    ShmRing producer(&channel->requests, channel->requestData);
+    ShmRing consumer(&channel->requests, channel->requestData);
+    std::function<bool()> alive = [] { return true; };
+
+    std::string message;
+    CHECK(producer.writeMessage("PING", alive));
+    CHECK(consumer.readMessage(message, ShmChannelLayout::kRingBytes, alive));
+    CHECK(message == "PING");
+
+    CHECK(producer.writeMessage("UPDATE\t1", alive));
+    CHECK(!consumer.readMessage(message, 4, alive));
+
+    // A peer announcing a 4 GiB message is refused before anything is allocated for it
+    ShmRing forged(&channel->responses, channel->responseData);
+    uint32_t length = 0xFFFFFFF0u;
+    std::memcpy(channel->responseData, &length, sizeof(length));
+    channel->responses.tail.store(sizeof(length));
+    message.clear();
+    CHECK(!forged.readMessage(message, ShmChannelLayout::kRingBytes, alive));
+    CHECK(message.capacity() < ShmChannelLayout::kRingBytes);
+}
+
+int main() {
+    testWellFormedBatch();
+    testOversizedCount();
+    testHeaderWithoutPayload();
+    testTruncatedAndUnknownOperations();
+    testShmMessageLimits();
+    return checkResult();
+}
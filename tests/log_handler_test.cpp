@@ -0,0 +1,86 @@
+// Library diagnostics (see setLogHandler in inventory.h): they reach the handler, and without
+// one the library writes nothing to stdout or stderr, even while it migrates an old file.
+
+#include "check.h"
+#include "inventory.h"
+#include "inventory_sqlite.h"
+
+#include <cstdio>   // For std::remove, std::fflush
+#include <fcntl.h>  // For open
+#include <unistd.h> // For dup, dup2
+
+static const char* const kDbName = "log_handler_test.db";
+static const char* const kOutputName = "log_handler_test.out";
+
+// A products table from before prices were stored as cents, which open() has to migrate
+static bool createPreCentsDatabase() {
+    std::remove(kDbName);
+    sqlite3* db = nullptr;
+    bool created = sqlite3_open(kDbName, &db) == SQLITE_OK &&
+                   executeSQL(db, "CREATE TABLE products (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT NOT NULL, "
+                                  "quantity INTEGER NOT NULL, price REAL NOT NULL);"
+                                  "INSERT INTO products (name, quantity, price) VALUES ('Washer', 3, 0.25);");
+    sqlite3_close(db);
+    return created;
+}
+
+// Opens the file with stdout and stderr sent to kOutputName; returns how many bytes they got
+static long openWithOutputCaptured() {
+    std::fflush(stdout);
+    std::fflush(stderr);
+    int savedOut = ::dup(1);
+    int savedErr = ::dup(2);
+    int capture = ::open(kOutputName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ::dup2(capture, 1);
+    ::dup2(capture, 2);
+    {
+        InventoryDB store;
+        CHECK(store.open(kDbName));
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    std::fflush(stderr);
+    long written = ::lseek(capture, 0, SEEK_END);
+    ::dup2(savedOut, 1);
+    ::dup2(savedErr, 2);
+    ::close(capture);
+    ::close(savedOut);
+    ::close(savedErr);
+    std::remove(kOutputName);
+    return written;
+}
+
+static void testSilentWithoutHandler() {
+    CHECK(createPreCentsDatabase());
+    CHECK(openWithOutputCaptured() == 0);
+}
+
+static void testHandlerGetsMigrationMessages() {
+    CHECK(createPreCentsDatabase());
+    std::vector<std::pair<LogLevel, std::string>> lines;
+    setLogHandler([&lines](LogLevel level, const std::string& message) {
+        lines.push_back(std::make_pair(level, message));
+    });
+    CHECK(openWithOutputCaptured() == 0);
+    setLogHandler(nullptr);
+
+    bool converted = false;
+    for (const std::pair<LogLevel, std::string>& line : lines) {
+        converted = converted ||
+                    (line.first == LOG_LEVEL_INFO && line.second.find("to integer cents") != std::string::npos);
+    }
+    CHECK(converted);
+
+    InventoryDB store;
+    std::vector<Product> products;
+    CHECK(store.open(kDbName) && store.listProducts(products));
+    CHECK(products.size() == 1 && products[0].priceCents == 25);
+}
+
+int main() {
+    testSilentWithoutHandler();
+    testHandlerGetsMigrationMessages();
+    std::remove(kDbName);
+    return checkResult();
+}
@@ -0,0 +1,75 @@
+// Memory storage (see inventory_vfs.h): flushes reach the file, the last close flushes, and
+// connections opened and closed concurrently on one file lose nothing.
+
+#include "check.h"
+#include "inventory.h"
+#include "inventory_sqlite.h"
+#include "inventory_vfs.h"
+
+#include <cstdio>   // For std::remove
+#include <thread>   // For concurrent opens and closes
+#include <unistd.h> // For access
+
+static const char* const kDbName = "memory_storage_test.db";
+
+// Counts the products in the file on disk, reading around the memory VFS
+static long long productsOnDisk() {
+    sqlite3* db = nullptr;
+    long long count = -1;
+    if (sqlite3_open_v2(kDbName, &db, SQLITE_OPEN_READONLY, "unix") == SQLITE_OK) {
+        queryInt64(db, "SELECT COUNT(*) FROM products;", count);
+    }
+    sqlite3_close(db);
+    return count;
+}
+
+static void testFlushAndClose() {
+    InventoryDB store;
+    CHECK(store.open(kDbName));
+    int id = 0;
+    CHECK(store.addProduct(Product{0, "Flushed", 1, 100}, id));
+    std::string error;
+    CHECK(flushMemoryStorage(error));
+    CHECK(productsOnDisk() == 1);
+
+    CHECK(store.addProduct(Product{0, "Closed", 2, 200}, id));
+    store.close();
+    CHECK(productsOnDisk() == 2);
+    CHECK(::access((std::string(kDbName) + "-flush").c_str(), F_OK) != 0); // Redo file removed
+}
+
+// Each thread opens the file, adds a product and closes it again, so last closes (which
+// flush) race with opens of the same file
+static void testConcurrentOpenAndClose() {
+    const int kThreads = 4;
+    const int kRounds = 10;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back(std::thread([t] {
+            for (int round = 0; round < kRounds; ++round) {
+                InventoryDB store;
+                int id = 0;
+                CHECK(store.open(kDbName));
+                CHECK(store.addProduct(Product{0, "Thread " + std::to_string(t), round, 100}, id));
+            }
+        }));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(productsOnDisk() == 2 + kThreads * kRounds);
+}
+
+int main() {
+    std::remove(kDbName);
+    std::string error;
+    if (!enableMemoryStorage(0, error)) {
+        std::cerr << "Can't enable memory storage: " << error << std::endl;
+        return 1;
+    }
+    testFlushAndClose();
+    testConcurrentOpenAndClose();
+    stopMemoryStorage();
+    std::remove(kDbName);
+    return checkResult();
+}
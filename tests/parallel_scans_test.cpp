@@ -0,0 +1,101 @@
+// Parallel scans (see "Parallel scans" in README.md): the work-stealing pool runs every task
+// once, waiting from inside a task does not deadlock, and partitioned scans return what the
+// serial ones do.
+
+#include "check.h"
+#include "inventory.h"
+#include "inventory_sqlite.h"
+#include "scheduler.h"
+
+#include <atomic>   // For counting task runs
+#include <cstdio>   // For std::remove
+
+static const char* const kDbName = "parallel_scans_test.db";
+
+static void testParallelFor() {
+    TaskScheduler scheduler(4);
+    std::vector<std::atomic<int>> runs(1000);
+    scheduler.parallelFor(1000, PRIORITY_INTERACTIVE, [&runs](int i) { ++runs[i]; });
+    bool once = true;
+    for (std::atomic<int>& count : runs) {
+        once = once && count == 1;
+    }
+    CHECK(once);
+
+    // Each outer task waits for its own inner tasks, more of them than there are workers
+    std::atomic<int> inner(0);
+    scheduler.parallelFor(16, PRIORITY_BATCH, [&scheduler, &inner](int) {
+        scheduler.parallelFor(16, PRIORITY_INTERACTIVE, [&inner](int) { ++inner; });
+    });
+    CHECK(inner == 256);
+
+    TaskGroup group;
+    std::atomic<int> submitted(0);
+    for (int i = 0; i < 50; ++i) {
+        scheduler.submit([&submitted] { ++submitted; }, i % 2 ? PRIORITY_BATCH : PRIORITY_INTERACTIVE, &group);
+    }
+    scheduler.wait(group);
+    CHECK(submitted == 50 && group.pending == 0);
+}
+
+struct ScanResults {
+    std::vector<Product> found;
+    std::vector<Product> low;
+    InventoryReport report;
+    long long matching = 0;
+};
+
+static bool scan(InventoryDB& store, ScanResults& results) {
+    BulkRequest request;
+    request.action = BULK_SET_QUANTITY;
+    request.filter.nameContains = "7";
+    request.filter.hasQuantityRange = true;
+    request.filter.minQuantity = 10;
+    request.filter.maxQuantity = 30;
+    return store.searchProducts("item 1", results.found) && store.filterProductsByQuantity(5, results.low) &&
+           store.generateReport(results.report) && store.bulkOperation(request, results.matching);
+}
+
+static bool sameIds(const std::vector<Product>& a, const std::vector<Product>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].id != b[i].id || a[i].quantity != b[i].quantity) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testPartitionedScans() {
+    std::remove(kDbName);
+    InventoryDB store;
+    CHECK(store.open(kDbName));
+    CHECK(executeSQL(store.handle(),
+                     "WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM n WHERE x < 20000) "
+                     "INSERT INTO products (name, quantity, price_cents) SELECT 'Item ' || x, x % 50, x FROM n;"));
+
+    ScanResults serial;
+    CHECK(scan(store, serial));
+    CHECK(!serial.found.empty() && !serial.low.empty() && serial.matching > 0);
+
+    CHECK(store.setParallelScans(4) && store.parallelScans() == 4);
+    ScanResults parallel;
+    CHECK(scan(store, parallel));
+    CHECK(sameIds(parallel.found, serial.found));
+    CHECK(sameIds(parallel.low, serial.low));
+    CHECK(parallel.report.totalItems == serial.report.totalItems);
+    CHECK(parallel.report.totalValue == serial.report.totalValue);
+    CHECK(parallel.matching == serial.matching);
+
+    CHECK(store.setParallelScans(0) && store.parallelScans() == 0);
+    store.close();
+}
+
+int main() {
+    testParallelFor();
+    testPartitionedScans();
+    std::remove(kDbName);
+    return checkResult();
+}
@@ -0,0 +1,81 @@
+// Prefix search (see "Searching by name" in README.md): names are matched on their stored
+// normalized form, which ignores case and collapses runs of spaces and tabs, through the
+// products_by_name index.
+
+#include "check.h"
+#include "inventory.h"
+#include "inventory_sqlite.h"
+
+#include <cstdio>   // For std::remove
+
+static const char* const kDbName = "prefix_search_test.db";
+
+static std::string namesByPrefix(InventoryDB& store, const std::string& prefix) {
+    std::vector<Product> products;
+    if (!store.searchProductsByPrefix(prefix, products)) {
+        return "error";
+    }
+    std::string names;
+    for (const Product& p : products) {
+        names += (names.empty() ? "" : ",") + p.name;
+    }
+    return names;
+}
+
+static void testNormalizedNames() {
+    CHECK(normalizeProductName("Steel Bolt M8") == "steel bolt m8");
+    CHECK(normalizeProductName("  Steel \t\t Bolt  ") == "steel bolt");
+    CHECK(normalizeProductName("") == "");
+}
+
+static void testPrefixes(InventoryDB& store) {
+    CHECK(namesByPrefix(store, "steel") == "Steel Bolt M8,steel  nut,STEEL\tWasher");
+    CHECK(namesByPrefix(store, "steel  bolt") == "Steel Bolt M8");
+    CHECK(namesByPrefix(store, "STEEL\tN") == "steel  nut");
+    CHECK(namesByPrefix(store, "bolt") == "");             // Only at the start of the name
+    CHECK(namesByPrefix(store, "red ") == "Red paint");    // A trailing space ends the word
+    CHECK(namesByPrefix(store, "red") == "Red paint,Redwood plank");
+    CHECK(namesByPrefix(store, "100%") == "100% cotton");   // No LIKE wildcards
+    CHECK(namesByPrefix(store, "10_") == "");
+    CHECK(namesByPrefix(store, "") == "Steel Bolt M8,steel  nut,STEEL\tWasher,Red paint,Redwood plank,100% cotton");
+}
+
+// The search is a range over the name index rather than a scan of every row
+static void testUsesIndex(InventoryDB& store) {
+    sqlite3_stmt* stmt = nullptr;
+    CHECK(sqlite3_prepare_v2(store.handle(),
+                             "EXPLAIN QUERY PLAN SELECT id FROM products WHERE name_normalized >= 'st' "
+                             "AND name_normalized < 'su';", -1, &stmt, nullptr) == SQLITE_OK);
+    std::string plan;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        plan += reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+    }
+    sqlite3_finalize(stmt);
+    CHECK(plan.find("products_by_name") != std::string::npos);
+}
+
+// A rename updates the stored normalized name
+static void testRename(InventoryDB& store) {
+    bool found = false;
+    CHECK(store.updateProduct(Product{5, "Cedar plank", 1, 100}, found) && found);
+    CHECK(namesByPrefix(store, "red") == "Red paint");
+    CHECK(namesByPrefix(store, "cedar   PLANK") == "Cedar plank");
+}
+
+int main() {
+    std::remove(kDbName);
+    InventoryDB store;
+    CHECK(store.open(kDbName));
+    const char* names[] = {"Steel Bolt M8", "steel  nut", "STEEL\tWasher", "Red paint", "Redwood plank", "100% cotton"};
+    int id = 0;
+    for (const char* name : names) {
+        CHECK(store.addProduct(Product{0, name, 1, 100}, id));
+    }
+    testNormalizedNames();
+    testPrefixes(store);
+    testUsesIndex(store);
+    testRename(store);
+    store.close();
+    std::remove(kDbName);
+    return checkResult();
+}
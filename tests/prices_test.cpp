@@ -0,0 +1,88 @@
+// Prices as integer cents (see "Prices" in README.md): amounts parse and format without
+// floating point, totals are exact, and old REAL prices are converted on open.
+
+#include "check.h"
+#include "inventory.h"
+#include "inventory_sqlite.h"
+
+#include <cstdio>   // For std::remove
+
+static const char* const kDbName = "prices_test.db";
+
+static bool parsesTo(const std::string& text, Cents expected) {
+    Cents cents = -1;
+    return parseCents(text, cents) && cents == expected;
+}
+
+static bool rejected(const std::string& text) {
+    Cents cents = 0;
+    return !parseCents(text, cents);
+}
+
+static void testParseAndFormat() {
+    CHECK(parsesTo("12", 1200));
+    CHECK(parsesTo("12.34", 1234));
+    CHECK(parsesTo("0.1", 10));
+    CHECK(parsesTo(".05", 5));
+    CHECK(parsesTo("-0.5", -50));
+    CHECK(parsesTo("+3.", 300));
+    CHECK(rejected(""));
+    CHECK(rejected("."));
+    CHECK(rejected("1.234"));
+    CHECK(rejected("1,50"));
+    CHECK(rejected("1e3"));
+    CHECK(rejected("99999999999999999999"));
+
+    CHECK(formatCents(1234) == "12.34");
+    CHECK(formatCents(5) == "0.05");
+    CHECK(formatCents(-5) == "-0.05");
+    CHECK(formatCents(0) == "0.00");
+}
+
+// 0.10 three times is exactly 0.30, where doubles would give 0.30000000000000004
+static void testExactTotals() {
+    std::remove(kDbName);
+    InventoryDB store;
+    CHECK(store.open(kDbName));
+    int id = 0;
+    for (int i = 0; i < 3; ++i) {
+        CHECK(store.addProduct(Product{0, "Dime " + std::to_string(i), 1, 10}, id));
+    }
+    CHECK(store.addProduct(Product{0, "Crate", 7, 1999}, id));
+    InventoryReport report;
+    CHECK(store.generateReport(report));
+    CHECK(report.totalItems == 4);
+    CHECK(report.totalValue == 30 + 7 * 1999);
+
+    const int32_t quantities[] = {3, 0, 1000000};
+    const Cents prices[] = {333, 12345, 9999999};
+    CHECK(sumInventoryValue(quantities, prices, 3) == 999 + 1000000LL * 9999999);
+    store.close();
+}
+
+// Rounds each REAL price to the nearest cent, once, and keeps the rows
+static void testConversionOfRealPrices() {
+    std::remove(kDbName);
+    sqlite3* db = nullptr;
+    CHECK(sqlite3_open(kDbName, &db) == SQLITE_OK &&
+          executeSQL(db, "CREATE TABLE products (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT NOT NULL, "
+                         "quantity INTEGER NOT NULL, price REAL NOT NULL);"
+                         "INSERT INTO products (name, quantity, price) VALUES ('Washer', 3, 0.1), ('Hinge', 1, 2.675);"));
+    sqlite3_close(db);
+
+    InventoryDB store;
+    std::vector<Product> products;
+    CHECK(store.open(kDbName) && store.listProducts(products));
+    CHECK(products.size() == 2 && products[0].priceCents == 10 && products[1].priceCents == 268);
+    store.close();
+    CHECK(store.open(kDbName) && store.listProducts(products));
+    CHECK(products.size() == 2 && products[1].priceCents == 268);
+}
+
+int main() {
+    testParseAndFormat();
+    testExactTotals();
+    testConversionOfRealPrices();
+    std::remove(kDbName);
+    return checkResult();
+}
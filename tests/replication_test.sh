@@ -0,0 +1,28 @@
+#!/bin/sh
+# Replication (see "Replication mode" in README.md): the primary's change log only keeps what a
+# replica still needs, and a replica that joins after the log was pruned starts from a copy.
+# Usage: replication_test.sh path/to/inventory
+
+inventory=$1
+command -v sqlite3 >/dev/null || { echo "SKIP: needs the sqlite3 shell"; exit 77; }
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+fail() { echo "FAIL: $1"; exit 1; }
+
+# Writes go to the primary; give the replica time to apply them before exiting
+{ printf '1\nAnvil\n1\n1.00\n1\nBell\n2\n2.00\n3\n1\nAnvil XL\n5\n1.50\n'; sleep 1; printf '13\n'; } |
+    "$inventory" --db replica1.db --replica-of primary.db >first.out 2>&1 || fail "first replica session"
+[ "$(sqlite3 primary.db 'SELECT COUNT(*) FROM change_log;')" = 0 ] || fail "applied entries were not pruned"
+[ "$(sqlite3 primary.db 'SELECT applied_seq FROM replica_progress;')" = 3 ] || fail "replica progress not recorded"
+
+# A second replica finds the log pruned and copies the products instead
+{ sleep 1; printf '1\nCrate\n3\n3.00\n'; sleep 1; printf '2\n13\n'; } |
+    "$inventory" --db replica2.db --replica-of primary.db >second.out 2>&1 || fail "second replica session"
+[ "$(sqlite3 replica2.db 'SELECT group_concat(name, ",") FROM (SELECT name FROM products ORDER BY id);')" = \
+    "Anvil XL,Bell,Crate" ] || fail "new replica did not start from a copy"
+grep -q "Anvil XL" second.out || fail "view on the new replica"
+
+# The first replica has not seen Crate yet, so its entry stays until it has
+[ "$(sqlite3 primary.db 'SELECT COUNT(*) FROM change_log;')" = 1 ] || fail "an entry a replica needs was pruned"
+echo "PASS"
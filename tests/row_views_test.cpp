@@ -0,0 +1,89 @@
+// Row views (see "Embedding the inventory" in README.md): ranges yield the same rows as the
+// vector API, materialize copies them out, and a query that cannot run reports its error.
+
+#include "check.h"
+#include "inventory.h"
+
+#include <cstdio>   // For std::remove
+
+static const char* const kDbName = "row_views_test.db";
+
+static bool sameRows(const std::vector<Product>& a, const std::vector<Product>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].id != b[i].id || a[i].name != b[i].name || a[i].quantity != b[i].quantity ||
+            a[i].priceCents != b[i].priceCents) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testRangesMatchVectors(InventoryDB& store) {
+    std::vector<Product> expected;
+    CHECK(store.searchProducts("Bolt", expected) && expected.size() == 2);
+    std::vector<Product> viewed;
+    ProductRange range = store.searchProducts("Bolt");
+    for (const ProductView& view : range) {
+        viewed.push_back(view.materialize());
+    }
+    CHECK(range.ok());
+    CHECK(sameRows(viewed, expected));
+
+    CHECK(store.filterProductsByQuantity(5, expected) && expected.size() == 2);
+    ProductRange low = store.filterProductsByQuantity(5);
+    CHECK(sameRows(low.materialize(), expected) && low.ok());
+
+    CHECK(store.searchProductsByPrefix("bolt", expected) && expected.size() == 2);
+    ProductRange prefixed = store.searchProductsByPrefix("bolt");
+    CHECK(sameRows(prefixed.materialize(), expected) && prefixed.ok());
+}
+
+// Materialized names own their text; views stop being valid once the range moves on
+static void testMaterializeCopies(InventoryDB& store) {
+    std::vector<Product> copies;
+    {
+        ProductRange range = store.searchProducts("");
+        copies = range.materialize();
+    }
+    CHECK(copies.size() == 3);
+    CHECK(copies[0].name == "Bolt M4" && copies[1].name == "Bolt M6" && copies[2].name == "Nut");
+}
+
+// A range abandoned part way through ends its call, so the store stays usable
+static void testAbandonedRange(InventoryDB& store) {
+    {
+        ProductRange range = store.searchProducts("");
+        CHECK(range.begin() != range.end());
+    }
+    int id = 0;
+    CHECK(store.addProduct(Product{0, "Washer", 9, 5}, id));
+    bool found = false;
+    CHECK(store.deleteProduct(id, found) && found);
+}
+
+static void testClosedStore() {
+    InventoryDB store;
+    ProductRange range = store.searchProducts("Bolt");
+    CHECK(range.begin() == range.end());
+    CHECK(!range.ok() && !range.error().empty());
+}
+
+int main() {
+    std::remove(kDbName);
+    InventoryDB store;
+    int id = 0;
+    CHECK(store.open(kDbName));
+    CHECK(store.addProduct(Product{0, "Bolt M4", 3, 10}, id));
+    CHECK(store.addProduct(Product{0, "Bolt M6", 12, 15}, id));
+    CHECK(store.addProduct(Product{0, "Nut", 2, 5}, id));
+    testRangesMatchVectors(store);
+    testMaterializeCopies(store);
+    testAbandonedRange(store);
+    store.close();
+    testClosedStore();
+    std::remove(kDbName);
+    return checkResult();
+}
@@ -0,0 +1,101 @@
+// Schema migrations (see "Schema migrations" in README.md): an old file is upgraded to the
+// latest version, and products tables too large to rebuild at open are rebuilt online while
+// the store keeps taking writes, none of which are lost.
+
+#include "check.h"
+#include "inventory.h"
+#include "inventory_sqlite.h"
+
+#include <chrono>   // For the rebuild deadline
+#include <cstdio>   // For std::remove
+#include <thread>   // For polling the rebuild
+
+static const char* const kDbName = "schema_migrations_test.db";
+static const int kLatestVersion = 6;
+static const int kRows = 12000; // More than one rebuild chunk, so the rebuild runs in the background
+
+static long long queryOnce(const std::string& sql) {
+    sqlite3* db = nullptr;
+    long long value = -1;
+    if (sqlite3_open_v2(kDbName, &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK) {
+        queryInt64(db, sql, value);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+// A file as version 2 left it: products with integer prices, no indexes, no stock tracking
+static bool createVersion2Database() {
+    std::remove(kDbName);
+    sqlite3* db = nullptr;
+    bool created = sqlite3_open(kDbName, &db) == SQLITE_OK &&
+                   executeSQL(db, "CREATE TABLE products (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT NOT NULL, "
+                                  "quantity INTEGER NOT NULL, price_cents INTEGER NOT NULL);"
+                                  "WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM n WHERE x < " +
+                                  std::to_string(kRows) + ") INSERT INTO products (name, quantity, price_cents) "
+                                  "SELECT 'Part  ' || x, x % 7, 100 + x FROM n;"
+                                  "PRAGMA user_version = 2;");
+    sqlite3_close(db);
+    return created;
+}
+
+static bool rebuildFinished() {
+    return queryOnce("PRAGMA user_version;") == kLatestVersion &&
+           queryOnce("SELECT COUNT(*) FROM sqlite_master WHERE name IN ('products_retired', 'products_rebuild');") == 0;
+}
+
+static void testFreshDatabase() {
+    std::remove(kDbName);
+    InventoryDB store;
+    CHECK(store.open(kDbName));
+    store.close();
+    CHECK(queryOnce("PRAGMA user_version;") == kLatestVersion);
+    CHECK(queryOnce("SELECT COUNT(*) FROM sqlite_master WHERE type = 'index' AND tbl_name = 'products' "
+                    "AND name IN ('products_by_quantity_v5', 'products_by_name_v5');") == 2);
+}
+
+static void testOnlineRebuild() {
+    CHECK(createVersion2Database());
+    InventoryDB store;
+    CHECK(store.open(kDbName));
+    CHECK(queryOnce("PRAGMA user_version;") < kLatestVersion); // Still rebuilding
+
+    // Writes while the rebuild copies the table
+    int newId = 0;
+    bool found = false;
+    CHECK(store.addProduct(Product{0, "Added during rebuild", 1, 1}, newId));
+    CHECK(newId == kRows + 1);
+    CHECK(store.updateProduct(Product{1, "Updated during rebuild", 9, 999}, found) && found);
+    CHECK(store.deleteProduct(2, found) && found);
+    CHECK(store.updateProduct(Product{kRows, "Last   row", 3, 300}, found) && found);
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    while (!rebuildFinished() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    CHECK(rebuildFinished());
+
+    std::vector<Product> products;
+    CHECK(store.listProducts(products));
+    CHECK(products.size() == static_cast<size_t>(kRows));
+    Product p;
+    CHECK(store.getProduct(1, p, found) && found && p.name == "Updated during rebuild" && p.priceCents == 999);
+    CHECK(store.getProduct(2, p, found) && !found);
+    CHECK(store.getProduct(newId, p, found) && found && p.name == "Added during rebuild");
+
+    // The rebuilt table has the normalized names and keeps the id counter
+    CHECK(store.searchProductsByPrefix("last row", products) && products.size() == 1 && products[0].id == kRows);
+    CHECK(store.searchProductsByPrefix("PART 1199", products) && products.size() == 11);
+    CHECK(store.addProduct(Product{0, "After rebuild", 1, 1}, newId) && newId == kRows + 2);
+    CHECK(queryOnce("SELECT COUNT(*) FROM products WHERE quantity = 0 AND id NOT IN "
+                    "(SELECT product_id FROM stock_out_since);") == 0);
+    store.close();
+}
+
+int main() {
+    testFreshDatabase();
+    testOnlineRebuild();
+    stopSchemaRebuilds();
+    std::remove(kDbName);
+    return checkResult();
+}
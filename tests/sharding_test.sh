@@ -0,0 +1,29 @@
+#!/bin/sh
+# Sharded mode (see "Sharded mode" in README.md): products stay reachable by id across
+# restarts, and reopening the shard files with another shard count is refused.
+# Usage: sharding_test.sh path/to/inventory
+
+inventory=$1
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+fail() { echo "FAIL: $1"; exit 1; }
+
+# Add three products, one per shard (shard k of 3 hands out ids k+3, k+6, ...), then exit
+printf '1\nAnvil\n1\n1.00\n1\nBell\n2\n2.00\n1\nCrate\n3\n3.00\n13\n' |
+    "$inventory" --db inv.db --shards 3 >add.out 2>&1 || fail "adding products"
+grep -q "ID 3, shard 0" add.out || fail "product 3 not placed on shard 0"
+
+# A different shard count would route ids to the wrong files
+printf '13\n' | "$inventory" --db inv.db --shards 2 >fewer.out 2>&1 && fail "--shards 2 was accepted"
+grep -q "inv.shard0.db is shard 0 of 3" fewer.out || fail "no layout message for --shards 2"
+printf '13\n' | "$inventory" --db inv.db --shards 4 >more.out 2>&1 && fail "--shards 4 was accepted"
+[ ! -e inv.shard3.db ] || fail "a refused open created a new shard file"
+
+# With the right count, update and view by id still find every product
+printf '3\n4\nBell XL\n5\n2.50\n8\n4\n8\n5\n13\n' |
+    "$inventory" --db inv.db --shards 3 >reopen.out 2>&1 || fail "reopening with --shards 3"
+grep -q "Bell XL" reopen.out || fail "update by id after reopening"
+grep -q "Crate" reopen.out || fail "view by id after reopening"
+if grep -q "No product found" reopen.out; then fail "a product went missing"; fi
+echo "PASS"
@@ -0,0 +1,105 @@
+// SQLite allocators (see "SQLite allocators" in README.md): with each allocator the store
+// works from several threads, the counting ones record allocations per operation, and the
+// allocator cannot be changed once SQLite has started. SQLite takes its allocator once per
+// process, so every allocator is tried in a child process of its own.
+
+#include "check.h"
+#include "inventory.h"
+#include "inventory_alloc.h"
+#include "inventory_sqlite.h"
+
+#include <cstdio>   // For std::remove
+#include <sstream>  // For reading the metrics
+#include <sys/wait.h> // For waitpid
+#include <thread>   // For the concurrent readers
+#include <unistd.h> // For fork
+
+static const char* const kDbName = "sqlite_allocators_test.db";
+
+// Each thread adds, searches, updates and deletes its own products on its own connection
+static bool exerciseStore(int thread) {
+    InventoryDB store;
+    if (!store.open(kDbName)) {
+        return false;
+    }
+    store.setTimeout(10000);
+    std::string prefix = "Thread " + std::to_string(thread) + " part ";
+    std::vector<int> ids;
+    for (int i = 0; i < 200; ++i) {
+        int id = 0;
+        if (!store.addProduct(Product{0, prefix + std::to_string(i), i % 7, 100 + i}, id)) {
+            return false;
+        }
+        ids.push_back(id);
+    }
+    std::vector<Product> found;
+    if (!store.searchProducts(prefix, found) || found.size() != ids.size()) {
+        return false;
+    }
+    bool exists = false;
+    for (int id : ids) {
+        if (!store.updateProduct(Product{id, "Renamed", 1, 1}, exists) || !exists ||
+            !store.deleteProduct(id, exists) || !exists) {
+            return false;
+        }
+    }
+    return store.searchProducts(prefix, found) && found.empty();
+}
+
+static int runWith(SqliteAllocator allocator) {
+    std::string error;
+    CHECK(setSqliteAllocator(allocator, error));
+    CHECK(sqliteAllocator() == allocator);
+
+    InventoryDB store;
+    CHECK(store.open(kDbName));
+    CHECK(!setSqliteAllocator(allocator == ALLOCATOR_POOLED ? ALLOCATOR_SYSTEM : ALLOCATOR_POOLED, error));
+    CHECK(!error.empty() && sqliteAllocator() == allocator);
+
+    bool results[4] = {false, false, false, false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([i, &results] { results[i] = exerciseStore(i); });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (bool ok : results) {
+        CHECK(ok);
+    }
+
+    bool counting = allocator != ALLOCATOR_SYSTEM;
+    CHECK(allocationsCounted() == counting);
+    AllocationCounters before = threadAllocationCounters();
+    std::vector<Product> found;
+    CHECK(store.searchProducts("part", found));
+    AllocationCounters after = threadAllocationCounters();
+    CHECK(counting ? after.allocations > before.allocations && after.bytes > before.bytes
+                   : after.allocations == before.allocations);
+
+    std::ostringstream metrics;
+    Metrics::instance().print(metrics);
+    CHECK((metrics.str().find("alloc.search.calls") != std::string::npos) == counting);
+    store.close();
+    return checkResult();
+}
+
+int main() {
+    const SqliteAllocator allocators[] = {ALLOCATOR_SYSTEM, ALLOCATOR_COUNTING, ALLOCATOR_POOLED};
+    for (SqliteAllocator allocator : allocators) {
+        std::remove(kDbName);
+        pid_t child = fork();
+        if (child == 0) {
+            _exit(runWith(allocator));
+        }
+        int status = 0;
+        bool passed = child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) &&
+                      WEXITSTATUS(status) == 0;
+        if (!passed) {
+            std::cerr << "allocator " << allocator << " failed" << std::endl;
+        }
+        CHECK(passed);
+    }
+    std::remove(kDbName);
+    return checkResult();
+}